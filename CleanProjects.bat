@@ -3,4 +3,10 @@ rd /s /q bin-int
 del /q NamelessRaytracer.sln
 del /q NamelessRaytracer\NamelessRaytracer.vcxproj
 del /q NamelessRaytracer\NamelessRaytracer.vcxproj.filters
-del /q NamelessRaytracer\NamelessRaytracer.vcxproj.user
\ No newline at end of file
+del /q NamelessRaytracer\NamelessRaytracer.vcxproj.user
+del /q NamelessRaytracer\NamelessRaytracerHeadless.vcxproj
+del /q NamelessRaytracer\NamelessRaytracerHeadless.vcxproj.filters
+del /q NamelessRaytracer\NamelessRaytracerHeadless.vcxproj.user
+del /q NamelessRaytracer\NamelessRaytracerBenchmark.vcxproj
+del /q NamelessRaytracer\NamelessRaytracerBenchmark.vcxproj.filters
+del /q NamelessRaytracer\NamelessRaytracerBenchmark.vcxproj.user
\ No newline at end of file
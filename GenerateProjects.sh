@@ -0,0 +1,3 @@
+#!/bin/sh
+# premake5 needs to be on the PATH, only the Windows binary is in vendor/bin
+premake5 gmake2
@@ -0,0 +1,258 @@
+#include "Animation.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+// Interpolated value of a track at time, Width floats written to value
+static void SampleTrack(const AnimationTrack& track, float time, float* value)
+{
+	auto next = std::upper_bound(track.Times.begin(), track.Times.end(), time);
+	if (next == track.Times.begin() || next == track.Times.end())
+	{
+		size_t key = next == track.Times.begin() ? 0 : track.Times.size() - 1;
+		std::copy_n(track.Values.begin() + key * track.Width, track.Width, value);
+		return;
+	}
+
+	size_t key = static_cast<size_t>(next - track.Times.begin()) - 1;
+	const float* from = track.Values.data() + key * track.Width;
+	const float* to = from + track.Width;
+	if (track.IsStep)
+	{
+		std::copy_n(from, track.Width, value);
+		return;
+	}
+
+	float t = (time - track.Times[key]) / (track.Times[key + 1] - track.Times[key]);
+	if (track.Target == AnimationTrack::Property::Rotation)
+	{
+		// Stored as xyzw
+		glm::quat rotation = glm::normalize(glm::slerp(glm::quat(from[3], from[0], from[1], from[2]), glm::quat(to[3], to[0], to[1], to[2]), t));
+		value[0] = rotation.x;
+		value[1] = rotation.y;
+		value[2] = rotation.z;
+		value[3] = rotation.w;
+		return;
+	}
+
+	for (uint32_t i = 0; i < track.Width; i++)
+		value[i] = from[i] + (to[i] - from[i]) * t;
+}
+
+// Composed the same way as LoadModel does, so a node nothing animates ends up exactly where LoadModel put it
+static glm::dmat4 GetLocalTransform(const AnimationNode& node)
+{
+	if (node.HasMatrix)
+		return node.Matrix;
+
+	glm::dmat4 transform = glm::translate(glm::dmat4(1.0), node.Translation);
+	transform = transform * glm::mat4_cast(node.Rotation);
+	return glm::scale(transform, node.Scale);
+}
+
+AnimationPose EvaluateAnimation(const ModelAnimation& animation, float time)
+{
+	std::vector<AnimationNode> nodes = animation.Nodes;
+	float value[4];
+	for (const AnimationTrack& track : animation.Tracks)
+	{
+		AnimationNode& node = nodes[track.NodeIndex];
+		switch (track.Target)
+		{
+		case AnimationTrack::Property::Translation:
+			SampleTrack(track, time, value);
+			node.Translation = glm::dvec3(value[0], value[1], value[2]);
+			break;
+		case AnimationTrack::Property::Rotation:
+			SampleTrack(track, time, value);
+			node.Rotation = glm::dquat(value[3], value[0], value[1], value[2]);
+			break;
+		case AnimationTrack::Property::Scale:
+			SampleTrack(track, time, value);
+			node.Scale = glm::dvec3(value[0], value[1], value[2]);
+			break;
+		case AnimationTrack::Property::Weights:
+			SampleTrack(track, time, node.Weights.data());
+			break;
+		}
+	}
+
+	// Chains get multiplied from the root down in double, like LoadModel. A broken file could have a cycle, the
+	// chain can't be longer than there are nodes
+	AnimationPose pose;
+	pose.InstanceTransforms.reserve(animation.InstanceNodes.size());
+	std::vector<uint32_t> chain;
+	for (uint32_t nodeIndex : animation.InstanceNodes)
+	{
+		chain.clear();
+		for (int32_t parent = static_cast<int32_t>(nodeIndex); parent >= 0 && chain.size() < nodes.size(); parent = nodes[parent].Parent)
+			chain.push_back(static_cast<uint32_t>(parent));
+
+		glm::dmat4 transform(1.0);
+		for (auto link = chain.rbegin(); link != chain.rend(); ++link)
+			transform = transform * GetLocalTransform(nodes[*link]);
+		pose.InstanceTransforms.push_back(glm::mat4(transform));
+	}
+
+	pose.MeshWeights.resize(animation.MorphNodes.size());
+	for (size_t i = 0; i < animation.MorphNodes.size(); i++)
+	{
+		if (animation.MorphNodes[i] >= 0)
+			pose.MeshWeights[i] = nodes[animation.MorphNodes[i]].Weights;
+	}
+
+	return pose;
+}
+
+AnimationPlayer::AnimationPlayer(Scene& scene, const ModelAnimation& animation, ThreadPool& pool, const AnimationSettings& settings)
+	: m_Scene(scene), m_Animation(animation), m_Pool(pool), m_Settings(settings)
+{
+	// LoadModel leaves every mesh in its rest pose, whatever weights the file asks for
+	m_AppliedWeights.resize(animation.MorphNodes.size());
+	for (size_t i = 0; i < animation.MorphNodes.size(); i++)
+		m_AppliedWeights[i].assign(animation.Morphs[i].PositionOffsets.size(), 0.0f);
+
+	m_BuildCosts.reserve(scene.MeshAccelerators.size());
+	for (const BVH& accelerator : scene.MeshAccelerators)
+		m_BuildCosts.push_back(accelerator.GetCost());
+}
+
+AnimationPlayer::~AnimationPlayer()
+{
+	if (m_NextFrame.valid())
+		m_NextFrame.wait();
+}
+
+bool AnimationPlayer::IsValid() const
+{
+	if (m_Scene.Instances.size() != m_Animation.InstanceNodes.size() || m_Scene.Meshes.size() != m_Animation.Morphs.size())
+		return false;
+
+	for (size_t i = 0; i < m_Scene.Meshes.size(); i++)
+	{
+		const MorphTargets& morph = m_Animation.Morphs[i];
+		if (!morph.Positions.empty() && morph.Positions.size() != m_Scene.Meshes[i].VertexCount)
+			return false;
+	}
+	return true;
+}
+
+void AnimationPlayer::Prepare(float time)
+{
+	if (m_NextFrame.valid())
+		m_NextFrame.wait();
+
+	// Its own thread rather than the pool, the pool is busy with the frame this is getting ready to follow
+	m_NextFrame = std::async(std::launch::async, [this, time] { return PrepareFrame(time); });
+}
+
+AnimationPlayer::PreparedFrame AnimationPlayer::PrepareFrame(float time) const
+{
+	PreparedFrame frame;
+	frame.Pose = EvaluateAnimation(m_Animation, time);
+	frame.Positions.resize(m_Animation.Morphs.size());
+	frame.Normals.resize(m_Animation.Morphs.size());
+
+	// Only meshes whose weights changed get new vertices, everything else keeps its tree as it is
+	for (size_t i = 0; i < m_Animation.Morphs.size(); i++)
+	{
+		const std::vector<float>& weights = frame.Pose.MeshWeights[i];
+		if (weights.empty() || weights == m_AppliedWeights[i])
+			continue;
+
+		const MorphTargets& morph = m_Animation.Morphs[i];
+		std::vector<glm::vec3>& positions = frame.Positions[i];
+		std::vector<glm::vec3>& normals = frame.Normals[i];
+		positions = morph.Positions;
+		normals = morph.Normals;
+		for (size_t target = 0; target < weights.size(); target++)
+		{
+			float weight = weights[target];
+			if (weight == 0.0f)
+				continue;
+
+			const std::vector<glm::vec3>& positionOffsets = morph.PositionOffsets[target];
+			for (size_t vertex = 0; vertex < positions.size(); vertex++)
+				positions[vertex] += positionOffsets[vertex] * weight;
+
+			const std::vector<glm::vec3>& normalOffsets = morph.NormalOffsets[target];
+			for (size_t vertex = 0; vertex < normalOffsets.size(); vertex++)
+				normals[vertex] += normalOffsets[vertex] * weight;
+		}
+
+		for (glm::vec3& normal : normals)
+			normal = glm::normalize(normal);
+	}
+
+	return frame;
+}
+
+AnimationStats AnimationPlayer::Apply()
+{
+	AnimationStats stats;
+	if (!m_NextFrame.valid())
+		return stats;
+
+	auto waitStart = std::chrono::steady_clock::now();
+	PreparedFrame frame = m_NextFrame.get();
+	auto updateStart = std::chrono::steady_clock::now();
+	stats.WaitTime = std::chrono::duration<double>(updateStart - waitStart).count();
+
+	for (size_t i = 0; i < m_Scene.Instances.size(); i++)
+		m_Scene.Instances[i].ObjectToWorld = frame.Pose.InstanceTransforms[i];
+
+	// Every morphed mesh is a task of its own, colors don't change so they get written back as they are
+	std::vector<uint8_t> wasRebuilt(m_Scene.Meshes.size(), 0);
+	for (size_t i = 0; i < m_Scene.Meshes.size(); i++)
+	{
+		if (frame.Positions[i].empty())
+			continue;
+
+		stats.RefitMeshes++;
+		m_AppliedWeights[i] = frame.Pose.MeshWeights[i];
+		m_Pool.Submit([this, &frame, &wasRebuilt, i](uint32_t) {
+			TriangleRegistry& registry = m_Scene.Meshes[i];
+			const std::vector<glm::vec3>& positions = frame.Positions[i];
+			const std::vector<glm::vec3>& normals = frame.Normals[i];
+
+			// LoadModel's bounds hold every mix of weights between 0 and 1, weights past that can move vertices
+			// outside of them. The range only ever grows, every vertex gets written again below anyway
+			if (registry.Layout == VertexLayout::Quantized)
+			{
+				glm::vec3 boundsMin = registry.PositionOrigin;
+				glm::vec3 boundsMax = registry.PositionOrigin + registry.PositionScale * 65535.0f;
+				glm::vec3 morphedMin = boundsMin, morphedMax = boundsMax;
+				for (const glm::vec3& position : positions)
+				{
+					morphedMin = glm::min(morphedMin, position);
+					morphedMax = glm::max(morphedMax, position);
+				}
+				if (morphedMin != boundsMin || morphedMax != boundsMax)
+					registry.SetPositionBounds(morphedMin, morphedMax);
+			}
+
+			for (size_t vertex = 0; vertex < positions.size(); vertex++)
+				registry.SetVertex(vertex, positions[vertex], normals[vertex], registry.GetColor(vertex));
+
+			BVH& accelerator = m_Scene.MeshAccelerators[i];
+			if (accelerator.Refit(registry) > m_BuildCosts[i] * m_Settings.RebuildThreshold)
+			{
+				accelerator.Build(registry);
+				m_BuildCosts[i] = accelerator.GetCost();
+				wasRebuilt[i] = 1;
+			}
+		});
+	}
+	m_Pool.Wait();
+
+	for (uint8_t rebuilt : wasRebuilt)
+		stats.RebuiltMeshes += rebuilt;
+	stats.RefitMeshes -= stats.RebuiltMeshes;
+
+	m_Scene.Accelerator.Build(m_Scene.MeshAccelerators, m_Scene.Instances);
+	stats.UpdateTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - updateStart).count();
+	return stats;
+}
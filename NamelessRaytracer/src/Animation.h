@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "Model.h"
+#include "Renderer.h"
+#include "ThreadPool.h"
+
+// Animation playback
+// Poses a loaded scene at any time of its glTF animation without loading anything again. Instances get their new
+// transforms, morphed meshes get their vertices rewritten in place and their BVHs refit, and the top level gets
+// rebuilt, which is cheap with one leaf per instance. A refit tree keeps the splits it was built with for the first
+// pose, so a mesh whose tree gets too much worse than that gets a full rebuild instead.
+
+// Where everything is at one time
+struct AnimationPose
+{
+	std::vector<glm::mat4> InstanceTransforms; // In the scene's instance order
+	std::vector<std::vector<float>> MeshWeights; // Per mesh, empty for meshes without morph targets
+};
+
+// Samples every track at time and walks the hierarchy down to the instances. Times outside the keys hold the
+// first or last one
+AnimationPose EvaluateAnimation(const ModelAnimation& animation, float time);
+
+struct AnimationSettings
+{
+	// A refit BVH gets rebuilt once its SAH cost is this many times what it was right after its last build
+	float RebuildThreshold = 1.5f;
+};
+
+struct AnimationStats
+{
+	uint32_t RefitMeshes = 0;
+	uint32_t RebuiltMeshes = 0;
+	double WaitTime = 0.0; // Seconds Apply spent waiting for Prepare, 0 when it finished while the last frame rendered
+	double UpdateTime = 0.0; // Seconds spent moving the scene over
+};
+
+// Keeps one frame ahead of the renderer. Prepare evaluates the next pose and mixes the morph targets on a thread of
+// its own while the current frame renders, then Apply waits for that and moves the scene over between frames with
+// the pool doing the meshes. The scene can't be rendered during Apply
+class AnimationPlayer
+{
+public:
+	// scene has to come from the same file as animation and both have to outlive the player
+	AnimationPlayer(Scene& scene, const ModelAnimation& animation, ThreadPool& pool, const AnimationSettings& settings = AnimationSettings());
+	~AnimationPlayer(); // Waits for a frame that's still being prepared
+
+	AnimationPlayer(const AnimationPlayer&) = delete;
+	AnimationPlayer& operator=(const AnimationPlayer&) = delete;
+
+	// False when the scene doesn't have the instances and meshes the animation expects
+	bool IsValid() const;
+
+	// Starts preparing the frame at time. A frame prepared earlier that never got applied is thrown away
+	void Prepare(float time);
+
+	// Moves the scene to the last prepared frame. Does nothing when there isn't one
+	AnimationStats Apply();
+
+private:
+	struct PreparedFrame
+	{
+		AnimationPose Pose;
+		std::vector<std::vector<glm::vec3>> Positions; // Per mesh, empty when its vertices stay where they are
+		std::vector<std::vector<glm::vec3>> Normals;
+	};
+
+	PreparedFrame PrepareFrame(float time) const;
+
+	Scene& m_Scene;
+	const ModelAnimation& m_Animation;
+	ThreadPool& m_Pool;
+	AnimationSettings m_Settings;
+
+	// The weights the registries were last morphed with, only changed by Apply so Prepare can read it
+	std::vector<std::vector<float>> m_AppliedWeights;
+	std::vector<float> m_BuildCosts; // SAH cost of every mesh BVH right after its last build
+
+	std::future<PreparedFrame> m_NextFrame;
+};
@@ -0,0 +1,370 @@
+#include "BVH.h"
+
+#include <algorithm>
+
+// Build parameters
+static constexpr uint32_t BinCount = 16;
+static constexpr uint32_t MaxTrianglesPerLeaf = 8;
+static constexpr float TraversalCost = 1.0f; // Relative to the cost of one triangle test
+
+// Working state for one build, the recursion only needs this and the node range it's on
+struct BVHBuilder
+{
+	const std::vector<BuildPrimitive>& Primitives;
+	uint32_t MaxLeafSize;
+	std::vector<BVHNode>& Nodes;
+	std::vector<uint32_t>& Indices;
+	uint32_t Depth = 0;
+
+	void Subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth);
+};
+
+uint32_t BuildBVHNodes(const std::vector<BuildPrimitive>& primitives, uint32_t maxLeafSize,
+	std::vector<BVHNode>& nodes, std::vector<uint32_t>& indices)
+{
+	uint32_t primitiveCount = static_cast<uint32_t>(primitives.size());
+	nodes.clear();
+	indices.resize(primitiveCount);
+	for (uint32_t i = 0; i < primitiveCount; i++)
+		indices[i] = i;
+
+	if (primitiveCount == 0)
+		return 0;
+
+	// A binary tree with n leaves has 2n - 1 nodes
+	nodes.reserve(primitiveCount * 2 - 1);
+	nodes.emplace_back();
+	BVHBuilder builder{ primitives, maxLeafSize, nodes, indices };
+	builder.Subdivide(0, 0, primitiveCount, 1);
+	nodes.shrink_to_fit();
+	return builder.Depth;
+}
+
+BVH::BVH(TriangleRegistry& registry)
+{
+	Build(registry);
+}
+
+void BVH::Build(TriangleRegistry& registry)
+{
+	m_Nodes.clear();
+	m_NodeData = nullptr;
+	m_NodeCount = 0;
+	m_Depth = 0;
+	m_Kernel = GetTriangleKernel();
+
+	uint32_t triangleCount = static_cast<uint32_t>(registry.Triangles.size());
+	if (triangleCount == 0)
+		return;
+
+	// Precompute the bounds and centroid of every triangle once instead of at every level
+	std::vector<BuildPrimitive> buildTriangles(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		const glm::uvec3& triangle = registry.Triangles[i];
+		BuildPrimitive& buildTriangle = buildTriangles[i];
+		buildTriangle.Bounds.Grow(registry.GetPosition(triangle.x));
+		buildTriangle.Bounds.Grow(registry.GetPosition(triangle.y));
+		buildTriangle.Bounds.Grow(registry.GetPosition(triangle.z));
+		buildTriangle.Centroid = (buildTriangle.Bounds.Min + buildTriangle.Bounds.Max) * 0.5f;
+	}
+
+	std::vector<uint32_t> indices;
+	m_Depth = BuildBVHNodes(buildTriangles, MaxTrianglesPerLeaf, m_Nodes, indices);
+	m_NodeData = m_Nodes.data();
+	m_NodeCount = static_cast<uint32_t>(m_Nodes.size());
+
+	// Reorder the triangles so the leaves can reference them directly. They can't move, so they go back where they were
+	std::vector<glm::uvec3> reordered(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; i++)
+		reordered[i] = registry.Triangles[indices[i]];
+	std::copy(reordered.begin(), reordered.end(), registry.Triangles.begin());
+
+	m_Triangles.Build(registry);
+}
+
+void BVH::Attach(const BVHNode* nodes, uint32_t nodeCount, uint32_t depth, const float* packedTriangles, uint32_t triangleCount)
+{
+	m_Nodes.clear();
+	m_Nodes.shrink_to_fit();
+	m_NodeData = nodes;
+	m_NodeCount = nodeCount;
+	m_Depth = depth;
+	m_Kernel = GetTriangleKernel();
+	m_Triangles.Attach(packedTriangles, triangleCount);
+}
+
+void BVH::MoveTo(MemoryArena& arena)
+{
+	if (m_NodeCount == 0)
+		return;
+
+	BVHNode* nodes = arena.Allocate<BVHNode>(m_NodeCount);
+	float* packedTriangles = static_cast<float*>(arena.Allocate(m_Triangles.GetDataSize()));
+	std::copy_n(m_NodeData, m_NodeCount, nodes);
+	std::copy_n(m_Triangles.GetData(), m_Triangles.GetDataSize() / sizeof(float), packedTriangles);
+	Attach(nodes, m_NodeCount, m_Depth, packedTriangles, m_Triangles.GetCount());
+}
+
+size_t BVH::GetArenaSize() const
+{
+	if (m_NodeCount == 0)
+		return 0;
+	return MemoryArena::GetBlockSize(m_NodeCount * sizeof(BVHNode)) + MemoryArena::GetBlockSize(m_Triangles.GetDataSize());
+}
+
+float BVH::Refit(const TriangleRegistry& registry)
+{
+	if (m_NodeCount == 0)
+		return 0.0f;
+
+	// Attached nodes are read only, the tree gets its own copy the first time it moves
+	if (m_NodeData != m_Nodes.data())
+	{
+		m_Nodes.assign(m_NodeData, m_NodeData + m_NodeCount);
+		m_NodeData = m_Nodes.data();
+	}
+
+	// Children always come after their parent, so going backwards reaches both children before the parent
+	for (uint32_t i = m_NodeCount; i-- > 0;)
+	{
+		BVHNode& node = m_Nodes[i];
+		AABB bounds;
+		if (node.IsLeaf())
+		{
+			for (uint32_t triangle = node.LeftFirst; triangle < node.LeftFirst + node.TriangleCount; triangle++)
+			{
+				const glm::uvec3& indices = registry.Triangles[triangle];
+				bounds.Grow(registry.GetPosition(indices.x));
+				bounds.Grow(registry.GetPosition(indices.y));
+				bounds.Grow(registry.GetPosition(indices.z));
+			}
+		}
+		else
+		{
+			const BVHNode& left = m_Nodes[i + 1];
+			const BVHNode& right = m_Nodes[node.LeftFirst];
+			bounds.Min = glm::min(left.BoundsMin, right.BoundsMin);
+			bounds.Max = glm::max(left.BoundsMax, right.BoundsMax);
+		}
+		node.BoundsMin = bounds.Min;
+		node.BoundsMax = bounds.Max;
+	}
+
+	m_Triangles.Build(registry);
+	return GetCost();
+}
+
+float BVH::GetCost() const
+{
+	if (m_NodeCount == 0)
+		return 0.0f;
+
+	AABB root{ m_NodeData[0].BoundsMin, m_NodeData[0].BoundsMax };
+	float rootArea = root.SurfaceArea();
+	if (rootArea <= 0.0f)
+		return 0.0f;
+
+	float cost = 0.0f;
+	for (uint32_t i = 0; i < m_NodeCount; i++)
+	{
+		const BVHNode& node = m_NodeData[i];
+		float area = AABB{ node.BoundsMin, node.BoundsMax }.SurfaceArea();
+		cost += area * (node.IsLeaf() ? static_cast<float>(node.TriangleCount) : TraversalCost);
+	}
+	return cost / rootArea;
+}
+
+void BVHBuilder::Subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth)
+{
+	Depth = std::max(Depth, depth);
+
+	AABB bounds, centroidBounds;
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		const BuildPrimitive& primitive = Primitives[Indices[i]];
+		bounds.Grow(primitive.Bounds);
+		centroidBounds.Grow(primitive.Centroid);
+	}
+
+	BVHNode& node = Nodes[nodeIndex];
+	node.BoundsMin = bounds.Min;
+	node.BoundsMax = bounds.Max;
+	node.LeftFirst = first;
+	node.TriangleCount = count;
+
+	if (count == 1 || depth >= BVHMaxDepth)
+		return;
+
+	// Find the cheapest split plane by binning centroids along every axis
+	int32_t bestAxis = -1;
+	uint32_t bestSplit = 0;
+	float bestCost = std::numeric_limits<float>::infinity();
+	glm::vec3 extent = centroidBounds.Max - centroidBounds.Min;
+	for (int32_t axis = 0; axis < 3; axis++)
+	{
+		if (extent[axis] <= 0.0f)
+			continue;
+
+		AABB binBounds[BinCount];
+		uint32_t binCounts[BinCount] = {};
+		float scale = static_cast<float>(BinCount) / extent[axis];
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			const BuildPrimitive& primitive = Primitives[Indices[i]];
+			uint32_t bin = std::min(BinCount - 1,
+				static_cast<uint32_t>((primitive.Centroid[axis] - centroidBounds.Min[axis]) * scale));
+			binCounts[bin]++;
+			binBounds[bin].Grow(primitive.Bounds);
+		}
+
+		// Sweep from both sides so every split plane is evaluated in linear time
+		float leftAreas[BinCount - 1], rightAreas[BinCount - 1];
+		uint32_t leftCounts[BinCount - 1], rightCounts[BinCount - 1];
+		AABB leftBox, rightBox;
+		uint32_t leftSum = 0, rightSum = 0;
+		for (uint32_t i = 0; i < BinCount - 1; i++)
+		{
+			leftSum += binCounts[i];
+			leftBox.Grow(binBounds[i]);
+			leftCounts[i] = leftSum;
+			leftAreas[i] = leftBox.SurfaceArea();
+
+			rightSum += binCounts[BinCount - 1 - i];
+			rightBox.Grow(binBounds[BinCount - 1 - i]);
+			rightCounts[BinCount - 2 - i] = rightSum;
+			rightAreas[BinCount - 2 - i] = rightBox.SurfaceArea();
+		}
+
+		for (uint32_t i = 0; i < BinCount - 1; i++)
+		{
+			if (leftCounts[i] == 0 || rightCounts[i] == 0)
+				continue;
+
+			float cost = leftCounts[i] * leftAreas[i] + rightCounts[i] * rightAreas[i];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+
+	uint32_t leftCount = 0;
+	if (bestAxis != -1)
+	{
+		// Only split when it is cheaper than testing every primitive in a leaf
+		float leafCost = count * bounds.SurfaceArea();
+		float splitCost = TraversalCost * bounds.SurfaceArea() + bestCost;
+		if (splitCost >= leafCost && count <= MaxLeafSize)
+			return;
+
+		float scale = static_cast<float>(BinCount) / extent[bestAxis];
+		auto middle = std::partition(Indices.begin() + first, Indices.begin() + first + count,
+			[&](uint32_t index) {
+				uint32_t bin = std::min(BinCount - 1,
+					static_cast<uint32_t>((Primitives[index].Centroid[bestAxis] - centroidBounds.Min[bestAxis]) * scale));
+				return bin <= bestSplit;
+			});
+		leftCount = static_cast<uint32_t>(middle - (Indices.begin() + first));
+	}
+	else
+	{
+		// Every centroid is in the same spot so there is no good plane. Just cut the range in half if it's too big
+		if (count <= MaxLeafSize)
+			return;
+		leftCount = count / 2;
+	}
+
+	// Children are allocated depth first so the left child directly follows its parent
+	uint32_t leftIndex = static_cast<uint32_t>(Nodes.size());
+	Nodes.emplace_back();
+	Subdivide(leftIndex, first, leftCount, depth + 1);
+
+	uint32_t rightIndex = static_cast<uint32_t>(Nodes.size());
+	Nodes.emplace_back();
+	Subdivide(rightIndex, first + leftCount, count - leftCount, depth + 1);
+
+	// The node reference can't be reused because the vector may have grown
+	Nodes[nodeIndex].LeftFirst = rightIndex;
+	Nodes[nodeIndex].TriangleCount = 0;
+}
+
+// Float rays go through the SIMD kernel picked at build time, double rays through the double scalar kernel
+static inline void IntersectLeaf(TriangleKernel kernel, const PackedTriangles& triangles, const WatertightRay<float>& ray,
+	uint32_t first, uint32_t count, TriangleHitT<float>& hit)
+{
+	kernel(triangles, ray, first, count, hit);
+}
+
+static inline void IntersectLeaf(TriangleKernel, const PackedTriangles& triangles, const WatertightRay<double>& ray,
+	uint32_t first, uint32_t count, TriangleHitT<double>& hit)
+{
+	IntersectTrianglesScalar(triangles, ray, first, count, hit);
+}
+
+TriangleHit BVH::Intersect(const Ray& ray, Real tMax) const
+{
+	// The search tightens closestHit.T as hits come in, so later leaves and nodes get culled sooner
+	TriangleHit closestHit = { tMax, Real(0), Real(0) };
+	if (m_NodeCount == 0)
+		return closestHit;
+
+	WatertightRay<Real> watertightRay(ray);
+	uint64_t testedTriangles = 0;
+	TraverseBVH(m_NodeData, ray, closestHit.T, [&](uint32_t first, uint32_t count) {
+		IntersectLeaf(m_Kernel, m_Triangles, watertightRay, first, count, closestHit);
+		testedTriangles += count;
+	});
+
+	CountRenderWork(RenderCounter::TriangleTests, testedTriangles);
+	return closestHit;
+}
+
+bool BVH::IsOccluded(const Ray& ray, Real tMax) const
+{
+	if (m_NodeCount == 0)
+		return false;
+
+	// The kernels only know closest hit, but the search stops at the first leaf where one turns up
+	WatertightRay<Real> watertightRay(ray);
+	uint64_t testedTriangles = 0;
+	bool isOccluded = TraverseBVHAnyHit(m_NodeData, ray, static_cast<float>(tMax), [&](uint32_t first, uint32_t count) {
+		TriangleHit hit = { tMax, Real(0), Real(0) };
+		IntersectLeaf(m_Kernel, m_Triangles, watertightRay, first, count, hit);
+		testedTriangles += count;
+		return hit.IsHit();
+	});
+
+	CountRenderWork(RenderCounter::TriangleTests, testedTriangles);
+	return isOccluded;
+}
+
+void BVH::IntersectPacket(RayPacket& packet, TriangleHitT<float>* hits) const
+{
+	if (m_NodeCount == 0)
+		return;
+
+	uint32_t groupCount = packet.GetGroupCount();
+	uint64_t testedTriangles = 0;
+	TraverseBVHPacket(m_NodeData, packet, [&](const BVHNode& node, uint32_t firstGroup) {
+		// Each ray that hits the leaf's box tests its triangles on its own, at this point the packet has
+		// usually thinned out too much to be worth keeping together
+		for (uint32_t group = firstGroup; group < groupCount; group++)
+		{
+			uint32_t mask = packet.IntersectGroup(node.BoundsMin, node.BoundsMax, group);
+			for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1)
+			{
+				if ((mask & 1) == 0)
+					continue;
+				uint32_t i = group * RayPacket::GroupSize + lane;
+				m_Kernel(m_Triangles, packet.Rays[i], node.LeftFirst, node.TriangleCount, hits[i]);
+				packet.TMax[i] = hits[i].T;
+				testedTriangles += node.TriangleCount;
+			}
+		}
+	});
+
+	CountRenderWork(RenderCounter::TriangleTests, testedTriangles);
+}
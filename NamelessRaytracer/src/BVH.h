@@ -0,0 +1,324 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+
+#include "glm/glm.hpp"
+
+#include "Ray.h"
+#include "Model.h"
+#include "PackedTriangles.h"
+#include "RayPacket.h"
+#include "RenderCounters.h"
+
+// Bounding volume hierarchy
+
+struct AABB
+{
+	glm::vec3 Min = glm::vec3(std::numeric_limits<float>::infinity());
+	glm::vec3 Max = glm::vec3(-std::numeric_limits<float>::infinity());
+
+	void Grow(const glm::vec3& point)
+	{
+		Min = glm::min(Min, point);
+		Max = glm::max(Max, point);
+	}
+
+	void Grow(const AABB& other)
+	{
+		Min = glm::min(Min, other.Min);
+		Max = glm::max(Max, other.Max);
+	}
+
+	float SurfaceArea() const
+	{
+		glm::vec3 extent = Max - Min;
+		if (extent.x < 0.0f)
+			return 0.0f; // Empty box
+		return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+};
+
+// Nodes are stored depth first so the left child of an interior node is always the next node in the array
+// and only the right child needs to be stored. Two nodes fit in a cache line.
+struct BVHNode
+{
+	glm::vec3 BoundsMin;
+	uint32_t LeftFirst; // Right child index for interior nodes, first primitive index for leaves
+	glm::vec3 BoundsMax;
+	uint32_t TriangleCount; // 0 for interior nodes, counts instances instead in a TopLevelBVH
+
+	bool IsLeaf() const { return TriangleCount != 0; }
+};
+
+static_assert(sizeof(BVHNode) == 32, "BVHNode should stay 32 bytes");
+
+static constexpr uint32_t BVHMaxDepth = 60; // Keeps the traversal stack bounded
+
+// What the builder needs to know about each primitive, triangles for a BVH and instances for a TopLevelBVH
+struct BuildPrimitive
+{
+	AABB Bounds;
+	glm::vec3 Centroid;
+};
+
+// Binned SAH build shared by both levels. Fills nodes depth first and reorders indices so every leaf covers a
+// contiguous range of it. Returns the depth of the tree
+uint32_t BuildBVHNodes(const std::vector<BuildPrimitive>& primitives, uint32_t maxLeafSize,
+	std::vector<BVHNode>& nodes, std::vector<uint32_t>& indices);
+
+class BVH
+{
+public:
+	BVH() = default;
+
+	// Builds the hierarchy with binned SAH. The triangles in the registry get reordered so
+	// every leaf references a contiguous range of registry.Triangles, then the packed triangle
+	// data for the SIMD kernels is built in that same order.
+	BVH(TriangleRegistry& registry);
+
+	void Build(TriangleRegistry& registry);
+
+	// Uses nodes and packed triangles that were built earlier and live somewhere else, like a mapped scene
+	// cache, without copying them. The memory has to outlive the BVH
+	void Attach(const BVHNode* nodes, uint32_t nodeCount, uint32_t depth, const float* packedTriangles, uint32_t triangleCount);
+
+	// Copies the nodes and packed triangles into arena and attaches to the copies, freeing its own. GetArenaSize() of
+	// the arena has to be left, and it has to outlive the BVH
+	void MoveTo(MemoryArena& arena);
+	size_t GetArenaSize() const;
+
+	// Fits the boxes to vertices that moved since the build without changing which triangles go where, for
+	// animation. Much cheaper than Build and keeps registry.Triangles in order, but the boxes of a tree built for
+	// one pose can overlap badly in another. Returns GetCost() afterwards so the caller can tell when to rebuild
+	float Refit(const TriangleRegistry& registry);
+
+	// Expected cost of a ray through the tree by the same surface area heuristic the build minimizes, relative to
+	// the root. Only comparable between trees over the same triangles
+	float GetCost() const;
+
+	// Closest hit traversal. Only finds t, the barycentrics and the triangle index, use
+	// ComputeHitAttributes for the rest once the closest hit is known
+	TriangleHit Intersect(const Ray& ray, Real tMax = std::numeric_limits<Real>::infinity()) const;
+
+	// Any hit query, true as soon as something is found closer than tMax. Skips the search for the closest hit
+	// and never works out where the hit was
+	bool IsOccluded(const Ray& ray, Real tMax) const;
+
+	// Intersect for every ray of a packet at once. hits[i] gets replaced when ray i finds something closer than
+	// packet.TMax[i], which gets lowered to match
+	void IntersectPacket(RayPacket& packet, TriangleHitT<float>* hits) const;
+
+	const BVHNode* GetNodes() const { return m_NodeData; }
+	uint32_t GetNodeCount() const { return m_NodeCount; }
+	const PackedTriangles& GetTriangles() const { return m_Triangles; }
+	uint32_t GetDepth() const { return m_Depth; }
+
+private:
+	std::vector<BVHNode> m_Nodes; // Only filled when built here
+	const BVHNode* m_NodeData = nullptr; // Either m_Nodes or attached memory
+	uint32_t m_NodeCount = 0;
+	PackedTriangles m_Triangles;
+	TriangleKernel m_Kernel = IntersectTrianglesScalar<float>; // Only used by float builds
+	uint32_t m_Depth = 0;
+};
+
+// Slab test that returns the entry distance or infinity on a miss
+static inline float IntersectAABB(const glm::vec3& origin, const glm::vec3& inverseDirection,
+	const glm::vec3& boundsMin, const glm::vec3& boundsMax, float tMax)
+{
+	glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+	glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+
+	float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	// Conservative rounding so triangles on the edge of a box aren't missed
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax)) * 1.00000024f;
+
+	return entry <= exit ? entry : std::numeric_limits<float>::infinity();
+}
+
+// Closest hit traversal shared by both levels. intersectLeaf(first, count) tests the primitives of a leaf and
+// lowers closestDistance when it finds something closer, which then culls every node further away than that
+template<typename LeafFunction>
+void TraverseBVH(const BVHNode* nodes, const Ray& ray, const Real& closestDistance, LeafFunction&& intersectLeaf)
+{
+	// Node bounds are always float, double rays only use double for the primitive tests
+	glm::vec3 origin = glm::vec3(ray.Origin);
+	glm::vec3 inverseDirection = glm::vec3(
+		1.0f / static_cast<float>(ray.Direction.x),
+		1.0f / static_cast<float>(ray.Direction.y),
+		1.0f / static_cast<float>(ray.Direction.z)
+	);
+
+	// Far children are pushed with their entry distance so they can be skipped once a closer hit is found
+	struct StackEntry
+	{
+		uint32_t NodeIndex;
+		float Distance;
+	};
+
+	StackEntry stack[BVHMaxDepth + 1];
+	uint32_t stackSize = 0;
+	uint32_t nodeIndex = 0;
+
+	// Counted once at the end rather than per node, the counter lives in thread local storage
+	uint64_t visitedNodes = 1;
+	if (IntersectAABB(origin, inverseDirection, nodes[0].BoundsMin, nodes[0].BoundsMax,
+		static_cast<float>(closestDistance)) == std::numeric_limits<float>::infinity())
+	{
+		CountRenderWork(RenderCounter::NodeVisits, visitedNodes);
+		return;
+	}
+
+	while (true)
+	{
+		const BVHNode& node = nodes[nodeIndex];
+		if (node.IsLeaf())
+		{
+			// Only hits closer than everything found so far get through
+			intersectLeaf(node.LeftFirst, node.TriangleCount);
+		}
+		else
+		{
+			// Visit the nearer child first and skip any child further away than the closest hit
+			uint32_t leftIndex = nodeIndex + 1;
+			uint32_t rightIndex = node.LeftFirst;
+			float tClosest = static_cast<float>(closestDistance);
+			visitedNodes += 2;
+			float leftDistance = IntersectAABB(origin, inverseDirection,
+				nodes[leftIndex].BoundsMin, nodes[leftIndex].BoundsMax, tClosest);
+			float rightDistance = IntersectAABB(origin, inverseDirection,
+				nodes[rightIndex].BoundsMin, nodes[rightIndex].BoundsMax, tClosest);
+
+			if (leftDistance > rightDistance)
+			{
+				std::swap(leftDistance, rightDistance);
+				std::swap(leftIndex, rightIndex);
+			}
+
+			if (leftDistance != std::numeric_limits<float>::infinity())
+			{
+				if (rightDistance != std::numeric_limits<float>::infinity())
+					stack[stackSize++] = { rightIndex, rightDistance };
+				nodeIndex = leftIndex;
+				continue;
+			}
+		}
+
+		// Pop until a node that could still contain a closer hit turns up
+		bool found = false;
+		while (stackSize > 0)
+		{
+			StackEntry entry = stack[--stackSize];
+			if (entry.Distance <= closestDistance)
+			{
+				nodeIndex = entry.NodeIndex;
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+			break;
+	}
+
+	CountRenderWork(RenderCounter::NodeVisits, visitedNodes);
+}
+
+// Any hit traversal for occlusion queries. There's no closest hit to cull against so children get visited in
+// whatever order, and the first leaf where intersectLeaf(first, count) returns true ends the search
+template<typename LeafFunction>
+bool TraverseBVHAnyHit(const BVHNode* nodes, const Ray& ray, float tMax, LeafFunction&& intersectLeaf)
+{
+	glm::vec3 origin = glm::vec3(ray.Origin);
+	glm::vec3 inverseDirection = glm::vec3(
+		1.0f / static_cast<float>(ray.Direction.x),
+		1.0f / static_cast<float>(ray.Direction.y),
+		1.0f / static_cast<float>(ray.Direction.z)
+	);
+
+	// Both children get pushed, so one more than the depth can be waiting
+	uint32_t stack[BVHMaxDepth + 2];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	uint64_t visitedNodes = 0;
+	while (stackSize > 0)
+	{
+		uint32_t nodeIndex = stack[--stackSize];
+		const BVHNode& node = nodes[nodeIndex];
+		visitedNodes++;
+		if (IntersectAABB(origin, inverseDirection, node.BoundsMin, node.BoundsMax, tMax) == std::numeric_limits<float>::infinity())
+			continue;
+
+		if (node.IsLeaf())
+		{
+			if (intersectLeaf(node.LeftFirst, node.TriangleCount))
+			{
+				CountRenderWork(RenderCounter::NodeVisits, visitedNodes);
+				return true;
+			}
+			continue;
+		}
+
+		stack[stackSize++] = node.LeftFirst;
+		stack[stackSize++] = nodeIndex + 1;
+	}
+
+	CountRenderWork(RenderCounter::NodeVisits, visitedNodes);
+	return false;
+}
+
+// Packet version of TraverseBVH. intersectLeaf(node, firstGroup) gets every leaf some ray from firstGroup on hits
+// and tests the rays itself, lowering packet.TMax as it goes so nodes behind the hits get culled
+template<typename LeafFunction>
+void TraverseBVHPacket(const BVHNode* nodes, const RayPacket& packet, LeafFunction&& intersectLeaf)
+{
+	struct StackEntry
+	{
+		uint32_t NodeIndex;
+		uint32_t FirstGroup;
+	};
+
+	// Both children get pushed, so one more than the depth can be waiting
+	StackEntry stack[BVHMaxDepth + 2];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = { 0, 0 };
+
+	// A node tested for the whole packet counts once, not once per ray
+	uint64_t visitedNodes = 0;
+	uint32_t groupCount = packet.GetGroupCount();
+	while (stackSize > 0)
+	{
+		// Nodes are only tested once they get popped, by then hits found in the nearer child may have culled them
+		StackEntry entry = stack[--stackSize];
+		const BVHNode& node = nodes[entry.NodeIndex];
+		visitedNodes++;
+		uint32_t firstGroup = packet.FindFirstActiveGroup(node.BoundsMin, node.BoundsMax, entry.FirstGroup);
+		if (firstGroup == groupCount)
+			continue;
+
+		if (node.IsLeaf())
+		{
+			intersectLeaf(node, firstGroup);
+			continue;
+		}
+
+		// There's no distance for the whole packet to sort by, the child whose center lies further along the
+		// packet's direction is taken to be the far one
+		uint32_t nearIndex = entry.NodeIndex + 1;
+		uint32_t farIndex = node.LeftFirst;
+		glm::vec3 between = (nodes[farIndex].BoundsMin + nodes[farIndex].BoundsMax) - (nodes[nearIndex].BoundsMin + nodes[nearIndex].BoundsMax);
+		if (glm::dot(between, packet.DirectionSum) < 0.0f)
+			std::swap(nearIndex, farIndex);
+
+		stack[stackSize++] = { farIndex, firstGroup };
+		stack[stackSize++] = { nearIndex, firstGroup };
+	}
+
+	CountRenderWork(RenderCounter::NodeVisits, visitedNodes);
+}
@@ -0,0 +1,627 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include "Ray.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Model.h"
+#include "BVH.h"
+#include "PackedTriangles.h"
+#include "Random.h"
+#include "Sampler.h"
+#include "ThreadPool.h"
+#include "Renderer.h"
+#include "SceneCache.h"
+#include "Denoiser.h"
+
+// Benchmarks for tracking performance regressions
+// Every benchmark is timed over several runs after a warmup, and the results go to stdout (or --output) as JSON
+// so CI can keep a history. Progress goes to stderr to keep stdout clean.
+
+struct BenchmarkOptions
+{
+	std::string ScenePath = "amongus.glb";
+	std::string OutputPath; // Empty writes to stdout
+	std::vector<uint32_t> Scales = { 8, 64 }; // Copies of the scene in the synthetic scenes
+	uint32_t Runs = 10;
+	uint32_t WarmupRuns = 1;
+	uint32_t ThreadCount = 0;
+	RenderSettings Frame = { 1280, 720, 1, 32 }; // One camera ray per pixel, plus a shadow ray from the lit hits
+};
+
+struct BenchmarkResult
+{
+	std::string Name;
+	std::string WorkUnit; // What one unit of work is, like "rays"
+	double WorkPerRun = 0.0;
+	std::vector<double> Seconds; // One entry per run
+};
+
+// Keeps the optimizer from throwing away benchmark loops whose results are never used
+static volatile uint64_t s_Sink = 0;
+
+static BenchmarkResult RunBenchmark(const BenchmarkOptions& options, const std::string& name, const std::string& workUnit,
+	double workPerRun, const std::function<void()>& body)
+{
+	std::cerr << "Running " << name << "\n";
+
+	for (uint32_t i = 0; i < options.WarmupRuns; i++)
+		body();
+
+	BenchmarkResult result{ name, workUnit, workPerRun, {} };
+	result.Seconds.reserve(options.Runs);
+	for (uint32_t i = 0; i < options.Runs; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		body();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		result.Seconds.push_back(elapsed.count());
+	}
+	return result;
+}
+
+// Synthetic scenes
+
+// Copies of the whole scene laid out in a grid, for seeing how things scale past amongus.glb's few hundred triangles.
+// Flattened copies bake every instance into one big mesh while instanced copies only add instances, so the two
+// show what instancing saves and costs at the same triangle count. Instanced copies clone the source's meshes,
+// building their BVHs reorders the triangles
+static Scene MakeScaledScene(const Scene& source, uint32_t copies, bool instanced)
+{
+	AABB bounds = source.Accelerator.GetBounds();
+	glm::vec3 spacing = (bounds.Max - bounds.Min) * 1.25f;
+	uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<double>(copies))));
+	auto copyTransform = [&](uint32_t copy, const MeshInstance& instance) {
+		glm::vec3 offset = spacing * glm::vec3(
+			static_cast<float>(copy % side),
+			static_cast<float>((copy / side) % side),
+			static_cast<float>(copy / (side * side))
+		);
+		return glm::translate(glm::mat4(1.0f), offset) * instance.ObjectToWorld;
+	};
+
+	Scene scene;
+	scene.Light = source.Light;
+	if (instanced)
+	{
+		for (const TriangleRegistry& mesh : source.Meshes)
+			scene.Meshes.push_back(mesh.Clone());
+		for (uint32_t copy = 0; copy < copies; copy++)
+		{
+			for (const MeshInstance& instance : source.Instances)
+				scene.Instances.push_back({ copyTransform(copy, instance), instance.MeshIndex });
+		}
+		return scene;
+	}
+
+	size_t vertexCount = 0;
+	size_t triangleCount = 0;
+	for (const MeshInstance& instance : source.Instances)
+	{
+		vertexCount += source.Meshes[instance.MeshIndex].VertexCount * copies;
+		triangleCount += source.Meshes[instance.MeshIndex].Triangles.size() * copies;
+	}
+
+	TriangleRegistry registry;
+	registry.Allocate(vertexCount, triangleCount);
+
+	size_t firstVertex = 0;
+	size_t firstTriangle = 0;
+	for (uint32_t copy = 0; copy < copies; copy++)
+	{
+		for (const MeshInstance& instance : source.Instances)
+		{
+			const TriangleRegistry& mesh = source.Meshes[instance.MeshIndex];
+			glm::mat4 transform = copyTransform(copy, instance);
+			glm::mat4 normalTransform = glm::transpose(glm::inverse(transform));
+			for (size_t i = 0; i < mesh.VertexCount; i++)
+			{
+				registry.SetVertex(firstVertex + i,
+					glm::vec3(transform * glm::vec4(mesh.GetPosition(i), 1.0f)),
+					glm::normalize(glm::vec3(normalTransform * glm::vec4(mesh.GetNormal(i), 0.0f))),
+					mesh.GetColor(i));
+			}
+
+			for (const glm::uvec3& triangle : mesh.Triangles)
+				registry.Triangles[firstTriangle++] = triangle + glm::uvec3(static_cast<uint32_t>(firstVertex));
+			firstVertex += mesh.VertexCount;
+		}
+	}
+
+	scene.Meshes.push_back(std::move(registry));
+	scene.Instances.push_back({ glm::mat4(1.0f), 0 });
+	return scene;
+}
+
+// Same viewing direction as the default camera, pulled back far enough to see the whole scene. Needs a built scene
+static CameraSettings FrameScene(const Scene& scene)
+{
+	AABB bounds = scene.Accelerator.GetBounds();
+
+	CameraSettings defaults;
+	glm::vec3 center = (bounds.Min + bounds.Max) * 0.5f;
+	glm::vec3 direction = glm::normalize(defaults.LookFrom - defaults.LookAt);
+	float distance = glm::length(bounds.Max - bounds.Min) * 1.2f;
+
+	CameraSettings view;
+	view.LookAt = center;
+	view.LookFrom = center + direction * distance;
+	view.FocusDistance = distance;
+	return view;
+}
+
+// Benchmarks
+
+static void BenchmarkLoading(const BenchmarkOptions& options, std::vector<BenchmarkResult>& results, const Scene& scene)
+{
+	double triangleCount = static_cast<double>(scene.GetTriangleCount());
+	results.push_back(RunBenchmark(options, "load_model", "triangles", triangleCount, [&] {
+		ModelData model = LoadModel(options.ScenePath);
+		s_Sink = s_Sink + model.Meshes.size() + model.Instances.size();
+	}));
+
+	// Startup with the scene cache, hashing the source included since every cached load has to do it
+	uint64_t sourceHash = 0;
+	std::string cachePath = options.ScenePath + ".benchmark.nrcache";
+	if (!HashFile(options.ScenePath, sourceHash) || !WriteSceneCache(cachePath, scene, sourceHash))
+		return;
+
+	results.push_back(RunBenchmark(options, "load_scene_cache", "triangles", triangleCount, [&] {
+		Scene cached;
+		uint64_t hash = 0;
+		if (HashFile(options.ScenePath, hash) && LoadSceneCache(cachePath, hash, VertexLayout::Full, cached))
+			s_Sink = s_Sink + cached.GetTriangleCount();
+	}));
+	std::remove(cachePath.c_str());
+}
+
+static void BenchmarkCamera(const BenchmarkOptions& options, std::vector<BenchmarkResult>& results)
+{
+	constexpr uint32_t RayCount = 1 << 20;
+	Camera camera = CameraSettings().MakeCamera(options.Frame);
+
+	results.push_back(RunBenchmark(options, "camera_get_ray", "rays", RayCount, [&] {
+		Real sum = Real(0);
+		for (uint32_t i = 0; i < RayCount; i++)
+		{
+			RandomStream random(i, 0, RandomDimension::Lens);
+			Real lensU = static_cast<Real>(random.NextDouble());
+			Ray ray = camera.GetRay(Real(0.5), Real(0.5), lensU, static_cast<Real>(random.NextDouble()));
+			sum += ray.Direction.x;
+		}
+		s_Sink = s_Sink + static_cast<uint64_t>(std::abs(sum));
+	}));
+
+	// Both camera dimensions of a sample, what every camera ray pays before it gets traced
+	const std::pair<const char*, SamplerType> samplers[] = {
+		{ "random", SamplerType::Random }, { "sobol", SamplerType::Sobol }, { "bluenoise", SamplerType::BlueNoise } };
+	for (const auto& [name, samplerType] : samplers)
+	{
+		SamplerType type = samplerType;
+		results.push_back(RunBenchmark(options, std::string("pixel_sampler/") + name, "samples", RayCount, [&] {
+			double sum = 0.0;
+			for (uint32_t i = 0; i < RayCount; i++)
+			{
+				int32_t x = static_cast<int32_t>(i & 1023), y = static_cast<int32_t>((i >> 10) & 63);
+				PixelSampler sampler(type, x, y, static_cast<uint32_t>(x + y * 1024), i >> 16);
+				sum += sampler.Get2D(RandomDimension::PixelJitter).x + sampler.Get2D(RandomDimension::Lens).y;
+			}
+			s_Sink = s_Sink + static_cast<uint64_t>(sum);
+		}));
+	}
+}
+
+static void BenchmarkTriangleTests(const BenchmarkOptions& options, std::vector<BenchmarkResult>& results, const Scene& scene)
+{
+	// Camera rays spread over the frame, every one tested against every triangle
+	constexpr uint32_t RayCount = 4096;
+	Camera camera = CameraSettings().MakeCamera(options.Frame);
+	std::vector<Ray> rays;
+	rays.reserve(RayCount);
+	for (uint32_t i = 0; i < RayCount; i++)
+	{
+		RandomStream random(i, 0, RandomDimension::PixelJitter);
+		Real u = static_cast<Real>(random.NextDouble());
+		Real v = static_cast<Real>(random.NextDouble());
+		Real lensU = static_cast<Real>(random.NextDouble());
+		rays.push_back(camera.GetRay(u, v, lensU, static_cast<Real>(random.NextDouble())));
+	}
+
+	// Tested against the meshes as they're stored, in object space
+	double tests = static_cast<double>(RayCount) * static_cast<double>(scene.GetTriangleCount());
+
+	results.push_back(RunBenchmark(options, "ray_triangle_intersection", "tests", tests, [&] {
+		uint64_t hits = 0;
+		for (const Ray& ray : rays)
+		{
+			for (const TriangleRegistry& registry : scene.Meshes)
+			{
+				TriangleHit hit = { std::numeric_limits<Real>::infinity(), Real(0), Real(0) };
+				uint32_t triangleCount = static_cast<uint32_t>(registry.Triangles.size());
+				for (uint32_t i = 0; i < triangleCount; i++)
+				{
+					const glm::uvec3& triangle = registry.Triangles[i];
+					RayTriangleIntersection(ray, Vec3(registry.GetPosition(triangle.x)), Vec3(registry.GetPosition(triangle.y)),
+						Vec3(registry.GetPosition(triangle.z)), i, hit);
+				}
+				hits += hit.IsHit();
+			}
+		}
+		s_Sink = s_Sink + hits;
+	}));
+
+	// The SIMD kernel the BVHs use, over the same rays and triangles
+	TriangleKernel kernel = GetTriangleKernel();
+	std::string name = std::string("triangle_kernel_") + GetTriangleKernelName();
+	results.push_back(RunBenchmark(options, name, "tests", tests, [&] {
+		uint64_t hits = 0;
+		for (const Ray& ray : rays)
+		{
+			PackedRay packedRay(ray);
+			for (const BVH& accelerator : scene.MeshAccelerators)
+			{
+				const PackedTriangles& packed = accelerator.GetTriangles();
+				uint32_t triangleCount = packed.GetCount();
+				TriangleHitT<float> hit = { std::numeric_limits<float>::infinity(), 0.0f, 0.0f };
+				for (uint32_t first = 0; first < triangleCount; first += PackedTriangles::MaxWidth)
+					kernel(packed, packedRay, first, std::min(PackedTriangles::MaxWidth, triangleCount - first), hit);
+				hits += hit.IsHit();
+			}
+		}
+		s_Sink = s_Sink + hits;
+	}));
+}
+
+// Rays a frame really traces, the camera rays and the shadow rays of their hits. Those are the same every run, so
+// one render ahead of time gives the rate
+static double CountFrameRays(const Scene& scene, const Camera& camera, const RenderSettings& settings, ThreadPool& pool, HDRImage& image)
+{
+	uint64_t before = pool.GetTotalCounters().Get(RenderCounter::Rays);
+	RenderImage(scene, camera, settings, pool, image);
+	return static_cast<double>(pool.GetTotalCounters().Get(RenderCounter::Rays) - before);
+}
+
+static void BenchmarkScene(const BenchmarkOptions& options, std::vector<BenchmarkResult>& results, ThreadPool& pool,
+	Scene& scene, const CameraSettings& view, const std::string& sceneName)
+{
+	// Every unique mesh plus the top level, so instanced scenes only pay for the triangles they store
+	results.push_back(RunBenchmark(options, "bvh_build/" + sceneName, "triangles",
+		static_cast<double>(scene.GetTriangleCount()), [&] {
+		BuildScene(scene);
+		s_Sink = s_Sink + scene.Accelerator.GetNodeCount();
+	}));
+
+	// What an animated frame pays instead of the build, every mesh refit where its vertices already are
+	results.push_back(RunBenchmark(options, "bvh_refit/" + sceneName, "triangles",
+		static_cast<double>(scene.GetTriangleCount()), [&] {
+		for (size_t i = 0; i < scene.Meshes.size(); i++)
+			scene.MeshAccelerators[i].Refit(scene.Meshes[i]);
+		scene.Accelerator.Build(scene.MeshAccelerators, scene.Instances);
+		s_Sink = s_Sink + scene.Accelerator.GetNodeCount();
+	}));
+
+	const RenderSettings& settings = options.Frame;
+	Camera camera = view.MakeCamera(settings);
+	HDRImage image(settings.Width, settings.Height);
+	double rays = CountFrameRays(scene, camera, settings, pool, image);
+	results.push_back(RunBenchmark(options, "primary_frame/" + sceneName, "rays", rays, [&] {
+		RenderImage(scene, camera, settings, pool, image);
+	}));
+
+	// The same frame with every ray traced on its own, what the packets are measured against
+	RenderSettings singleSettings = settings;
+	singleSettings.UsePacketTracing = false;
+	double singleRays = CountFrameRays(scene, camera, singleSettings, pool, image);
+	results.push_back(RunBenchmark(options, "primary_frame_single/" + sceneName, "rays", singleRays, [&] {
+		RenderImage(scene, camera, singleSettings, pool, image);
+	}));
+
+	// Full paths through the wavefront engine. The ray count is the same every run, so one render ahead of time
+	// gives the rate
+	RenderSettings pathSettings = settings;
+	pathSettings.UsePathTracing = true;
+	double pathRays = static_cast<double>(RenderImage(scene, camera, pathSettings, pool, image).RayCount);
+	results.push_back(RunBenchmark(options, "path_trace/" + sceneName, "rays", pathRays, [&] {
+		RenderImage(scene, camera, pathSettings, pool, image);
+	}));
+	pathSettings.UsePacketTracing = false;
+	results.push_back(RunBenchmark(options, "path_trace_single/" + sceneName, "rays", pathRays, [&] {
+		RenderImage(scene, camera, pathSettings, pool, image);
+	}));
+
+	// Shadow rays from wherever a grid of camera rays lands to the light, as occlusion queries and as the closest
+	// hit search they'd need without them. Set up the way ShadeHit does, off the surface on the camera's side
+	constexpr int32_t GridSize = 256;
+	std::vector<Ray> shadowRays;
+	for (int32_t y = 0; y < GridSize; y++)
+	{
+		for (int32_t x = 0; x < GridSize; x++)
+		{
+			RandomStream lens(static_cast<uint32_t>(x + y * GridSize), 0, RandomDimension::Lens);
+			Real lensU = static_cast<Real>(lens.NextDouble());
+			Ray ray = camera.GetRay(Real(x) / Real(GridSize - 1), Real(y) / Real(GridSize - 1), lensU, static_cast<Real>(lens.NextDouble()));
+			TriangleHit hit = scene.Accelerator.Intersect(ray);
+			if (hit.IsHit())
+			{
+				IntersectionResult surface = ComputeHitAttributes(scene, ray, hit);
+				Vec3 normal = glm::dot(surface.Normal, ray.Direction) < Real(0) ? surface.Normal : -surface.Normal;
+				Vec3 origin = OffsetRayOrigin(surface.Position, normal);
+				shadowRays.push_back({ origin, scene.Light - origin });
+			}
+		}
+	}
+	if (shadowRays.empty())
+		return;
+
+	double shadowRayCount = static_cast<double>(shadowRays.size());
+	results.push_back(RunBenchmark(options, "shadow_rays/" + sceneName, "rays", shadowRayCount, [&] {
+		uint64_t occluded = 0;
+		for (const Ray& ray : shadowRays)
+			occluded += scene.Accelerator.IsOccluded(ray, Real(0), Real(1));
+		s_Sink = s_Sink + occluded;
+	}));
+	results.push_back(RunBenchmark(options, "shadow_rays_closest/" + sceneName, "rays", shadowRayCount, [&] {
+		uint64_t occluded = 0;
+		for (const Ray& ray : shadowRays)
+			occluded += scene.Accelerator.Intersect(ray, Real(1)).IsHit();
+		s_Sink = s_Sink + occluded;
+	}));
+}
+
+// The denoiser and the tone map every 8 bit output goes through, over a 4 spp render of the base scene
+static void BenchmarkPostProcess(const BenchmarkOptions& options, std::vector<BenchmarkResult>& results, ThreadPool& pool, const Scene& scene)
+{
+	RenderSettings settings = options.Frame;
+	settings.SamplesPerPixel = 4;
+	Camera camera = CameraSettings().MakeCamera(settings);
+	HDRImage image(settings.Width, settings.Height);
+	FeatureBuffer features;
+	RenderImage(scene, camera, settings, pool, image, &features);
+
+	std::vector<glm::vec3> denoised;
+	results.push_back(RunBenchmark(options, "denoise/base", "pixels", static_cast<double>(settings.Width) * settings.Height, [&] {
+		Denoise(features, DenoiseSettings(), pool, denoised);
+		s_Sink = s_Sink + static_cast<uint64_t>(denoised[denoised.size() / 2].x * 255.0f);
+	}));
+
+	size_t channelCount = static_cast<size_t>(settings.Width) * static_cast<size_t>(settings.Height) * 3;
+	std::vector<uint8_t> quantized(channelCount);
+	ToneMapSettings toneMap;
+	toneMap.Operator = ToneMapOperator::Reinhard;
+	results.push_back(RunBenchmark(options, "tonemap/base", "pixels", static_cast<double>(settings.Width) * settings.Height, [&] {
+		QuantizeColors(image.GetRow(0), quantized.data(), channelCount, toneMap);
+		s_Sink = s_Sink + quantized[channelCount / 2];
+	}));
+}
+
+// JSON output
+
+struct Statistics
+{
+	double Mean, Variance, StandardDeviation, Min, Max, P50, P90, P99;
+};
+
+// Linear interpolation between the closest ranks
+static double Percentile(const std::vector<double>& sorted, double percentile)
+{
+	double position = percentile / 100.0 * static_cast<double>(sorted.size() - 1);
+	size_t lower = static_cast<size_t>(position);
+	size_t upper = std::min(lower + 1, sorted.size() - 1);
+	double fraction = position - static_cast<double>(lower);
+	return sorted[lower] + (sorted[upper] - sorted[lower]) * fraction;
+}
+
+static Statistics ComputeStatistics(std::vector<double> samples)
+{
+	std::sort(samples.begin(), samples.end());
+
+	double sum = 0.0;
+	for (double sample : samples)
+		sum += sample;
+	double mean = sum / static_cast<double>(samples.size());
+
+	// Sample variance, runs are a sample of what the machine could do
+	double squaredError = 0.0;
+	for (double sample : samples)
+		squaredError += (sample - mean) * (sample - mean);
+	double variance = samples.size() > 1 ? squaredError / static_cast<double>(samples.size() - 1) : 0.0;
+
+	return {
+		mean, variance, std::sqrt(variance), samples.front(), samples.back(),
+		Percentile(samples, 50.0), Percentile(samples, 90.0), Percentile(samples, 99.0)
+	};
+}
+
+static std::string EscapeJSON(const std::string& text)
+{
+	std::string escaped;
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		escaped += c;
+	}
+	return escaped;
+}
+
+static void WriteStatistics(std::ostream& out, const char* name, const Statistics& stats)
+{
+	out << "\t\t\t\"" << name << "\": { \"mean\": " << stats.Mean << ", \"variance\": " << stats.Variance
+		<< ", \"stddev\": " << stats.StandardDeviation << ", \"min\": " << stats.Min << ", \"p50\": " << stats.P50
+		<< ", \"p90\": " << stats.P90 << ", \"p99\": " << stats.P99 << ", \"max\": " << stats.Max << " }";
+}
+
+static void WriteJSON(std::ostream& out, const BenchmarkOptions& options, uint32_t threadCount,
+	const std::vector<BenchmarkResult>& results)
+{
+	out.precision(9);
+	out << "{\n";
+	out << "\t\"version\": 1,\n";
+	out << "\t\"precision\": \"" << (sizeof(Real) == sizeof(float) ? "float" : "double") << "\",\n";
+	out << "\t\"triangle_kernel\": \"" << GetTriangleKernelName() << "\",\n";
+	out << "\t\"threads\": " << threadCount << ",\n";
+	out << "\t\"runs\": " << options.Runs << ",\n";
+	out << "\t\"warmup_runs\": " << options.WarmupRuns << ",\n";
+	out << "\t\"benchmarks\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchmarkResult& result = results[i];
+
+		// Throughput per run in millions of work units per second
+		std::vector<double> throughput;
+		for (double seconds : result.Seconds)
+			throughput.push_back(result.WorkPerRun / seconds / 1e6);
+
+		out << "\t\t{\n";
+		out << "\t\t\t\"name\": \"" << EscapeJSON(result.Name) << "\",\n";
+		out << "\t\t\t\"work_unit\": \"" << result.WorkUnit << "\",\n";
+		out << "\t\t\t\"work_per_run\": " << result.WorkPerRun << ",\n";
+		WriteStatistics(out, "seconds", ComputeStatistics(result.Seconds));
+		out << ",\n";
+		WriteStatistics(out, ("M" + result.WorkUnit + "_per_second").c_str(), ComputeStatistics(throughput));
+		out << "\n\t\t}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "\t]\n";
+	out << "}\n";
+}
+
+// Command line
+
+static void PrintUsage()
+{
+	std::cerr <<
+		"Usage: NamelessRaytracerBenchmark [options]\n"
+		"  --scene <path>          GLB file to benchmark (default amongus.glb)\n"
+		"  --output <path>         JSON file to write (default stdout)\n"
+		"  --runs <count>          Timed runs per benchmark (default 10)\n"
+		"  --warmup <count>        Untimed runs before timing (default 1)\n"
+		"  --threads <count>       Render threads, 0 for all of them (default 0)\n"
+		"  --scales <a,b,...>      Copies of the scene in the synthetic scenes, flattened and instanced (default 8,64)\n";
+}
+
+static bool ParseCount(const std::string& text, uint32_t& value)
+{
+	char trailing;
+	int32_t parsed;
+	if (std::sscanf(text.c_str(), "%d%c", &parsed, &trailing) != 1 || parsed < 0)
+		return false;
+	value = static_cast<uint32_t>(parsed);
+	return true;
+}
+
+static bool ParseOptions(int argc, char** argv, BenchmarkOptions& options)
+{
+	for (int32_t i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		std::string value = argv[i + 1];
+		bool isValid = true;
+		if (arg == "--scene")
+			options.ScenePath = value;
+		else if (arg == "--output")
+			options.OutputPath = value;
+		else if (arg == "--runs")
+			isValid = ParseCount(value, options.Runs) && options.Runs > 0;
+		else if (arg == "--warmup")
+			isValid = ParseCount(value, options.WarmupRuns);
+		else if (arg == "--threads")
+			isValid = ParseCount(value, options.ThreadCount);
+		else if (arg == "--scales")
+		{
+			options.Scales.clear();
+			std::stringstream list(value);
+			std::string item;
+			while (isValid && std::getline(list, item, ','))
+			{
+				uint32_t scale = 0;
+				isValid = ParseCount(item, scale) && scale > 0;
+				options.Scales.push_back(scale);
+			}
+		}
+		else
+			isValid = false;
+
+		if (!isValid)
+		{
+			std::cerr << "Bad option " << arg << " " << value << "\n";
+			return false;
+		}
+	}
+
+	return argc % 2 == 1;
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	Scene scene;
+	if (!LoadScene(scene, options.ScenePath))
+	{
+		std::cerr << "Failed to load " << options.ScenePath << "\n";
+		return 2;
+	}
+
+	ThreadPool pool(options.ThreadCount);
+	std::vector<BenchmarkResult> results;
+
+	BenchmarkLoading(options, results, scene);
+	BenchmarkCamera(options, results);
+	BenchmarkTriangleTests(options, results, scene);
+	BenchmarkScene(options, results, pool, scene, CameraSettings(), "base");
+	BenchmarkPostProcess(options, results, pool, scene);
+
+	// Shading cost of decoding the compact vertex layouts
+	for (VertexLayout layout : { VertexLayout::Compact, VertexLayout::Quantized })
+	{
+		Scene compact;
+		if (!LoadScene(compact, options.ScenePath, false, layout))
+			continue;
+		std::string sceneName = layout == VertexLayout::Compact ? "base_compact" : "base_quantized";
+		BenchmarkScene(options, results, pool, compact, CameraSettings(), sceneName);
+	}
+
+	for (uint32_t scale : options.Scales)
+	{
+		for (bool instanced : { false, true })
+		{
+			Scene scaled = MakeScaledScene(scene, scale, instanced);
+			BuildScene(scaled);
+			std::string sceneName = "x" + std::to_string(scale) + (instanced ? "_instanced" : "");
+			BenchmarkScene(options, results, pool, scaled, FrameScene(scaled), sceneName);
+		}
+	}
+
+	if (options.OutputPath.empty())
+	{
+		WriteJSON(std::cout, options, pool.GetThreadCount(), results);
+		return 0;
+	}
+
+	std::ofstream outFile(options.OutputPath, std::ios::trunc);
+	if (!outFile.is_open())
+	{
+		std::cerr << "Failed to write " << options.OutputPath << "\n";
+		return 3;
+	}
+	WriteJSON(outFile, options, pool.GetThreadCount(), results);
+	return 0;
+}
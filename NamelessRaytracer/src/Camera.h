@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+
+#include "glm/glm.hpp"
+
+#include "Ray.h"
+#include "Sampler.h"
+
+// Camera code
+
+// Entire camera structure adapted from raytracing in one weekend book
+template<typename Scalar>
+struct CameraT
+{
+	Vec3T<Scalar> Origin;
+	Vec3T<Scalar> UpperLeftCorner;
+	Vec3T<Scalar> Horizontal;
+	Vec3T<Scalar> Vertical;
+	Vec3T<Scalar> U, V, W;
+	Scalar LensRadius;
+	Scalar FocusDistance;
+
+	CameraT(
+		Vec3T<Scalar> lookFrom,
+		Vec3T<Scalar> lookAt,
+		Vec3T<Scalar> vup,
+		Scalar vfov, // vertical field-of-view in degrees
+		Scalar aspectRatio,
+		Scalar aperture,
+		Scalar focusDist)
+	{
+		Scalar theta = glm::radians(vfov);
+		Scalar h = std::tan(theta / Scalar(2));
+		Scalar viewportHeight = Scalar(2) * h;
+		Scalar viewportWidth = aspectRatio * viewportHeight;
+
+		W = glm::normalize(lookFrom - lookAt);
+		U = glm::normalize(glm::cross(vup, W));
+		V = glm::cross(W, U);
+
+		Origin = lookFrom;
+		Horizontal = focusDist * viewportWidth * U;
+		Vertical = focusDist * viewportHeight * V;
+		UpperLeftCorner = Origin - Horizontal / Scalar(2) + Vertical / Scalar(2) - focusDist * W;
+
+		LensRadius = aperture / Scalar(2);
+		FocusDistance = focusDist;
+	}
+
+	// (lensU, lensV) is a point in the unit square that picks where on the lens the ray starts
+	RayT<Scalar> GetRay(Scalar s, Scalar t, Scalar lensU, Scalar lensV) const
+	{
+		glm::vec<2, Scalar> rd = LensRadius * MapToConcentricDisk(lensU, lensV);
+		Vec3T<Scalar> offset = U * rd.x + V * rd.y;
+
+		return {
+			Origin + offset,
+			UpperLeftCorner + s * Horizontal - t * Vertical - Origin - offset
+		};
+	}
+
+	// GetRay plus the rays from the same lens point through (s + ds, t) and (s, t + dt)
+	RayT<Scalar> GetRay(Scalar s, Scalar t, Scalar lensU, Scalar lensV, Scalar ds, Scalar dt, RayDifferentialT<Scalar>& differential) const
+	{
+		RayT<Scalar> ray = GetRay(s, t, lensU, lensV);
+		differential = { ray.Origin, ray.Direction + ds * Horizontal, ray.Origin, ray.Direction - dt * Vertical };
+		return ray;
+	}
+
+	// Differentials of a pinhole ray that reaches point, for rays that didn't come from the camera. Steps of ds and
+	// dt cover as much at point's distance as they would for a camera ray hitting it (pbrt-v4's approximation)
+	RayDifferentialT<Scalar> ApproximateDifferential(const Vec3T<Scalar>& point, Scalar ds, Scalar dt) const
+	{
+		Vec3T<Scalar> direction = point - Origin;
+		Scalar scale = std::abs(glm::dot(direction, W)) / -glm::dot(UpperLeftCorner - Origin, W);
+		return { Origin, direction + scale * ds * Horizontal, Origin, direction - scale * dt * Vertical };
+	}
+
+	// The ray through the middle of the lens, what every lens sample at (s, t) is spread around
+	RayT<Scalar> GetPinholeRay(Scalar s, Scalar t) const
+	{
+		return { Origin, UpperLeftCorner + s * Horizontal - t * Vertical - Origin };
+	}
+
+	// How wide the lens blurs a point on the image, as a fraction of the image width. The circle of confusion measured
+	// on the focus plane, 0 for a pinhole and points on the focus plane. Infinite for points behind the camera
+	Scalar GetBlurWidth(const Vec3T<Scalar>& point) const
+	{
+		Scalar depth = -glm::dot(point - Origin, W);
+		if (depth <= Scalar(0))
+			return std::numeric_limits<Scalar>::infinity();
+		return Scalar(2) * LensRadius * std::abs(depth - FocusDistance) / depth / glm::length(Horizontal);
+	}
+
+	// Where a point shows up on the image, the inverse of GetPinholeRay. False for points behind the camera
+	bool Project(const Vec3T<Scalar>& point, Scalar& s, Scalar& t) const
+	{
+		Vec3T<Scalar> toPoint = point - Origin;
+		Scalar depth = -glm::dot(toPoint, W);
+		if (depth <= Scalar(0))
+			return false;
+
+		// Scale the point onto the focus plane the image corners lie on, then measure it against the image axes
+		Vec3T<Scalar> toCorner = UpperLeftCorner - Origin;
+		Vec3T<Scalar> onPlane = toPoint * (-glm::dot(toCorner, W) / depth) - toCorner;
+		s = glm::dot(onPlane, Horizontal) / glm::dot(Horizontal, Horizontal);
+		t = -glm::dot(onPlane, Vertical) / glm::dot(Vertical, Vertical);
+		return true;
+	}
+};
+
+using Camera = CameraT<Real>;
@@ -0,0 +1,306 @@
+#include "Denoiser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+	#define NR_X64
+	#include <emmintrin.h>
+#endif
+
+// Every buffer gets split into planes of one float per pixel so a row of taps is a straight run of loads
+// The color planes get filtered and ping pong between iterations, the variance travels with them
+enum ColorPlane : uint32_t
+{
+	ColorR, ColorG, ColorB,
+	ColorVariance,
+	ColorPlaneCount
+};
+
+// The guides stay the same through every iteration
+enum GuidePlane : uint32_t
+{
+	AlbedoR, AlbedoG, AlbedoB,
+	NormalX, NormalY, NormalZ,
+	Depth,
+
+	// 1 / (sigma^2 + the feature's own variance), saves a divide per tap. Depth's sigma is relative to the depth
+	AlbedoScale, NormalScale, DepthScale,
+	GuidePlaneCount
+};
+
+static constexpr float KernelWeights[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+static constexpr float VarianceBlurWeights[3] = { 0.25f, 0.5f, 0.25f };
+static constexpr int32_t RowsPerTask = 8;
+static constexpr float GuideNoiseScale = 4.0f; // Feature differences within two standard deviations are noise
+
+void FeatureBuffer::Reset(int32_t width, int32_t height)
+{
+	Width = width;
+	Height = height;
+	size_t pixelCount = static_cast<size_t>(width) * static_cast<size_t>(height);
+	Color.assign(pixelCount, glm::vec3(0.0f));
+	Albedo.assign(pixelCount, glm::vec3(0.0f));
+	Normal.assign(pixelCount, glm::vec3(0.0f));
+	Depth.assign(pixelCount, 0.0f);
+	Variance.assign(pixelCount, 0.0f);
+	FeatureVariance.assign(pixelCount, glm::vec3(0.0f));
+}
+
+// One row of the filter. The center pointers are the row being filtered, the tap pointers the row the current
+// taps land on
+struct FilterRow
+{
+	const float* Color[ColorPlaneCount];
+	const float* Guide[GuidePlaneCount];
+	const float* TapColor[ColorPlaneCount];
+	const float* TapGuide[GuidePlaneCount];
+	const float* LuminanceScale; // 1 / (sigma^2 * variance) of every center pixel
+	float* Sum[5]; // Weighted r, g, b, the total weight and the variance weighted by the squared weights
+};
+
+static constexpr float LuminanceWeights[3] = { 0.2126f, 0.7152f, 0.0722f };
+
+// exp(x) for x <= 0, good to about 1e-4 relative which is plenty for weights. The SSE2 version below does the
+// exact same operations so the border pixels match the vectorized ones
+static inline float FastExp(float x)
+{
+	float t = std::max(x, -87.0f) * 1.44269504f;
+	float integer = std::floor(t);
+	float f = t - integer;
+	float p = 1.0f + f * (0.69314718f + f * (0.24022651f + f * (0.05550411f + f * (0.00961813f + f * 0.00133336f))));
+	int32_t bits = (static_cast<int32_t>(integer) + 127) << 23;
+	float scale;
+	std::memcpy(&scale, &bits, sizeof(scale));
+	return p * scale;
+}
+
+static inline void AccumulateTap(const FilterRow& row, int32_t x, int32_t q, float kernelWeight)
+{
+	float luminance = 0.0f, albedoDistance = 0.0f, normalDistance = 0.0f;
+	for (int32_t c = 0; c < 3; c++)
+	{
+		float color = row.TapColor[c][q] - row.Color[c][x];
+		float albedo = row.TapGuide[AlbedoR + c][q] - row.Guide[AlbedoR + c][x];
+		float normal = row.TapGuide[NormalX + c][q] - row.Guide[NormalX + c][x];
+		luminance += color * LuminanceWeights[c];
+		albedoDistance += albedo * albedo;
+		normalDistance += normal * normal;
+	}
+	float depth = row.TapGuide[Depth][q] - row.Guide[Depth][x];
+
+	float exponent = luminance * luminance * row.LuminanceScale[x] + albedoDistance * row.Guide[AlbedoScale][x] +
+		normalDistance * row.Guide[NormalScale][x] + depth * depth * row.Guide[DepthScale][x];
+	float weight = kernelWeight * FastExp(-exponent);
+
+	for (int32_t c = 0; c < 3; c++)
+		row.Sum[c][x] += weight * row.TapColor[c][q];
+	row.Sum[3][x] += weight;
+	row.Sum[4][x] += weight * weight * row.TapColor[ColorVariance][q];
+}
+
+#ifdef NR_X64
+
+// Four pixels at a time for the taps that don't need clamping. SSE2 is all any x64 CPU is guaranteed to have
+static int32_t AccumulateTapsSSE(const FilterRow& row, int32_t begin, int32_t end, int32_t offset, float kernelWeight)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 weightScale = _mm_set1_ps(kernelWeight);
+
+	int32_t x = begin;
+	for (; x + 4 <= end; x += 4)
+	{
+		int32_t q = x + offset;
+		__m128 tapColor[3];
+		__m128 luminance = _mm_setzero_ps(), albedoDistance = _mm_setzero_ps(), normalDistance = _mm_setzero_ps();
+		for (int32_t c = 0; c < 3; c++)
+		{
+			tapColor[c] = _mm_loadu_ps(row.TapColor[c] + q);
+			__m128 color = _mm_sub_ps(tapColor[c], _mm_loadu_ps(row.Color[c] + x));
+			__m128 albedo = _mm_sub_ps(_mm_loadu_ps(row.TapGuide[AlbedoR + c] + q), _mm_loadu_ps(row.Guide[AlbedoR + c] + x));
+			__m128 normal = _mm_sub_ps(_mm_loadu_ps(row.TapGuide[NormalX + c] + q), _mm_loadu_ps(row.Guide[NormalX + c] + x));
+			luminance = _mm_add_ps(luminance, _mm_mul_ps(color, _mm_set1_ps(LuminanceWeights[c])));
+			albedoDistance = _mm_add_ps(albedoDistance, _mm_mul_ps(albedo, albedo));
+			normalDistance = _mm_add_ps(normalDistance, _mm_mul_ps(normal, normal));
+		}
+		__m128 depth = _mm_sub_ps(_mm_loadu_ps(row.TapGuide[Depth] + q), _mm_loadu_ps(row.Guide[Depth] + x));
+
+		__m128 exponent = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_mul_ps(luminance, luminance), _mm_loadu_ps(row.LuminanceScale + x)),
+			_mm_mul_ps(albedoDistance, _mm_loadu_ps(row.Guide[AlbedoScale] + x))),
+			_mm_mul_ps(normalDistance, _mm_loadu_ps(row.Guide[NormalScale] + x))),
+			_mm_mul_ps(_mm_mul_ps(depth, depth), _mm_loadu_ps(row.Guide[DepthScale] + x)));
+
+		// FastExp(-exponent), floor done by truncating and stepping down where that rounded up
+		__m128 t = _mm_mul_ps(_mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), exponent), _mm_set1_ps(-87.0f)), _mm_set1_ps(1.44269504f));
+		__m128 integer = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+		integer = _mm_sub_ps(integer, _mm_and_ps(_mm_cmpgt_ps(integer, t), one));
+		__m128 f = _mm_sub_ps(t, integer);
+		__m128 p = _mm_add_ps(_mm_set1_ps(0.00961813f), _mm_mul_ps(f, _mm_set1_ps(0.00133336f)));
+		p = _mm_add_ps(_mm_set1_ps(0.05550411f), _mm_mul_ps(f, p));
+		p = _mm_add_ps(_mm_set1_ps(0.24022651f), _mm_mul_ps(f, p));
+		p = _mm_add_ps(_mm_set1_ps(0.69314718f), _mm_mul_ps(f, p));
+		p = _mm_add_ps(one, _mm_mul_ps(f, p));
+		__m128i bits = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(integer), _mm_set1_epi32(127)), 23);
+		__m128 weight = _mm_mul_ps(weightScale, _mm_mul_ps(p, _mm_castsi128_ps(bits)));
+
+		for (int32_t c = 0; c < 3; c++)
+			_mm_storeu_ps(row.Sum[c] + x, _mm_add_ps(_mm_loadu_ps(row.Sum[c] + x), _mm_mul_ps(weight, tapColor[c])));
+		_mm_storeu_ps(row.Sum[3] + x, _mm_add_ps(_mm_loadu_ps(row.Sum[3] + x), weight));
+		__m128 variance = _mm_mul_ps(_mm_mul_ps(weight, weight), _mm_loadu_ps(row.TapColor[ColorVariance] + q));
+		_mm_storeu_ps(row.Sum[4] + x, _mm_add_ps(_mm_loadu_ps(row.Sum[4] + x), variance));
+	}
+	return x;
+}
+
+#endif
+
+// Taps that land past the left or right edge get clamped to it, everything in between is a straight run
+static void AccumulateTaps(const FilterRow& row, int32_t width, int32_t offset, float kernelWeight)
+{
+	int32_t begin = std::clamp(-offset, 0, width);
+	int32_t end = std::clamp(width - offset, begin, width);
+
+	for (int32_t x = 0; x < begin; x++)
+		AccumulateTap(row, x, 0, kernelWeight);
+
+	int32_t x = begin;
+#ifdef NR_X64
+	x = AccumulateTapsSSE(row, begin, end, offset, kernelWeight);
+#endif
+	for (; x < end; x++)
+		AccumulateTap(row, x, x + offset, kernelWeight);
+
+	for (x = end; x < width; x++)
+		AccumulateTap(row, x, width - 1, kernelWeight);
+}
+
+static float GuideScale(float sigma, float variance)
+{
+	// A sigma of 0 leaves that feature out of the weights entirely
+	return sigma > 0.0f ? 1.0f / (sigma * sigma + GuideNoiseScale * variance) : 0.0f;
+}
+
+void Denoise(const FeatureBuffer& features, const DenoiseSettings& settings, ThreadPool& pool, std::vector<glm::vec3>& output)
+{
+	int32_t width = features.Width;
+	int32_t height = features.Height;
+	size_t pixelCount = static_cast<size_t>(width) * static_cast<size_t>(height);
+	output.resize(pixelCount);
+	if (pixelCount == 0)
+		return;
+
+	// Two sets of color planes to ping pong between, the guides never change
+	std::vector<float> colors[2] = { std::vector<float>(pixelCount * ColorPlaneCount), std::vector<float>(pixelCount * ColorPlaneCount) };
+	std::vector<float> guides(pixelCount * GuidePlaneCount);
+
+	// The feature variances get the same 3x3 blur as the color's, a pixel just inside a silhouette whose samples
+	// all happened to hit the same surface still counts as part of the noisy edge
+	std::vector<glm::vec3> featureVariances(pixelCount);
+	for (int32_t y = 0; y < height; y++)
+	{
+		for (int32_t x = 0; x < width; x++)
+		{
+			glm::vec3 variance(0.0f);
+			for (int32_t ky = 0; ky < 3; ky++)
+			{
+				size_t rowStart = static_cast<size_t>(std::clamp(y + ky - 1, 0, height - 1)) * static_cast<size_t>(width);
+				for (int32_t kx = 0; kx < 3; kx++)
+					variance += VarianceBlurWeights[ky] * VarianceBlurWeights[kx] * features.FeatureVariance[rowStart + static_cast<size_t>(std::clamp(x + kx - 1, 0, width - 1))];
+			}
+			featureVariances[static_cast<size_t>(x) + static_cast<size_t>(y) * static_cast<size_t>(width)] = variance;
+		}
+	}
+
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		for (int32_t c = 0; c < 3; c++)
+		{
+			colors[0][pixelCount * (ColorR + c) + i] = features.Color[i][c];
+			guides[pixelCount * (AlbedoR + c) + i] = features.Albedo[i][c];
+			guides[pixelCount * (NormalX + c) + i] = features.Normal[i][c];
+		}
+		colors[0][pixelCount * ColorVariance + i] = features.Variance[i];
+		guides[pixelCount * Depth + i] = features.Depth[i];
+
+		const glm::vec3& variance = featureVariances[i];
+		guides[pixelCount * AlbedoScale + i] = GuideScale(settings.AlbedoSigma, variance.x);
+		guides[pixelCount * NormalScale + i] = GuideScale(settings.NormalSigma, variance.y);
+		guides[pixelCount * DepthScale + i] = settings.DepthSigma > 0.0f ? GuideScale(settings.DepthSigma * features.Depth[i] + 1e-3f, variance.z) : 0.0f;
+	}
+
+	float luminanceVariance = settings.LuminanceSigma * settings.LuminanceSigma;
+
+	for (int32_t iteration = 0; iteration < settings.Iterations; iteration++)
+	{
+		const float* source = colors[iteration % 2].data();
+		float* destination = colors[(iteration + 1) % 2].data();
+		int32_t step = 1 << iteration;
+
+		for (int32_t firstRow = 0; firstRow < height; firstRow += RowsPerTask)
+		{
+			pool.Submit([&, source, destination, step, firstRow](uint32_t) {
+				std::vector<float> scratch(static_cast<size_t>(width) * 6);
+				FilterRow row;
+				for (int32_t c = 0; c < 5; c++)
+					row.Sum[c] = scratch.data() + static_cast<size_t>(width) * c;
+				float* luminanceScale = scratch.data() + static_cast<size_t>(width) * 5;
+				row.LuminanceScale = luminanceScale;
+
+				int32_t endRow = std::min(firstRow + RowsPerTask, height);
+				for (int32_t y = firstRow; y < endRow; y++)
+				{
+					size_t rowStart = static_cast<size_t>(y) * static_cast<size_t>(width);
+					for (uint32_t c = 0; c < ColorPlaneCount; c++)
+						row.Color[c] = source + pixelCount * c + rowStart;
+					for (uint32_t g = 0; g < GuidePlaneCount; g++)
+						row.Guide[g] = guides.data() + pixelCount * g + rowStart;
+					std::fill(scratch.begin(), scratch.begin() + static_cast<std::ptrdiff_t>(width) * 5, 0.0f);
+
+					// The variance gets a 3x3 blur first like SVGF does. A pixel whose few samples all happened to agree
+					// would otherwise claim to be noise free and refuse every neighbour
+					const float* varianceRows[3];
+					for (int32_t ky = 0; ky < 3; ky++)
+						varianceRows[ky] = source + pixelCount * ColorVariance + static_cast<size_t>(std::clamp(y + ky - 1, 0, height - 1)) * static_cast<size_t>(width);
+					for (int32_t x = 0; x < width; x++)
+					{
+						float variance = 0.0f;
+						for (int32_t ky = 0; ky < 3; ky++)
+							for (int32_t kx = 0; kx < 3; kx++)
+								variance += VarianceBlurWeights[ky] * VarianceBlurWeights[kx] * varianceRows[ky][std::clamp(x + kx - 1, 0, width - 1)];
+						luminanceScale[x] = luminanceVariance > 0.0f ? 1.0f / (luminanceVariance * variance + 1e-6f) : 0.0f;
+					}
+
+					for (int32_t ky = 0; ky < 5; ky++)
+					{
+						int32_t tapY = std::clamp(y + (ky - 2) * step, 0, height - 1);
+						size_t tapRowStart = static_cast<size_t>(tapY) * static_cast<size_t>(width);
+						for (uint32_t c = 0; c < ColorPlaneCount; c++)
+							row.TapColor[c] = source + pixelCount * c + tapRowStart;
+						for (uint32_t g = 0; g < GuidePlaneCount; g++)
+							row.TapGuide[g] = guides.data() + pixelCount * g + tapRowStart;
+
+						for (int32_t kx = 0; kx < 5; kx++)
+							AccumulateTaps(row, width, (kx - 2) * step, KernelWeights[ky] * KernelWeights[kx]);
+					}
+
+					// The center tap always has a weight, so the total never ends up 0
+					for (int32_t x = 0; x < width; x++)
+					{
+						float inverseWeight = 1.0f / row.Sum[3][x];
+						for (int32_t c = 0; c < 3; c++)
+							destination[pixelCount * c + rowStart + x] = row.Sum[c][x] * inverseWeight;
+						destination[pixelCount * ColorVariance + rowStart + x] = row.Sum[4][x] * inverseWeight * inverseWeight;
+					}
+				}
+			});
+		}
+
+		pool.Wait();
+	}
+
+	const float* result = colors[settings.Iterations > 0 ? settings.Iterations % 2 : 0].data();
+	for (size_t i = 0; i < pixelCount; i++)
+		output[i] = glm::vec3(result[ColorR * pixelCount + i], result[ColorG * pixelCount + i], result[ColorB * pixelCount + i]);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "ThreadPool.h"
+
+// Edge avoiding a-trous wavelet denoiser (Dammertz et al. 2010)
+// Runs as a post pass over a finished render. Every iteration blurs with a 5x5 B3 spline kernel whose taps get
+// twice as far apart each time, so five iterations cover a 125 pixel wide footprint for only 25 taps a pixel each.
+// The luminance difference of every tap is measured against how noisy the center pixel is like SVGF does
+// (Schied et al. 2017), so clean pixels hold on to their detail while noisy ones get averaged with everything
+// similar around them, and the variance gets filtered along with the color so later iterations ease off.
+// Taps also get weighted down by how much their albedo, normal and depth differ from the center pixel's, with
+// differences inside those features' own noise not counting.
+
+// What a render writes out next to the color, everything in scanline order. The features come from the first
+// hit of every camera ray and are averaged over the pixel's samples the same way the color is
+struct FeatureBuffer
+{
+	int32_t Width = 0;
+	int32_t Height = 0;
+	std::vector<glm::vec3> Color;
+	std::vector<glm::vec3> Albedo;
+	std::vector<glm::vec3> Normal; // World space shading normal, zero where nothing was hit
+	std::vector<float> Depth; // Distance from the camera, zero where nothing was hit
+	std::vector<float> Variance; // Of the luminance mean, how noisy the pixel's color is
+
+	// How much the albedo, normal and depth moved around between the pixel's samples, as the variance of their
+	// means. Defocused and antialiased edges mix several surfaces into a pixel and make its features just as
+	// noisy as its color, differences that small don't count as edges
+	std::vector<glm::vec3> FeatureVariance;
+
+	// Resizes every buffer and zeroes it
+	void Reset(int32_t width, int32_t height);
+};
+
+// Setting a sigma to 0 leaves that feature out of the weights. Albedo and depth are off by default, at a few
+// samples per pixel the noise is mostly at silhouettes where they're as noisy as the color and only end up
+// keeping it. They're worth turning on for scenes with textures or noise inside the surfaces
+struct DenoiseSettings
+{
+	int32_t Iterations = 5;
+	float LuminanceSigma = 8.0f; // In standard deviations of the center pixel's luminance
+	float AlbedoSigma = 0.0f;
+	float NormalSigma = 1.0f; // On the distance between the normals, not the angle
+	float DepthSigma = 0.0f; // Relative to the center pixel's depth
+};
+
+// Filters features.Color into output. Rows get split over the pool
+void Denoise(const FeatureBuffer& features, const DenoiseSettings& settings, ThreadPool& pool, std::vector<glm::vec3>& output);
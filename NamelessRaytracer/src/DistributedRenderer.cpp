@@ -0,0 +1,542 @@
+#include "DistributedRenderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "SceneCache.h"
+#include "WavefrontPathTracer.h"
+
+static constexpr uint32_t ProtocolMagic = 0x5244524E; // "NRDR"
+static constexpr uint32_t ProtocolVersion = 2;
+
+// Nothing legitimate comes close, a bigger size means the stream is garbage
+static constexpr uint32_t MaxMessageSize = 1u << 30;
+
+// Seconds a connection gets to say hello before it's dropped
+static constexpr double HandshakeTimeout = 10.0;
+
+enum class MessageType : uint32_t
+{
+	Hello, // Worker to coordinator, HelloMessage
+	Setup, // Coordinator to worker, SetupMessage and the scene path
+	Ready, // Worker to coordinator, ReadyMessage once the scene is loaded
+	Job, // Coordinator to worker, JobMessage
+	Result, // Worker to coordinator, ResultMessage and a color sum per pixel of the job
+	Shutdown // Coordinator to worker, nothing more is coming
+};
+
+struct MessageHeader
+{
+	uint32_t Magic;
+	MessageType Type;
+	uint32_t Size; // Bytes after the header
+};
+
+struct HelloMessage
+{
+	uint32_t Version;
+};
+
+struct SetupMessage
+{
+	uint64_t SourceHash;
+	int32_t Width;
+	int32_t Height;
+	int32_t SamplesPerPixel;
+	int32_t TileSize;
+	int32_t MaxBounces;
+	VertexLayout Layout;
+	uint8_t UsePacketTracing;
+	uint8_t UsePathTracing;
+	uint8_t UseCache;
+	SamplerType Sampler;
+	uint32_t PathLength;
+};
+
+struct ReadyMessage
+{
+	uint32_t IsLoaded;
+};
+
+struct JobMessage
+{
+	uint32_t Frame;
+	uint32_t JobIndex;
+	int32_t FirstRow;
+	int32_t RowCount;
+	uint32_t FirstSample;
+	uint32_t SampleCount;
+	glm::vec3 LookFrom;
+	glm::vec3 LookAt;
+	float FieldOfView;
+	float Aperture;
+	float FocusDistance;
+};
+
+struct ResultMessage
+{
+	uint32_t Frame;
+	uint32_t JobIndex;
+};
+
+static bool WriteMessage(Socket& socket, MessageType type, const void* message, size_t size, const void* data = nullptr, size_t dataSize = 0)
+{
+	MessageHeader header = { ProtocolMagic, type, static_cast<uint32_t>(size + dataSize) };
+	return socket.Send(&header, sizeof(header)) && socket.Send(message, size) && (dataSize == 0 || socket.Send(data, dataSize));
+}
+
+static bool ReadMessage(Socket& socket, MessageType& type, std::vector<uint8_t>& payload, double timeout = 0.0)
+{
+	MessageHeader header;
+	if (!socket.Receive(&header, sizeof(header), timeout) || header.Magic != ProtocolMagic || header.Size > MaxMessageSize)
+		return false;
+
+	type = header.Type;
+	payload.resize(header.Size);
+	return header.Size == 0 || socket.Receive(payload.data(), payload.size(), timeout);
+}
+
+// Pulls a fixed size message off the front of a payload
+template<typename Message>
+static bool ParseMessage(const std::vector<uint8_t>& payload, Message& message)
+{
+	if (payload.size() < sizeof(Message))
+		return false;
+	std::memcpy(&message, payload.data(), sizeof(Message));
+	return true;
+}
+
+RenderCoordinator::RenderCoordinator(const DistributedSettings& distributed)
+	: m_Distributed(distributed)
+{
+}
+
+RenderCoordinator::~RenderCoordinator()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stopping = true;
+		m_PendingJobs.clear();
+
+		// Idle workers get told they're done, the ones still on a job or a handshake would otherwise hold the
+		// join up until their read times out
+		for (Socket* connection : m_BusyConnections)
+			connection->Shutdown();
+	}
+	m_JobAvailable.notify_all();
+
+	// The accept loop is the only one adding worker threads, once it's gone the list can't change
+	if (m_AcceptThread.joinable())
+		m_AcceptThread.join();
+	for (std::thread& thread : m_WorkerThreads)
+		thread.join();
+}
+
+bool RenderCoordinator::Start(const std::string& scenePath, bool useCache, VertexLayout layout, const RenderSettings& settings)
+{
+	if (!HashFile(scenePath, m_SourceHash))
+		return false;
+
+	m_Listener = Socket::Listen(m_Distributed.Port);
+	if (!m_Listener.IsValid())
+		return false;
+
+	m_ScenePath = scenePath;
+	m_UseCache = useCache;
+	m_Layout = layout;
+	m_Settings = settings;
+
+	// Bands are whole tiles so the tiles a worker splits them back into never cross into the next band
+	int32_t tileSize = std::max(settings.TileSize, 1);
+	int32_t rows = m_Distributed.RowsPerJob > 0 ? m_Distributed.RowsPerJob : tileSize;
+	m_Distributed.RowsPerJob = (rows + tileSize - 1) / tileSize * tileSize;
+	if (m_Distributed.SamplesPerJob <= 0)
+		m_Distributed.SamplesPerJob = std::max(settings.SamplesPerPixel, 1);
+
+	m_AcceptThread = std::thread(&RenderCoordinator::AcceptLoop, this);
+	return true;
+}
+
+uint32_t RenderCoordinator::GetWorkerCount()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_WorkerCount;
+}
+
+bool RenderCoordinator::RenderFrame(const CameraSettings& view, HDRImage& image, RenderStats& stats,
+	const std::function<void(int32_t rowCount)>& onRowsFinished)
+{
+	const RenderSettings& settings = m_Settings;
+	uint32_t samplesPerPixel = static_cast<uint32_t>(std::max(settings.SamplesPerPixel, 1));
+	uint32_t samplesPerJob = static_cast<uint32_t>(m_Distributed.SamplesPerJob);
+	uint32_t jobsPerBand = (samplesPerPixel + samplesPerJob - 1) / samplesPerJob;
+	int32_t bandCount = (settings.Height + m_Distributed.RowsPerJob - 1) / m_Distributed.RowsPerJob;
+
+	// Jobs go out band by band, so the top of the image comes back first and can be written early
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Frame++;
+		m_View = view;
+		m_HasFailed = false;
+		m_Jobs.clear();
+		m_PendingJobs.clear();
+		for (int32_t band = 0; band < bandCount; band++)
+		{
+			int32_t firstRow = band * m_Distributed.RowsPerJob;
+			for (uint32_t firstSample = 0; firstSample < samplesPerPixel; firstSample += samplesPerJob)
+			{
+				Job job;
+				job.FirstRow = firstRow;
+				job.RowCount = std::min(m_Distributed.RowsPerJob, settings.Height - firstRow);
+				job.FirstSample = firstSample;
+				job.SampleCount = std::min(samplesPerJob, samplesPerPixel - firstSample);
+				m_PendingJobs.push_back(static_cast<uint32_t>(m_Jobs.size()));
+				m_Jobs.push_back(std::move(job));
+			}
+		}
+	}
+	m_JobAvailable.notify_all();
+
+	size_t width = static_cast<size_t>(settings.Width);
+	int32_t mergedBands = 0;
+	while (mergedBands < bandCount)
+	{
+		// Finished jobs never change again and the list stays put until the next frame, so merging can happen
+		// without holding everyone else up
+		int32_t finishedBands = mergedBands;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			auto isBandDone = [&](int32_t band) {
+				for (uint32_t j = 0; j < jobsPerBand; j++)
+				{
+					if (!m_Jobs[static_cast<size_t>(band) * jobsPerBand + j].IsDone)
+						return false;
+				}
+				return true;
+			};
+			m_JobFinished.wait(lock, [&] { return m_HasFailed || isBandDone(mergedBands); });
+			if (m_HasFailed)
+			{
+				m_PendingJobs.clear();
+				return false;
+			}
+			while (finishedBands < bandCount && isBandDone(finishedBands))
+				finishedBands++;
+		}
+
+		// Sample ranges get added in order whoever finished first, then divided like PixelEstimate::GetColor
+		for (int32_t band = mergedBands; band < finishedBands; band++)
+		{
+			const Job& first = m_Jobs[static_cast<size_t>(band) * jobsPerBand];
+			for (int32_t row = 0; row < first.RowCount; row++)
+			{
+				for (size_t x = 0; x < width; x++)
+				{
+					size_t i = x + static_cast<size_t>(row) * width;
+					glm::vec3 sum(0.0f);
+					for (uint32_t j = 0; j < jobsPerBand; j++)
+						sum += m_Jobs[static_cast<size_t>(band) * jobsPerBand + j].ColorSums[i];
+					image.SetPixel(static_cast<int32_t>(x), first.FirstRow + row, sum / static_cast<float>(samplesPerPixel));
+				}
+			}
+		}
+		mergedBands = finishedBands;
+
+		if (onRowsFinished)
+			onRowsFinished(std::min(mergedBands * m_Distributed.RowsPerJob, settings.Height));
+	}
+
+	stats = RenderStats();
+	stats.SampleCount = static_cast<uint64_t>(settings.Width) * static_cast<uint64_t>(settings.Height) * samplesPerPixel;
+	stats.Passes = 1;
+	return true;
+}
+
+void RenderCoordinator::AcceptLoop()
+{
+	uint32_t workerIndex = 0;
+	while (true)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (m_Stopping)
+				return;
+		}
+
+		// Wakes up now and then to notice the coordinator shutting down
+		Socket connection = m_Listener.Accept(0.25);
+		if (connection.IsValid())
+			m_WorkerThreads.emplace_back(&RenderCoordinator::ServeWorker, this, std::move(connection), workerIndex++);
+	}
+}
+
+void RenderCoordinator::SetBusy(Socket* connection, bool isBusy)
+{
+	if (isBusy)
+		m_BusyConnections.push_back(connection);
+	else
+		m_BusyConnections.erase(std::remove(m_BusyConnections.begin(), m_BusyConnections.end(), connection), m_BusyConnections.end());
+}
+
+void RenderCoordinator::ServeWorker(Socket connection, uint32_t workerIndex)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (m_Stopping)
+			return;
+		SetBusy(&connection, true);
+	}
+
+	MessageType type;
+	std::vector<uint8_t> payload;
+	HelloMessage hello;
+	if (!ReadMessage(connection, type, payload, HandshakeTimeout) || type != MessageType::Hello || !ParseMessage(payload, hello) ||
+		hello.Version != ProtocolVersion)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		SetBusy(&connection, false);
+		if (!m_Stopping)
+			std::cout << "WARNING: Worker " << workerIndex << " didn't say hello in a language this coordinator speaks\n";
+		return;
+	}
+
+	SetupMessage setup{};
+	setup.SourceHash = m_SourceHash;
+	setup.Width = m_Settings.Width;
+	setup.Height = m_Settings.Height;
+	setup.SamplesPerPixel = m_Settings.SamplesPerPixel;
+	setup.TileSize = m_Settings.TileSize;
+	setup.MaxBounces = m_Settings.MaxBounces;
+	setup.Layout = m_Layout;
+	setup.UsePacketTracing = m_Settings.UsePacketTracing;
+	setup.UsePathTracing = m_Settings.UsePathTracing;
+	setup.UseCache = m_UseCache;
+	setup.Sampler = m_Settings.Sampler;
+	setup.PathLength = static_cast<uint32_t>(m_ScenePath.size());
+
+	// Loading can take a while on a big scene, it gets as long as a job does
+	ReadyMessage ready;
+	if (!WriteMessage(connection, MessageType::Setup, &setup, sizeof(setup), m_ScenePath.data(), m_ScenePath.size()) ||
+		!ReadMessage(connection, type, payload, m_Distributed.JobTimeout) || type != MessageType::Ready ||
+		!ParseMessage(payload, ready) || !ready.IsLoaded)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		SetBusy(&connection, false);
+		if (!m_Stopping)
+			std::cout << "WARNING: Worker " << workerIndex << " couldn't load " << m_ScenePath << "\n";
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		SetBusy(&connection, false);
+		m_WorkerCount++;
+	}
+	std::cout << "Worker " << workerIndex << " connected\n";
+
+	size_t width = static_cast<size_t>(m_Settings.Width);
+	while (true)
+	{
+		JobMessage message;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_JobAvailable.wait(lock, [this] { return m_Stopping || !m_PendingJobs.empty(); });
+			if (m_Stopping)
+			{
+				m_WorkerCount--;
+				break;
+			}
+
+			uint32_t jobIndex = m_PendingJobs.front();
+			m_PendingJobs.pop_front();
+			const Job& job = m_Jobs[jobIndex];
+			message = { m_Frame, jobIndex, job.FirstRow, job.RowCount, job.FirstSample, job.SampleCount,
+				m_View.LookFrom, m_View.LookAt, m_View.FieldOfView, m_View.Aperture, m_View.FocusDistance };
+			SetBusy(&connection, true);
+		}
+
+		size_t resultSize = sizeof(ResultMessage) + static_cast<size_t>(message.RowCount) * width * sizeof(glm::vec3);
+		ResultMessage result;
+		bool isReturned = WriteMessage(connection, MessageType::Job, &message, sizeof(message)) &&
+			ReadMessage(connection, type, payload, m_Distributed.JobTimeout) && type == MessageType::Result &&
+			payload.size() == resultSize && ParseMessage(payload, result) && result.Frame == message.Frame && result.JobIndex == message.JobIndex;
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		SetBusy(&connection, false);
+		bool isCurrent = message.Frame == m_Frame;
+		if (!isReturned)
+		{
+			// The job goes to the front so the band it holds up gets finished first. The worker is dropped either
+			// way, there's no telling what state its end of the connection is in
+			if (isCurrent)
+			{
+				Job& job = m_Jobs[message.JobIndex];
+				if (++job.Attempts >= m_Distributed.MaxAttempts)
+					m_HasFailed = true;
+				else
+					m_PendingJobs.push_front(message.JobIndex);
+				m_JobAvailable.notify_one();
+				m_JobFinished.notify_all();
+			}
+			m_WorkerCount--;
+			if (!m_Stopping)
+			{
+				std::cout << "WARNING: Lost worker " << workerIndex << ", rows " << message.FirstRow << " to "
+					<< message.FirstRow + message.RowCount << " go to another one\n";
+			}
+			return;
+		}
+
+		if (isCurrent)
+		{
+			Job& job = m_Jobs[message.JobIndex];
+			job.ColorSums.resize(static_cast<size_t>(job.RowCount) * width);
+			std::memcpy(job.ColorSums.data(), payload.data() + sizeof(ResultMessage), job.ColorSums.size() * sizeof(glm::vec3));
+			job.IsDone = true;
+			m_JobFinished.notify_all();
+		}
+	}
+
+	WriteMessage(connection, MessageType::Shutdown, nullptr, 0);
+}
+
+// Renders one job into a color sum per pixel of its band, the same sums RenderImage's estimates get
+static void RenderJob(const Scene& scene, const Camera& camera, const RenderSettings& settings, ThreadPool& pool,
+	WavefrontPathTracer* tracer, const JobMessage& job, std::vector<glm::vec3>& colorSums)
+{
+	size_t width = static_cast<size_t>(settings.Width);
+	colorSums.assign(static_cast<size_t>(job.RowCount) * width, glm::vec3(0.0f));
+
+	if (tracer)
+	{
+		// The band is one run of pixels in scanline order, exactly what the tracer takes
+		uint32_t firstPixel = static_cast<uint32_t>(job.FirstRow) * static_cast<uint32_t>(width);
+		uint32_t pixelCount = static_cast<uint32_t>(colorSums.size());
+		std::vector<glm::vec3> colors(std::min(pixelCount, WavefrontPathTracer::MaxBatchSize));
+		for (uint32_t first = 0; first < pixelCount; first += WavefrontPathTracer::MaxBatchSize)
+		{
+			uint32_t count = std::min(pixelCount - first, WavefrontPathTracer::MaxBatchSize);
+			for (uint32_t s = job.FirstSample; s < job.FirstSample + job.SampleCount; s++)
+			{
+				tracer->TraceSamples(firstPixel + first, count, s, colors.data(), nullptr);
+				for (uint32_t j = 0; j < count; j++)
+					colorSums[first + j] += colors[j];
+			}
+		}
+		return;
+	}
+
+	for (int32_t tileY = job.FirstRow; tileY < job.FirstRow + job.RowCount; tileY += settings.TileSize)
+	{
+		for (int32_t tileX = 0; tileX < settings.Width; tileX += settings.TileSize)
+		{
+			glm::vec3* tileSums = colorSums.data() + static_cast<size_t>(tileX) + static_cast<size_t>(tileY - job.FirstRow) * width;
+			pool.Submit([&, tileX, tileY, tileSums](uint32_t) {
+				AccumulateTile(scene, camera, settings, tileX, tileY, job.FirstSample, job.SampleCount, tileSums, width);
+			});
+		}
+	}
+	pool.Wait();
+}
+
+bool RunRenderWorker(const std::string& host, uint16_t port, ThreadPool& pool, double connectTimeout)
+{
+	// Workers are often started alongside the coordinator, it gets a moment to start listening
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(connectTimeout));
+	Socket connection = Socket::Connect(host, port);
+	while (!connection.IsValid() && Clock::now() < deadline)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+		connection = Socket::Connect(host, port);
+	}
+	if (!connection.IsValid())
+	{
+		std::cout << "Couldn't connect to " << host << ":" << port << "\n";
+		return false;
+	}
+
+	MessageType type;
+	std::vector<uint8_t> payload;
+	HelloMessage hello = { ProtocolVersion };
+	SetupMessage setup;
+	if (!WriteMessage(connection, MessageType::Hello, &hello, sizeof(hello)) || !ReadMessage(connection, type, payload) ||
+		type != MessageType::Setup || !ParseMessage(payload, setup) || payload.size() != sizeof(setup) + setup.PathLength)
+	{
+		std::cout << "Coordinator at " << host << ":" << port << " didn't send a setup\n";
+		return false;
+	}
+
+	std::string scenePath(reinterpret_cast<const char*>(payload.data()) + sizeof(setup), setup.PathLength);
+	RenderSettings settings;
+	settings.Width = setup.Width;
+	settings.Height = setup.Height;
+	settings.SamplesPerPixel = setup.SamplesPerPixel;
+	settings.TileSize = setup.TileSize;
+	settings.MaxBounces = setup.MaxBounces;
+	settings.UsePacketTracing = setup.UsePacketTracing != 0;
+	settings.UsePathTracing = setup.UsePathTracing != 0;
+	settings.Sampler = setup.Sampler;
+
+	// A different file under the same name would quietly render a different picture into the same image
+	uint64_t sourceHash = 0;
+	Scene scene;
+	bool isLoaded = HashFile(scenePath, sourceHash) && sourceHash == setup.SourceHash &&
+		LoadScene(scene, scenePath, setup.UseCache != 0, setup.Layout);
+	ReadyMessage ready = { isLoaded ? 1u : 0u };
+	WriteMessage(connection, MessageType::Ready, &ready, sizeof(ready));
+	if (!isLoaded)
+	{
+		std::cout << "Couldn't load " << scenePath << " or it isn't the coordinator's version of it\n";
+		return false;
+	}
+	std::cout << "Loaded " << scenePath << ", rendering " << settings.Width << "x" << settings.Height << " jobs\n";
+
+	// The tracer keeps a reference to the camera, which gets moved to every job's view in place
+	Camera camera = CameraSettings().MakeCamera(settings);
+	std::unique_ptr<WavefrontPathTracer> tracer;
+	if (settings.UsePathTracing)
+		tracer = std::make_unique<WavefrontPathTracer>(scene, camera, settings, pool);
+
+	std::vector<glm::vec3> colorSums;
+	uint32_t jobCount = 0;
+	while (true)
+	{
+		JobMessage job;
+		if (!ReadMessage(connection, type, payload))
+		{
+			std::cout << "Lost the coordinator after " << jobCount << " jobs\n";
+			return false;
+		}
+		if (type == MessageType::Shutdown)
+			break;
+		if (type != MessageType::Job || !ParseMessage(payload, job) || job.FirstRow < 0 || job.RowCount <= 0 ||
+			job.FirstRow + job.RowCount > settings.Height)
+		{
+			std::cout << "Got a message that isn't a job from the coordinator\n";
+			return false;
+		}
+
+		CameraSettings view;
+		view.LookFrom = job.LookFrom;
+		view.LookAt = job.LookAt;
+		view.FieldOfView = job.FieldOfView;
+		view.Aperture = job.Aperture;
+		view.FocusDistance = job.FocusDistance;
+		camera = view.MakeCamera(settings);
+
+		RenderJob(scene, camera, settings, pool, tracer.get(), job, colorSums);
+		ResultMessage result = { job.Frame, job.JobIndex };
+		if (!WriteMessage(connection, MessageType::Result, &result, sizeof(result), colorSums.data(), colorSums.size() * sizeof(glm::vec3)))
+		{
+			std::cout << "Lost the coordinator after " << jobCount << " jobs\n";
+			return false;
+		}
+		jobCount++;
+	}
+
+	std::cout << "Coordinator is done, rendered " << jobCount << " jobs\n";
+	return true;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "Image.h"
+#include "Model.h"
+#include "Renderer.h"
+#include "Socket.h"
+#include "ThreadPool.h"
+
+// Distributed rendering
+// A coordinator splits every frame into jobs, a band of rows and a range of samples each, and hands them out over
+// TCP to worker processes on the same machine or the LAN. Workers load the scene themselves from the path the
+// coordinator gives them, the coordinator only hashes the file to make sure everyone renders the same one. Every
+// job comes back as the unquantized color sums of its pixels, which the coordinator adds up in job order once a
+// band is complete, so the image doesn't depend on which worker rendered what or when. A worker that drops its
+// connection or takes too long loses its job to the next worker that asks.
+// Messages use the native byte order and struct layout like the scene cache, so every machine taking part has to
+// be the same kind. Adaptive sampling and the feature buffers aren't supported.
+
+struct DistributedSettings
+{
+	uint16_t Port = 7070;
+	int32_t RowsPerJob = 0; // 0 uses the tile size
+	int32_t SamplesPerJob = 0; // 0 gives every job all the samples, which keeps the image identical to a local render
+	double JobTimeout = 120.0; // Seconds a worker gets to send a job back before it's dropped
+	int32_t MaxAttempts = 3; // A job that gets lost this many times fails the frame
+};
+
+class RenderCoordinator
+{
+public:
+	RenderCoordinator(const DistributedSettings& distributed);
+	~RenderCoordinator(); // Tells every worker it's done
+
+	RenderCoordinator(const RenderCoordinator&) = delete;
+	RenderCoordinator& operator=(const RenderCoordinator&) = delete;
+
+	// Starts listening for workers. Returns false if the scene can't be read or the port can't be bound
+	bool Start(const std::string& scenePath, bool useCache, VertexLayout layout, const RenderSettings& settings);
+
+	// Blocks until every job of the frame is back, merging bands into the image as they complete. Waits for as long
+	// as it takes for a worker to connect. Returns false if a job failed MaxAttempts times
+	// onRowsFinished works like RenderImage's
+	bool RenderFrame(const CameraSettings& view, HDRImage& image, RenderStats& stats,
+		const std::function<void(int32_t rowCount)>& onRowsFinished = nullptr);
+
+	uint16_t GetPort() const { return m_Listener.GetLocalPort(); }
+	uint32_t GetWorkerCount();
+
+private:
+	struct Job
+	{
+		int32_t FirstRow;
+		int32_t RowCount;
+		uint32_t FirstSample;
+		uint32_t SampleCount;
+		int32_t Attempts = 0;
+		bool IsDone = false;
+		std::vector<glm::vec3> ColorSums;
+	};
+
+	void AcceptLoop();
+	void ServeWorker(Socket connection, uint32_t workerIndex);
+	void SetBusy(Socket* connection, bool isBusy); // Callers hold m_Mutex
+
+	DistributedSettings m_Distributed;
+	RenderSettings m_Settings;
+	std::string m_ScenePath;
+	uint64_t m_SourceHash = 0;
+	bool m_UseCache = false;
+	VertexLayout m_Layout = VertexLayout::Full;
+
+	Socket m_Listener;
+	std::thread m_AcceptThread;
+	std::vector<std::thread> m_WorkerThreads;
+
+	// Everything below is shared with the worker threads
+	std::mutex m_Mutex;
+	std::condition_variable m_JobAvailable;
+	std::condition_variable m_JobFinished;
+	uint32_t m_Frame = 0; // Results from an earlier frame get thrown away
+	CameraSettings m_View;
+	std::vector<Job> m_Jobs;
+	std::deque<uint32_t> m_PendingJobs;
+	uint32_t m_WorkerCount = 0;
+	std::vector<Socket*> m_BusyConnections; // Connections waiting on their worker, shutting down cuts them short
+	bool m_HasFailed = false;
+	bool m_Stopping = false;
+};
+
+// Connects to a coordinator and renders jobs for it on the pool until it says it's done. Waits up to
+// connectTimeout seconds for the coordinator to come up. Returns false if the connection drops first or the
+// scene can't be loaded
+bool RunRenderWorker(const std::string& host, uint16_t port, ThreadPool& pool, double connectTimeout = 10.0);
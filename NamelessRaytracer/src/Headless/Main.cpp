@@ -0,0 +1,706 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+#include "glm/glm.hpp"
+
+#include "Ray.h"
+#include "Camera.h"
+#include "Image.h"
+#include "ImageWriter.h"
+#include "Model.h"
+#include "BVH.h"
+#include "ThreadPool.h"
+#include "RenderCounters.h"
+#include "Renderer.h"
+#include "Denoiser.h"
+#include "DistributedRenderer.h"
+#include "Animation.h"
+
+// Batch renderer for machines without a display. Links nothing from GLFW, glad or imgui so it starts
+// straight into loading the scene, and everything about the job comes from the command line so a
+// scheduler can run as many of these side by side as it likes.
+
+struct HeadlessOptions
+{
+	std::string ScenePath = "amongus.glb";
+	std::string OutputPath = "image.png";
+	RenderSettings Settings;
+	CameraSettings View;
+	ToneMapSettings ToneMap;
+	int32_t FrameCount = 1;
+	bool HasFrameCount = false;
+	uint32_t ThreadCount = 0;
+	bool UseCache = false;
+	bool UseDenoiser = false;
+	bool WriteFeatures = false;
+	VertexLayout Layout = VertexLayout::Full;
+	size_t TextureMemory = TextureCache::DefaultMemoryBudget;
+	bool WriteHeatmap = false;
+	std::string StatsPath;
+
+	// Sequences turn around --look-at unless the file's animation or a camera path moves things instead
+	bool PlayAnimation = false;
+	float FramesPerSecond = 24.0f;
+	std::string CameraPathFile;
+	std::vector<CameraSettings> CameraPath; // One view per frame
+
+	// Distributed rendering, the process is a coordinator with IsCoordinator and a worker with a WorkerHost
+	bool IsCoordinator = false;
+	DistributedSettings Distributed;
+	std::string WorkerHost;
+	uint16_t WorkerPort = 0;
+};
+
+static void PrintUsage()
+{
+	std::cout <<
+		"Usage: NamelessRaytracerHeadless [options]\n"
+		"  --scene <path>          GLB file to render (default amongus.glb)\n"
+		"  --output <path>         File to write, a .ppm or .pfm extension writes those instead of a PNG. PFMs\n"
+		"                          keep the colors unclamped (default image.png)\n"
+		"  --width <pixels>        Image width (default 1280)\n"
+		"  --height <pixels>       Image height (default 720)\n"
+		"  --spp <count>           Samples per pixel, the most any pixel gets with --error or --time (default 10)\n"
+		"  --error <target>        Adaptive sampling, pixels stop once the relative error of their mean gets\n"
+		"                          this low (0.01 is a good start)\n"
+		"  --time <seconds>        Adaptive sampling, stops refining once this much time has gone by\n"
+		"  --min-spp <count>       Samples every pixel gets before adaptive sampling can stop it (default 4)\n"
+		"  --threads <count>       Render threads, 0 for all of them (default 0)\n"
+		"  --frames <count>        Renders a turntable around --look-at, written as image_0000.png and on. Every\n"
+		"                          frame gets written in the background while the next one renders (default 1)\n"
+		"  --animate               Plays the scene's glTF animation from a fixed camera instead of a turntable. Without\n"
+		"                          --frames the whole animation gets rendered\n"
+		"  --fps <rate>            Frames per second of animation time with --animate (default 24)\n"
+		"  --camera-path <path>    Text file with one view per frame as '<look-from x,y,z> <look-at x,y,z> [fov]',\n"
+		"                          focused on the look-at point. Sets the frame count, can go with --animate\n"
+		"  --exposure <scale>      Multiplies the colors before tone mapping (default 1)\n"
+		"  --tonemap <operator>    clamp or reinhard, how colors past 1 get squeezed into 8 bits (default clamp)\n"
+		"  --denoise               Runs the a-trous denoiser over the render before writing it\n"
+		"  --aovs                  Also writes the albedo, normal and depth buffers next to the output\n"
+		"  --no-packets            Traces every camera ray on its own instead of 8x8 pixels at a time\n"
+		"  --path-trace            Multi bounce path tracing with the wavefront engine, ignores --error and --time\n"
+		"  --bounces <count>       Most bounces a path gets with --path-trace (default 8)\n"
+		"  --sampler <type>        random, sobol or bluenoise, how camera samples spread over their pixel and the\n"
+		"                          lens. bluenoise leaves what noise is left as fine grain (default sobol)\n"
+		"  --heatmap               Writes a false color PNG of how many nodes and triangles every pixel's rays\n"
+		"                          tested instead of the render, black for none up to red for the costliest pixels\n"
+		"  --stats <path>          Writes what every render thread did (rays, triangle tests, node visits, hits,\n"
+		"                          samples, tile times) to a JSON file once all frames are done\n"
+		"  --cache                 Load from <scene>.nrcache, writing it first if it's missing or stale\n"
+		"  --vertices <layout>     full, compact (octahedral normals, 16 bit colors) or quantized\n"
+		"                          (compact with 16 bit positions) (default full)\n"
+		"  --texture-memory <MB>   Most memory decoded texture tiles and mip chains take up, the least recently\n"
+		"                          used ones get dropped past it (default 256)\n"
+		"  --look-from <x,y,z>     Camera position\n"
+		"  --look-at <x,y,z>       Point the camera looks at\n"
+		"  --fov <degrees>         Vertical field of view\n"
+		"  --aperture <size>       Lens aperture, 0 for a pinhole\n"
+		"  --focus <distance>      Focus distance\n"
+		"Distributed rendering:\n"
+		"  --listen <port>         Coordinates workers instead of rendering, frames get split into jobs that go to\n"
+		"                          whichever worker asks next. Workers load --scene from the same path\n"
+		"  --worker <host:port>    Renders jobs for the coordinator at host:port until it's done, only --threads\n"
+		"                          applies, everything else comes from the coordinator\n"
+		"  --rows-per-job <count>  Rows in a job, rounded up to whole tiles (default 32)\n"
+		"  --samples-per-job <n>   Samples in a job, by default every job takes all of them and the image comes out\n"
+		"                          the same as a local render\n"
+		"  --job-timeout <seconds> How long a worker gets to finish a job before it goes to another (default 120)\n";
+}
+
+static bool ParseVec3(const std::string& text, glm::vec3& value)
+{
+	char trailing;
+	return std::sscanf(text.c_str(), "%f,%f,%f%c", &value.x, &value.y, &value.z, &trailing) == 3;
+}
+
+static bool ParseFloat(const std::string& text, float& value)
+{
+	char trailing;
+	return std::sscanf(text.c_str(), "%f%c", &value, &trailing) == 1;
+}
+
+static bool ParseInt(const std::string& text, int32_t& value, int32_t minimum)
+{
+	char trailing;
+	return std::sscanf(text.c_str(), "%d%c", &value, &trailing) == 1 && value >= minimum;
+}
+
+// host:port, the host being a name or an address
+static bool ParseAddress(const std::string& text, std::string& host, uint16_t& port)
+{
+	size_t colon = text.find_last_of(':');
+	int32_t value = 0;
+	if (colon == std::string::npos || colon == 0 || !ParseInt(text.substr(colon + 1), value, 1) || value > 65535)
+		return false;
+	host = text.substr(0, colon);
+	port = static_cast<uint16_t>(value);
+	return true;
+}
+
+static bool ParseVertexLayout(const std::string& text, VertexLayout& layout)
+{
+	if (text == "full")
+		layout = VertexLayout::Full;
+	else if (text == "compact")
+		layout = VertexLayout::Compact;
+	else if (text == "quantized")
+		layout = VertexLayout::Quantized;
+	else
+		return false;
+	return true;
+}
+
+static bool ParseSamplerType(const std::string& text, SamplerType& type)
+{
+	if (text == "random")
+		type = SamplerType::Random;
+	else if (text == "sobol")
+		type = SamplerType::Sobol;
+	else if (text == "bluenoise")
+		type = SamplerType::BlueNoise;
+	else
+		return false;
+	return true;
+}
+
+static bool ParseToneMapOperator(const std::string& text, ToneMapOperator& toneMapOperator)
+{
+	if (text == "clamp")
+		toneMapOperator = ToneMapOperator::Clamp;
+	else if (text == "reinhard")
+		toneMapOperator = ToneMapOperator::Reinhard;
+	else
+		return false;
+	return true;
+}
+
+// A view per line, blank lines and lines starting with # are skipped. Everything a line doesn't set comes from view
+static bool LoadCameraPath(const std::string& path, const CameraSettings& view, std::vector<CameraSettings>& cameraPath)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cout << "Couldn't open camera path " << path << "\n";
+		return false;
+	}
+
+	std::string line;
+	int32_t lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		std::istringstream fields(line);
+		std::string lookFrom, lookAt, fieldOfView, trailing;
+		if (!(fields >> lookFrom) || lookFrom[0] == '#')
+			continue;
+
+		CameraSettings frameView = view;
+		bool isValid = (fields >> lookAt) && ParseVec3(lookFrom, frameView.LookFrom) && ParseVec3(lookAt, frameView.LookAt);
+		if (fields >> fieldOfView)
+			isValid &= ParseFloat(fieldOfView, frameView.FieldOfView);
+		if (!isValid || (fields >> trailing))
+		{
+			std::cout << "Bad view on line " << lineNumber << " of " << path << "\n";
+			return false;
+		}
+
+		frameView.FocusDistance = glm::length(frameView.LookAt - frameView.LookFrom);
+		cameraPath.push_back(frameView);
+	}
+
+	if (cameraPath.empty())
+	{
+		std::cout << "Camera path " << path << " has no views\n";
+		return false;
+	}
+	return true;
+}
+
+static bool ParseOptions(int argc, char** argv, HeadlessOptions& options)
+{
+	for (int32_t i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--help")
+			return false;
+		// Flags, everything else takes a value
+		if (arg == "--cache" || arg == "--denoise" || arg == "--aovs" || arg == "--no-packets" || arg == "--path-trace" || arg == "--animate"
+			|| arg == "--heatmap")
+		{
+			if (arg == "--cache")
+				options.UseCache = true;
+			else if (arg == "--denoise")
+				options.UseDenoiser = true;
+			else if (arg == "--aovs")
+				options.WriteFeatures = true;
+			else if (arg == "--path-trace")
+				options.Settings.UsePathTracing = true;
+			else if (arg == "--animate")
+				options.PlayAnimation = true;
+			else if (arg == "--heatmap")
+				options.WriteHeatmap = true;
+			else
+				options.Settings.UsePacketTracing = false;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			std::cout << "Missing value for " << arg << "\n";
+			return false;
+		}
+
+		std::string value = argv[++i];
+		int32_t threadCount = 0;
+		bool isValid = true;
+		if (arg == "--scene")
+			options.ScenePath = value;
+		else if (arg == "--output")
+			options.OutputPath = value;
+		else if (arg == "--width")
+			isValid = ParseInt(value, options.Settings.Width, 2);
+		else if (arg == "--height")
+			isValid = ParseInt(value, options.Settings.Height, 2);
+		else if (arg == "--spp")
+			isValid = ParseInt(value, options.Settings.SamplesPerPixel, 1);
+		else if (arg == "--error")
+			isValid = ParseFloat(value, options.Settings.ErrorThreshold) && options.Settings.ErrorThreshold >= 0.0f;
+		else if (arg == "--time")
+		{
+			float timeLimit = 0.0f;
+			isValid = ParseFloat(value, timeLimit) && timeLimit >= 0.0f;
+			options.Settings.TimeLimit = timeLimit;
+		}
+		else if (arg == "--min-spp")
+			isValid = ParseInt(value, options.Settings.MinSamplesPerPixel, 1);
+		else if (arg == "--bounces")
+			isValid = ParseInt(value, options.Settings.MaxBounces, 0);
+		else if (arg == "--frames")
+		{
+			isValid = ParseInt(value, options.FrameCount, 1);
+			options.HasFrameCount = true;
+		}
+		else if (arg == "--fps")
+			isValid = ParseFloat(value, options.FramesPerSecond) && options.FramesPerSecond > 0.0f;
+		else if (arg == "--camera-path")
+			options.CameraPathFile = value;
+		else if (arg == "--stats")
+			options.StatsPath = value;
+		else if (arg == "--exposure")
+			isValid = ParseFloat(value, options.ToneMap.Exposure) && options.ToneMap.Exposure >= 0.0f;
+		else if (arg == "--tonemap")
+			isValid = ParseToneMapOperator(value, options.ToneMap.Operator);
+		else if (arg == "--threads")
+		{
+			isValid = ParseInt(value, threadCount, 0);
+			options.ThreadCount = static_cast<uint32_t>(threadCount);
+		}
+		else if (arg == "--listen")
+		{
+			int32_t port = 0;
+			isValid = ParseInt(value, port, 0) && port <= 65535;
+			options.IsCoordinator = true;
+			options.Distributed.Port = static_cast<uint16_t>(port);
+		}
+		else if (arg == "--worker")
+			isValid = ParseAddress(value, options.WorkerHost, options.WorkerPort);
+		else if (arg == "--rows-per-job")
+			isValid = ParseInt(value, options.Distributed.RowsPerJob, 1);
+		else if (arg == "--samples-per-job")
+			isValid = ParseInt(value, options.Distributed.SamplesPerJob, 1);
+		else if (arg == "--job-timeout")
+		{
+			float timeout = 0.0f;
+			isValid = ParseFloat(value, timeout) && timeout > 0.0f;
+			options.Distributed.JobTimeout = timeout;
+		}
+		else if (arg == "--sampler")
+			isValid = ParseSamplerType(value, options.Settings.Sampler);
+		else if (arg == "--vertices")
+			isValid = ParseVertexLayout(value, options.Layout);
+		else if (arg == "--texture-memory")
+		{
+			int32_t megabytes = 0;
+			isValid = ParseInt(value, megabytes, 1);
+			options.TextureMemory = static_cast<size_t>(megabytes) << 20;
+		}
+		else if (arg == "--look-from")
+			isValid = ParseVec3(value, options.View.LookFrom);
+		else if (arg == "--look-at")
+			isValid = ParseVec3(value, options.View.LookAt);
+		else if (arg == "--fov")
+			isValid = ParseFloat(value, options.View.FieldOfView);
+		else if (arg == "--aperture")
+			isValid = ParseFloat(value, options.View.Aperture);
+		else if (arg == "--focus")
+			isValid = ParseFloat(value, options.View.FocusDistance);
+		else
+		{
+			std::cout << "Unknown option " << arg << "\n";
+			return false;
+		}
+
+		if (!isValid)
+		{
+			std::cout << "Bad value '" << value << "' for " << arg << "\n";
+			return false;
+		}
+	}
+
+	// The coordinator never has the features or the per pixel errors, only the color sums come back
+	if (options.IsCoordinator && (options.UseDenoiser || options.WriteFeatures || options.Settings.IsAdaptive()))
+	{
+		std::cout << "--listen can't be combined with --denoise, --aovs, --error or --time\n";
+		return false;
+	}
+
+	// The coordinator's own threads never trace anything, the workers do
+	if (options.IsCoordinator && (options.WriteHeatmap || !options.StatsPath.empty()))
+	{
+		std::cout << "--listen can't be combined with --heatmap or --stats\n";
+		return false;
+	}
+
+	// The heatmap is of the direct shading's rays and has nothing to denoise
+	if (options.WriteHeatmap && (options.UseDenoiser || options.WriteFeatures || options.Settings.UsePathTracing))
+	{
+		std::cout << "--heatmap can't be combined with --denoise, --aovs or --path-trace\n";
+		return false;
+	}
+
+	// Workers load the scene as it is in the file and never see the animation
+	if (options.IsCoordinator && options.PlayAnimation)
+	{
+		std::cout << "--listen can't be combined with --animate\n";
+		return false;
+	}
+
+	if (!options.CameraPathFile.empty())
+	{
+		if (options.HasFrameCount)
+		{
+			std::cout << "--frames can't be combined with --camera-path, the path has a line per frame\n";
+			return false;
+		}
+		if (!LoadCameraPath(options.CameraPathFile, options.View, options.CameraPath))
+			return false;
+		options.FrameCount = static_cast<int32_t>(options.CameraPath.size());
+	}
+
+	return true;
+}
+
+// image.png with the suffix "_albedo" becomes image_albedo.png
+static std::string AddSuffix(const std::string& path, const std::string& suffix)
+{
+	size_t extension = path.find_last_of('.');
+	size_t directory = path.find_last_of("/\\");
+	if (extension == std::string::npos || (directory != std::string::npos && extension < directory))
+		return path + suffix;
+	return path.substr(0, extension) + suffix + path.substr(extension);
+}
+
+// Frames of a sequence get numbered, image.png becomes image_0000.png, image_0001.png and so on
+static std::string GetFramePath(const HeadlessOptions& options, int32_t frame)
+{
+	if (options.FrameCount == 1)
+		return options.OutputPath;
+
+	char number[16];
+	std::snprintf(number, sizeof(number), "_%04d", frame);
+	return AddSuffix(options.OutputPath, number);
+}
+
+// Turns LookFrom around LookAt's vertical axis, the whole sequence makes one full turn. Animations and camera paths
+// don't turn
+static CameraSettings GetFrameView(const HeadlessOptions& options, int32_t frame)
+{
+	if (!options.CameraPath.empty())
+		return options.CameraPath[frame];
+
+	CameraSettings view = options.View;
+	if (options.PlayAnimation)
+		return view;
+
+	float angle = glm::radians(360.0f * static_cast<float>(frame) / static_cast<float>(options.FrameCount));
+	glm::vec3 offset = view.LookFrom - view.LookAt;
+	float c = std::cos(angle), s = std::sin(angle);
+	view.LookFrom = view.LookAt + glm::vec3(offset.x * c + offset.z * s, offset.y, offset.z * c - offset.x * s);
+	return view;
+}
+
+// Normals get mapped from -1..1 to 0..1 and depth gets divided by the farthest hit
+static void WriteFeatureImages(ImageWriter& writer, const FeatureBuffer& features, const std::string& outputPath)
+{
+	float maxDepth = 0.0f;
+	for (float depth : features.Depth)
+		maxDepth = std::max(maxDepth, depth);
+	float depthScale = maxDepth > 0.0f ? 1.0f / maxDepth : 0.0f;
+
+	HDRImage albedo(features.Width, features.Height), normal(features.Width, features.Height), depth(features.Width, features.Height);
+	for (int32_t y = 0; y < features.Height; y++)
+	{
+		for (int32_t x = 0; x < features.Width; x++)
+		{
+			size_t i = static_cast<size_t>(x) + static_cast<size_t>(y) * static_cast<size_t>(features.Width);
+			albedo.SetPixel(x, y, features.Albedo[i]);
+			normal.SetPixel(x, y, features.Normal[i] * 0.5f + 0.5f);
+			depth.SetPixel(x, y, glm::vec3(features.Depth[i] * depthScale));
+		}
+	}
+
+	writer.Write(std::move(albedo), AddSuffix(outputPath, "_albedo"));
+	writer.Write(std::move(normal), AddSuffix(outputPath, "_normal"));
+	writer.Write(std::move(depth), AddSuffix(outputPath, "_depth"));
+}
+
+// The costs get scaled so the 99th percentile is red, a few pathological pixels would leave the rest of the image
+// dark otherwise. Always written as a PNG whatever the extension
+static bool WriteCostHeatmap(const std::vector<float>& costs, int32_t width, int32_t height, const std::string& path)
+{
+	std::vector<float> sorted = costs;
+	size_t rank = sorted.size() * 99 / 100;
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+	float scale = sorted[rank] > 0.0f ? 1.0f / sorted[rank] : 0.0f;
+	std::cout << "Heatmap is red at " << sorted[rank] << " node visits and triangle tests per sample\n";
+
+	PNGImage heatmap(width, height);
+	for (int32_t y = 0; y < height; y++)
+		for (int32_t x = 0; x < width; x++)
+			heatmap.SetPixel(x, y, GetHeatmapColor(costs[static_cast<size_t>(x) + static_cast<size_t>(y) * static_cast<size_t>(width)] * scale));
+	return heatmap.WriteImage(path);
+}
+
+static void WriteCounters(std::ostream& out, const RenderCounterValues& counters, double seconds)
+{
+	out << "{ ";
+	for (size_t i = 0; i < RenderCounterCount; i++)
+		out << "\"" << GetRenderCounterName(static_cast<RenderCounter>(i)) << "\": " << counters.Values[i] << ", ";
+	out << "\"mrays_per_second\": " << static_cast<double>(counters.Get(RenderCounter::Rays)) / seconds / 1e6 << " }";
+}
+
+// Every thread's counters and their total over the whole run, rays per second are over the wall time
+static bool WriteRenderCounters(const std::string& path, const HeadlessOptions& options, const ThreadPool& pool, double seconds)
+{
+	std::ofstream out(path);
+	if (!out)
+		return false;
+
+	out.precision(9);
+	out << "{\n";
+	out << "\t\"version\": 1,\n";
+	out << "\t\"width\": " << options.Settings.Width << ",\n";
+	out << "\t\"height\": " << options.Settings.Height << ",\n";
+	out << "\t\"frames\": " << options.FrameCount << ",\n";
+	out << "\t\"seconds\": " << seconds << ",\n";
+	out << "\t\"total\": ";
+	WriteCounters(out, pool.GetTotalCounters(), seconds);
+	out << ",\n";
+	out << "\t\"threads\": [\n";
+	for (uint32_t i = 0; i < pool.GetThreadCount(); i++)
+	{
+		out << "\t\t";
+		WriteCounters(out, pool.GetCounters(i).Read(), seconds);
+		out << (i + 1 < pool.GetThreadCount() ? "," : "") << "\n";
+	}
+	out << "\t]\n";
+	out << "}\n";
+	return static_cast<bool>(out);
+}
+
+static void ApplyNextPose(AnimationPlayer& player, int32_t frame)
+{
+	AnimationStats animationStats = player.Apply();
+	std::cout << "Frame " << frame << " posed in " << animationStats.UpdateTime << "s after waiting " << animationStats.WaitTime
+		<< "s, " << animationStats.RefitMeshes << " meshes refit and " << animationStats.RebuiltMeshes << " rebuilt\n";
+}
+
+int main(int argc, char** argv)
+{
+	HeadlessOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if (!options.WorkerHost.empty())
+	{
+		ThreadPool pool(options.ThreadCount);
+		std::cout << "Working for " << options.WorkerHost << ":" << options.WorkerPort << " with " << pool.GetThreadCount() << " threads\n";
+		return RunRenderWorker(options.WorkerHost, options.WorkerPort, pool) ? 0 : 4;
+	}
+
+	// The coordinator leaves the scene to the workers
+	const RenderSettings& settings = options.Settings;
+	Scene scene;
+	std::unique_ptr<RenderCoordinator> coordinator;
+	if (options.IsCoordinator)
+	{
+		coordinator = std::make_unique<RenderCoordinator>(options.Distributed);
+		if (!coordinator->Start(options.ScenePath, options.UseCache, options.Layout, settings))
+		{
+			std::cout << "Couldn't read " << options.ScenePath << " or listen on port " << options.Distributed.Port << "\n";
+			return 2;
+		}
+		std::cout << "Listening for workers on port " << coordinator->GetPort() << "\n";
+	}
+	else
+	{
+		auto loadStart = std::chrono::steady_clock::now();
+		if (!LoadScene(scene, options.ScenePath, options.UseCache, options.Layout))
+		{
+			std::cout << "Failed to load " << options.ScenePath << "\n";
+			return 2;
+		}
+		std::chrono::duration<double> loadTime = std::chrono::steady_clock::now() - loadStart;
+		std::cout << "Loaded " << options.ScenePath << " (" << scene.GetTriangleCount() << " triangles in " << scene.Meshes.size()
+			<< " meshes, " << scene.GetInstancedTriangleCount() << " in " << scene.Instances.size() << " instances, "
+			<< scene.GetVertexBytes() << " bytes of vertices) " << (scene.Cache ? "from cache " : "")
+			<< "in " << loadTime.count() << "s\n";
+		if (scene.Textures)
+			scene.Textures->SetMemoryBudget(options.TextureMemory);
+	}
+
+	ThreadPool pool(coordinator ? 1 : options.ThreadCount);
+
+	// Frame 0 gets posed up front, after that every frame gets prepared while the one before it renders
+	ModelAnimation animation;
+	std::unique_ptr<AnimationPlayer> player;
+	if (options.PlayAnimation)
+	{
+		animation = LoadAnimation(options.ScenePath);
+		player = std::make_unique<AnimationPlayer>(scene, animation, pool);
+		if (!animation.IsAnimated() || !player->IsValid())
+		{
+			std::cout << options.ScenePath << " has no animation that can be played\n";
+			return 2;
+		}
+		if (!options.HasFrameCount && options.CameraPath.empty())
+			options.FrameCount = static_cast<int32_t>(animation.Duration * options.FramesPerSecond) + 1;
+		std::cout << "Playing " << animation.Tracks.size() << " animation tracks over " << animation.Duration << "s at "
+			<< options.FramesPerSecond << " fps\n";
+
+		player->Prepare(0.0f);
+		player->Apply();
+	}
+	std::cout << "Rendering " << (options.FrameCount > 1 ? std::to_string(options.FrameCount) + " frames at " : "")
+		<< settings.Width << "x" << settings.Height << " at " << (settings.IsAdaptive() ? "up to " : "")
+		<< settings.SamplesPerPixel << " spp " << (coordinator ? std::string("on workers") : "with " + std::to_string(pool.GetThreadCount()) + " threads") << "\n";
+
+	ImageWriter writer;
+	bool needsFeatures = options.UseDenoiser || options.WriteFeatures;
+	FeatureBuffer features;
+	std::vector<std::string> failedHeatmaps;
+	pool.ResetCounters();
+	auto sequenceStart = std::chrono::steady_clock::now();
+	for (int32_t frame = 0; frame < options.FrameCount; frame++)
+	{
+		bool hasNextPose = player && frame + 1 < options.FrameCount;
+		if (hasNextPose)
+			player->Prepare(static_cast<float>(frame + 1) / options.FramesPerSecond);
+
+		Camera camera = GetFrameView(options, frame).MakeCamera(settings);
+		auto image = std::make_shared<HDRImage>(settings.Width, settings.Height);
+		std::string outputPath = GetFramePath(options, frame);
+
+		if (options.WriteHeatmap)
+		{
+			auto renderStart = std::chrono::steady_clock::now();
+			std::vector<float> costs;
+			RenderCostImage(scene, camera, settings, pool, costs);
+			std::chrono::duration<double> renderTime = std::chrono::steady_clock::now() - renderStart;
+			std::cout << "Frame " << frame << " costs counted in " << renderTime.count() << "s\n";
+			if (!WriteCostHeatmap(costs, settings.Width, settings.Height, outputPath))
+				failedHeatmaps.push_back(outputPath);
+			if (hasNextPose)
+				ApplyNextPose(*player, frame + 1);
+			continue;
+		}
+
+		// Rows go out to the writer as soon as their tiles are done. Denoising changes every pixel once the render
+		// is finished, those frames get handed over whole instead
+		ImageStream stream;
+		std::function<void(int32_t)> onRowsFinished;
+		if (!options.UseDenoiser)
+		{
+			writer.BeginStream(image, outputPath, stream, options.ToneMap);
+			onRowsFinished = [&stream](int32_t rowCount) { stream.FinishRows(rowCount); };
+		}
+
+		auto renderStart = std::chrono::steady_clock::now();
+		RenderStats stats;
+		if (coordinator)
+		{
+			if (!coordinator->RenderFrame(GetFrameView(options, frame), *image, stats, onRowsFinished))
+			{
+				std::cout << "Gave up on frame " << frame << ", a job failed " << options.Distributed.MaxAttempts << " times\n";
+				return 4;
+			}
+		}
+		else
+			stats = RenderImage(scene, camera, settings, pool, *image, needsFeatures ? &features : nullptr, onRowsFinished);
+		std::chrono::duration<double> renderTime = std::chrono::steady_clock::now() - renderStart;
+		if (options.FrameCount > 1)
+			std::cout << "Frame " << frame << " rendered in " << renderTime.count() << "s\n";
+		else
+			std::cout << "Rendered in " << renderTime.count() << "s\n";
+		if (settings.UsePathTracing && !coordinator)
+			std::cout << stats.RayCount << " rays, " << static_cast<double>(stats.RayCount) / renderTime.count() / 1e6 << " Mrays/s\n";
+		else if (settings.IsAdaptive())
+		{
+			double pixelCount = static_cast<double>(settings.Width) * static_cast<double>(settings.Height);
+			std::cout << "Averaged " << static_cast<double>(stats.SampleCount) / pixelCount << " spp over " << stats.Passes << " passes, "
+				<< 100.0 * stats.ConvergedPixels / pixelCount << "% of pixels converged\n";
+		}
+
+		if (options.UseDenoiser)
+		{
+			auto denoiseStart = std::chrono::steady_clock::now();
+			std::vector<glm::vec3> denoised;
+			Denoise(features, DenoiseSettings(), pool, denoised);
+			for (int32_t y = 0; y < settings.Height; y++)
+				for (int32_t x = 0; x < settings.Width; x++)
+					image->SetPixel(x, y, denoised[static_cast<size_t>(x) + static_cast<size_t>(y) * static_cast<size_t>(settings.Width)]);
+			std::chrono::duration<double> denoiseTime = std::chrono::steady_clock::now() - denoiseStart;
+			std::cout << "Denoised in " << denoiseTime.count() << "s\n";
+			writer.Write(std::move(*image), outputPath, options.ToneMap);
+		}
+
+		if (options.WriteFeatures)
+			WriteFeatureImages(writer, features, outputPath);
+
+		if (hasNextPose)
+			ApplyNextPose(*player, frame + 1);
+	}
+
+	std::vector<std::string> failedPaths = writer.Flush();
+	failedPaths.insert(failedPaths.end(), failedHeatmaps.begin(), failedHeatmaps.end());
+	std::chrono::duration<double> sequenceTime = std::chrono::steady_clock::now() - sequenceStart;
+	if (options.FrameCount > 1)
+		std::cout << "Rendered and wrote " << options.FrameCount << " frames in " << sequenceTime.count() << "s\n";
+	if (scene.Textures)
+	{
+		TextureCacheStats textureStats = scene.Textures->GetStats();
+		std::cout << scene.Textures->GetTextureCount() << " textures, " << textureStats.Lookups << " tile lookups, "
+			<< textureStats.Misses << " misses, " << textureStats.Decodes << " decodes, " << textureStats.Evictions
+			<< " evictions, " << (textureStats.PeakResidentBytes >> 20) << " MB of tiles and mip chains at most\n";
+	}
+	if (!options.StatsPath.empty())
+	{
+		if (WriteRenderCounters(options.StatsPath, options, pool, sequenceTime.count()))
+			std::cout << "Wrote render statistics to " << options.StatsPath << "\n";
+		else
+			failedPaths.push_back(options.StatsPath);
+	}
+	for (const std::string& path : failedPaths)
+		std::cout << "Failed to write " << path << "\n";
+	return failedPaths.empty() ? 0 : 3;
+}
@@ -0,0 +1,224 @@
+#include "Image.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+	#define NR_X64
+	#include <emmintrin.h>
+#endif
+
+// Same as std::clamp(c, 0, 0.999) except NaNs come out as 0 like _mm_max_ps makes them
+static uint8_t QuantizeChannel(float c, const ToneMapSettings& toneMap)
+{
+	c *= toneMap.Exposure;
+	if (toneMap.Operator == ToneMapOperator::Reinhard)
+		c = c / (1.0f + c);
+	c = c > 0.0f ? std::min(c, 0.999f) : 0.0f;
+	return static_cast<uint8_t>(c * 255.0f);
+}
+
+#ifdef NR_X64
+
+// 16 channels at a time, the packs saturate but nothing ever gets past 254 anyway
+// Does exactly the same float math as QuantizeChannel so both paths give the same bytes
+static size_t QuantizeColorsSSE(const float* colors, uint8_t* output, size_t count, const ToneMapSettings& toneMap)
+{
+	const __m128 exposure = _mm_set1_ps(toneMap.Exposure);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 maximum = _mm_set1_ps(0.999f);
+	const __m128 scale = _mm_set1_ps(255.0f);
+	bool isReinhard = toneMap.Operator == ToneMapOperator::Reinhard;
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i quantized[4];
+		for (int32_t j = 0; j < 4; j++)
+		{
+			__m128 c = _mm_mul_ps(_mm_loadu_ps(colors + i + j * 4), exposure);
+			if (isReinhard)
+				c = _mm_div_ps(c, _mm_add_ps(one, c));
+			c = _mm_min_ps(_mm_max_ps(c, _mm_setzero_ps()), maximum);
+			quantized[j] = _mm_cvttps_epi32(_mm_mul_ps(c, scale));
+		}
+		__m128i low = _mm_packs_epi32(quantized[0], quantized[1]);
+		__m128i high = _mm_packs_epi32(quantized[2], quantized[3]);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_packus_epi16(low, high));
+	}
+	return i;
+}
+
+#endif
+
+void QuantizeColors(const float* colors, uint8_t* output, size_t count, const ToneMapSettings& toneMap)
+{
+	size_t i = 0;
+#ifdef NR_X64
+	i = QuantizeColorsSSE(colors, output, count, toneMap);
+#endif
+	for (; i < count; i++)
+		output[i] = QuantizeChannel(colors[i], toneMap);
+}
+
+glm::vec3 GetHeatmapColor(float t)
+{
+	static const glm::vec3 stops[] = {
+		{ 0.0f, 0.0f, 0.0f },
+		{ 0.0f, 0.0f, 1.0f },
+		{ 0.0f, 1.0f, 1.0f },
+		{ 0.0f, 1.0f, 0.0f },
+		{ 1.0f, 1.0f, 0.0f },
+		{ 1.0f, 0.0f, 0.0f }
+	};
+	constexpr int32_t segmentCount = static_cast<int32_t>(sizeof(stops) / sizeof(stops[0])) - 1;
+
+	float position = std::clamp(t, 0.0f, 1.0f) * static_cast<float>(segmentCount);
+	int32_t segment = std::min(static_cast<int32_t>(position), segmentCount - 1);
+	return glm::mix(stops[segment], stops[segment + 1], position - static_cast<float>(segment));
+}
+
+ImageFormat GetImageFormat(const std::string& path)
+{
+	size_t extension = path.find_last_of('.');
+	size_t directory = path.find_last_of("/\\");
+	if (extension == std::string::npos || (directory != std::string::npos && extension < directory))
+		return ImageFormat::PNG;
+
+	std::string name = path.substr(extension + 1);
+	for (char& c : name)
+		c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	if (name == "ppm")
+		return ImageFormat::PPM;
+	if (name == "pfm")
+		return ImageFormat::PFM;
+	return ImageFormat::PNG;
+}
+
+bool HDRImage::WriteImage(const std::string& path, const ToneMapSettings& toneMap) const
+{
+	ImageFileWriter writer;
+	return writer.Open(path, m_Width, m_Height, toneMap) && writer.WriteRows(*this, 0, m_Height) && writer.Close();
+}
+
+ImageFileWriter::~ImageFileWriter()
+{
+	if (m_File.is_open())
+		Discard();
+}
+
+bool ImageFileWriter::Open(const std::string& path, int32_t width, int32_t height, const ToneMapSettings& toneMap)
+{
+	m_Path = path;
+	m_Format = GetImageFormat(path);
+	m_ToneMap = toneMap;
+	m_Width = width;
+	m_Height = height;
+	m_WrittenRows = 0;
+	m_HasFailed = false;
+
+	size_t rowChannels = static_cast<size_t>(width) * 3;
+	if (m_Format == ImageFormat::PNG)
+	{
+		// stb writes the file itself once every row is in
+		m_Bytes.resize(rowChannels * static_cast<size_t>(height));
+		return true;
+	}
+
+	m_File.open(path, std::ios::binary | std::ios::trunc);
+	if (!m_File.is_open())
+		return false;
+
+	// -1 scale in a PFM means little endian, which is every machine this runs on
+	char header[64];
+	if (m_Format == ImageFormat::PPM)
+	{
+		std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+		m_Bytes.resize(rowChannels);
+	}
+	else
+		std::snprintf(header, sizeof(header), "PF\n%d %d\n-1.0\n", width, height);
+	m_File.write(header, static_cast<std::streamsize>(std::strlen(header)));
+	m_DataOffset = static_cast<std::streamoff>(std::strlen(header));
+	return static_cast<bool>(m_File);
+}
+
+bool ImageFileWriter::WriteRows(const HDRImage& image, int32_t beginRow, int32_t endRow)
+{
+	if (m_HasFailed || beginRow != m_WrittenRows || endRow < beginRow || endRow > m_Height ||
+		image.GetWidth() != m_Width || image.GetHeight() != m_Height)
+	{
+		m_HasFailed = true;
+		return false;
+	}
+
+	size_t rowChannels = static_cast<size_t>(m_Width) * 3;
+	if (m_Format == ImageFormat::PNG)
+	{
+		for (int32_t y = beginRow; y < endRow; y++)
+			QuantizeColors(image.GetRow(y), m_Bytes.data() + static_cast<size_t>(y) * rowChannels, rowChannels, m_ToneMap);
+	}
+	else if (m_Format == ImageFormat::PPM)
+	{
+		for (int32_t y = beginRow; y < endRow; y++)
+		{
+			QuantizeColors(image.GetRow(y), m_Bytes.data(), rowChannels, m_ToneMap);
+			m_File.write(reinterpret_cast<const char*>(m_Bytes.data()), static_cast<std::streamsize>(rowChannels));
+		}
+	}
+	else if (endRow > beginRow)
+	{
+		// PFM rows go bottom to top, so the band lands in the file upside down and ends where the row above it
+		// started. Writing into the middle of the file leaves a gap the rows further down fill in later
+		int32_t rowCount = endRow - beginRow;
+		m_Floats.resize(rowChannels * static_cast<size_t>(rowCount));
+		for (int32_t y = beginRow; y < endRow; y++)
+			std::memcpy(m_Floats.data() + static_cast<size_t>(endRow - 1 - y) * rowChannels, image.GetRow(y), rowChannels * sizeof(float));
+
+		std::streamoff rowBytes = static_cast<std::streamoff>(rowChannels * sizeof(float));
+		m_File.seekp(m_DataOffset + static_cast<std::streamoff>(m_Height - endRow) * rowBytes);
+		m_File.write(reinterpret_cast<const char*>(m_Floats.data()), static_cast<std::streamsize>(rowBytes * rowCount));
+	}
+
+	m_WrittenRows = endRow;
+	if (m_Format != ImageFormat::PNG && !m_File)
+		m_HasFailed = true;
+	return !m_HasFailed;
+}
+
+bool ImageFileWriter::Close()
+{
+	if (m_HasFailed || m_WrittenRows != m_Height)
+	{
+		Discard();
+		return false;
+	}
+
+	bool isWritten;
+	if (m_Format == ImageFormat::PNG)
+		isWritten = stbi_write_png(m_Path.c_str(), m_Width, m_Height, 3, m_Bytes.data(), m_Width * 3) != 0;
+	else
+	{
+		m_File.close();
+		isWritten = !m_File.fail();
+	}
+	m_Bytes = std::vector<uint8_t>();
+	m_Floats = std::vector<float>();
+
+	if (!isWritten)
+		std::remove(m_Path.c_str());
+	return isWritten;
+}
+
+void ImageFileWriter::Discard()
+{
+	if (m_File.is_open())
+	{
+		m_File.close();
+		std::remove(m_Path.c_str());
+	}
+	m_HasFailed = true;
+	m_Bytes = std::vector<uint8_t>();
+	m_Floats = std::vector<float>();
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "stb_image_write.h"
+
+// Image helper class
+
+class PNGImage
+{
+public:
+
+	PNGImage(int32_t width, int32_t height)
+		: Width(width), Height(height)
+	{
+		m_Buffer = new uint8_t[width * height * 3];
+	}
+
+	~PNGImage() { delete[] m_Buffer; }
+
+	glm::vec3 GetPixel(int32_t x, int32_t y)
+	{
+		if (x >= 0 && x < Width && y >= 0 && y < Height)
+		{
+			int32_t i = (x + y * Width) * 3;
+			return {
+				m_Buffer[i] / 255.0f,
+				m_Buffer[i + 1] / 255.0f,
+				m_Buffer[i + 2] / 255.0f,
+			};
+		}
+		return { 0.0f, 0.0f, 0.0f };
+	}
+
+	void SetPixel(int32_t x, int32_t y, glm::vec3 color)
+	{
+		if (x >= 0 && x < Width && y >= 0 && y < Height)
+		{
+			int32_t i = (x + y * Width) * 3;
+			m_Buffer[i] = static_cast<uint8_t>(std::clamp(color.x, 0.0f, 0.999f) * 255.0f);
+			m_Buffer[i + 1] = static_cast<uint8_t>(std::clamp(color.y, 0.0f, 0.999f) * 255.0f);
+			m_Buffer[i + 2] = static_cast<uint8_t>(std::clamp(color.z, 0.0f, 0.999f) * 255.0f);
+		}
+	}
+
+	bool WriteImage(const std::string& path)
+	{
+		return stbi_write_png(path.c_str(), Width, Height, 3, m_Buffer, Width * 3) != 0;
+	}
+
+private:
+	uint8_t* m_Buffer;
+
+	int32_t Width, Height;
+};
+
+// False color ramp for debug images, 0 is black and goes through blue, cyan, green and yellow to red at 1. Values
+// outside that get clamped
+glm::vec3 GetHeatmapColor(float t);
+
+// Which file an HDRImage gets written as, picked from the extension of the path
+enum class ImageFormat : uint8_t
+{
+	PNG, // 8 bit, tone mapped
+	PPM, // Binary P6, 8 bit, tone mapped
+	PFM // 32 bit float, written as is
+};
+
+// .ppm and .pfm in any case, everything else is a PNG
+ImageFormat GetImageFormat(const std::string& path);
+
+enum class ToneMapOperator : uint8_t
+{
+	Clamp, // Everything past 1 just saturates, what the renderer always did
+	Reinhard // c / (1 + c) per channel, rolls highlights off instead of clipping them
+};
+
+struct ToneMapSettings
+{
+	float Exposure = 1.0f; // Multiplies the color before the operator
+	ToneMapOperator Operator = ToneMapOperator::Clamp;
+};
+
+// Tone maps count floats and quantizes each of them to a byte. The channels are treated the same so it doesn't
+// care how they're laid out. With the defaults it matches PNGImage::SetPixel byte for byte
+void QuantizeColors(const float* colors, uint8_t* output, size_t count, const ToneMapSettings& toneMap);
+
+// Float RGB framebuffer, what the renderer writes into. Kept unquantized so the same render can go out as a
+// PFM or get tone mapped differently without rendering it again
+class HDRImage
+{
+public:
+	HDRImage() = default;
+	HDRImage(int32_t width, int32_t height)
+		: m_Width(width), m_Height(height), m_Buffer(static_cast<size_t>(width) * static_cast<size_t>(height) * 3, 0.0f)
+	{
+	}
+
+	int32_t GetWidth() const { return m_Width; }
+	int32_t GetHeight() const { return m_Height; }
+
+	glm::vec3 GetPixel(int32_t x, int32_t y) const
+	{
+		if (x >= 0 && x < m_Width && y >= 0 && y < m_Height)
+		{
+			const float* pixel = GetRow(y) + x * 3;
+			return { pixel[0], pixel[1], pixel[2] };
+		}
+		return { 0.0f, 0.0f, 0.0f };
+	}
+
+	void SetPixel(int32_t x, int32_t y, glm::vec3 color)
+	{
+		if (x >= 0 && x < m_Width && y >= 0 && y < m_Height)
+		{
+			float* pixel = GetRow(y) + x * 3;
+			pixel[0] = color.x;
+			pixel[1] = color.y;
+			pixel[2] = color.z;
+		}
+	}
+
+	// Rows run top to bottom with the channels interleaved
+	float* GetRow(int32_t y) { return m_Buffer.data() + static_cast<size_t>(y) * static_cast<size_t>(m_Width) * 3; }
+	const float* GetRow(int32_t y) const { return m_Buffer.data() + static_cast<size_t>(y) * static_cast<size_t>(m_Width) * 3; }
+
+	// Writes it in whatever format the extension asks for. toneMap is ignored for PFMs
+	bool WriteImage(const std::string& path, const ToneMapSettings& toneMap = ToneMapSettings()) const;
+
+private:
+	int32_t m_Width = 0;
+	int32_t m_Height = 0;
+	std::vector<float> m_Buffer;
+};
+
+// Writes an HDRImage out a band of rows at a time, so the top of a file can go out while the rest is still rendering
+// PPMs and PFMs get written as the rows come in. PNGs can't be written in pieces, their rows get quantized as
+// they come and the whole file gets encoded after the last one
+class ImageFileWriter
+{
+public:
+	ImageFileWriter() = default;
+	~ImageFileWriter(); // Removes the file if it never got all its rows
+
+	ImageFileWriter(const ImageFileWriter&) = delete;
+	ImageFileWriter& operator=(const ImageFileWriter&) = delete;
+
+	bool Open(const std::string& path, int32_t width, int32_t height, const ToneMapSettings& toneMap = ToneMapSettings());
+
+	// Rows have to come top to bottom, each band starting where the last one ended
+	bool WriteRows(const HDRImage& image, int32_t beginRow, int32_t endRow);
+
+	// Fails if anything went wrong or rows are missing, the file gets removed then
+	bool Close();
+
+private:
+	void Discard();
+
+	std::string m_Path;
+	std::ofstream m_File;
+	ImageFormat m_Format = ImageFormat::PNG;
+	ToneMapSettings m_ToneMap;
+	int32_t m_Width = 0;
+	int32_t m_Height = 0;
+	int32_t m_WrittenRows = 0;
+	std::streamoff m_DataOffset = 0; // Where the pixels start, past the header
+	bool m_HasFailed = false;
+	std::vector<uint8_t> m_Bytes; // One quantized row, or every row of a PNG
+	std::vector<float> m_Floats; // PFM rows flipped and ready to write
+};
@@ -0,0 +1,154 @@
+#include "ImageWriter.h"
+
+#include <algorithm>
+
+ImageStream::~ImageStream()
+{
+	Close();
+}
+
+ImageStream& ImageStream::operator=(ImageStream&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		m_State = std::move(other.m_State);
+	}
+	return *this;
+}
+
+void ImageStream::FinishRows(int32_t rowCount)
+{
+	if (!m_State)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_State->Mutex);
+		m_State->FinishedRows = std::clamp(rowCount, m_State->FinishedRows, m_State->Image->GetHeight());
+	}
+	m_State->RowsFinished.notify_one();
+}
+
+void ImageStream::Close()
+{
+	if (!m_State)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_State->Mutex);
+		m_State->IsClosed = true;
+	}
+	m_State->RowsFinished.notify_one();
+	m_State.reset();
+}
+
+ImageWriter::ImageWriter(uint32_t maxQueued)
+	: m_MaxQueued(std::max(maxQueued, 1u))
+{
+	m_Thread = std::thread(&ImageWriter::WriterLoop, this);
+}
+
+ImageWriter::~ImageWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stopping = true;
+	}
+	m_JobAvailable.notify_one();
+	m_Thread.join();
+}
+
+void ImageWriter::Write(HDRImage image, const std::string& path, const ToneMapSettings& toneMap)
+{
+	Enqueue({ std::make_shared<const HDRImage>(std::move(image)), nullptr, path, toneMap });
+}
+
+void ImageWriter::BeginStream(std::shared_ptr<const HDRImage> image, const std::string& path, ImageStream& stream,
+	const ToneMapSettings& toneMap)
+{
+	// Whatever the stream was feeding before gets given up on
+	stream = ImageStream();
+	stream.m_State = std::make_shared<ImageStream::State>();
+	stream.m_State->Image = image;
+	Enqueue({ std::move(image), stream.m_State, path, toneMap });
+}
+
+std::vector<std::string> ImageWriter::Flush()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_JobFinished.wait(lock, [this] { return m_Jobs.empty() && !m_IsWriting; });
+	std::vector<std::string> failedPaths;
+	failedPaths.swap(m_FailedPaths);
+	return failedPaths;
+}
+
+void ImageWriter::Enqueue(Job job)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_JobFinished.wait(lock, [this] { return m_Jobs.size() < m_MaxQueued; });
+		m_Jobs.push_back(std::move(job));
+	}
+	m_JobAvailable.notify_one();
+}
+
+void ImageWriter::WriterLoop()
+{
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_JobAvailable.wait(lock, [this] { return m_Stopping || !m_Jobs.empty(); });
+			if (m_Jobs.empty())
+				return;
+
+			job = std::move(m_Jobs.front());
+			m_Jobs.pop_front();
+			m_IsWriting = true;
+		}
+		// Taken out of the queue already, so Enqueue can take another one while this gets written
+		m_JobFinished.notify_all();
+
+		bool isWritten = WriteJob(job);
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (!isWritten)
+				m_FailedPaths.push_back(job.Path);
+			m_IsWriting = false;
+		}
+		m_JobFinished.notify_all();
+	}
+}
+
+bool ImageWriter::WriteJob(const Job& job)
+{
+	const HDRImage& image = *job.Image;
+	ImageFileWriter file;
+	if (!file.Open(job.Path, image.GetWidth(), image.GetHeight(), job.ToneMap))
+		return false;
+
+	if (!job.Stream)
+		return file.WriteRows(image, 0, image.GetHeight()) && file.Close();
+
+	// Writes every band as soon as it's finished, a stream that gets closed early leaves the file unfinished and
+	// Close() removes it
+	ImageStream::State& stream = *job.Stream;
+	int32_t writtenRows = 0;
+	while (writtenRows < image.GetHeight())
+	{
+		int32_t finishedRows;
+		{
+			std::unique_lock<std::mutex> lock(stream.Mutex);
+			stream.RowsFinished.wait(lock, [&] { return stream.FinishedRows > writtenRows || stream.IsClosed; });
+			finishedRows = stream.FinishedRows;
+		}
+		if (finishedRows == writtenRows)
+			break;
+		if (!file.WriteRows(image, writtenRows, finishedRows))
+			return false;
+		writtenRows = finishedRows;
+	}
+	return file.Close();
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Image.h"
+
+// Encodes and writes images on a thread of its own, so a sequence can get on with rendering the next frame
+// while the last one is still being compressed. Jobs get written one at a time in the order they were queued.
+
+class ImageWriter;
+
+// Hands the rows of a frame that's still rendering to the writer as they get finished. Letting go of the stream
+// before every row is finished gives up on the file
+class ImageStream
+{
+public:
+	ImageStream() = default;
+	~ImageStream();
+
+	ImageStream(ImageStream&& other) noexcept = default;
+	ImageStream& operator=(ImageStream&& other) noexcept;
+	ImageStream(const ImageStream&) = delete;
+	ImageStream& operator=(const ImageStream&) = delete;
+
+	// The first rowCount rows are final and won't be touched again. The count can only go up
+	void FinishRows(int32_t rowCount);
+
+private:
+	friend class ImageWriter;
+
+	struct State
+	{
+		std::shared_ptr<const HDRImage> Image;
+		std::mutex Mutex;
+		std::condition_variable RowsFinished;
+		int32_t FinishedRows = 0;
+		bool IsClosed = false; // The stream was let go of, nothing more is coming
+	};
+
+	void Close();
+
+	std::shared_ptr<State> m_State;
+};
+
+class ImageWriter
+{
+public:
+	// Write and BeginStream block while maxQueued jobs are waiting, which keeps a long sequence from piling up
+	// frames in memory when encoding is slower than rendering
+	ImageWriter(uint32_t maxQueued = 4);
+	~ImageWriter(); // Writes out everything that's queued first
+
+	ImageWriter(const ImageWriter&) = delete;
+	ImageWriter& operator=(const ImageWriter&) = delete;
+
+	// Takes the image over and writes it in the format the extension asks for, like HDRImage::WriteImage
+	void Write(HDRImage image, const std::string& path, const ToneMapSettings& toneMap = ToneMapSettings());
+
+	// Writes rows out as the stream says they're finished. The renderer can keep writing into the rows that aren't
+	// Every row has to get finished before calling Flush, the writer waits on the stream until then
+	void BeginStream(std::shared_ptr<const HDRImage> image, const std::string& path, ImageStream& stream,
+		const ToneMapSettings& toneMap = ToneMapSettings());
+
+	// Blocks until everything queued so far has been written. Returns the paths that failed since the last call
+	std::vector<std::string> Flush();
+
+private:
+	struct Job
+	{
+		std::shared_ptr<const HDRImage> Image;
+		std::shared_ptr<ImageStream::State> Stream; // Null when the image was finished before it got queued
+		std::string Path;
+		ToneMapSettings ToneMap;
+	};
+
+	void Enqueue(Job job);
+	void WriterLoop();
+	bool WriteJob(const Job& job);
+
+	std::thread m_Thread;
+	uint32_t m_MaxQueued;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_JobAvailable;
+	std::condition_variable m_JobFinished;
+	std::deque<Job> m_Jobs;
+	bool m_IsWriting = false;
+	bool m_Stopping = false;
+	std::vector<std::string> m_FailedPaths;
+};
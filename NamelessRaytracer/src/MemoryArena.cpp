@@ -0,0 +1,66 @@
+#include "MemoryArena.h"
+
+#include <new>
+#include <utility>
+
+#ifdef __linux__
+	#include <sys/mman.h>
+#endif
+
+static constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+MemoryArena::MemoryArena(size_t capacity)
+{
+	if (capacity == 0)
+		return;
+
+	// Smaller arenas would only waste the rounding, they can't fill a huge page anyway
+	m_Alignment = capacity >= HugePageSize ? HugePageSize : BlockAlignment;
+	m_Capacity = (capacity + m_Alignment - 1) & ~(m_Alignment - 1);
+	m_Data = static_cast<uint8_t*>(::operator new(m_Capacity, std::align_val_t(m_Alignment)));
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	// Only a hint, the kernel falls back to normal pages when it has no huge ones to give
+	if (m_Alignment == HugePageSize)
+		madvise(m_Data, m_Capacity, MADV_HUGEPAGE);
+#endif
+}
+
+MemoryArena::MemoryArena(MemoryArena&& other) noexcept
+	: m_Data(std::exchange(other.m_Data, nullptr)), m_Capacity(std::exchange(other.m_Capacity, 0)),
+	m_Used(std::exchange(other.m_Used, 0)), m_Alignment(other.m_Alignment)
+{
+}
+
+MemoryArena& MemoryArena::operator=(MemoryArena&& other) noexcept
+{
+	if (this != &other)
+	{
+		Release();
+		m_Data = std::exchange(other.m_Data, nullptr);
+		m_Capacity = std::exchange(other.m_Capacity, 0);
+		m_Used = std::exchange(other.m_Used, 0);
+		m_Alignment = other.m_Alignment;
+	}
+	return *this;
+}
+
+void* MemoryArena::Allocate(size_t bytes)
+{
+	size_t blockSize = GetBlockSize(bytes);
+	if (bytes == 0 || blockSize > m_Capacity - m_Used)
+		return nullptr;
+
+	void* block = m_Data + m_Used;
+	m_Used += blockSize;
+	return block;
+}
+
+void MemoryArena::Release()
+{
+	if (m_Data)
+		::operator delete(m_Data, std::align_val_t(m_Alignment));
+	m_Data = nullptr;
+	m_Capacity = 0;
+	m_Used = 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Memory arena
+// One allocation sized up front that a scene's arrays get carved out of, every one starting on its own cache line.
+// Nothing gets freed on its own, everything goes at once with the arena. Arenas spanning more than a huge page
+// get aligned to one and, where the system has transparent huge pages, asked to be backed by them, so walking a
+// scene's data needs a handful of TLB entries instead of one per 4 KB page.
+
+class MemoryArena
+{
+public:
+	static constexpr size_t BlockAlignment = 64;
+
+	MemoryArena() = default;
+	explicit MemoryArena(size_t capacity);
+	~MemoryArena() { Release(); }
+
+	// Moving keeps the memory where it is, so pointers into it stay valid
+	MemoryArena(MemoryArena&& other) noexcept;
+	MemoryArena& operator=(MemoryArena&& other) noexcept;
+
+	MemoryArena(const MemoryArena&) = delete;
+	MemoryArena& operator=(const MemoryArena&) = delete;
+
+	// What bytes take out of an arena once they're rounded up to a cache line, for sizing one up front
+	static size_t GetBlockSize(size_t bytes) { return (bytes + BlockAlignment - 1) & ~(BlockAlignment - 1); }
+
+	// Null when the arena doesn't have that much left, which means whoever sized it got it wrong, and for 0 bytes
+	void* Allocate(size_t bytes);
+
+	template<typename T>
+	T* Allocate(size_t count) { return static_cast<T*>(Allocate(count * sizeof(T))); }
+
+	size_t GetCapacity() const { return m_Capacity; }
+	size_t GetUsedSize() const { return m_Used; }
+
+private:
+	void Release();
+
+	uint8_t* m_Data = nullptr;
+	size_t m_Capacity = 0;
+	size_t m_Used = 0;
+	size_t m_Alignment = BlockAlignment; // What m_Data was allocated with, needed to free it
+};
+
+// Fixed size array in memory someone else keeps alive, an arena or a mapped scene cache
+template<typename T>
+struct ArenaArray
+{
+	T* Data = nullptr;
+	size_t Count = 0;
+
+	T* data() { return Data; }
+	const T* data() const { return Data; }
+	size_t size() const { return Count; }
+	bool empty() const { return Count == 0; }
+
+	T& operator[](size_t index) { return Data[index]; }
+	const T& operator[](size_t index) const { return Data[index]; }
+
+	T* begin() { return Data; }
+	T* end() { return Data + Count; }
+	const T* begin() const { return Data; }
+	const T* end() const { return Data + Count; }
+};
@@ -0,0 +1,991 @@
+#include "Model.h"
+
+#include <iostream>
+#include <cstring>
+#include <limits>
+#include <map>
+
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+#include "tiny_gltf.h"
+
+const char* GLTFTypeName(int32_t gltfType)
+{
+	switch (gltfType)
+	{
+	case TINYGLTF_TYPE_SCALAR:
+		return "SCALAR";
+		break;
+	case TINYGLTF_TYPE_VEC2:
+		return "VEC2";
+		break;
+	case TINYGLTF_TYPE_VEC3:
+		return "VEC3";
+		break;
+	case TINYGLTF_TYPE_VEC4:
+		return "VEC4";
+		break;
+	case TINYGLTF_TYPE_MAT2:
+		return "MAT2";
+		break;
+	case TINYGLTF_TYPE_MAT3:
+		return "MAT3";
+		break;
+	case TINYGLTF_TYPE_MAT4:
+		return "MAT4";
+		break;
+	default:
+		return "UNKNOWN";
+	}
+}
+
+const char* GLTFComponentTypeName(int32_t gltfComponentType)
+{
+	switch (gltfComponentType)
+	{
+	case TINYGLTF_COMPONENT_TYPE_BYTE:
+		return "BYTE";
+		break;
+	case TINYGLTF_COMPONENT_TYPE_DOUBLE:
+		return "DOUBLE";
+		break;
+	case TINYGLTF_COMPONENT_TYPE_FLOAT:
+		return "FLOAT";
+		break;
+	case TINYGLTF_COMPONENT_TYPE_INT:
+		return "INT";
+		break;
+	case TINYGLTF_COMPONENT_TYPE_SHORT:
+		return "SHORT";
+		break;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		return "UNSIGNED_BYTE";
+		break;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+		return "UNSIGNED_INT";
+		break;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+		return "UNSIGNED_SHORT";
+		break;
+	default:
+		return "UNKNOWN";
+	}
+}
+
+const char* GLTFModeName(int32_t gltfMode)
+{
+	switch (gltfMode)
+	{
+	case TINYGLTF_MODE_POINTS:
+		return "POINTS";
+		break;
+	case TINYGLTF_MODE_LINE:
+		return "LINES";
+		break;
+	case TINYGLTF_MODE_LINE_LOOP:
+		return "LINE_LOOP";
+		break;
+	case TINYGLTF_MODE_LINE_STRIP:
+		return "LINE_STRIP";
+		break;
+	case TINYGLTF_MODE_TRIANGLES:
+		return "TRIANGLES";
+		break;
+	case TINYGLTF_MODE_TRIANGLE_STRIP:
+		return "TRIANGLE_STRIP";
+		break;
+	case TINYGLTF_MODE_TRIANGLE_FAN:
+		return "TRIANGLE_FAN";
+		break;
+	default:
+		return "UNKNOWN";
+	}
+}
+
+template<typename T>
+T* GetBufferLocation(tinygltf::Model& model, int32_t accessorIndex)
+{
+	auto& accessor = model.accessors[accessorIndex];
+	auto& bufferView = model.bufferViews[accessor.bufferView];
+	auto& buffer = model.buffers[bufferView.buffer];
+	return reinterpret_cast<T*>(buffer.data.data() + bufferView.byteOffset + accessor.byteOffset);
+}
+
+// This function takes in a lot of data because it needs to print error messages with useful information
+// Takes the attributes instead of the primitive so morph targets can be checked the same way
+bool VerifyPrimitiveAttribute(tinygltf::Model& model, std::map<std::string, int>& attributes,
+	const char* attributeName, int32_t requiredType, int32_t requiredComponentType, 
+	const std::string& meshName, const char* attributeDescription)
+{
+	bool isValid = true;
+	
+	auto attribute = attributes.find(attributeName);
+	if (attribute != attributes.end())
+	{
+		auto& accessor = model.accessors[attribute->second];
+		if (accessor.type != requiredType)
+		{
+			std::cout << "ERROR: [" << meshName << "] Primitive found with " << attributeDescription << " type of '" <<
+				GLTFTypeName(accessor.type) << "' instead of '" << GLTFTypeName(requiredType) << "'!\n";
+			isValid = false;
+		}
+
+		if (accessor.componentType != requiredComponentType)
+		{
+			std::cout << "ERROR: [" << meshName << "] Primitive found with " << attributeDescription << " component type of '" <<
+				GLTFComponentTypeName(accessor.componentType) << "' instead of '" << 
+				GLTFComponentTypeName(requiredComponentType) << "'!\n";
+			isValid = false;
+		}
+	}
+	else
+	{
+		std::cout << "ERROR: [" << meshName << "] Primitive found without " << attributeDescription << " data!\n";
+		isValid = false;
+	}
+
+	return isValid;
+}
+
+bool VerifyPrimitive(tinygltf::Model& model, tinygltf::Mesh& mesh, tinygltf::Primitive& primitive)
+{
+	bool isValid = true;
+
+	// Mode needs to be TRIANGLES
+	if (primitive.mode != TINYGLTF_MODE_TRIANGLES)
+	{
+		std::cout << "ERROR: [" << mesh.name << "] Primitive found with mode '" 
+			<< GLTFModeName(primitive.mode) << "' which is not supported! (Only 'TRIANGLES' is supported.)\n";
+		isValid = false;
+	}
+
+	// Vertex positions need to be VEC3 and of type FLOAT
+	isValid &= VerifyPrimitiveAttribute(model, primitive.attributes,
+		"POSITION", TINYGLTF_TYPE_VEC3, TINYGLTF_COMPONENT_TYPE_FLOAT,
+		mesh.name, "vertex position");
+
+	// Vertex normals need to be VEC3 and of type FLOAT
+	isValid &= VerifyPrimitiveAttribute(model, primitive.attributes,
+		"NORMAL", TINYGLTF_TYPE_VEC3, TINYGLTF_COMPONENT_TYPE_FLOAT,
+		mesh.name, "vertex normal");
+
+	// Vertex colors need to be VEC4 and of type UNSIGNED_SHORT. Textured assets often go without, which is white
+	if (primitive.attributes.count("COLOR_0"))
+	{
+		isValid &= VerifyPrimitiveAttribute(model, primitive.attributes,
+			"COLOR_0", TINYGLTF_TYPE_VEC4, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT,
+			mesh.name, "vertex color");
+	}
+
+	// Texture coordinates need to be VEC2 and of type FLOAT, only the first set is used
+	if (primitive.attributes.count("TEXCOORD_0"))
+	{
+		isValid &= VerifyPrimitiveAttribute(model, primitive.attributes,
+			"TEXCOORD_0", TINYGLTF_TYPE_VEC2, TINYGLTF_COMPONENT_TYPE_FLOAT,
+			mesh.name, "texture coordinate");
+	}
+
+	// Only the base color of a material is used. A texture without coordinates to go by just shows its corner
+	if (primitive.material >= static_cast<int32_t>(model.materials.size()))
+	{
+		std::cout << "ERROR: [" << mesh.name << "] Primitive found with a material that doesn't exist!\n";
+		isValid = false;
+	}
+	else if (primitive.material >= 0 && model.materials[primitive.material].pbrMetallicRoughness.baseColorTexture.index >= 0 &&
+		!primitive.attributes.count("TEXCOORD_0"))
+	{
+		std::cout << "WARNING: [" << mesh.name << "] Primitive found with a base color texture but no texture coordinates!\n";
+	}
+
+	// Indices need to be present. I'm gonna assume that they're okay if they're here
+	if (primitive.indices == -1)
+	{
+		std::cout << "Error: [" << mesh.name << "] Primitive found with no indices!\n";
+		isValid = false;
+	}
+
+	// Morph targets only get checked for what they have, a target can move positions or normals or both
+	for (auto& target : primitive.targets)
+	{
+		if (target.count("POSITION"))
+		{
+			isValid &= VerifyPrimitiveAttribute(model, target,
+				"POSITION", TINYGLTF_TYPE_VEC3, TINYGLTF_COMPONENT_TYPE_FLOAT,
+				mesh.name, "morph target position");
+		}
+		if (target.count("NORMAL"))
+		{
+			isValid &= VerifyPrimitiveAttribute(model, target,
+				"NORMAL", TINYGLTF_TYPE_VEC3, TINYGLTF_COMPONENT_TYPE_FLOAT,
+				mesh.name, "morph target normal");
+		}
+	}
+
+	if (primitive.targets.size() != mesh.primitives[0].targets.size())
+	{
+		std::cout << "ERROR: [" << mesh.name << "] Primitives found with different morph target counts!\n";
+		isValid = false;
+	}
+
+	return isValid; // I sure hope this is enough error checking
+}
+
+uint32_t EncodeNormal(const glm::vec3& normal)
+{
+	// Project onto the octahedron, then fold the lower half over the upper half
+	glm::vec3 octahedron = normal / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+	glm::vec2 square(octahedron.x, octahedron.y);
+	if (octahedron.z < 0.0f)
+	{
+		square = glm::vec2(
+			(1.0f - std::abs(octahedron.y)) * (octahedron.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::abs(octahedron.x)) * (octahedron.y >= 0.0f ? 1.0f : -1.0f)
+		);
+	}
+
+	int16_t x = static_cast<int16_t>(std::round(glm::clamp(square.x, -1.0f, 1.0f) * 32767.0f));
+	int16_t y = static_cast<int16_t>(std::round(glm::clamp(square.y, -1.0f, 1.0f) * 32767.0f));
+	return static_cast<uint32_t>(static_cast<uint16_t>(x)) | (static_cast<uint32_t>(static_cast<uint16_t>(y)) << 16);
+}
+
+// Arrays with the biggest alignment go first so every array stays aligned without padding
+size_t TriangleRegistry::GetBufferSize(size_t vertexCount, VertexLayout layout)
+{
+	switch (layout)
+	{
+	case VertexLayout::Compact:
+		return vertexCount * (sizeof(uint32_t) + sizeof(uint16_t) * 4 + sizeof(glm::vec3));
+	case VertexLayout::Quantized:
+		return vertexCount * (sizeof(uint32_t) + sizeof(uint16_t) * 4 + sizeof(uint16_t) * 3);
+	default:
+		return vertexCount * (sizeof(glm::vec3) * 2 + sizeof(glm::vec4));
+	}
+}
+
+size_t TriangleRegistry::GetArenaSize(size_t vertexCount, size_t triangleCount, VertexLayout layout, bool hasTexCoords)
+{
+	return MemoryArena::GetBlockSize(GetBufferSize(vertexCount, layout)) + MemoryArena::GetBlockSize(triangleCount * sizeof(glm::uvec3)) +
+		(hasTexCoords ? MemoryArena::GetBlockSize(vertexCount * sizeof(glm::vec2)) : 0);
+}
+
+void TriangleRegistry::Allocate(size_t vertexCount, size_t triangleCount, VertexLayout layout, bool hasTexCoords)
+{
+	Memory = MemoryArena(GetArenaSize(vertexCount, triangleCount, layout, hasTexCoords));
+	Allocate(Memory, vertexCount, triangleCount, layout, hasTexCoords);
+}
+
+void TriangleRegistry::Allocate(MemoryArena& arena, size_t vertexCount, size_t triangleCount, VertexLayout layout, bool hasTexCoords)
+{
+	SetBuffer(static_cast<uint8_t*>(arena.Allocate(GetBufferSize(vertexCount, layout))), vertexCount, layout);
+	Triangles = { arena.Allocate<glm::uvec3>(triangleCount), triangleCount };
+	TexCoords = {};
+	if (hasTexCoords)
+		TexCoords = { arena.Allocate<glm::vec2>(vertexCount), vertexCount };
+}
+
+TriangleRegistry TriangleRegistry::Clone() const
+{
+	TriangleRegistry copy;
+	copy.Allocate(VertexCount, Triangles.size(), Layout, !TexCoords.empty());
+	copy.PositionOrigin = PositionOrigin;
+	copy.PositionScale = PositionScale;
+	std::copy_n(VertexData, GetBufferSize(), copy.VertexData);
+	std::copy(Triangles.begin(), Triangles.end(), copy.Triangles.begin());
+	std::copy(TexCoords.begin(), TexCoords.end(), copy.TexCoords.begin());
+	copy.MaterialRanges = MaterialRanges;
+	return copy;
+}
+
+void TriangleRegistry::SetBuffer(uint8_t* data, size_t vertexCount, VertexLayout layout)
+{
+	VertexData = data;
+	VertexCount = vertexCount;
+	Layout = layout;
+	Positions = nullptr;
+	Normals = nullptr;
+	Colors = nullptr;
+	EncodedNormals = nullptr;
+	PackedColors = nullptr;
+	QuantizedPositions = nullptr;
+
+	if (layout == VertexLayout::Full)
+	{
+		Positions = reinterpret_cast<glm::vec3*>(data);
+		Normals = Positions + vertexCount;
+		Colors = reinterpret_cast<glm::vec4*>(Normals + vertexCount);
+		return;
+	}
+
+	EncodedNormals = reinterpret_cast<uint32_t*>(data);
+	PackedColors = reinterpret_cast<uint16_t*>(EncodedNormals + vertexCount);
+	if (layout == VertexLayout::Compact)
+		Positions = reinterpret_cast<glm::vec3*>(PackedColors + vertexCount * 4);
+	else
+		QuantizedPositions = PackedColors + vertexCount * 4;
+}
+
+void TriangleRegistry::SetPositionBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	PositionOrigin = boundsMin;
+	PositionScale = (boundsMax - boundsMin) / 65535.0f;
+}
+
+void TriangleRegistry::SetVertex(size_t index, const glm::vec3& position, const glm::vec3& normal, const glm::vec4& color)
+{
+	if (Layout == VertexLayout::Full)
+	{
+		Positions[index] = position;
+		Normals[index] = normal;
+		Colors[index] = color;
+		return;
+	}
+
+	EncodedNormals[index] = EncodeNormal(normal);
+	for (int32_t channel = 0; channel < 4; channel++)
+		PackedColors[index * 4 + channel] = static_cast<uint16_t>(std::round(glm::clamp(color[channel], 0.0f, 1.0f) * 65535.0f));
+
+	if (Layout == VertexLayout::Compact)
+	{
+		Positions[index] = position;
+		return;
+	}
+
+	for (int32_t axis = 0; axis < 3; axis++)
+	{
+		// A flat axis has no scale and everything on it sits at the origin
+		float quantized = PositionScale[axis] > 0.0f ? (position[axis] - PositionOrigin[axis]) / PositionScale[axis] : 0.0f;
+		QuantizedPositions[index * 3 + axis] = static_cast<uint16_t>(std::round(glm::clamp(quantized, 0.0f, 65535.0f)));
+	}
+}
+
+// Vertices and triangles of every primitive of a mesh together, what its registry needs room for. Texture
+// coordinates get stored for the whole mesh when any of its primitives has them
+static void CountMeshElements(tinygltf::Model& model, tinygltf::Mesh& mesh, size_t& vertexCount, size_t& triangleCount, bool& hasTexCoords)
+{
+	vertexCount = 0;
+	triangleCount = 0;
+	hasTexCoords = false;
+	for (auto& primitive : mesh.primitives)
+	{
+		vertexCount += model.accessors[primitive.attributes["POSITION"]].count;
+		triangleCount += model.accessors[primitive.indices].count / 3;
+		hasTexCoords |= primitive.attributes.count("TEXCOORD_0") > 0;
+	}
+}
+
+// Copies every primitive of a mesh into its own registry, carved out of arena. The mesh has to have passed
+// VerifyPrimitive
+static TriangleRegistry LoadMesh(tinygltf::Model& model, tinygltf::Mesh& mesh, VertexLayout layout, MemoryArena& arena)
+{
+	TriangleRegistry registry;
+
+	// Quantizing needs the bounds up front
+	size_t vertexCount = 0, triangleCount = 0;
+	bool hasTexCoords = false;
+	CountMeshElements(model, mesh, vertexCount, triangleCount, hasTexCoords);
+	glm::vec3 boundsMin(std::numeric_limits<float>::infinity());
+	glm::vec3 boundsMax(-std::numeric_limits<float>::infinity());
+	std::vector<glm::vec3> targetLowest, targetHighest; // Furthest offsets of every morph target over all primitives
+	for (auto& primitive : mesh.primitives)
+	{
+		int32_t positionAccessor = primitive.attributes["POSITION"];
+		size_t count = model.accessors[positionAccessor].count;
+		glm::vec3* positions = GetBufferLocation<glm::vec3>(model, positionAccessor);
+		for (size_t i = 0; i < count; i++)
+		{
+			boundsMin = glm::min(boundsMin, positions[i]);
+			boundsMax = glm::max(boundsMax, positions[i]);
+		}
+
+		if (primitive.targets.size() > targetLowest.size())
+		{
+			targetLowest.resize(primitive.targets.size(), glm::vec3(0.0f));
+			targetHighest.resize(primitive.targets.size(), glm::vec3(0.0f));
+		}
+		for (size_t target = 0; target < primitive.targets.size(); target++)
+		{
+			auto offsetAccessor = primitive.targets[target].find("POSITION");
+			if (offsetAccessor == primitive.targets[target].end())
+				continue;
+
+			glm::vec3* offsets = GetBufferLocation<glm::vec3>(model, offsetAccessor->second);
+			for (size_t i = 0; i < count; i++)
+			{
+				targetLowest[target] = glm::min(targetLowest[target], offsets[i]);
+				targetHighest[target] = glm::max(targetHighest[target], offsets[i]);
+			}
+		}
+	}
+
+	// Morph targets move vertices away from the rest pose. Every primitive shares the mesh's weights, so the bounds
+	// only have to hold the rest pose plus every mix of the targets with weights between 0 and 1. Weights outside
+	// that are rare enough to be left to AnimationPlayer::Apply, which grows the bounds when it has to
+	for (size_t target = 0; target < targetLowest.size(); target++)
+	{
+		boundsMin += targetLowest[target];
+		boundsMax += targetHighest[target];
+	}
+
+	registry.Allocate(arena, vertexCount, triangleCount, layout, hasTexCoords);
+	if (vertexCount > 0)
+		registry.SetPositionBounds(boundsMin, boundsMax);
+
+	// Copy every vertex, converting it to the layout on the way. Colors get converted to floats here for the
+	// full layout and stay 16 bit for the others
+	{
+		size_t verticesCopied = 0;
+		bool hasMaterials = false;
+		for (auto& primitive : mesh.primitives)
+		{
+			size_t count = model.accessors[primitive.attributes["POSITION"]].count;
+			glm::vec3* positions = GetBufferLocation<glm::vec3>(model, primitive.attributes["POSITION"]);
+			glm::vec3* normals = GetBufferLocation<glm::vec3>(model, primitive.attributes["NORMAL"]);
+			auto colorAccessor = primitive.attributes.find("COLOR_0");
+			uint16_t* colors = colorAccessor != primitive.attributes.end() ? GetBufferLocation<uint16_t>(model, colorAccessor->second) : nullptr;
+
+			for (size_t i = 0; i < count; i++)
+			{
+				size_t index = i * 4;
+				glm::vec4 color(1.0f);
+				if (colors)
+				{
+					color = glm::vec4(
+						colors[index] / 65535.0f,
+						colors[index + 1] / 65535.0f,
+						colors[index + 2] / 65535.0f,
+						colors[index + 3] / 65535.0f
+					);
+				}
+				registry.SetVertex(verticesCopied + i, positions[i], normals[i], color);
+			}
+
+			if (hasTexCoords)
+			{
+				auto texCoordAccessor = primitive.attributes.find("TEXCOORD_0");
+				glm::vec2* texCoords = texCoordAccessor != primitive.attributes.end() ? GetBufferLocation<glm::vec2>(model, texCoordAccessor->second) : nullptr;
+				for (size_t i = 0; i < count; i++)
+					registry.TexCoords[verticesCopied + i] = texCoords ? texCoords[i] : glm::vec2(0.0f);
+			}
+
+			hasMaterials |= primitive.material >= 0;
+			uint32_t material = primitive.material >= 0 ? static_cast<uint32_t>(primitive.material) : NoMaterial;
+			registry.MaterialRanges.push_back({ static_cast<uint32_t>(verticesCopied), material });
+
+			verticesCopied += count;
+		}
+
+		if (!hasMaterials)
+			registry.MaterialRanges.clear();
+	}
+
+	{
+		uint32_t vertexOffset = 0; // Keep track of the vertex offset so that triangle relations are preserved
+		size_t trianglesCopied = 0;
+		for (auto& primitive : mesh.primitives)
+		{
+			auto& accessor = model.accessors[primitive.indices];
+			uint16_t* indices = GetBufferLocation<uint16_t>(model, primitive.indices);
+			for (int32_t i = 0; i < accessor.count / 3; i++)
+			{
+				int32_t index = i * 3;
+				registry.Triangles[trianglesCopied++] = glm::uvec3(
+					indices[index] + vertexOffset,
+					indices[index + 1] + vertexOffset,
+					indices[index + 2] + vertexOffset
+				);
+			}
+
+			vertexOffset += static_cast<uint32_t>(model.accessors[primitive.attributes["POSITION"]].count);
+		}
+	}
+
+	return registry;
+}
+
+static TextureWrap GetTextureWrap(int32_t gltfWrap)
+{
+	switch (gltfWrap)
+	{
+	case TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE:
+		return TextureWrap::ClampToEdge;
+	case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT:
+		return TextureWrap::MirroredRepeat;
+	default:
+		return TextureWrap::Repeat;
+	}
+}
+
+// Every material in the file, in the same order, and a texture for every glTF texture one of them uses as its base
+// color. Only the encoded images those need are kept, back to back in data.TextureData
+static void LoadMaterials(tinygltf::Model& model, const std::vector<std::vector<uint8_t>>& encodedImages, ModelData& data)
+{
+	std::map<int32_t, uint32_t> textureIndices; // glTF texture to the model's
+	std::vector<size_t> textureOffsets;
+	for (auto& gltfMaterial : model.materials)
+	{
+		Material material;
+		const std::vector<double>& factor = gltfMaterial.pbrMetallicRoughness.baseColorFactor;
+		if (factor.size() == 4)
+			material.BaseColorFactor = glm::vec4(factor[0], factor[1], factor[2], factor[3]);
+
+		const tinygltf::TextureInfo& textureInfo = gltfMaterial.pbrMetallicRoughness.baseColorTexture;
+		int32_t imageIndex = textureInfo.index >= 0 && textureInfo.index < static_cast<int32_t>(model.textures.size()) ?
+			model.textures[textureInfo.index].source : -1;
+		if (textureInfo.index >= 0 && textureInfo.texCoord != 0)
+		{
+			std::cout << "WARNING: [" << gltfMaterial.name << "] Material found with a base color texture using TEXCOORD_" <<
+				textureInfo.texCoord << ". Only TEXCOORD_0 is supported, the texture will be ignored.\n";
+		}
+		else if (textureInfo.index >= 0 && (imageIndex < 0 || imageIndex >= static_cast<int32_t>(encodedImages.size()) ||
+			encodedImages[imageIndex].empty()))
+		{
+			std::cout << "WARNING: [" << gltfMaterial.name << "] Material found with a base color texture that has no image. " <<
+				"The texture will be ignored.\n";
+		}
+		else if (textureInfo.index >= 0)
+		{
+			auto known = textureIndices.find(textureInfo.index);
+			if (known == textureIndices.end())
+			{
+				TextureSource source;
+				source.EncodedSize = encodedImages[imageIndex].size();
+				int32_t samplerIndex = model.textures[textureInfo.index].sampler;
+				if (samplerIndex >= 0 && samplerIndex < static_cast<int32_t>(model.samplers.size()))
+				{
+					source.WrapS = GetTextureWrap(model.samplers[samplerIndex].wrapS);
+					source.WrapT = GetTextureWrap(model.samplers[samplerIndex].wrapT);
+				}
+
+				// Pointed into the data once it's all there and won't move anymore
+				textureOffsets.push_back(data.TextureData.size());
+				data.TextureData.insert(data.TextureData.end(), encodedImages[imageIndex].begin(), encodedImages[imageIndex].end());
+				known = textureIndices.emplace(textureInfo.index, static_cast<uint32_t>(data.Textures.size())).first;
+				data.Textures.push_back(source);
+			}
+			material.BaseColorTexture = known->second;
+		}
+
+		data.Materials.push_back(material);
+	}
+
+	for (size_t i = 0; i < data.Textures.size(); i++)
+		data.Textures[i].EncodedData = data.TextureData.data() + textureOffsets[i];
+}
+
+// A node's transform relative to its parent. glTF gives either a whole matrix or translation, rotation and scale
+static glm::dmat4 GetNodeTransform(const tinygltf::Node& node)
+{
+	if (node.matrix.size() == 16)
+		return glm::make_mat4(node.matrix.data());
+
+	glm::dmat4 transform(1.0);
+	if (node.translation.size() == 3)
+		transform = glm::translate(transform, glm::dvec3(node.translation[0], node.translation[1], node.translation[2]));
+	if (node.rotation.size() == 4) // Stored as xyzw
+		transform = transform * glm::mat4_cast(glm::dquat(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]));
+	if (node.scale.size() == 3)
+		transform = glm::scale(transform, glm::dvec3(node.scale[0], node.scale[1], node.scale[2]));
+	return transform;
+}
+
+// Walks down the node hierarchy and adds an instance for every node with a mesh. Transforms are combined in double
+// so deep hierarchies don't pile up rounding error
+static void AddNodeInstances(const tinygltf::Model& model, int32_t nodeIndex, const glm::dmat4& parentTransform,
+	uint32_t depth, std::vector<MeshInstance>& instances)
+{
+	// glTF doesn't allow cycles but a broken file could still have one
+	if (nodeIndex < 0 || nodeIndex >= static_cast<int32_t>(model.nodes.size()) || depth > model.nodes.size())
+		return;
+
+	const tinygltf::Node& node = model.nodes[nodeIndex];
+	glm::dmat4 transform = parentTransform * GetNodeTransform(node);
+
+	if (node.mesh >= 0 && node.mesh < static_cast<int32_t>(model.meshes.size()))
+		instances.push_back({ glm::mat4(transform), static_cast<uint32_t>(node.mesh) });
+
+	for (int32_t child : node.children)
+		AddNodeInstances(model, child, transform, depth + 1, instances);
+}
+
+// Instances come from the nodes of the default scene, or every root node if the file doesn't say which scene
+static std::vector<int32_t> GetRootNodes(const tinygltf::Model& model)
+{
+	if (!model.scenes.empty())
+	{
+		int32_t sceneIndex = model.defaultScene >= 0 && model.defaultScene < static_cast<int32_t>(model.scenes.size()) ?
+			model.defaultScene : 0;
+		return model.scenes[sceneIndex].nodes;
+	}
+
+	std::vector<bool> isChild(model.nodes.size(), false);
+	for (auto& node : model.nodes)
+	{
+		for (int32_t child : node.children)
+		{
+			if (child >= 0 && child < static_cast<int32_t>(model.nodes.size()))
+				isChild[child] = true;
+		}
+	}
+
+	std::vector<int32_t> roots;
+	for (int32_t i = 0; i < static_cast<int32_t>(model.nodes.size()); i++)
+	{
+		if (!isChild[i])
+			roots.push_back(i);
+	}
+	return roots;
+}
+
+// Takes the encoded bytes of every image instead of letting tinygltf decode them all up front, the texture cache
+// decodes them once they're needed. Without a place to keep them they're dropped
+static bool KeepEncodedImage(tinygltf::Image*, const int imageIndex, std::string*, std::string*, int, int,
+	const unsigned char* bytes, int size, void* userData)
+{
+	if (!userData || imageIndex < 0)
+		return true;
+
+	auto& encodedImages = *static_cast<std::vector<std::vector<uint8_t>>*>(userData);
+	if (static_cast<size_t>(imageIndex) >= encodedImages.size())
+		encodedImages.resize(imageIndex + 1);
+	encodedImages[imageIndex].assign(bytes, bytes + size);
+	return true;
+}
+
+static bool LoadGLTF(const std::string& path, tinygltf::Model& model, std::vector<std::vector<uint8_t>>* encodedImages = nullptr)
+{
+	// Load the gltf with tinygltf
+	tinygltf::TinyGLTF loader;
+	std::string err;
+	std::string warn;
+	loader.SetImageLoader(KeepEncodedImage, encodedImages);
+
+	bool res = loader.LoadBinaryFromFile(&model, &err, &warn, path);
+
+	if (!warn.empty())
+		std::cout << "WARN: " << warn << std::endl;
+	if (!err.empty())
+		std::cout << "ERR: " << err << std::endl;
+
+	return res;
+}
+
+ModelData LoadModel(const std::string& path, VertexLayout layout)
+{
+	ModelData data;
+
+	tinygltf::Model model;
+	std::vector<std::vector<uint8_t>> encodedImages;
+	if (!LoadGLTF(path, model, &encodedImages))
+		return data;
+
+	// Verify all the primitives before loading anything
+	bool isValid = true;
+	for (auto& mesh : model.meshes)
+	{
+		//std::cout << mesh.name << "\n";
+		for (auto& primitive : mesh.primitives)
+			isValid &= VerifyPrimitive(model, mesh, primitive);
+	}
+
+	if (!isValid)
+		return data;
+
+	// Each mesh is loaded once, however many nodes reference it. They all go into one arena sized for every one of
+	// them first, so nothing gets reallocated on the way
+	size_t arenaSize = 0;
+	for (auto& mesh : model.meshes)
+	{
+		size_t vertexCount = 0, triangleCount = 0;
+		bool hasTexCoords = false;
+		CountMeshElements(model, mesh, vertexCount, triangleCount, hasTexCoords);
+		arenaSize += TriangleRegistry::GetArenaSize(vertexCount, triangleCount, layout, hasTexCoords);
+	}
+
+	data.Memory = MemoryArena(arenaSize);
+	data.Meshes.reserve(model.meshes.size());
+	for (auto& mesh : model.meshes)
+		data.Meshes.push_back(LoadMesh(model, mesh, layout, data.Memory));
+
+	LoadMaterials(model, encodedImages, data);
+
+	glm::dmat4 identity(1.0);
+	for (int32_t nodeIndex : GetRootNodes(model))
+		AddNodeInstances(model, nodeIndex, identity, 0, data.Instances);
+
+	// A file with meshes but no nodes still gets every mesh drawn once, where it is
+	if (model.nodes.empty())
+	{
+		for (uint32_t i = 0; i < static_cast<uint32_t>(data.Meshes.size()); i++)
+			data.Instances.push_back({ glm::mat4(1.0f), i });
+	}
+
+	return data;
+}
+
+// Same walk as AddNodeInstances, so the instances come out in the same order as LoadModel's
+static void AddAnimationNodes(const tinygltf::Model& model, int32_t nodeIndex, int32_t parent, uint32_t depth,
+	ModelAnimation& animation)
+{
+	if (nodeIndex < 0 || nodeIndex >= static_cast<int32_t>(model.nodes.size()) || depth > model.nodes.size())
+		return;
+
+	const tinygltf::Node& node = model.nodes[nodeIndex];
+	animation.Nodes[nodeIndex].Parent = parent;
+	if (node.mesh >= 0 && node.mesh < static_cast<int32_t>(model.meshes.size()))
+		animation.InstanceNodes.push_back(static_cast<uint32_t>(nodeIndex));
+
+	for (int32_t child : node.children)
+		AddAnimationNodes(model, child, nodeIndex, depth + 1, animation);
+}
+
+// Rest pose and target offsets in registry order, primitives back to back like LoadMesh. The mesh has to have
+// passed VerifyPrimitive
+static MorphTargets LoadMorphTargets(tinygltf::Model& model, tinygltf::Mesh& mesh)
+{
+	MorphTargets morph;
+	size_t targetCount = mesh.primitives.empty() ? 0 : mesh.primitives[0].targets.size();
+	morph.PositionOffsets.resize(targetCount);
+	morph.NormalOffsets.resize(targetCount);
+
+	for (auto& primitive : mesh.primitives)
+	{
+		size_t count = model.accessors[primitive.attributes["POSITION"]].count;
+		glm::vec3* positions = GetBufferLocation<glm::vec3>(model, primitive.attributes["POSITION"]);
+		glm::vec3* normals = GetBufferLocation<glm::vec3>(model, primitive.attributes["NORMAL"]);
+		morph.Positions.insert(morph.Positions.end(), positions, positions + count);
+		morph.Normals.insert(morph.Normals.end(), normals, normals + count);
+
+		// A target without one of the attributes doesn't move it, which is the same as zero offsets. Normals only
+		// get stored when some primitive actually has them
+		for (size_t target = 0; target < targetCount; target++)
+		{
+			auto& attributes = primitive.targets[target];
+			std::vector<glm::vec3>& positionOffsets = morph.PositionOffsets[target];
+			auto positionAccessor = attributes.find("POSITION");
+			if (positionAccessor != attributes.end())
+			{
+				glm::vec3* offsets = GetBufferLocation<glm::vec3>(model, positionAccessor->second);
+				positionOffsets.insert(positionOffsets.end(), offsets, offsets + count);
+			}
+			else
+				positionOffsets.resize(positionOffsets.size() + count, glm::vec3(0.0f));
+
+			std::vector<glm::vec3>& normalOffsets = morph.NormalOffsets[target];
+			auto normalAccessor = attributes.find("NORMAL");
+			if (normalAccessor != attributes.end())
+			{
+				glm::vec3* offsets = GetBufferLocation<glm::vec3>(model, normalAccessor->second);
+				normalOffsets.resize(morph.Positions.size() - count, glm::vec3(0.0f));
+				normalOffsets.insert(normalOffsets.end(), offsets, offsets + count);
+			}
+			else if (!normalOffsets.empty())
+				normalOffsets.resize(normalOffsets.size() + count, glm::vec3(0.0f));
+		}
+	}
+
+	return morph;
+}
+
+// Checks a sampler accessor is float and of the type the channel needs. Sparse accessors aren't supported
+static bool VerifyAnimationAccessor(const tinygltf::Model& model, int32_t accessorIndex, int32_t requiredType)
+{
+	if (accessorIndex < 0 || accessorIndex >= static_cast<int32_t>(model.accessors.size()))
+		return false;
+
+	const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+	return accessor.bufferView >= 0 && accessor.type == requiredType && accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT;
+}
+
+ModelAnimation LoadAnimation(const std::string& path)
+{
+	ModelAnimation animation;
+
+	tinygltf::Model model;
+	if (!LoadGLTF(path, model))
+		return animation;
+
+	// LoadModel gives up on meshes it can't load, there's nothing to animate then either
+	bool isValid = true;
+	for (auto& mesh : model.meshes)
+	{
+		for (auto& primitive : mesh.primitives)
+			isValid &= VerifyPrimitive(model, mesh, primitive);
+	}
+
+	if (!isValid)
+		return animation;
+
+	animation.Morphs.resize(model.meshes.size());
+	animation.MorphNodes.assign(model.meshes.size(), -1);
+	for (size_t i = 0; i < model.meshes.size(); i++)
+	{
+		tinygltf::Mesh& mesh = model.meshes[i];
+		if (!mesh.primitives.empty() && !mesh.primitives[0].targets.empty())
+			animation.Morphs[i] = LoadMorphTargets(model, mesh);
+	}
+
+	// The rest pose of every node, with the weights of nodes that don't have their own taken from the mesh
+	animation.Nodes.resize(model.nodes.size());
+	for (size_t i = 0; i < model.nodes.size(); i++)
+	{
+		const tinygltf::Node& gltfNode = model.nodes[i];
+		AnimationNode& node = animation.Nodes[i];
+		if (gltfNode.matrix.size() == 16)
+		{
+			node.HasMatrix = true;
+			node.Matrix = glm::make_mat4(gltfNode.matrix.data());
+		}
+		if (gltfNode.translation.size() == 3)
+			node.Translation = glm::dvec3(gltfNode.translation[0], gltfNode.translation[1], gltfNode.translation[2]);
+		if (gltfNode.rotation.size() == 4) // Stored as xyzw
+			node.Rotation = glm::dquat(gltfNode.rotation[3], gltfNode.rotation[0], gltfNode.rotation[1], gltfNode.rotation[2]);
+		if (gltfNode.scale.size() == 3)
+			node.Scale = glm::dvec3(gltfNode.scale[0], gltfNode.scale[1], gltfNode.scale[2]);
+
+		if (gltfNode.mesh < 0 || gltfNode.mesh >= static_cast<int32_t>(model.meshes.size()))
+			continue;
+
+		size_t targetCount = animation.Morphs[gltfNode.mesh].PositionOffsets.size();
+		const std::vector<double>& weights = gltfNode.weights.empty() ? model.meshes[gltfNode.mesh].weights : gltfNode.weights;
+		node.Weights.assign(weights.begin(), weights.begin() + std::min(weights.size(), targetCount));
+		node.Weights.resize(targetCount, 0.0f);
+	}
+
+	for (int32_t nodeIndex : GetRootNodes(model))
+		AddAnimationNodes(model, nodeIndex, -1, 0, animation);
+
+	for (uint32_t nodeIndex : animation.InstanceNodes)
+	{
+		int32_t meshIndex = model.nodes[nodeIndex].mesh;
+		if (!animation.Morphs[meshIndex].Positions.empty() && animation.MorphNodes[meshIndex] < 0)
+			animation.MorphNodes[meshIndex] = static_cast<int32_t>(nodeIndex);
+	}
+
+	// Channels that can't be played get left out, the rest of the animation still works without them
+	for (auto& gltfAnimation : model.animations)
+	{
+		for (auto& channel : gltfAnimation.channels)
+		{
+			if (channel.sampler < 0 || channel.sampler >= static_cast<int32_t>(gltfAnimation.samplers.size()) ||
+				channel.target_node < 0 || channel.target_node >= static_cast<int32_t>(model.nodes.size()))
+			{
+				std::cout << "WARNING: [" << gltfAnimation.name << "] Channel found without a sampler or node, it will be ignored.\n";
+				continue;
+			}
+
+			AnimationTrack track;
+			track.NodeIndex = static_cast<uint32_t>(channel.target_node);
+			int32_t outputType = TINYGLTF_TYPE_SCALAR;
+			if (channel.target_path == "translation" || channel.target_path == "scale")
+			{
+				track.Target = channel.target_path == "translation" ? AnimationTrack::Property::Translation : AnimationTrack::Property::Scale;
+				track.Width = 3;
+				outputType = TINYGLTF_TYPE_VEC3;
+			}
+			else if (channel.target_path == "rotation")
+			{
+				track.Target = AnimationTrack::Property::Rotation;
+				track.Width = 4;
+				outputType = TINYGLTF_TYPE_VEC4;
+			}
+			else if (channel.target_path == "weights")
+			{
+				track.Target = AnimationTrack::Property::Weights;
+				track.Width = static_cast<uint32_t>(animation.Nodes[track.NodeIndex].Weights.size());
+			}
+			else
+			{
+				std::cout << "WARNING: [" << gltfAnimation.name << "] Channel found animating '" << channel.target_path <<
+					"' which is not supported. It will be ignored.\n";
+				continue;
+			}
+
+			const tinygltf::AnimationSampler& sampler = gltfAnimation.samplers[channel.sampler];
+			bool isCubic = sampler.interpolation == "CUBICSPLINE";
+			track.IsStep = sampler.interpolation == "STEP";
+			if (track.Width == 0 || animation.Nodes[track.NodeIndex].HasMatrix ||
+				!VerifyAnimationAccessor(model, sampler.input, TINYGLTF_TYPE_SCALAR) ||
+				!VerifyAnimationAccessor(model, sampler.output, outputType))
+			{
+				std::cout << "WARNING: [" << gltfAnimation.name << "] Channel found animating '" << channel.target_path <<
+					"' of a node without morph targets, a node given as a matrix or with keys that aren't floats. It will be ignored.\n";
+				continue;
+			}
+
+			// Cubic splines store an in tangent, the value and an out tangent for every key, only the value is used
+			size_t keyCount = model.accessors[sampler.input].count;
+			size_t elementsPerKey = isCubic ? 3 : 1;
+			size_t floatsPerElement = track.Target == AnimationTrack::Property::Weights ? 1 : track.Width;
+			size_t elementCount = model.accessors[sampler.output].count;
+			if (keyCount == 0 || elementCount * floatsPerElement != keyCount * elementsPerKey * track.Width)
+			{
+				std::cout << "WARNING: [" << gltfAnimation.name << "] Channel found with " << keyCount << " keys but " <<
+					elementCount << " values. It will be ignored.\n";
+				continue;
+			}
+
+			float* times = GetBufferLocation<float>(model, sampler.input);
+			float* values = GetBufferLocation<float>(model, sampler.output);
+			track.Times.assign(times, times + keyCount);
+			track.Values.resize(keyCount * track.Width);
+			for (size_t key = 0; key < keyCount; key++)
+			{
+				const float* value = values + (key * elementsPerKey + (isCubic ? 1 : 0)) * track.Width;
+				std::copy(value, value + track.Width, track.Values.begin() + key * track.Width);
+			}
+
+			animation.Duration = std::max(animation.Duration, track.Times.back());
+			animation.Tracks.push_back(std::move(track));
+		}
+	}
+
+	return animation;
+}
+
+IntersectionResult ComputeHitAttributes(const TriangleRegistry& registry, const Ray& ray, const TriangleHit& hit)
+{
+	IntersectionResult result{};
+	if (!hit.IsHit())
+		return result;
+
+	// Compact layouts get decoded here, only for the three vertices of the closest hit
+	const glm::uvec3& indices = registry.Triangles[hit.Index];
+	Vec3 A = registry.GetPosition(indices.x);
+	Vec3 B = registry.GetPosition(indices.y);
+	Vec3 C = registry.GetPosition(indices.z);
+
+	Vec3 barycentric(Real(1) - hit.U - hit.V, hit.U, hit.V);
+
+	result.IsHit = true;
+	result.T = hit.T;
+	result.TriangleIndex = hit.Index;
+	result.Position = RayEquation(ray, result.T);
+	result.Normal = glm::normalize(glm::cross(B - A, C - A));
+	result.Barycentric = barycentric;
+
+	result.Albedo = glm::vec3(
+		registry.GetColor(indices.x) * static_cast<float>(barycentric.x) +
+		registry.GetColor(indices.y) * static_cast<float>(barycentric.y) +
+		registry.GetColor(indices.z) * static_cast<float>(barycentric.z)
+	);
+
+	result.ShadingNormal = glm::normalize(Vec3(
+		registry.GetNormal(indices.x) * static_cast<float>(barycentric.x) +
+		registry.GetNormal(indices.y) * static_cast<float>(barycentric.y) +
+		registry.GetNormal(indices.z) * static_cast<float>(barycentric.z)
+	));
+
+	result.TexCoord = glm::vec2(0.0f);
+	if (!registry.TexCoords.empty())
+	{
+		result.TexCoord =
+			registry.TexCoords[indices.x] * static_cast<float>(barycentric.x) +
+			registry.TexCoords[indices.y] * static_cast<float>(barycentric.y) +
+			registry.TexCoords[indices.z] * static_cast<float>(barycentric.z);
+	}
+	result.Material = registry.GetMaterial(indices.x);
+
+	return result;
+}
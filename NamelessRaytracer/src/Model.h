@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#include "Ray.h"
+#include "MemoryArena.h"
+#include "TextureCache.h"
+
+// Model loading
+
+// How a registry stores its vertices. After the BVH is built nothing but shading reads the registry, so the
+// compact layouts trade a little decoding per hit for a lot less memory
+enum class VertexLayout : uint32_t
+{
+	Full, // 40 bytes per vertex, float positions, normals and colors
+	Compact, // 24 bytes, float positions, octahedral normals and the file's 16 bit colors
+	Quantized // 18 bytes, like Compact but positions are 16 bits per axis inside the mesh bounds
+};
+
+// Octahedral normal encoding (Cigolle et al. 2014). The sphere gets folded flat onto a square and both square
+// coordinates are stored as 16 bit snorms, which stays within about 0.05 degrees of the original
+uint32_t EncodeNormal(const glm::vec3& normal);
+
+inline glm::vec3 DecodeNormal(uint32_t encoded)
+{
+	glm::vec2 square(
+		static_cast<float>(static_cast<int16_t>(encoded & 0xFFFF)) / 32767.0f,
+		static_cast<float>(static_cast<int16_t>(encoded >> 16)) / 32767.0f
+	);
+	glm::vec3 normal(square.x, square.y, 1.0f - std::abs(square.x) - std::abs(square.y));
+
+	// Unfold the lower half of the sphere
+	float fold = std::max(-normal.z, 0.0f);
+	normal.x += normal.x >= 0.0f ? -fold : fold;
+	normal.y += normal.y >= 0.0f ? -fold : fold;
+	return glm::normalize(normal);
+}
+
+static constexpr uint32_t NoMaterial = 0xFFFFFFFF;
+static constexpr uint32_t NoTexture = 0xFFFFFFFF;
+
+// The part of a glTF material the renderer uses. The albedo is the vertex color times the factor times the texture
+struct Material
+{
+	glm::vec4 BaseColorFactor = glm::vec4(1.0f);
+	uint32_t BaseColorTexture = NoTexture; // Index into the scene's texture cache, sampled with TEXCOORD_0
+};
+
+// The vertices of a mesh's primitives are stored one primitive after the other, so a primitive's material goes
+// with a range of vertices
+struct MaterialRange
+{
+	uint32_t FirstVertex;
+	uint32_t Material;
+};
+
+// Move only, the vertices and triangles either belong to the registry's own arena or to memory whoever made it keeps
+// alive, like a model's arena or a mapped scene cache. Clone() for a copy that doesn't share them
+struct TriangleRegistry
+{
+	TriangleRegistry() = default;
+	TriangleRegistry(TriangleRegistry&&) = default;
+	TriangleRegistry& operator=(TriangleRegistry&&) = default;
+
+	TriangleRegistry(const TriangleRegistry&) = delete;
+	TriangleRegistry& operator=(const TriangleRegistry&) = delete;
+
+	// Vertex Data all in one contiguous buffer for cache locality
+	// I hope that helps
+	MemoryArena Memory; // Only has anything when the registry allocated its own data
+	uint8_t* VertexData = nullptr; // Start of the vertex arrays
+	VertexLayout Layout = VertexLayout::Full;
+
+	// Only the arrays the layout uses are set, the Get functions below work with any of them
+	glm::vec3* Positions = nullptr; // Full and Compact
+	glm::vec3* Normals = nullptr; // Full
+	glm::vec4* Colors = nullptr; // Full
+	uint32_t* EncodedNormals = nullptr; // Compact and Quantized
+	uint16_t* PackedColors = nullptr; // Compact and Quantized, 4 per vertex
+	uint16_t* QuantizedPositions = nullptr; // Quantized, 3 per vertex
+
+	// Quantized positions decode to PositionOrigin + q * PositionScale
+	glm::vec3 PositionOrigin = glm::vec3(0.0f);
+	glm::vec3 PositionScale = glm::vec3(0.0f);
+
+	size_t VertexCount = 0;
+
+	// Fixed once allocated, the BVH build reorders them in place
+	ArenaArray<glm::uvec3> Triangles;
+
+	// Texture coordinates of every vertex in any layout, only allocated for meshes with TEXCOORD_0. Animation
+	// doesn't move them
+	ArenaArray<glm::vec2> TexCoords;
+
+	// Sorted by first vertex, empty when none of the mesh's primitives has a material
+	std::vector<MaterialRange> MaterialRanges;
+
+	// Room for the vertices and triangles in an arena of the registry's own, freed with the registry
+	void Allocate(size_t vertexCount, size_t triangleCount, VertexLayout layout = VertexLayout::Full, bool hasTexCoords = false);
+
+	// Room for the vertices and triangles in arena, which has to outlive the registry. GetArenaSize() of them has to
+	// be left in it
+	void Allocate(MemoryArena& arena, size_t vertexCount, size_t triangleCount, VertexLayout layout, bool hasTexCoords = false);
+	static size_t GetArenaSize(size_t vertexCount, size_t triangleCount, VertexLayout layout, bool hasTexCoords = false);
+
+	// Points the arrays into vertex data laid out the way Allocate lays it out. Doesn't take ownership
+	void SetBuffer(uint8_t* data, size_t vertexCount, VertexLayout layout);
+
+	static size_t GetBufferSize(size_t vertexCount, VertexLayout layout);
+	size_t GetBufferSize() const { return GetBufferSize(VertexCount, Layout); }
+
+	// Same vertices and triangles in an arena of the copy's own
+	TriangleRegistry Clone() const;
+
+	// Quantized registries need the bounds of every position before any vertex gets set
+	void SetPositionBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+	// Encodes a vertex into whatever the layout is
+	void SetVertex(size_t index, const glm::vec3& position, const glm::vec3& normal, const glm::vec4& color);
+
+	glm::vec3 GetPosition(size_t index) const
+	{
+		if (Layout == VertexLayout::Quantized)
+		{
+			const uint16_t* quantized = QuantizedPositions + index * 3;
+			return PositionOrigin + glm::vec3(quantized[0], quantized[1], quantized[2]) * PositionScale;
+		}
+		return Positions[index];
+	}
+
+	glm::vec3 GetNormal(size_t index) const
+	{
+		return Layout == VertexLayout::Full ? Normals[index] : DecodeNormal(EncodedNormals[index]);
+	}
+
+	glm::vec4 GetColor(size_t index) const
+	{
+		if (Layout == VertexLayout::Full)
+			return Colors[index];
+
+		const uint16_t* color = PackedColors + index * 4;
+		return glm::vec4(color[0], color[1], color[2], color[3]) / 65535.0f;
+	}
+
+	// Material of the primitive a vertex came from, NoMaterial if it has none
+	uint32_t GetMaterial(uint32_t vertexIndex) const
+	{
+		auto range = std::upper_bound(MaterialRanges.begin(), MaterialRanges.end(), vertexIndex,
+			[](uint32_t vertex, const MaterialRange& other) { return vertex < other.FirstVertex; });
+		return range == MaterialRanges.begin() ? NoMaterial : (range - 1)->Material;
+	}
+};
+
+// One placement of a mesh in the world, from a glTF node that references it
+struct MeshInstance
+{
+	glm::mat4 ObjectToWorld;
+	uint32_t MeshIndex;
+};
+
+// Every mesh is loaded once no matter how many nodes use it, the instances place the copies
+struct ModelData
+{
+	MemoryArena Memory; // Every mesh's vertices and triangles, sized before the first one gets loaded
+	std::vector<TriangleRegistry> Meshes;
+	std::vector<MeshInstance> Instances;
+
+	std::vector<Material> Materials;
+	std::vector<TextureSource> Textures; // One per base color texture, pointing into TextureData
+	std::vector<uint8_t> TextureData; // The encoded images, they only get decoded once a ray lands on them
+};
+
+// Meshes come back in the same order as in the file. Returns no meshes if anything in the file isn't supported
+ModelData LoadModel(const std::string& path, VertexLayout layout = VertexLayout::Full);
+
+// Animation
+// glTF keyframes for node translation, rotation and scale and for morph target weights, with everything needed to
+// pose the model at any time. Skins aren't supported, skinned meshes stay in their bind pose
+
+// Keyframes of one property of one node
+struct AnimationTrack
+{
+	enum class Property : uint32_t { Translation, Rotation, Scale, Weights };
+
+	uint32_t NodeIndex;
+	Property Target;
+	bool IsStep; // Holds every key until the next one. Cubic splines get interpolated linearly between their keys
+	uint32_t Width; // Floats per key, 3 for translation and scale, 4 for rotation (xyzw) and one per morph target
+	std::vector<float> Times;
+	std::vector<float> Values;
+};
+
+// A node's pose when nothing animates it
+struct AnimationNode
+{
+	int32_t Parent = -1;
+	bool HasMatrix = false; // glTF doesn't allow animating nodes given as a matrix
+	glm::dmat4 Matrix = glm::dmat4(1.0);
+	glm::dvec3 Translation = glm::dvec3(0.0);
+	glm::dquat Rotation = glm::dquat(1.0, 0.0, 0.0, 0.0);
+	glm::dvec3 Scale = glm::dvec3(1.0);
+	std::vector<float> Weights; // Morph target weights, the node's own or its mesh's defaults
+};
+
+// Rest pose and morph target offsets of a mesh, per vertex in the same order as its registry
+struct MorphTargets
+{
+	std::vector<glm::vec3> Positions;
+	std::vector<glm::vec3> Normals;
+	std::vector<std::vector<glm::vec3>> PositionOffsets; // One array per target
+	std::vector<std::vector<glm::vec3>> NormalOffsets; // Empty for targets without normals
+};
+
+struct ModelAnimation
+{
+	std::vector<AnimationNode> Nodes;
+	std::vector<uint32_t> InstanceNodes; // The node every instance LoadModel returns came from, in the same order
+	std::vector<AnimationTrack> Tracks;
+	std::vector<MorphTargets> Morphs; // Per mesh, empty for meshes without targets
+	std::vector<int32_t> MorphNodes; // Per mesh, the node whose weights pose it. Registries are shared, so a mesh
+	                                 // used by several nodes follows the first one. -1 for meshes without targets
+	float Duration = 0.0f; // Time of the last key in seconds
+
+	bool IsAnimated() const { return !Tracks.empty(); }
+};
+
+// Every animation in the file, played together. Comes back without tracks if the file has none or can't be loaded.
+// Channels that can't be played get left out with a warning
+ModelAnimation LoadAnimation(const std::string& path);
+
+// Fills in position, normals, barycentrics and interpolated vertex attributes for a hit. Meant to be called
+// once per ray on the closest hit only. The normals are in the mesh's object space
+IntersectionResult ComputeHitAttributes(const TriangleRegistry& registry, const Ray& ray, const TriangleHit& hit);
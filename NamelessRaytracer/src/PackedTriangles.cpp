@@ -0,0 +1,344 @@
+#include "PackedTriangles.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(_M_X64) || defined(__x86_64__)
+	#define NR_X64
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#endif
+
+// MSVC lets any function use AVX intrinsics, GCC and Clang need the function marked
+#if defined(_MSC_VER) && !defined(__clang__)
+	#define NR_TARGET_AVX2
+#else
+	#define NR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+size_t PackedTriangles::GetPaddedCount(uint32_t count)
+{
+	// Enough padding that a full width load starting at the last triangle stays in bounds
+	return ((static_cast<size_t>(count) + MaxWidth - 1) / MaxWidth + 1) * MaxWidth;
+}
+
+void PackedTriangles::Build(const TriangleRegistry& registry)
+{
+	m_Count = static_cast<uint32_t>(registry.Triangles.size());
+
+	size_t paddedCount = GetPaddedCount(m_Count);
+	size_t floatCount = paddedCount * 9;
+	m_Buffer.reset(static_cast<float*>(::operator new[](floatCount * sizeof(float), std::align_val_t(64))));
+	std::fill(m_Buffer.get(), m_Buffer.get() + floatCount, 0.0f);
+
+	float* components[9];
+	for (uint32_t i = 0; i < 9; i++)
+		components[i] = m_Buffer.get() + paddedCount * i;
+
+	for (uint32_t i = 0; i < m_Count; i++)
+	{
+		const glm::uvec3& indices = registry.Triangles[i];
+		// Quantized positions decode the same way every time, so shared vertices still match bit for bit
+		glm::vec3 a = registry.GetPosition(indices.x);
+		glm::vec3 b = registry.GetPosition(indices.y);
+		glm::vec3 c = registry.GetPosition(indices.z);
+
+		for (int32_t axis = 0; axis < 3; axis++)
+		{
+			components[axis][i] = a[axis];
+			components[3 + axis][i] = b[axis];
+			components[6 + axis][i] = c[axis];
+		}
+	}
+
+	SetComponents(m_Buffer.get());
+}
+
+void PackedTriangles::Attach(const float* data, uint32_t count)
+{
+	m_Buffer.reset();
+	m_Count = count;
+	SetComponents(data);
+}
+
+void PackedTriangles::SetComponents(const float* data)
+{
+	size_t paddedCount = GetPaddedCount(m_Count);
+	for (int32_t axis = 0; axis < 3; axis++)
+	{
+		VertexA[axis] = data + paddedCount * axis;
+		VertexB[axis] = data + paddedCount * (3 + axis);
+		VertexC[axis] = data + paddedCount * (6 + axis);
+	}
+}
+
+// Scalar fallback, same math as the wide kernels one triangle at a time
+
+template<typename Scalar>
+static void IntersectPackedTriangle(const PackedTriangles& triangles, const WatertightRay<Scalar>& ray, uint32_t index, TriangleHitT<Scalar>& hit)
+{
+	Scalar a[3], b[3], c[3];
+	for (int32_t axis = 0; axis < 3; axis++)
+	{
+		a[axis] = static_cast<Scalar>(triangles.VertexA[axis][index]);
+		b[axis] = static_cast<Scalar>(triangles.VertexB[axis][index]);
+		c[axis] = static_cast<Scalar>(triangles.VertexC[axis][index]);
+	}
+
+	IntersectTriangleWatertight(ray, a, b, c, index, hit);
+}
+
+template<typename Scalar>
+void IntersectTrianglesScalar(const PackedTriangles& triangles, const WatertightRay<Scalar>& ray, uint32_t first, uint32_t count, TriangleHitT<Scalar>& hit)
+{
+	for (uint32_t i = first; i < first + count; i++)
+		IntersectPackedTriangle(triangles, ray, i, hit);
+}
+
+template void IntersectTrianglesScalar<float>(const PackedTriangles&, const WatertightRay<float>&, uint32_t, uint32_t, TriangleHitT<float>&);
+template void IntersectTrianglesScalar<double>(const PackedTriangles&, const WatertightRay<double>&, uint32_t, uint32_t, TriangleHitT<double>&);
+
+#ifdef NR_X64
+
+static inline uint32_t CountTrailingZeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return static_cast<uint32_t>(index);
+#else
+	return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+}
+
+// The wide kernels run the same watertight test as IntersectTriangleWatertight on several triangles at once.
+// The axis permutation is picked per ray, so it only decides which component arrays get loaded. Lanes with an edge
+// function of exactly 0 need the double precision redo, they're rare enough to go through the scalar test instead.
+// That happens before the range test so the wide lanes compare against whatever hit it found
+
+// 4 wide SSE kernel. Only needs SSE2 which every x64 CPU has
+
+void IntersectTrianglesSSE(const PackedTriangles& triangles, const PackedRay& ray, uint32_t first, uint32_t count, TriangleHitT<float>& hit)
+{
+	const float* aX = triangles.VertexA[ray.Kx]; const float* aY = triangles.VertexA[ray.Ky]; const float* aZ = triangles.VertexA[ray.Kz];
+	const float* bX = triangles.VertexB[ray.Kx]; const float* bY = triangles.VertexB[ray.Ky]; const float* bZ = triangles.VertexB[ray.Kz];
+	const float* cX = triangles.VertexC[ray.Kx]; const float* cY = triangles.VertexC[ray.Ky]; const float* cZ = triangles.VertexC[ray.Kz];
+
+	const __m128 originX = _mm_set1_ps(ray.Origin[ray.Kx]), originY = _mm_set1_ps(ray.Origin[ray.Ky]), originZ = _mm_set1_ps(ray.Origin[ray.Kz]);
+	const __m128 shearX = _mm_set1_ps(ray.Sx), shearY = _mm_set1_ps(ray.Sy), shearZ = _mm_set1_ps(ray.Sz);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	const __m128 minDistance = _mm_set1_ps(static_cast<float>(MinHitDistance));
+	const __m128 infinity = _mm_set1_ps(std::numeric_limits<float>::infinity());
+	const __m128 laneIndex = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+
+	uint32_t end = first + count;
+	for (uint32_t i = first; i < end; i += 4)
+	{
+		// Vertices relative to the origin and sheared into ray space
+		__m128 az = _mm_sub_ps(_mm_loadu_ps(aZ + i), originZ);
+		__m128 bz = _mm_sub_ps(_mm_loadu_ps(bZ + i), originZ);
+		__m128 cz = _mm_sub_ps(_mm_loadu_ps(cZ + i), originZ);
+		__m128 ax = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(aX + i), originX), _mm_mul_ps(shearX, az));
+		__m128 ay = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(aY + i), originY), _mm_mul_ps(shearY, az));
+		__m128 bx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(bX + i), originX), _mm_mul_ps(shearX, bz));
+		__m128 by = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(bY + i), originY), _mm_mul_ps(shearY, bz));
+		__m128 cx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(cX + i), originX), _mm_mul_ps(shearX, cz));
+		__m128 cy = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(cY + i), originY), _mm_mul_ps(shearY, cz));
+
+		// Edge functions
+		__m128 u = _mm_sub_ps(_mm_mul_ps(cx, by), _mm_mul_ps(cy, bx));
+		__m128 v = _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx));
+		__m128 w = _mm_sub_ps(_mm_mul_ps(bx, ay), _mm_mul_ps(by, ax));
+
+		__m128 isValid = _mm_cmplt_ps(laneIndex, _mm_set1_ps(static_cast<float>(end - i)));
+		__m128 isOnEdge = _mm_and_ps(isValid, _mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(u, zero), _mm_cmpeq_ps(v, zero)), _mm_cmpeq_ps(w, zero)));
+		for (uint32_t lanes = static_cast<uint32_t>(_mm_movemask_ps(isOnEdge)); lanes != 0; lanes &= lanes - 1)
+			IntersectPackedTriangle(triangles, ray, i + CountTrailingZeros(lanes), hit);
+
+		__m128 anyNegative = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmplt_ps(v, zero)), _mm_cmplt_ps(w, zero));
+		__m128 anyPositive = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(u, zero), _mm_cmpgt_ps(v, zero)), _mm_cmpgt_ps(w, zero));
+
+		__m128 det = _mm_add_ps(_mm_add_ps(u, v), w);
+		__m128 t = _mm_mul_ps(shearZ, _mm_add_ps(_mm_add_ps(_mm_mul_ps(u, az), _mm_mul_ps(v, bz)), _mm_mul_ps(w, cz)));
+
+		// Flip everything to a positive determinant so the range test works for both windings
+		__m128 detSign = _mm_and_ps(det, signMask);
+		__m128 absDet = _mm_xor_ps(det, detSign);
+		t = _mm_xor_ps(t, detSign);
+
+		__m128 mask = _mm_andnot_ps(_mm_and_ps(anyNegative, anyPositive), _mm_cmpneq_ps(det, zero));
+		mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, _mm_mul_ps(minDistance, absDet)));
+		mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_mul_ps(_mm_set1_ps(hit.T), absDet)));
+		mask = _mm_and_ps(mask, _mm_andnot_ps(isOnEdge, isValid));
+		if (_mm_movemask_ps(mask) == 0)
+			continue;
+
+		__m128 inverseDet = _mm_div_ps(one, absDet);
+		t = _mm_mul_ps(t, inverseDet);
+
+		// Closest lane wins
+		__m128 maskedT = _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, infinity));
+		__m128 minT = _mm_min_ps(maskedT, _mm_shuffle_ps(maskedT, maskedT, _MM_SHUFFLE(2, 3, 0, 1)));
+		minT = _mm_min_ps(minT, _mm_shuffle_ps(minT, minT, _MM_SHUFFLE(1, 0, 3, 2)));
+		uint32_t lane = CountTrailingZeros(static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpeq_ps(maskedT, minT))));
+
+		alignas(16) float ts[4], vs[4], ws[4];
+		_mm_store_ps(ts, t);
+		_mm_store_ps(vs, _mm_mul_ps(_mm_xor_ps(v, detSign), inverseDet));
+		_mm_store_ps(ws, _mm_mul_ps(_mm_xor_ps(w, detSign), inverseDet));
+		hit = { ts[lane], vs[lane], ws[lane], i + lane };
+	}
+}
+
+// 8 wide AVX2 kernel
+
+NR_TARGET_AVX2
+void IntersectTrianglesAVX2(const PackedTriangles& triangles, const PackedRay& ray, uint32_t first, uint32_t count, TriangleHitT<float>& hit)
+{
+	const float* aX = triangles.VertexA[ray.Kx]; const float* aY = triangles.VertexA[ray.Ky]; const float* aZ = triangles.VertexA[ray.Kz];
+	const float* bX = triangles.VertexB[ray.Kx]; const float* bY = triangles.VertexB[ray.Ky]; const float* bZ = triangles.VertexB[ray.Kz];
+	const float* cX = triangles.VertexC[ray.Kx]; const float* cY = triangles.VertexC[ray.Ky]; const float* cZ = triangles.VertexC[ray.Kz];
+
+	const __m256 originX = _mm256_set1_ps(ray.Origin[ray.Kx]), originY = _mm256_set1_ps(ray.Origin[ray.Ky]), originZ = _mm256_set1_ps(ray.Origin[ray.Kz]);
+	const __m256 shearX = _mm256_set1_ps(ray.Sx), shearY = _mm256_set1_ps(ray.Sy), shearZ = _mm256_set1_ps(ray.Sz);
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	const __m256 minDistance = _mm256_set1_ps(static_cast<float>(MinHitDistance));
+	const __m256 infinity = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+	const __m256 laneIndex = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+
+	uint32_t end = first + count;
+	for (uint32_t i = first; i < end; i += 8)
+	{
+		// Vertices relative to the origin and sheared into ray space
+		__m256 az = _mm256_sub_ps(_mm256_loadu_ps(aZ + i), originZ);
+		__m256 bz = _mm256_sub_ps(_mm256_loadu_ps(bZ + i), originZ);
+		__m256 cz = _mm256_sub_ps(_mm256_loadu_ps(cZ + i), originZ);
+		__m256 ax = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(aX + i), originX), _mm256_mul_ps(shearX, az));
+		__m256 ay = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(aY + i), originY), _mm256_mul_ps(shearY, az));
+		__m256 bx = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(bX + i), originX), _mm256_mul_ps(shearX, bz));
+		__m256 by = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(bY + i), originY), _mm256_mul_ps(shearY, bz));
+		__m256 cx = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(cX + i), originX), _mm256_mul_ps(shearX, cz));
+		__m256 cy = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(cY + i), originY), _mm256_mul_ps(shearY, cz));
+
+		// Edge functions
+		__m256 u = _mm256_sub_ps(_mm256_mul_ps(cx, by), _mm256_mul_ps(cy, bx));
+		__m256 v = _mm256_sub_ps(_mm256_mul_ps(ax, cy), _mm256_mul_ps(ay, cx));
+		__m256 w = _mm256_sub_ps(_mm256_mul_ps(bx, ay), _mm256_mul_ps(by, ax));
+
+		__m256 isValid = _mm256_cmp_ps(laneIndex, _mm256_set1_ps(static_cast<float>(end - i)), _CMP_LT_OQ);
+		__m256 isOnEdge = _mm256_and_ps(isValid, _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_EQ_OQ),
+			_mm256_cmp_ps(v, zero, _CMP_EQ_OQ)), _mm256_cmp_ps(w, zero, _CMP_EQ_OQ)));
+		for (uint32_t lanes = static_cast<uint32_t>(_mm256_movemask_ps(isOnEdge)); lanes != 0; lanes &= lanes - 1)
+			IntersectPackedTriangle(triangles, ray, i + CountTrailingZeros(lanes), hit);
+
+		__m256 anyNegative = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_LT_OQ), _mm256_cmp_ps(v, zero, _CMP_LT_OQ)), _mm256_cmp_ps(w, zero, _CMP_LT_OQ));
+		__m256 anyPositive = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_GT_OQ), _mm256_cmp_ps(v, zero, _CMP_GT_OQ)), _mm256_cmp_ps(w, zero, _CMP_GT_OQ));
+
+		__m256 det = _mm256_add_ps(_mm256_add_ps(u, v), w);
+		__m256 t = _mm256_mul_ps(shearZ, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(u, az), _mm256_mul_ps(v, bz)), _mm256_mul_ps(w, cz)));
+
+		// Flip everything to a positive determinant so the range test works for both windings
+		__m256 detSign = _mm256_and_ps(det, signMask);
+		__m256 absDet = _mm256_xor_ps(det, detSign);
+		t = _mm256_xor_ps(t, detSign);
+
+		__m256 mask = _mm256_andnot_ps(_mm256_and_ps(anyNegative, anyPositive), _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_mul_ps(minDistance, absDet), _CMP_GT_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_mul_ps(_mm256_set1_ps(hit.T), absDet), _CMP_LT_OQ));
+		mask = _mm256_and_ps(mask, _mm256_andnot_ps(isOnEdge, isValid));
+		if (_mm256_movemask_ps(mask) == 0)
+			continue;
+
+		__m256 inverseDet = _mm256_div_ps(one, absDet);
+		t = _mm256_mul_ps(t, inverseDet);
+
+		// Closest lane wins
+		__m256 maskedT = _mm256_blendv_ps(infinity, t, mask);
+		__m256 minT = _mm256_min_ps(maskedT, _mm256_permute_ps(maskedT, _MM_SHUFFLE(2, 3, 0, 1)));
+		minT = _mm256_min_ps(minT, _mm256_permute_ps(minT, _MM_SHUFFLE(1, 0, 3, 2)));
+		minT = _mm256_min_ps(minT, _mm256_permute2f128_ps(minT, minT, 0x01));
+		uint32_t lane = CountTrailingZeros(static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(maskedT, minT, _CMP_EQ_OQ))));
+
+		alignas(32) float ts[8], vs[8], ws[8];
+		_mm256_store_ps(ts, t);
+		_mm256_store_ps(vs, _mm256_mul_ps(_mm256_xor_ps(v, detSign), inverseDet));
+		_mm256_store_ps(ws, _mm256_mul_ps(_mm256_xor_ps(w, detSign), inverseDet));
+		hit = { ts[lane], vs[lane], ws[lane], i + lane };
+	}
+}
+
+static bool CPUSupportsAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// The OS also has to save the upper halves of the YMM registers
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#else
+
+// No wide kernels off x64, everything goes through the scalar path
+void IntersectTrianglesSSE(const PackedTriangles& triangles, const PackedRay& ray, uint32_t first, uint32_t count, TriangleHitT<float>& hit)
+{
+	IntersectTrianglesScalar(triangles, ray, first, count, hit);
+}
+
+void IntersectTrianglesAVX2(const PackedTriangles& triangles, const PackedRay& ray, uint32_t first, uint32_t count, TriangleHitT<float>& hit)
+{
+	IntersectTrianglesScalar(triangles, ray, first, count, hit);
+}
+
+#endif
+
+struct KernelChoice
+{
+	TriangleKernel Kernel;
+	const char* Name;
+};
+
+static KernelChoice SelectTriangleKernel()
+{
+#ifdef NR_X64
+	if (CPUSupportsAVX2())
+		return { IntersectTrianglesAVX2, "AVX2" };
+	return { IntersectTrianglesSSE, "SSE" };
+#else
+	return { IntersectTrianglesScalar<float>, "Scalar" };
+#endif
+}
+
+static const KernelChoice& GetKernelChoice()
+{
+	static const KernelChoice choice = SelectTriangleKernel();
+	return choice;
+}
+
+TriangleKernel GetTriangleKernel()
+{
+	return GetKernelChoice().Kernel;
+}
+
+const char* GetTriangleKernelName()
+{
+	return GetKernelChoice().Name;
+}
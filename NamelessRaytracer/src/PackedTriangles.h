@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <new>
+
+#include "glm/glm.hpp"
+
+#include "Ray.h"
+#include "Model.h"
+
+// SIMD triangle intersection
+
+// Ray setup for the float kernels, done once per traversal instead of once per triangle
+using PackedRay = WatertightRay<float>;
+
+// All three vertices of every triangle with each component in its own 64 byte aligned array, in the same
+// order as registry.Triangles. The vertices are stored instead of edges because the watertight test needs
+// shared vertices to be bit-identical between neighbouring triangles. The arrays are padded with degenerate
+// triangles up to a multiple of the widest kernel so a leaf near the end can always load full registers.
+class PackedTriangles
+{
+public:
+	static constexpr uint32_t MaxWidth = 8;
+
+	void Build(const TriangleRegistry& registry);
+
+	// Uses data laid out like GetData() without copying it, like a mapped scene cache. The memory has to
+	// stay valid and 64 byte aligned for as long as this is used
+	void Attach(const float* data, uint32_t count);
+
+	uint32_t GetCount() const { return m_Count; }
+
+	// All nine component arrays back to back, each GetPaddedCount() floats long
+	const float* GetData() const { return VertexA[0]; }
+	size_t GetDataSize() const { return GetPaddedCount(m_Count) * 9 * sizeof(float); }
+	static size_t GetPaddedCount(uint32_t count);
+
+	// Component arrays
+	const float* VertexA[3] = {};
+	const float* VertexB[3] = {};
+	const float* VertexC[3] = {};
+
+private:
+	void SetComponents(const float* data);
+
+	struct AlignedDelete
+	{
+		void operator()(float* data) const { ::operator delete[](data, std::align_val_t(64)); }
+	};
+
+	std::unique_ptr<float[], AlignedDelete> m_Buffer;
+	uint32_t m_Count = 0;
+};
+
+// Tests a ray against triangles [first, first + count) and replaces hit if anything closer than hit.T is found
+using TriangleKernel = void(*)(const PackedTriangles& triangles, const PackedRay& ray,
+	uint32_t first, uint32_t count, TriangleHitT<float>& hit);
+
+// The scalar kernel also comes in double for the validation build
+template<typename Scalar>
+void IntersectTrianglesScalar(const PackedTriangles& triangles, const WatertightRay<Scalar>& ray, uint32_t first, uint32_t count, TriangleHitT<Scalar>& hit);
+
+void IntersectTrianglesSSE(const PackedTriangles& triangles, const PackedRay& ray, uint32_t first, uint32_t count, TriangleHitT<float>& hit);
+void IntersectTrianglesAVX2(const PackedTriangles& triangles, const PackedRay& ray, uint32_t first, uint32_t count, TriangleHitT<float>& hit);
+
+// Picks the widest kernel the CPU supports. Checked once and cached
+TriangleKernel GetTriangleKernel();
+const char* GetTriangleKernelName();
@@ -0,0 +1,305 @@
+#include "ProgressiveRenderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+// Same quantization as QuantizeColors with the default tone map, packed as RGBA8 for the texture upload
+static uint32_t PackColor(const glm::vec3& color)
+{
+	uint32_t r = static_cast<uint32_t>(std::clamp(color.x, 0.0f, 0.999f) * 255.0f);
+	uint32_t g = static_cast<uint32_t>(std::clamp(color.y, 0.0f, 0.999f) * 255.0f);
+	uint32_t b = static_cast<uint32_t>(std::clamp(color.z, 0.0f, 0.999f) * 255.0f);
+	return r | (g << 8) | (b << 16) | (0xFFu << 24);
+}
+
+// Reprojected pixels never bring more samples than this, so the small errors from taking the nearest old pixel get
+// averaged away by new samples instead of sticking around
+static constexpr uint32_t MaxHistorySamples = 32;
+
+// How far the distance to a reprojected hit can be off, relative to the distance, before the pixel counts as
+// seeing something else
+static constexpr float HistoryDepthTolerance = 0.01f;
+
+static PixelEstimate ClampHistory(PixelEstimate estimate)
+{
+	if (estimate.SampleCount <= MaxHistorySamples)
+		return estimate;
+
+	// Same mean and about the same variance of the mean, as if the extra samples had never been taken
+	float scale = static_cast<float>(MaxHistorySamples) / static_cast<float>(estimate.SampleCount);
+	estimate.ColorSum *= scale;
+	estimate.LuminanceM2 *= scale;
+	estimate.SampleCount = MaxHistorySamples;
+	return estimate;
+}
+
+ProgressiveRenderer::ProgressiveRenderer(const Scene& scene, const Camera& camera, const RenderSettings& settings, uint32_t threadCount)
+	: m_Scene(scene), m_Settings(settings), m_Pool(threadCount), m_HistoryCamera(camera), m_Camera(camera), m_PendingCamera(camera)
+{
+	size_t pixelCount = static_cast<size_t>(settings.Width) * static_cast<size_t>(settings.Height);
+	m_Accumulation.resize(pixelCount);
+	m_NextAccumulation.resize(pixelCount);
+	m_Surfaces.resize(pixelCount);
+	m_NextSurfaces.resize(pixelCount);
+	m_BackBuffer.resize(pixelCount);
+	m_FrontBuffer.resize(pixelCount, PackColor(glm::vec3(0.0f)));
+
+	m_Thread = std::thread(&ProgressiveRenderer::RenderLoop, this);
+}
+
+ProgressiveRenderer::~ProgressiveRenderer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_CameraMutex);
+		m_Stopping = true;
+		m_Generation++; // Makes the pass in flight bail out
+	}
+	m_CameraChanged.notify_one();
+	m_Thread.join();
+}
+
+void ProgressiveRenderer::SetCamera(const Camera& camera)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_CameraMutex);
+		m_PendingCamera = camera;
+		m_Generation++;
+	}
+	m_CameraChanged.notify_one();
+}
+
+bool ProgressiveRenderer::CopyLatestFrame(uint32_t* pixels, uint64_t& frameVersion)
+{
+	std::lock_guard<std::mutex> lock(m_FrameMutex);
+	if (m_FrameVersion == frameVersion)
+		return false;
+
+	std::memcpy(pixels, m_FrontBuffer.data(), m_FrontBuffer.size() * sizeof(uint32_t));
+	frameVersion = m_FrameVersion;
+	return true;
+}
+
+uint64_t ProgressiveRenderer::GetFrameVersion()
+{
+	std::lock_guard<std::mutex> lock(m_FrameMutex);
+	return m_FrameVersion;
+}
+
+void ProgressiveRenderer::RenderLoop()
+{
+	uint32_t generation = m_Generation.load() - 1; // Forces the camera to be picked up on the first pass
+	uint32_t sampleIndex = 0;
+	uint32_t maxSamples = static_cast<uint32_t>(std::max(m_Settings.SamplesPerPixel, 1));
+	bool isConverged = false;
+
+	while (true)
+	{
+		{
+			// Sleeps once the image has all its samples or every pixel has converged, until the camera moves again
+			std::unique_lock<std::mutex> lock(m_CameraMutex);
+			m_CameraChanged.wait(lock, [&] {
+				return m_Stopping || m_Generation.load() != generation || (sampleIndex < maxSamples && !isConverged);
+			});
+			if (m_Stopping)
+				return;
+
+			if (m_Generation.load() != generation)
+			{
+				generation = m_Generation.load();
+				m_Camera = m_PendingCamera;
+				sampleIndex = 0;
+				isConverged = false;
+			}
+		}
+
+		if (sampleIndex == 0 && !ReprojectHistory(generation))
+			continue;
+		if (m_Settings.ErrorThreshold > 0.0f)
+			FindConvergedPixels(m_Settings, m_Accumulation, m_Converged);
+
+		auto start = std::chrono::steady_clock::now();
+		uint32_t fewestWaitingSamples = UINT32_MAX;
+		uint32_t activePixels = RenderPass(sampleIndex, generation, fewestWaitingSamples);
+
+		// A camera change mid pass leaves some pixels a sample ahead, which is still the right camera for them
+		if (m_Generation.load() != generation)
+			continue;
+
+		// A pass with nothing to do only means every pixel is done if none of them are waiting either, otherwise it
+		// skips ahead to where the first waiting pixels join in
+		isConverged = activePixels == 0 && fewestWaitingSamples == UINT32_MAX;
+		sampleIndex = activePixels == 0 && !isConverged ? fewestWaitingSamples : sampleIndex + 1;
+		{
+			std::lock_guard<std::mutex> lock(m_FrameMutex);
+			std::swap(m_FrontBuffer, m_BackBuffer);
+			m_FrameVersion++;
+		}
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		m_LastPassTime.store(elapsed.count(), std::memory_order_relaxed);
+		m_PublishedSamples.store(sampleIndex, std::memory_order_relaxed);
+		m_ActivePixels.store(activePixels, std::memory_order_relaxed);
+	}
+}
+
+bool ProgressiveRenderer::ReprojectHistory(uint32_t generation)
+{
+	// A different lens or focus blurs everything differently. With a lens only pixels sharp in both views can keep
+	// their samples, the center ray says nothing about what the rest of a blurry pixel's samples saw. A pinhole's
+	// misses shade black from any direction so they can take over any old miss
+	bool hasLens = m_Camera.LensRadius > Real(0);
+	bool canReuse = m_HasHistory && m_UseReprojection.load(std::memory_order_relaxed) && m_HistoryCamera.LensRadius == m_Camera.LensRadius &&
+		(!hasLens || m_HistoryCamera.FocusDistance == m_Camera.FocusDistance);
+	std::atomic<uint32_t> reusedPixels = 0;
+	int32_t width = m_Settings.Width;
+	int32_t height = m_Settings.Height;
+	for (int32_t bandY = 0; bandY < height; bandY += m_Settings.TileSize)
+	{
+		m_Pool.Submit([this, generation, canReuse, hasLens, &reusedPixels, width, height, bandY](uint32_t) {
+			if (m_Generation.load(std::memory_order_relaxed) != generation)
+				return;
+
+			uint32_t bandReused = 0;
+			int32_t endY = std::min(bandY + m_Settings.TileSize, height);
+			for (int32_t y = bandY; y < endY; y++)
+			{
+				for (int32_t x = 0; x < width; x++)
+				{
+					size_t i = static_cast<size_t>(x) + static_cast<size_t>(y) * static_cast<size_t>(width);
+					Ray ray = m_Camera.GetPinholeRay(
+						static_cast<Real>((static_cast<double>(x) + 0.5) / static_cast<double>(width - 1)),
+						static_cast<Real>((static_cast<double>(y) + 0.5) / static_cast<double>(height - 1)));
+					TriangleHit hit = m_Scene.Accelerator.Intersect(ray);
+
+					PixelSurface& surface = m_NextSurfaces[i];
+					surface.Id = hit.IsHit() ? (static_cast<uint64_t>(hit.InstanceIndex) << 32) | hit.Index : MissId;
+					surface.Distance = hit.IsHit() ? static_cast<float>(hit.T * glm::length(ray.Direction)) : 0.0f;
+					m_NextAccumulation[i] = PixelEstimate();
+					if (!canReuse)
+						continue;
+
+					// The old pixel whose center the hit is closest to has to have seen the same triangle at the
+					// same distance, anything else means the surface was hidden or off screen before
+					size_t previous = i;
+					if (!hit.IsHit() && hasLens)
+						continue;
+					if (hit.IsHit())
+					{
+						Vec3 position = RayEquation(ray, hit.T);
+						Real s, t;
+						if (!m_HistoryCamera.Project(position, s, t))
+							continue;
+						if (hasLens && std::max(m_Camera.GetBlurWidth(position), m_HistoryCamera.GetBlurWidth(position)) *
+							static_cast<Real>(width - 1) > Real(1))
+							continue;
+
+						double previousX = std::floor(static_cast<double>(s) * static_cast<double>(width - 1));
+						double previousY = std::floor(static_cast<double>(t) * static_cast<double>(height - 1));
+						if (previousX < 0.0 || previousY < 0.0 || previousX >= width || previousY >= height)
+							continue;
+
+						previous = static_cast<size_t>(previousX) + static_cast<size_t>(previousY) * static_cast<size_t>(width);
+						float distance = static_cast<float>(glm::length(position - m_HistoryCamera.Origin));
+						if (std::abs(distance - m_Surfaces[previous].Distance) > HistoryDepthTolerance * distance)
+							continue;
+					}
+
+					if (m_Surfaces[previous].Id != surface.Id)
+						continue;
+
+					m_NextAccumulation[i] = ClampHistory(m_Accumulation[previous]);
+					bandReused++;
+				}
+			}
+			reusedPixels.fetch_add(bandReused, std::memory_order_relaxed);
+		});
+	}
+	m_Pool.Wait();
+
+	if (m_Generation.load() != generation)
+		return false;
+
+	std::swap(m_Accumulation, m_NextAccumulation);
+	std::swap(m_Surfaces, m_NextSurfaces);
+	m_HistoryCamera = m_Camera;
+	m_HasHistory = true;
+	m_ReusedPixels.store(reusedPixels.load(), std::memory_order_relaxed);
+	return true;
+}
+
+uint32_t ProgressiveRenderer::RenderPass(uint32_t sampleIndex, uint32_t generation, uint32_t& fewestWaitingSamples)
+{
+	std::atomic<uint32_t> activePixels = 0;
+	std::atomic<uint32_t> fewestWaiting = fewestWaitingSamples;
+
+	for (int32_t tileY = 0; tileY < m_Settings.Height; tileY += m_Settings.TileSize)
+	{
+		for (int32_t tileX = 0; tileX < m_Settings.Width; tileX += m_Settings.TileSize)
+		{
+			m_Pool.Submit([this, sampleIndex, generation, &activePixels, &fewestWaiting, tileX, tileY](uint32_t) {
+				// Tiles left over from a stale camera are skipped so the restart shows up quickly
+				if (m_Generation.load(std::memory_order_relaxed) != generation)
+					return;
+				TileCounter tileCounter;
+
+				// Pixels still refining go out a block at a time as packets
+				PixelSample samples[RayPacket::MaxSize];
+				glm::vec3 colors[RayPacket::MaxSize];
+				uint32_t tileActivePixels = 0;
+				uint32_t tileFewestWaiting = UINT32_MAX;
+				int32_t endX = std::min(tileX + m_Settings.TileSize, m_Settings.Width);
+				int32_t endY = std::min(tileY + m_Settings.TileSize, m_Settings.Height);
+				for (int32_t blockY = tileY; blockY < endY; blockY += PacketBlockSize)
+				{
+					for (int32_t blockX = tileX; blockX < endX; blockX += PacketBlockSize)
+					{
+						int32_t blockEndX = std::min(blockX + PacketBlockSize, endX);
+						int32_t blockEndY = std::min(blockY + PacketBlockSize, endY);
+						uint32_t count = 0;
+						for (int32_t y = blockY; y < blockEndY; y++)
+						{
+							for (int32_t x = blockX; x < blockEndX; x++)
+							{
+								// Pixels that got their samples from the last camera wait for the rest to catch up. Every
+								// pixel's next sample index is its own count, which is the pass everywhere else
+								size_t i = static_cast<size_t>(x) + static_cast<size_t>(y) * static_cast<size_t>(m_Settings.Width);
+								uint32_t pixelSamples = m_Accumulation[i].SampleCount;
+								if (!m_Converged.empty() && m_Converged[i])
+									continue;
+								if (pixelSamples <= sampleIndex)
+									samples[count++] = { x, y, pixelSamples };
+								else
+									tileFewestWaiting = std::min(tileFewestWaiting, pixelSamples);
+							}
+						}
+						RenderSamples(m_Scene, m_Camera, m_Settings, samples, count, colors);
+						for (uint32_t j = 0; j < count; j++)
+							m_Accumulation[static_cast<size_t>(samples[j].X) + static_cast<size_t>(samples[j].Y) * static_cast<size_t>(m_Settings.Width)].AddSample(colors[j]);
+						tileActivePixels += count;
+
+						// Written either way, the back buffer still holds the frame from two passes ago
+						for (int32_t y = blockY; y < blockEndY; y++)
+						{
+							for (int32_t x = blockX; x < blockEndX; x++)
+							{
+								size_t i = static_cast<size_t>(x) + static_cast<size_t>(y) * static_cast<size_t>(m_Settings.Width);
+								m_BackBuffer[i] = PackColor(m_Accumulation[i].GetColor());
+							}
+						}
+					}
+				}
+				activePixels.fetch_add(tileActivePixels, std::memory_order_relaxed);
+				uint32_t current = fewestWaiting.load(std::memory_order_relaxed);
+				while (tileFewestWaiting < current && !fewestWaiting.compare_exchange_weak(current, tileFewestWaiting, std::memory_order_relaxed))
+				{
+				}
+			});
+		}
+	}
+
+	m_Pool.Wait();
+	fewestWaitingSamples = fewestWaiting.load();
+	return activePixels.load();
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "Camera.h"
+#include "Renderer.h"
+#include "ThreadPool.h"
+
+// Progressive rendering for the interactive viewer
+// A background thread keeps adding one sample per pixel to a float accumulation buffer, and after every pass
+// publishes the current average as RGBA8 pixels the window can upload. Changing the camera starts the accumulation
+// over, the pass in flight notices and bails out at the next tile.
+// Pixels that still see the same surface from the new camera keep what they had though. The center ray of every
+// pixel gets traced once per camera, and a new pixel takes over the accumulation of the old pixel its hit projects
+// to when that one hit the same triangle at the same depth. Shading doesn't depend on the view so those samples are
+// still good, and the passes after the move only trace the pixels that came out with fewer samples than that. With
+// depth of field that only holds for pixels whose surface is sharp from both cameras, and only when the lens and
+// focus distance stay the same.
+// With an ErrorThreshold in the settings converged pixels stop getting samples, and the render thread goes to
+// sleep early once every pixel has.
+
+class ProgressiveRenderer
+{
+public:
+	// settings.SamplesPerPixel caps the accumulation, the render thread sleeps once it gets there
+	ProgressiveRenderer(const Scene& scene, const Camera& camera, const RenderSettings& settings, uint32_t threadCount = 0);
+	~ProgressiveRenderer();
+
+	ProgressiveRenderer(const ProgressiveRenderer&) = delete;
+	ProgressiveRenderer& operator=(const ProgressiveRenderer&) = delete;
+
+	// Never blocks on the render, the new camera gets picked up before the next pass
+	void SetCamera(const Camera& camera);
+
+	// Whether camera changes keep the samples of pixels that still see the same surface, on by default. Takes
+	// effect at the next camera change
+	void SetReprojection(bool isEnabled) { m_UseReprojection.store(isEnabled, std::memory_order_relaxed); }
+
+	// Copies the newest published frame into pixels (Width * Height RGBA8, top row first) if there is one
+	// newer than frameVersion. Returns false and leaves pixels alone otherwise
+	bool CopyLatestFrame(uint32_t* pixels, uint64_t& frameVersion);
+
+	// Bumped every time a pass gets published
+	uint64_t GetFrameVersion();
+
+	uint32_t GetSampleCount() const { return m_PublishedSamples.load(std::memory_order_relaxed); }
+	uint32_t GetActivePixelCount() const { return m_ActivePixels.load(std::memory_order_relaxed); } // Still sampled by the last pass
+	double GetLastPassTime() const { return m_LastPassTime.load(std::memory_order_relaxed); }
+	uint32_t GetReusedPixelCount() const { return m_ReusedPixels.load(std::memory_order_relaxed); } // Kept by the last camera change
+	const RenderSettings& GetSettings() const { return m_Settings; }
+	const ThreadPool& GetPool() const { return m_Pool; } // For its render counters
+
+private:
+	// What the center ray of a pixel hit, the instance in the high half of the id and the triangle in the low half
+	struct PixelSurface
+	{
+		uint64_t Id;
+		float Distance; // From the camera origin
+	};
+
+	static constexpr uint64_t MissId = ~0ull;
+
+	void RenderLoop();
+
+	// Traces the pixel surfaces of m_Camera and fills the accumulation from the last camera's. Returns false and
+	// leaves both alone if the camera changed again before it finished
+	bool ReprojectHistory(uint32_t generation);
+
+	// Returns how many pixels were sampled. fewestWaitingSamples gets the lowest count of the pixels that were skipped
+	// for being ahead of the pass, or stays as it was if there weren't any
+	uint32_t RenderPass(uint32_t sampleIndex, uint32_t generation, uint32_t& fewestWaitingSamples);
+
+	const Scene& m_Scene;
+	RenderSettings m_Settings;
+	ThreadPool m_Pool;
+
+	std::vector<PixelEstimate> m_Accumulation;
+
+	// The accumulation and pixel surfaces belong to m_HistoryCamera, the next ones get built in the spare buffers
+	std::vector<PixelSurface> m_Surfaces;
+	std::vector<PixelSurface> m_NextSurfaces;
+	std::vector<PixelEstimate> m_NextAccumulation;
+	Camera m_HistoryCamera;
+	bool m_HasHistory = false;
+	std::vector<uint8_t> m_Converged; // Worked out between passes, empty without an ErrorThreshold
+	std::vector<uint32_t> m_BackBuffer; // Written by the pass in flight
+	std::vector<uint32_t> m_FrontBuffer; // Last finished pass, read by the window
+
+	std::mutex m_FrameMutex; // Guards m_FrontBuffer and m_FrameVersion
+	uint64_t m_FrameVersion = 0;
+
+	// Camera handoff from the window thread
+	std::mutex m_CameraMutex;
+	std::condition_variable m_CameraChanged;
+	Camera m_Camera;
+	Camera m_PendingCamera;
+	std::atomic<uint32_t> m_Generation = 0;
+	bool m_Stopping = false;
+
+	std::atomic<uint32_t> m_PublishedSamples = 0;
+	std::atomic<uint32_t> m_ActivePixels = 0;
+	std::atomic<double> m_LastPassTime = 0.0;
+	std::atomic<uint32_t> m_ReusedPixels = 0;
+	std::atomic<bool> m_UseReprojection = true;
+
+	std::thread m_Thread;
+};
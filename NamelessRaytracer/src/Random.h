@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+// Counter based random numbers
+// Every value is a pure function of (pixel, sample, dimension, counter), so an image comes out bit-identical
+// no matter how many threads render it or which order the tiles finish in. There's no shared state to race on
+// and the whole generator is two integers that live in registers.
+
+// The separate random decisions made for one sample. Each one gets its own stream so adding draws to one
+// of them doesn't shift the numbers the others see.
+enum class RandomDimension : uint32_t
+{
+	PixelJitter = 0,
+	Lens = 1,
+	Bounce = 2 // Bounce n of a path uses Bounce + n
+};
+
+// splitmix64 finalizer, a cheap bijective mix with good avalanche
+inline uint64_t MixBits(uint64_t value)
+{
+	value ^= value >> 30;
+	value *= 0xbf58476d1ce4e5b9ull;
+	value ^= value >> 27;
+	value *= 0x94d049bb133111ebull;
+	value ^= value >> 31;
+	return value;
+}
+
+struct RandomStream
+{
+	uint64_t Key;
+	uint32_t Counter = 0;
+
+	RandomStream(uint32_t pixelIndex, uint32_t sampleIndex, RandomDimension dimension)
+	{
+		uint64_t key = MixBits((static_cast<uint64_t>(pixelIndex) << 32) | sampleIndex);
+		Key = MixBits(key ^ (static_cast<uint64_t>(dimension) + 1) * 0x9e3779b97f4a7c15ull);
+	}
+
+	uint64_t NextBits()
+	{
+		return MixBits(Key + static_cast<uint64_t>(Counter++) * 0x9e3779b97f4a7c15ull);
+	}
+
+	// Returns a random real in [0,1)
+	double NextDouble()
+	{
+		// Top 53 bits fill the mantissa exactly
+		return static_cast<double>(NextBits() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	// Returns a random real in [min,max)
+	double NextDouble(double min, double max)
+	{
+		return min + (max - min) * NextDouble();
+	}
+};
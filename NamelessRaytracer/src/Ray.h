@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "glm/glm.hpp"
+
+// Precision of the ray pipeline
+// Everything from camera rays down to the hit records is templated on the scalar type. Normal builds use float,
+// which doubles the SIMD width and halves the bandwidth. The Validation configuration defines NR_DOUBLE_PRECISION
+// to build the same pipeline in double to check float results against.
+
+#ifdef NR_DOUBLE_PRECISION
+using Real = double;
+#else
+using Real = float;
+#endif
+
+template<typename Scalar>
+using Vec3T = glm::vec<3, Scalar>;
+
+using Vec3 = Vec3T<Real>;
+
+// Triangle intersection code
+
+template<typename Scalar>
+struct RayT
+{
+	Vec3T<Scalar> Origin; // P
+	Vec3T<Scalar> Direction; // d
+};
+
+// Where the rays through the next pixel over in x and in y go, for working out how much of a texture a pixel
+// covers (Igehy 1999)
+template<typename Scalar>
+struct RayDifferentialT
+{
+	Vec3T<Scalar> DxOrigin;
+	Vec3T<Scalar> DxDirection;
+	Vec3T<Scalar> DyOrigin;
+	Vec3T<Scalar> DyDirection;
+};
+
+template<typename Scalar>
+struct TriangleT
+{
+	Vec3T<Scalar> A;
+	Vec3T<Scalar> B;
+	Vec3T<Scalar> C;
+};
+
+template<typename Scalar>
+Vec3T<Scalar> RayEquation(const RayT<Scalar>& ray, Scalar t)
+{
+	return ray.Origin + ray.Direction * t;
+}
+
+template<typename Scalar>
+Scalar RayPlaneIntersection(const RayT<Scalar>& ray, Vec3T<Scalar> n, Scalar d, bool* hit)
+{
+	Scalar nd = glm::dot(n, ray.Direction);
+	if (nd == Scalar(0))
+	{
+		*hit = false;
+		return Scalar(0);
+	}
+	*hit = true;
+
+	Scalar np = glm::dot(n, ray.Origin);
+
+	return (d - np) / nd;
+}
+
+// Everything about the closest hit. Only ever worked out once per ray, for the winning triangle
+template<typename Scalar>
+struct IntersectionResultT
+{
+	bool IsHit;
+	Vec3T<Scalar> Normal; // Geometric normal
+	Vec3T<Scalar> Position;
+	Vec3T<Scalar> Barycentric;
+	Scalar T;
+	uint32_t TriangleIndex;
+	glm::vec3 Albedo; // Interpolated vertex color, times the material's base color once the scene has shaded it
+	Vec3T<Scalar> ShadingNormal; // Interpolated vertex normal
+	glm::vec2 TexCoord; // Interpolated, 0 for meshes without texture coordinates
+	uint32_t Material; // Of the hit triangle's primitive, 0xFFFFFFFF for none
+};
+
+// What the intersection routines report while searching. Just enough to pick the closest hit
+template<typename Scalar>
+struct TriangleHitT
+{
+	static constexpr uint32_t InvalidIndex = 0xFFFFFFFF;
+
+	Scalar T;
+	Scalar U, V; // Barycentric weights of B and C
+	uint32_t Index = InvalidIndex; // Index into registry.Triangles
+	uint32_t InstanceIndex = 0; // Which instance of the mesh was hit, only filled in by TopLevelBVH
+
+	bool IsHit() const { return Index != InvalidIndex; }
+};
+
+// Watertight ray/triangle intersection (Woop, Benthin and Wald 2013)
+// The ray gets turned into a shear transform that maps it onto the +Z axis, which turns the test into a 2D
+// edge function test. Triangles sharing an edge compute the exact same edge function with opposite sign,
+// so rays can't slip through the crack between them no matter how the rounding goes. The one case rounding can
+// still get wrong is an edge function that comes out exactly 0 in float, those get redone in double where the
+// products are exact.
+
+// Per ray setup, done once and shared by every triangle test
+template<typename Scalar>
+struct WatertightRay
+{
+	Scalar Origin[3];
+	int32_t Kx, Ky, Kz; // Axis permutation that makes Kz the dominant direction axis
+	Scalar Sx, Sy, Sz; // Shear constants
+
+	WatertightRay() = default;
+
+	WatertightRay(const RayT<Scalar>& ray)
+	{
+		Vec3T<Scalar> absDirection = glm::abs(ray.Direction);
+		Kz = absDirection.x > absDirection.y ? (absDirection.x > absDirection.z ? 0 : 2) : (absDirection.y > absDirection.z ? 1 : 2);
+		Kx = (Kz + 1) % 3;
+		Ky = (Kx + 1) % 3;
+		// Swapping keeps the winding the same
+		if (ray.Direction[Kz] < Scalar(0))
+			std::swap(Kx, Ky);
+
+		Sx = ray.Direction[Kx] / ray.Direction[Kz];
+		Sy = ray.Direction[Ky] / ray.Direction[Kz];
+		Sz = Scalar(1) / ray.Direction[Kz];
+
+		Origin[0] = ray.Origin.x;
+		Origin[1] = ray.Origin.y;
+		Origin[2] = ray.Origin.z;
+	}
+
+	// Ray converted from a different precision, like a double ray being tested against float data
+	template<typename OtherScalar>
+	explicit WatertightRay(const RayT<OtherScalar>& ray)
+		: WatertightRay(RayT<Scalar>{ Vec3T<Scalar>(ray.Origin), Vec3T<Scalar>(ray.Direction) })
+	{}
+};
+
+static constexpr double MinHitDistance = 0.0000001;
+
+// Replaces hit if the triangle is hit closer than hit.T. Only computes t and the barycentrics.
+// Vertices are given as pointers to their xyz components so SoA and AoS data can both be used
+template<typename Scalar>
+bool IntersectTriangleWatertight(const WatertightRay<Scalar>& ray, const Scalar* A, const Scalar* B, const Scalar* C,
+	uint32_t index, TriangleHitT<Scalar>& hit)
+{
+	// Vertices relative to the ray origin
+	Scalar ax = A[ray.Kx] - ray.Origin[ray.Kx], ay = A[ray.Ky] - ray.Origin[ray.Ky], az = A[ray.Kz] - ray.Origin[ray.Kz];
+	Scalar bx = B[ray.Kx] - ray.Origin[ray.Kx], by = B[ray.Ky] - ray.Origin[ray.Ky], bz = B[ray.Kz] - ray.Origin[ray.Kz];
+	Scalar cx = C[ray.Kx] - ray.Origin[ray.Kx], cy = C[ray.Ky] - ray.Origin[ray.Ky], cz = C[ray.Kz] - ray.Origin[ray.Kz];
+
+	// Shear into ray space
+	ax -= ray.Sx * az; ay -= ray.Sy * az;
+	bx -= ray.Sx * bz; by -= ray.Sy * bz;
+	cx -= ray.Sx * cz; cy -= ray.Sy * cz;
+
+	// Edge functions, each one is the weight of the opposite vertex
+	Scalar u = cx * by - cy * bx;
+	Scalar v = ax * cy - ay * cx;
+	Scalar w = bx * ay - by * ax;
+
+	// A float edge function of exactly 0 may have rounded away the sign that tells which side of the edge the ray
+	// is on. The product of two floats fits a double exactly, so in double both triangles of the edge agree again
+	if constexpr (std::is_same_v<Scalar, float>)
+	{
+		if (u == 0.0f || v == 0.0f || w == 0.0f)
+		{
+			u = static_cast<float>(static_cast<double>(cx) * static_cast<double>(by) - static_cast<double>(cy) * static_cast<double>(bx));
+			v = static_cast<float>(static_cast<double>(ax) * static_cast<double>(cy) - static_cast<double>(ay) * static_cast<double>(cx));
+			w = static_cast<float>(static_cast<double>(bx) * static_cast<double>(ay) - static_cast<double>(by) * static_cast<double>(ax));
+		}
+	}
+
+	if ((u < Scalar(0) || v < Scalar(0) || w < Scalar(0)) && (u > Scalar(0) || v > Scalar(0) || w > Scalar(0)))
+		return false;
+
+	Scalar det = u + v + w;
+	if (det == Scalar(0))
+		return false; // This ray is parallel to this triangle.
+
+	// Scaled hit distance, compared against the range before paying for the divide
+	Scalar t = ray.Sz * (u * az + v * bz + w * cz);
+	if (det < Scalar(0))
+	{
+		t = -t;
+		det = -det;
+		u = -u; v = -v; w = -w;
+	}
+
+	if (t <= static_cast<Scalar>(MinHitDistance) * det || t >= hit.T * det)
+		return false;
+
+	Scalar inverseDet = Scalar(1) / det;
+	hit = { t * inverseDet, v * inverseDet, w * inverseDet, index };
+	return true;
+}
+
+template<typename Scalar>
+bool RayTriangleIntersection(const RayT<Scalar>& ray, Vec3T<Scalar> A, Vec3T<Scalar> B, Vec3T<Scalar> C,
+	uint32_t index, TriangleHitT<Scalar>& hit)
+{
+	return IntersectTriangleWatertight(WatertightRay<Scalar>(ray), &A.x, &B.x, &C.x, index, hit);
+}
+
+using Ray = RayT<Real>;
+using RayDifferential = RayDifferentialT<Real>;
+using Triangle = TriangleT<Real>;
+using IntersectionResult = IntersectionResultT<Real>;
+using TriangleHit = TriangleHitT<Real>;
@@ -0,0 +1,159 @@
+#include "RayPacket.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "BVH.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+	#define NR_X64
+	#include <emmintrin.h>
+#endif
+
+void RayPacket::AddRay(const glm::vec3& origin, const glm::vec3& direction, float tMax)
+{
+	uint32_t i = Count++;
+	OriginX[i] = origin.x;
+	OriginY[i] = origin.y;
+	OriginZ[i] = origin.z;
+	DirectionX[i] = direction.x;
+	DirectionY[i] = direction.y;
+	DirectionZ[i] = direction.z;
+	InverseDirectionX[i] = 1.0f / direction.x;
+	InverseDirectionY[i] = 1.0f / direction.y;
+	InverseDirectionZ[i] = 1.0f / direction.z;
+	TMax[i] = tMax;
+	Rays[i] = PackedRay(RayT<float>{ origin, direction });
+}
+
+void RayPacket::Finish()
+{
+	if (Count == 0)
+	{
+		IsCoherent = false;
+		return;
+	}
+
+	glm::vec3 firstDirection(DirectionX[0], DirectionY[0], DirectionZ[0]);
+	OriginMin = OriginMax = glm::vec3(OriginX[0], OriginY[0], OriginZ[0]);
+	InverseDirectionMin = InverseDirectionMax = glm::vec3(InverseDirectionX[0], InverseDirectionY[0], InverseDirectionZ[0]);
+	DirectionSum = glm::vec3(0.0f);
+	IsCoherent = firstDirection.x != 0.0f && firstDirection.y != 0.0f && firstDirection.z != 0.0f;
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		glm::vec3 origin(OriginX[i], OriginY[i], OriginZ[i]);
+		glm::vec3 direction(DirectionX[i], DirectionY[i], DirectionZ[i]);
+		glm::vec3 inverseDirection(InverseDirectionX[i], InverseDirectionY[i], InverseDirectionZ[i]);
+		OriginMin = glm::min(OriginMin, origin);
+		OriginMax = glm::max(OriginMax, origin);
+		InverseDirectionMin = glm::min(InverseDirectionMin, inverseDirection);
+		InverseDirectionMax = glm::max(InverseDirectionMax, inverseDirection);
+		DirectionSum += direction;
+
+		// A product > 0 also rules out zeroes, whose infinite inverse would break the intervals
+		IsCoherent = IsCoherent && direction.x * firstDirection.x > 0.0f && direction.y * firstDirection.y > 0.0f &&
+			direction.z * firstDirection.z > 0.0f;
+	}
+
+	// The padding can never hit since every box entry is at least 0
+	uint32_t paddedCount = GetGroupCount() * GroupSize;
+	for (uint32_t i = Count; i < paddedCount; i++)
+	{
+		OriginX[i] = OriginX[0];
+		OriginY[i] = OriginY[0];
+		OriginZ[i] = OriginZ[0];
+		InverseDirectionX[i] = InverseDirectionX[0];
+		InverseDirectionY[i] = InverseDirectionY[0];
+		InverseDirectionZ[i] = InverseDirectionZ[0];
+		TMax[i] = -1.0f;
+	}
+}
+
+uint32_t RayPacket::IntersectGroup(const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t group) const
+{
+	uint32_t first = group * GroupSize;
+#ifdef NR_X64
+	// IntersectAABB four rays at a time
+	__m128 originX = _mm_load_ps(OriginX + first), originY = _mm_load_ps(OriginY + first), originZ = _mm_load_ps(OriginZ + first);
+	__m128 inverseX = _mm_load_ps(InverseDirectionX + first), inverseY = _mm_load_ps(InverseDirectionY + first);
+	__m128 inverseZ = _mm_load_ps(InverseDirectionZ + first);
+
+	__m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boundsMin.x), originX), inverseX);
+	__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boundsMax.x), originX), inverseX);
+	__m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boundsMin.y), originY), inverseY);
+	__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boundsMax.y), originY), inverseY);
+	__m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boundsMin.z), originZ), inverseZ);
+	__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boundsMax.z), originZ), inverseZ);
+
+	__m128 entry = _mm_max_ps(_mm_max_ps(_mm_min_ps(t1x, t0x), _mm_min_ps(t1y, t0y)), _mm_max_ps(_mm_min_ps(t1z, t0z), _mm_setzero_ps()));
+	__m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(t1x, t0x), _mm_max_ps(t1y, t0y)), _mm_min_ps(_mm_max_ps(t1z, t0z), _mm_load_ps(TMax + first)));
+	exit = _mm_mul_ps(exit, _mm_set1_ps(1.00000024f));
+	return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(entry, exit)));
+#else
+	uint32_t mask = 0;
+	for (uint32_t lane = 0; lane < GroupSize; lane++)
+	{
+		uint32_t i = first + lane;
+		glm::vec3 origin(OriginX[i], OriginY[i], OriginZ[i]);
+		glm::vec3 inverseDirection(InverseDirectionX[i], InverseDirectionY[i], InverseDirectionZ[i]);
+		if (IntersectAABB(origin, inverseDirection, boundsMin, boundsMax, TMax[i]) != std::numeric_limits<float>::infinity())
+			mask |= 1u << lane;
+	}
+	return mask;
+#endif
+}
+
+uint32_t RayPacket::FindFirstActiveGroup(const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t firstGroup) const
+{
+	// Coherent packets mostly hit a box with their first active group already, the interval test is only worth it
+	// once that one misses
+	uint32_t groupCount = GetGroupCount();
+	if (firstGroup >= groupCount || IntersectGroup(boundsMin, boundsMax, firstGroup) != 0)
+		return firstGroup;
+	if (MissesBox(boundsMin, boundsMax))
+		return groupCount;
+
+	for (uint32_t group = firstGroup + 1; group < groupCount; group++)
+	{
+		if (IntersectGroup(boundsMin, boundsMax, group) != 0)
+			return group;
+	}
+	return groupCount;
+}
+
+// Smallest and largest of (plane - origin) * inverseDirection over the packet's intervals. Rounding never moves a
+// float product or difference past one made from bigger inputs, so these bound what every ray's own slab test
+// works out, not just the exact values
+static void SlabInterval(float plane, float originMin, float originMax, float inverseMin, float inverseMax, float& low, float& high)
+{
+	float nearOffset = plane - originMax;
+	float farOffset = plane - originMin;
+	float a = nearOffset * inverseMin, b = nearOffset * inverseMax, c = farOffset * inverseMin, d = farOffset * inverseMax;
+	low = std::min(std::min(a, b), std::min(c, d));
+	high = std::max(std::max(a, b), std::max(c, d));
+}
+
+bool RayPacket::MissesBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+	if (!IsCoherent)
+		return false;
+
+	// Lowest entry and highest exit any ray could have. When even those don't overlap nothing gets through
+	float entry = 0.0f;
+	float exit = std::numeric_limits<float>::infinity();
+	for (int32_t axis = 0; axis < 3; axis++)
+	{
+		// Rays going the negative way enter through the max plane
+		bool isNegative = InverseDirectionMin[axis] < 0.0f;
+		float nearPlane = isNegative ? boundsMax[axis] : boundsMin[axis];
+		float farPlane = isNegative ? boundsMin[axis] : boundsMax[axis];
+
+		float nearLow, nearHigh, farLow, farHigh;
+		SlabInterval(nearPlane, OriginMin[axis], OriginMax[axis], InverseDirectionMin[axis], InverseDirectionMax[axis], nearLow, nearHigh);
+		SlabInterval(farPlane, OriginMin[axis], OriginMax[axis], InverseDirectionMin[axis], InverseDirectionMax[axis], farLow, farHigh);
+		entry = std::max(entry, nearLow);
+		exit = std::min(exit, farHigh);
+	}
+
+	return entry > exit * 1.00000024f;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+#include "glm/glm.hpp"
+
+#include "Ray.h"
+#include "PackedTriangles.h"
+
+// Coherent ray packets
+// Up to 64 rays that start close together and point roughly the same way, like the camera rays of an 8x8 block
+// of pixels. A packet goes down a BVH as one: every node gets fetched once for all of them, gets thrown out for the
+// whole packet when interval arithmetic over their origins and directions says none of them can reach it, and
+// otherwise only gets tested against rays from the first group that hits it onwards (ranged traversal, Wald et al.
+// 2007). Leaves go back to single rays, every ray that actually hits the leaf's box runs the SIMD triangle kernel
+// on its own. Always float, double builds trace every ray on its own.
+
+struct RayPacket
+{
+	static constexpr uint32_t MaxSize = 64;
+	static constexpr uint32_t GroupSize = 4; // Rays tested against a box at once
+
+	uint32_t Count = 0;
+
+	// Padded up to a whole group with copies of the first ray whose TMax keeps them from hitting anything
+	alignas(16) float OriginX[MaxSize];
+	alignas(16) float OriginY[MaxSize];
+	alignas(16) float OriginZ[MaxSize];
+	alignas(16) float DirectionX[MaxSize];
+	alignas(16) float DirectionY[MaxSize];
+	alignas(16) float DirectionZ[MaxSize];
+	alignas(16) float InverseDirectionX[MaxSize];
+	alignas(16) float InverseDirectionY[MaxSize];
+	alignas(16) float InverseDirectionZ[MaxSize];
+	alignas(16) float TMax[MaxSize]; // Closest hit so far, lowered by the traversal
+
+	PackedRay Rays[MaxSize]; // Set up for the triangle kernels
+
+	// Bounds over every ray for the interval test, only filled in when IsCoherent
+	glm::vec3 OriginMin, OriginMax;
+	glm::vec3 InverseDirectionMin, InverseDirectionMax;
+	glm::vec3 DirectionSum; // Which way the packet points overall, decides which child gets visited first
+	bool IsCoherent = false; // Every direction has the same nonzero sign on each axis
+
+	void Clear() { Count = 0; }
+	void AddRay(const glm::vec3& origin, const glm::vec3& direction, float tMax);
+
+	// Pads the last group and works out the bounds. Has to be called once every ray is in
+	void Finish();
+
+	uint32_t GetGroupCount() const { return (Count + GroupSize - 1) / GroupSize; }
+
+	// Bitmask of the rays in group that hit the box closer than their TMax
+	uint32_t IntersectGroup(const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t group) const;
+
+	// The first group from firstGroup on with a ray that hits the box, GetGroupCount() when none do
+	uint32_t FindFirstActiveGroup(const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t firstGroup) const;
+
+	// True when no ray in the packet can hit the box at all. Always false for packets that aren't coherent
+	bool MissesBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+};
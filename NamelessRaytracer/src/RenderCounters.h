@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Per thread render counters
+// Every pool worker counts into its own cache line aligned block, and only that worker ever writes to it, so
+// counting is a plain load and store with no lock and no contended cache line. Anyone can read the counters while
+// a render runs, the totals are just summed over the workers at that moment. Work done on threads that aren't pool
+// workers doesn't get counted.
+
+enum class RenderCounter : uint32_t
+{
+	Rays, // Closest hit and occlusion queries on the scene, every ray of a packet counted
+	TriangleTests,
+	NodeVisits, // Node bounds tested, in both levels
+	Hits, // Queries that found something
+	Samples, // Camera samples
+	Tiles,
+	TileNanoseconds, // Summed over every tile
+	SlowestTileNanoseconds, // The one tile that took longest, not a sum
+	Count
+};
+
+inline const char* GetRenderCounterName(RenderCounter counter)
+{
+	switch (counter)
+	{
+	case RenderCounter::Rays:
+		return "rays";
+	case RenderCounter::TriangleTests:
+		return "triangle_tests";
+	case RenderCounter::NodeVisits:
+		return "node_visits";
+	case RenderCounter::Hits:
+		return "hits";
+	case RenderCounter::Samples:
+		return "samples";
+	case RenderCounter::Tiles:
+		return "tiles";
+	case RenderCounter::TileNanoseconds:
+		return "tile_nanoseconds";
+	case RenderCounter::SlowestTileNanoseconds:
+		return "slowest_tile_nanoseconds";
+	default:
+		return "unknown";
+	}
+}
+
+static constexpr size_t RenderCounterCount = static_cast<size_t>(RenderCounter::Count);
+
+// Plain copy of a set of counters, what reading them gives
+struct RenderCounterValues
+{
+	std::array<uint64_t, RenderCounterCount> Values = {};
+
+	uint64_t Get(RenderCounter counter) const { return Values[static_cast<size_t>(counter)]; }
+
+	// Sums everything but the slowest tile, which takes the slower of the two
+	RenderCounterValues& operator+=(const RenderCounterValues& other)
+	{
+		for (size_t i = 0; i < RenderCounterCount; i++)
+		{
+			if (i == static_cast<size_t>(RenderCounter::SlowestTileNanoseconds))
+				Values[i] = Values[i] > other.Values[i] ? Values[i] : other.Values[i];
+			else
+				Values[i] += other.Values[i];
+		}
+		return *this;
+	}
+};
+
+struct alignas(64) ThreadCounters
+{
+	std::atomic<uint64_t> Values[RenderCounterCount] = {};
+
+	// Only the owning thread may call these, that's what makes the load and store safe without a read-modify-write
+	void Add(RenderCounter counter, uint64_t amount)
+	{
+		std::atomic<uint64_t>& value = Values[static_cast<size_t>(counter)];
+		value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+
+	void Raise(RenderCounter counter, uint64_t amount)
+	{
+		std::atomic<uint64_t>& value = Values[static_cast<size_t>(counter)];
+		if (amount > value.load(std::memory_order_relaxed))
+			value.store(amount, std::memory_order_relaxed);
+	}
+
+	uint64_t Get(RenderCounter counter) const { return Values[static_cast<size_t>(counter)].load(std::memory_order_relaxed); }
+
+	RenderCounterValues Read() const
+	{
+		RenderCounterValues values;
+		for (size_t i = 0; i < RenderCounterCount; i++)
+			values.Values[i] = Values[i].load(std::memory_order_relaxed);
+		return values;
+	}
+
+	// Races with the owner counting, only call it while the thread is idle
+	void Reset()
+	{
+		for (std::atomic<uint64_t>& value : Values)
+			value.store(0, std::memory_order_relaxed);
+	}
+};
+
+// The counters of the calling thread, set by the pool for each of its workers. Null everywhere else
+inline thread_local ThreadCounters* s_ThreadCounters = nullptr;
+
+// Counts work on whatever thread does it. Costs a thread local read and a branch when nothing is counting
+inline void CountRenderWork(RenderCounter counter, uint64_t amount)
+{
+	if (ThreadCounters* counters = s_ThreadCounters)
+		counters->Add(counter, amount);
+}
+
+// Cost of everything traced on the calling thread so far, node visits plus triangle tests. The difference before
+// and after a ray is that ray's traversal cost
+inline uint64_t GetThreadTraversalCost()
+{
+	ThreadCounters* counters = s_ThreadCounters;
+	return counters ? counters->Get(RenderCounter::NodeVisits) + counters->Get(RenderCounter::TriangleTests) : 0;
+}
+
+// Counts a tile and the time from construction to destruction on the calling thread
+class TileCounter
+{
+public:
+	TileCounter() : m_Start(std::chrono::steady_clock::now()) {}
+
+	~TileCounter()
+	{
+		ThreadCounters* counters = s_ThreadCounters;
+		if (!counters)
+			return;
+
+		uint64_t nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - m_Start).count());
+		counters->Add(RenderCounter::Tiles, 1);
+		counters->Add(RenderCounter::TileNanoseconds, nanoseconds);
+		counters->Raise(RenderCounter::SlowestTileNanoseconds, nanoseconds);
+	}
+
+	TileCounter(const TileCounter&) = delete;
+	TileCounter& operator=(const TileCounter&) = delete;
+
+private:
+	std::chrono::steady_clock::time_point m_Start;
+};
@@ -0,0 +1,672 @@
+#include "Renderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+
+#include "SceneCache.h"
+#include "WavefrontPathTracer.h"
+
+bool LoadScene(Scene& scene, const std::string& path, bool useCache, VertexLayout layout)
+{
+	scene.Light = Vec3(2, 4, -4);
+
+	uint64_t sourceHash = 0;
+	std::string cachePath = path + ".nrcache";
+	bool canCache = useCache && HashFile(path, sourceHash);
+	if (canCache && LoadSceneCache(cachePath, sourceHash, layout, scene))
+		return true;
+
+	ModelData model = LoadModel(path, layout);
+	scene.GeometryMemory = std::move(model.Memory);
+	scene.Meshes = std::move(model.Meshes);
+	scene.Instances = std::move(model.Instances);
+	if (scene.GetInstancedTriangleCount() == 0)
+		return false;
+
+	scene.Materials = std::move(model.Materials);
+	scene.TextureData = std::move(model.TextureData);
+	if (!model.Textures.empty())
+		scene.Textures = std::make_unique<TextureCache>(std::move(model.Textures));
+
+	BuildScene(scene);
+
+	if (canCache && !WriteSceneCache(cachePath, scene, sourceHash))
+		std::cout << "WARNING: Couldn't write scene cache " << cachePath << "\n";
+	return true;
+}
+
+void BuildScene(Scene& scene)
+{
+	scene.MeshAccelerators.clear();
+	scene.MeshAccelerators.resize(scene.Meshes.size());
+	for (size_t i = 0; i < scene.Meshes.size(); i++)
+		scene.MeshAccelerators[i].Build(scene.Meshes[i]);
+
+	// How big the trees come out is only known once they're built, then they all move next to each other
+	size_t arenaSize = 0;
+	for (const BVH& accelerator : scene.MeshAccelerators)
+		arenaSize += accelerator.GetArenaSize();
+	scene.AcceleratorMemory = MemoryArena(arenaSize);
+	for (BVH& accelerator : scene.MeshAccelerators)
+		accelerator.MoveTo(scene.AcceleratorMemory);
+
+	scene.Accelerator.Build(scene.MeshAccelerators, scene.Instances);
+}
+
+// How far the texture coordinates move from one pixel to the next in x and in y. The rays of the neighboring pixels
+// get intersected with the plane of the hit triangle, and the steps from the hit to where they land are written in
+// terms of the triangle's edges, which carry the texture coordinates along with them. All in object space since
+// that's what the triangle is stored in, an affine transform doesn't change the edge weights
+static void GetTexCoordDerivatives(const TriangleRegistry& registry, const InstanceMatrix& worldToObject, const IntersectionResult& surface,
+	const RayDifferential& differential, glm::vec2& duvdx, glm::vec2& duvdy)
+{
+	duvdx = glm::vec2(0.0f);
+	duvdy = glm::vec2(0.0f);
+
+	const glm::uvec3& indices = registry.Triangles[surface.TriangleIndex];
+	Vec3 A = registry.GetPosition(indices.x);
+	Vec3 edge1 = Vec3(registry.GetPosition(indices.y)) - A;
+	Vec3 edge2 = Vec3(registry.GetPosition(indices.z)) - A;
+	Vec3 normal = glm::cross(edge1, edge2);
+
+	// Only the differentials go into object space, the hit itself is already there as barycentrics
+	Vec3 position = A + edge1 * surface.Barycentric.y + edge2 * surface.Barycentric.z;
+	auto stepOnPlane = [&](const Vec3& worldOrigin, const Vec3& worldDirection, Vec3& step) {
+		Vec3 origin = Vec3(worldToObject * glm::vec<4, Real>(worldOrigin, Real(1)));
+		Vec3 direction = Vec3(worldToObject * glm::vec<4, Real>(worldDirection, Real(0)));
+		Real facing = glm::dot(normal, direction);
+		if (facing == Real(0))
+			return false;
+		step = origin + direction * (glm::dot(normal, position - origin) / facing) - position;
+		return true;
+	};
+
+	Vec3 dpdx, dpdy;
+	if (!stepOnPlane(differential.DxOrigin, differential.DxDirection, dpdx) ||
+		!stepOnPlane(differential.DyOrigin, differential.DyDirection, dpdy))
+		return;
+
+	// Least squares weights of the two edges for each step
+	Real e11 = glm::dot(edge1, edge1), e12 = glm::dot(edge1, edge2), e22 = glm::dot(edge2, edge2);
+	Real determinant = e11 * e22 - e12 * e12;
+	if (!(std::abs(determinant) > Real(0)))
+		return;
+	Real inverse = Real(1) / determinant;
+
+	glm::vec2 uvA = registry.TexCoords[indices.x];
+	glm::vec2 uvEdge1 = registry.TexCoords[indices.y] - uvA;
+	glm::vec2 uvEdge2 = registry.TexCoords[indices.z] - uvA;
+	auto toTexCoords = [&](const Vec3& step) {
+		Real d1 = glm::dot(edge1, step), d2 = glm::dot(edge2, step);
+		Real w1 = (e22 * d1 - e12 * d2) * inverse;
+		Real w2 = (e11 * d2 - e12 * d1) * inverse;
+		return uvEdge1 * static_cast<float>(w1) + uvEdge2 * static_cast<float>(w2);
+	};
+	duvdx = toTexCoords(dpdx);
+	duvdy = toTexCoords(dpdy);
+}
+
+IntersectionResult ComputeHitAttributes(const Scene& scene, const Ray& ray, const TriangleHit& hit, const RayDifferential* differential)
+{
+	if (!hit.IsHit())
+		return {};
+
+	// The position comes out in world space already since it's worked out from the world ray and t
+	const MeshInstance& instance = scene.Instances[hit.InstanceIndex];
+	const TriangleRegistry& registry = scene.Meshes[instance.MeshIndex];
+	IntersectionResult result = ComputeHitAttributes(registry, ray, hit);
+	result.Normal = glm::normalize(scene.Accelerator.NormalToWorld(hit.InstanceIndex, result.Normal));
+	result.ShadingNormal = glm::normalize(scene.Accelerator.NormalToWorld(hit.InstanceIndex, result.ShadingNormal));
+
+	// Scenes put together from other scenes' meshes can leave the materials behind
+	if (result.Material >= scene.Materials.size())
+		return result;
+
+	const Material& material = scene.Materials[result.Material];
+	glm::vec4 baseColor = material.BaseColorFactor;
+	if (material.BaseColorTexture != NoTexture && scene.Textures)
+	{
+		glm::vec2 duvdx(0.0f), duvdy(0.0f);
+		if (differential && !registry.TexCoords.empty())
+			GetTexCoordDerivatives(registry, scene.Accelerator.GetWorldToObject(hit.InstanceIndex), result, *differential, duvdx, duvdy);
+		baseColor *= scene.Textures->Sample(material.BaseColorTexture, result.TexCoord, duvdx, duvdy);
+	}
+	result.Albedo *= glm::vec3(baseColor);
+	return result;
+}
+
+// Shading for a hit that's already been found, shared by the single ray and packet paths
+static glm::vec3 ShadeHit(const Scene& scene, const Ray& ray, const TriangleHit& closestHit, SampleFeatures* features,
+	const RayDifferential* differential)
+{
+	if (!closestHit.IsHit())
+		return glm::vec3(0.0f);
+
+	// Attributes are only interpolated for the one triangle that's actually visible
+	IntersectionResult surface = ComputeHitAttributes(scene, ray, closestHit, differential);
+	if (features)
+	{
+		features->Albedo = surface.Albedo;
+		features->Normal = glm::vec3(surface.ShadingNormal);
+		features->Depth = static_cast<float>(closestHit.T * glm::length(ray.Direction));
+	}
+
+	// Half Lambert, the lit side goes from 0.5 to 1 and the side facing away from 0.5 down to 0. Points on the lit
+	// side the light can't see get the 0.5 of the terminator like the back of the object does, which is also why
+	// only those need a shadow ray. It leaves from the side the camera ray came from, t running from 0 there to 1
+	// at the light
+	Vec3 toLight = scene.Light - surface.Position;
+	float cosine = static_cast<float>(glm::dot(glm::normalize(toLight), surface.ShadingNormal));
+	if (cosine > 0.0f)
+	{
+		Vec3 normal = glm::dot(surface.Normal, ray.Direction) < Real(0) ? surface.Normal : -surface.Normal;
+		Vec3 origin = OffsetRayOrigin(surface.Position, normal);
+		if (scene.Accelerator.IsOccluded({ origin, scene.Light - origin }, Real(0), Real(1)))
+			cosine = 0.0f;
+	}
+	float lightFactor = cosine / 2.0f + 0.5f;
+
+	return surface.Albedo * lightFactor;
+}
+
+glm::vec3 TraceRay(const Scene& scene, const Ray& ray, SampleFeatures* features, const RayDifferential* differential)
+{
+	return ShadeHit(scene, ray, scene.Accelerator.Intersect(ray), features, differential);
+}
+
+Ray GetCameraRay(const Camera& camera, const RenderSettings& settings, int32_t x, int32_t y, uint32_t sampleIndex,
+	RayDifferential* differential)
+{
+	// Streams are keyed on the pixel and sample so the image doesn't depend on the thread count
+	uint32_t pixelIndex = static_cast<uint32_t>(x + y * settings.Width);
+	PixelSampler sampler(settings.Sampler, x, y, pixelIndex, sampleIndex);
+	glm::dvec2 jitter = sampler.Get2D(RandomDimension::PixelJitter);
+	glm::dvec2 lens = sampler.Get2D(RandomDimension::Lens);
+
+	Real u = static_cast<Real>((static_cast<double>(x) + jitter.x) / static_cast<double>(settings.Width - 1));
+	Real v = static_cast<Real>((static_cast<double>(y) + jitter.y) / static_cast<double>(settings.Height - 1));
+	if (!differential)
+		return camera.GetRay(u, v, static_cast<Real>(lens.x), static_cast<Real>(lens.y));
+
+	Real scale = GetDifferentialScale(settings);
+	Real du = scale / static_cast<Real>(settings.Width - 1);
+	Real dv = scale / static_cast<Real>(settings.Height - 1);
+	return camera.GetRay(u, v, static_cast<Real>(lens.x), static_cast<Real>(lens.y), du, dv, *differential);
+}
+
+glm::vec3 RenderSample(const Scene& scene, const Camera& camera, const RenderSettings& settings,
+	int32_t x, int32_t y, uint32_t sampleIndex, SampleFeatures* features)
+{
+	CountRenderWork(RenderCounter::Samples, 1);
+	RayDifferential differential;
+	Ray ray = GetCameraRay(camera, settings, x, y, sampleIndex, &differential);
+	return TraceRay(scene, ray, features, &differential);
+}
+
+void RenderSamples(const Scene& scene, const Camera& camera, const RenderSettings& settings,
+	const PixelSample* samples, uint32_t count, glm::vec3* colors, SampleFeatures* features)
+{
+#ifndef NR_DOUBLE_PRECISION
+	if (settings.UsePacketTracing && count > 1)
+	{
+		CountRenderWork(RenderCounter::Samples, count);
+		Ray rays[RayPacket::MaxSize];
+		RayDifferential differentials[RayPacket::MaxSize];
+		TriangleHit hits[RayPacket::MaxSize];
+		RayPacket packet;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			rays[i] = GetCameraRay(camera, settings, samples[i].X, samples[i].Y, samples[i].SampleIndex, &differentials[i]);
+			hits[i] = { std::numeric_limits<Real>::infinity(), Real(0), Real(0) };
+			packet.AddRay(rays[i].Origin, rays[i].Direction, hits[i].T);
+		}
+		packet.Finish();
+
+		// Rays spread too far apart to share intervals aren't worth the packet overhead
+		if (packet.IsCoherent)
+			scene.Accelerator.IntersectPacket(packet, hits);
+		else
+		{
+			for (uint32_t i = 0; i < count; i++)
+				hits[i] = scene.Accelerator.Intersect(rays[i]);
+		}
+
+		for (uint32_t i = 0; i < count; i++)
+			colors[i] = ShadeHit(scene, rays[i], hits[i], features ? &features[i] : nullptr, &differentials[i]);
+		return;
+	}
+#endif
+
+	for (uint32_t i = 0; i < count; i++)
+		colors[i] = RenderSample(scene, camera, settings, samples[i].X, samples[i].Y, samples[i].SampleIndex, features ? &features[i] : nullptr);
+}
+
+// Adds a sample's features to a pixel's running sums in the feature buffer, and their squares to FeatureVariance
+static void AddFeatures(FeatureBuffer& features, size_t i, const SampleFeatures& sample)
+{
+	features.Albedo[i] += sample.Albedo;
+	features.Normal[i] += sample.Normal;
+	features.Depth[i] += sample.Depth;
+	features.FeatureVariance[i] += glm::vec3(glm::dot(sample.Albedo, sample.Albedo), glm::dot(sample.Normal, sample.Normal), sample.Depth * sample.Depth);
+}
+
+// Turns the sums back into averages once a pixel has all its samples
+static void ResolveFeatures(FeatureBuffer& features, size_t i, const PixelEstimate& estimate)
+{
+	float inverseCount = 1.0f / static_cast<float>(std::max(estimate.SampleCount, 1u));
+	features.Color[i] = estimate.GetColor();
+	features.Albedo[i] *= inverseCount;
+	features.Normal[i] *= inverseCount;
+	features.Depth[i] *= inverseCount;
+
+	// FeatureVariance held the sums of squares so far
+	glm::vec3 meanSquares = features.FeatureVariance[i] * inverseCount;
+	glm::vec3 squaredMeans(glm::dot(features.Albedo[i], features.Albedo[i]), glm::dot(features.Normal[i], features.Normal[i]), features.Depth[i] * features.Depth[i]);
+	features.FeatureVariance[i] = glm::max(meanSquares - squaredMeans, glm::vec3(0.0f)) * inverseCount;
+
+	// A single sample says nothing about the noise, the denoiser gets told it's as bad as it gets
+	features.Variance[i] = estimate.SampleCount > 1 ? estimate.GetVariance() : 1.0f;
+}
+
+static void RenderTile(const Scene& scene, const Camera& camera, const RenderSettings& settings, HDRImage& image,
+	FeatureBuffer* features, int32_t tileX, int32_t tileY)
+{
+	TileCounter tileCounter;
+	int32_t endX = std::min(tileX + settings.TileSize, settings.Width);
+	int32_t endY = std::min(tileY + settings.TileSize, settings.Height);
+
+	// Every sample of a block goes out as one packet. Each pixel still gets its samples in order, so the sums come
+	// out the same as rendering pixel by pixel
+	PixelSample samples[RayPacket::MaxSize];
+	glm::vec3 colors[RayPacket::MaxSize];
+	SampleFeatures sampleFeatures[RayPacket::MaxSize];
+	PixelEstimate estimates[RayPacket::MaxSize];
+	for (int32_t blockY = tileY; blockY < endY; blockY += PacketBlockSize)
+	{
+		for (int32_t blockX = tileX; blockX < endX; blockX += PacketBlockSize)
+		{
+			int32_t blockEndX = std::min(blockX + PacketBlockSize, endX);
+			int32_t blockEndY = std::min(blockY + PacketBlockSize, endY);
+			uint32_t count = 0;
+			for (int32_t y = blockY; y < blockEndY; y++)
+				for (int32_t x = blockX; x < blockEndX; x++)
+					samples[count++] = { x, y, 0 };
+			std::fill(estimates, estimates + count, PixelEstimate());
+
+			for (uint32_t s = 0; s < static_cast<uint32_t>(settings.SamplesPerPixel); s++)
+			{
+				for (uint32_t j = 0; j < count; j++)
+					samples[j].SampleIndex = s;
+				RenderSamples(scene, camera, settings, samples, count, colors, features ? sampleFeatures : nullptr);
+
+				for (uint32_t j = 0; j < count; j++)
+				{
+					estimates[j].AddSample(colors[j]);
+					if (features)
+						AddFeatures(*features, static_cast<size_t>(samples[j].X) + static_cast<size_t>(samples[j].Y) * static_cast<size_t>(settings.Width), sampleFeatures[j]);
+				}
+			}
+
+			// Tiles never overlap so no two threads write the same pixel
+			for (uint32_t j = 0; j < count; j++)
+			{
+				image.SetPixel(samples[j].X, samples[j].Y, estimates[j].GetColor());
+				if (features)
+					ResolveFeatures(*features, static_cast<size_t>(samples[j].X) + static_cast<size_t>(samples[j].Y) * static_cast<size_t>(settings.Width), estimates[j]);
+			}
+		}
+	}
+}
+
+void AccumulateTile(const Scene& scene, const Camera& camera, const RenderSettings& settings, int32_t tileX, int32_t tileY,
+	uint32_t firstSample, uint32_t sampleCount, glm::vec3* colorSums, size_t rowStride)
+{
+	TileCounter tileCounter;
+	int32_t endX = std::min(tileX + settings.TileSize, settings.Width);
+	int32_t endY = std::min(tileY + settings.TileSize, settings.Height);
+
+	// Blocks and sample order like RenderTile, so the sums match its estimates exactly
+	PixelSample samples[RayPacket::MaxSize];
+	glm::vec3 colors[RayPacket::MaxSize];
+	for (int32_t blockY = tileY; blockY < endY; blockY += PacketBlockSize)
+	{
+		for (int32_t blockX = tileX; blockX < endX; blockX += PacketBlockSize)
+		{
+			int32_t blockEndX = std::min(blockX + PacketBlockSize, endX);
+			int32_t blockEndY = std::min(blockY + PacketBlockSize, endY);
+			uint32_t count = 0;
+			for (int32_t y = blockY; y < blockEndY; y++)
+				for (int32_t x = blockX; x < blockEndX; x++)
+					samples[count++] = { x, y, 0 };
+
+			for (uint32_t s = firstSample; s < firstSample + sampleCount; s++)
+			{
+				for (uint32_t j = 0; j < count; j++)
+					samples[j].SampleIndex = s;
+				RenderSamples(scene, camera, settings, samples, count, colors);
+
+				for (uint32_t j = 0; j < count; j++)
+					colorSums[static_cast<size_t>(samples[j].X - tileX) + static_cast<size_t>(samples[j].Y - tileY) * rowStride] += colors[j];
+			}
+		}
+	}
+}
+
+void FindConvergedPixels(const RenderSettings& settings, const std::vector<PixelEstimate>& estimates, std::vector<uint8_t>& isConverged)
+{
+	uint32_t minSamples = static_cast<uint32_t>(std::max(settings.MinSamplesPerPixel, 2));
+	size_t width = static_cast<size_t>(settings.Width);
+	size_t height = static_cast<size_t>(settings.Height);
+
+	std::vector<float> errors(estimates.size());
+	for (size_t i = 0; i < estimates.size(); i++)
+		errors[i] = estimates[i].GetRelativeError();
+
+	// A pixel on an edge can easily see only one side for its first few samples and look noise free, all of
+	// its neighbours doing the same is a lot less likely
+	isConverged.resize(estimates.size());
+	for (size_t y = 0; y < height; y++)
+	{
+		for (size_t x = 0; x < width; x++)
+		{
+			float worstError = 0.0f;
+			for (size_t ny = (y > 0 ? y - 1 : 0); ny <= std::min(y + 1, height - 1); ny++)
+				for (size_t nx = (x > 0 ? x - 1 : 0); nx <= std::min(x + 1, width - 1); nx++)
+					worstError = std::max(worstError, errors[nx + ny * width]);
+
+			size_t i = x + y * width;
+			isConverged[i] = estimates[i].SampleCount >= minSamples && worstError <= settings.ErrorThreshold;
+		}
+	}
+}
+
+static void RenderAdaptiveTile(const Scene& scene, const Camera& camera, const RenderSettings& settings,
+	std::vector<PixelEstimate>& estimates, const std::vector<uint32_t>& batches, FeatureBuffer* features, int32_t tileX, int32_t tileY)
+{
+	TileCounter tileCounter;
+	int32_t endX = std::min(tileX + settings.TileSize, settings.Width);
+	int32_t endY = std::min(tileY + settings.TileSize, settings.Height);
+
+	PixelSample samples[RayPacket::MaxSize];
+	glm::vec3 colors[RayPacket::MaxSize];
+	SampleFeatures sampleFeatures[RayPacket::MaxSize];
+	size_t indices[RayPacket::MaxSize];
+	uint32_t remaining[RayPacket::MaxSize];
+	for (int32_t blockY = tileY; blockY < endY; blockY += PacketBlockSize)
+	{
+		for (int32_t blockX = tileX; blockX < endX; blockX += PacketBlockSize)
+		{
+			int32_t blockEndX = std::min(blockX + PacketBlockSize, endX);
+			int32_t blockEndY = std::min(blockY + PacketBlockSize, endY);
+			uint32_t pixelCount = 0;
+			for (int32_t y = blockY; y < blockEndY; y++)
+			{
+				for (int32_t x = blockX; x < blockEndX; x++)
+				{
+					size_t i = static_cast<size_t>(x) + static_cast<size_t>(y) * static_cast<size_t>(settings.Width);
+					if (batches[i] == 0)
+						continue;
+					samples[pixelCount] = { x, y, 0 };
+					indices[pixelCount] = i;
+					remaining[pixelCount] = batches[i];
+					pixelCount++;
+				}
+			}
+
+			// Pixels with bigger batches keep going in smaller packets once the rest are done. Sample indices carry
+			// on from the last pass so no pixel ever sees the same sample twice
+			while (pixelCount > 0)
+			{
+				for (uint32_t j = 0; j < pixelCount; j++)
+					samples[j].SampleIndex = estimates[indices[j]].SampleCount;
+				RenderSamples(scene, camera, settings, samples, pixelCount, colors, features ? sampleFeatures : nullptr);
+
+				uint32_t activeCount = 0;
+				for (uint32_t j = 0; j < pixelCount; j++)
+				{
+					estimates[indices[j]].AddSample(colors[j]);
+					if (features)
+						AddFeatures(*features, indices[j], sampleFeatures[j]);
+					if (--remaining[j] > 0)
+					{
+						samples[activeCount] = samples[j];
+						indices[activeCount] = indices[j];
+						remaining[activeCount] = remaining[j];
+						activeCount++;
+					}
+				}
+				pixelCount = activeCount;
+			}
+		}
+	}
+}
+
+static RenderStats RenderImageAdaptive(const Scene& scene, const Camera& camera, const RenderSettings& settings, ThreadPool& pool, HDRImage& image,
+	FeatureBuffer* features)
+{
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(settings.TimeLimit));
+	bool hasDeadline = settings.TimeLimit > 0.0;
+
+	size_t pixelCount = static_cast<size_t>(settings.Width) * static_cast<size_t>(settings.Height);
+	uint32_t maxSamples = static_cast<uint32_t>(std::max(settings.SamplesPerPixel, 1));
+	uint32_t batchSize = std::min(static_cast<uint32_t>(std::max(settings.MinSamplesPerPixel, 2)), maxSamples);
+
+	std::vector<PixelEstimate> estimates(pixelCount);
+	std::vector<uint32_t> batches(pixelCount, batchSize);
+	std::vector<uint8_t> isConverged;
+	RenderStats stats;
+
+	while (true)
+	{
+		// Passes after the first drop whatever tiles they haven't started once the time is up, every pixel
+		// already has a usable estimate by then
+		bool isFirstPass = stats.Passes == 0;
+		for (int32_t tileY = 0; tileY < settings.Height; tileY += settings.TileSize)
+		{
+			for (int32_t tileX = 0; tileX < settings.Width; tileX += settings.TileSize)
+			{
+				pool.Submit([&, isFirstPass, tileX, tileY](uint32_t) {
+					if (hasDeadline && !isFirstPass && Clock::now() >= deadline)
+						return;
+					RenderAdaptiveTile(scene, camera, settings, estimates, batches, features, tileX, tileY);
+				});
+			}
+		}
+		pool.Wait();
+		stats.Passes++;
+
+		// Converged pixels and ones at the cap drop out, the rest share the next pass by how noisy they are
+		FindConvergedPixels(settings, estimates, isConverged);
+		double errorSum = 0.0;
+		uint32_t activeCount = 0;
+		for (size_t i = 0; i < pixelCount; i++)
+		{
+			bool isDone = isConverged[i] || estimates[i].SampleCount >= maxSamples;
+			batches[i] = isDone ? 0 : 1;
+			if (!isDone)
+			{
+				errorSum += estimates[i].GetRelativeError();
+				activeCount++;
+			}
+		}
+
+		if (activeCount == 0 || (hasDeadline && Clock::now() >= deadline))
+			break;
+
+		float meanError = static_cast<float>(errorSum / activeCount);
+		for (size_t i = 0; i < pixelCount; i++)
+		{
+			if (batches[i] == 0)
+				continue;
+
+			// Batches grow with the sample count since the error only falls with its square root, which keeps
+			// the number of passes down. Pixels noisier than average get up to four times as many on top
+			uint32_t base = std::max(batchSize, estimates[i].SampleCount / 4);
+			float share = meanError > 0.0f ? estimates[i].GetRelativeError() / meanError : 1.0f;
+			uint32_t batch = static_cast<uint32_t>(static_cast<float>(base) * std::clamp(share, 1.0f, 4.0f));
+			batches[i] = std::min(batch, maxSamples - estimates[i].SampleCount);
+		}
+	}
+
+	FindConvergedPixels(settings, estimates, isConverged);
+	for (int32_t y = 0; y < settings.Height; y++)
+	{
+		for (int32_t x = 0; x < settings.Width; x++)
+		{
+			size_t i = static_cast<size_t>(x) + static_cast<size_t>(y) * static_cast<size_t>(settings.Width);
+			image.SetPixel(x, y, estimates[i].GetColor());
+			if (features)
+				ResolveFeatures(*features, i, estimates[i]);
+			stats.SampleCount += estimates[i].SampleCount;
+			stats.ConvergedPixels += isConverged[i];
+		}
+	}
+
+	return stats;
+}
+
+static RenderStats RenderImagePathTraced(const Scene& scene, const Camera& camera, const RenderSettings& settings, ThreadPool& pool, HDRImage& image,
+	FeatureBuffer* features, const std::function<void(int32_t rowCount)>& onRowsFinished)
+{
+	// The tracer spreads every stage over the pool itself, the image goes through it a batch of pixels at a time
+	// in scanline order. A batch gets all its samples before the next one starts so finished rows can go out early
+	WavefrontPathTracer tracer(scene, camera, settings, pool);
+	uint32_t pixelCount = static_cast<uint32_t>(settings.Width) * static_cast<uint32_t>(settings.Height);
+	uint32_t samplesPerPixel = static_cast<uint32_t>(std::max(settings.SamplesPerPixel, 1));
+
+	std::vector<PixelEstimate> estimates(WavefrontPathTracer::MaxBatchSize);
+	std::vector<glm::vec3> colors(WavefrontPathTracer::MaxBatchSize);
+	std::vector<SampleFeatures> sampleFeatures(features ? WavefrontPathTracer::MaxBatchSize : 0);
+	int32_t finishedRows = 0;
+	for (uint32_t firstPixel = 0; firstPixel < pixelCount; firstPixel += WavefrontPathTracer::MaxBatchSize)
+	{
+		uint32_t count = std::min(pixelCount - firstPixel, WavefrontPathTracer::MaxBatchSize);
+		std::fill(estimates.begin(), estimates.begin() + count, PixelEstimate());
+		for (uint32_t s = 0; s < samplesPerPixel; s++)
+		{
+			tracer.TraceSamples(firstPixel, count, s, colors.data(), features ? sampleFeatures.data() : nullptr);
+			for (uint32_t j = 0; j < count; j++)
+			{
+				estimates[j].AddSample(colors[j]);
+				if (features)
+					AddFeatures(*features, firstPixel + j, sampleFeatures[j]);
+			}
+		}
+
+		for (uint32_t j = 0; j < count; j++)
+		{
+			uint32_t pixelIndex = firstPixel + j;
+			image.SetPixel(static_cast<int32_t>(pixelIndex % static_cast<uint32_t>(settings.Width)),
+				static_cast<int32_t>(pixelIndex / static_cast<uint32_t>(settings.Width)), estimates[j].GetColor());
+			if (features)
+				ResolveFeatures(*features, pixelIndex, estimates[j]);
+		}
+
+		int32_t rowCount = static_cast<int32_t>((firstPixel + count) / static_cast<uint32_t>(settings.Width));
+		if (onRowsFinished && rowCount > finishedRows)
+			onRowsFinished(rowCount);
+		finishedRows = rowCount;
+	}
+
+	RenderStats stats;
+	stats.SampleCount = static_cast<uint64_t>(pixelCount) * samplesPerPixel;
+	stats.Passes = 1;
+	stats.RayCount = tracer.GetRayCount();
+	return stats;
+}
+
+RenderStats RenderImage(const Scene& scene, const Camera& camera, const RenderSettings& settings, ThreadPool& pool, HDRImage& image,
+	FeatureBuffer* features, const std::function<void(int32_t rowCount)>& onRowsFinished)
+{
+	// The features get summed in place and divided down once a pixel is finished
+	if (features)
+		features->Reset(settings.Width, settings.Height);
+
+	if (settings.UsePathTracing)
+		return RenderImagePathTraced(scene, camera, settings, pool, image, features, onRowsFinished);
+
+	if (settings.IsAdaptive())
+	{
+		RenderStats stats = RenderImageAdaptive(scene, camera, settings, pool, image, features);
+		if (onRowsFinished)
+			onRowsFinished(settings.Height);
+		return stats;
+	}
+
+	// Every band of tile rows counts down its tiles. Whoever finishes a band's last one moves the finished rows
+	// along past every band that's complete by then
+	int32_t bandCount = (settings.Height + settings.TileSize - 1) / settings.TileSize;
+	int32_t tilesPerBand = (settings.Width + settings.TileSize - 1) / settings.TileSize;
+	std::vector<std::atomic<int32_t>> remainingTiles(static_cast<size_t>(bandCount));
+	for (std::atomic<int32_t>& remaining : remainingTiles)
+		remaining.store(tilesPerBand, std::memory_order_relaxed);
+	std::mutex finishedMutex;
+	int32_t finishedBands = 0;
+
+	auto finishTile = [&](int32_t band) {
+		if (!onRowsFinished || remainingTiles[band].fetch_sub(1, std::memory_order_acq_rel) != 1)
+			return;
+
+		std::lock_guard<std::mutex> lock(finishedMutex);
+		int32_t previousBands = finishedBands;
+		while (finishedBands < bandCount && remainingTiles[finishedBands].load(std::memory_order_acquire) == 0)
+			finishedBands++;
+		if (finishedBands > previousBands)
+			onRowsFinished(std::min(finishedBands * settings.TileSize, settings.Height));
+	};
+
+	// Tiles are submitted in scanline order and stolen by idle workers, so a thread stuck on dense
+	// geometry doesn't hold up the rest of the frame
+	for (int32_t tileY = 0; tileY < settings.Height; tileY += settings.TileSize)
+	{
+		for (int32_t tileX = 0; tileX < settings.Width; tileX += settings.TileSize)
+		{
+			pool.Submit([&scene, &camera, &settings, &image, &finishTile, features, tileX, tileY](uint32_t) {
+				RenderTile(scene, camera, settings, image, features, tileX, tileY);
+				finishTile(tileY / settings.TileSize);
+			});
+		}
+	}
+
+	pool.Wait();
+
+	RenderStats stats;
+	stats.SampleCount = static_cast<uint64_t>(settings.Width) * static_cast<uint64_t>(settings.Height) * static_cast<uint64_t>(settings.SamplesPerPixel);
+	stats.Passes = 1;
+	return stats;
+}
+
+void RenderCostImage(const Scene& scene, const Camera& camera, const RenderSettings& settings, ThreadPool& pool, std::vector<float>& costs)
+{
+	costs.assign(static_cast<size_t>(settings.Width) * static_cast<size_t>(settings.Height), 0.0f);
+	uint32_t samplesPerPixel = static_cast<uint32_t>(std::max(settings.SamplesPerPixel, 1));
+	for (int32_t tileY = 0; tileY < settings.Height; tileY += settings.TileSize)
+	{
+		for (int32_t tileX = 0; tileX < settings.Width; tileX += settings.TileSize)
+		{
+			pool.Submit([&scene, &camera, &settings, &costs, samplesPerPixel, tileX, tileY](uint32_t) {
+				TileCounter tileCounter;
+				int32_t endX = std::min(tileX + settings.TileSize, settings.Width);
+				int32_t endY = std::min(tileY + settings.TileSize, settings.Height);
+				for (int32_t y = tileY; y < endY; y++)
+				{
+					for (int32_t x = tileX; x < endX; x++)
+					{
+						// Only this thread counts into its counters, so whatever they went up by is this pixel's
+						uint64_t costBefore = GetThreadTraversalCost();
+						for (uint32_t s = 0; s < samplesPerPixel; s++)
+							RenderSample(scene, camera, settings, x, y, s);
+						uint64_t cost = GetThreadTraversalCost() - costBefore;
+						costs[static_cast<size_t>(x) + static_cast<size_t>(y) * static_cast<size_t>(settings.Width)] =
+							static_cast<float>(static_cast<double>(cost) / samplesPerPixel);
+					}
+				}
+			});
+		}
+	}
+	pool.Wait();
+}
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "Ray.h"
+#include "Camera.h"
+#include "Sampler.h"
+#include "Image.h"
+#include "Model.h"
+#include "BVH.h"
+#include "TopLevelBVH.h"
+#include "ThreadPool.h"
+#include "MappedFile.h"
+#include "MemoryArena.h"
+#include "TextureCache.h"
+#include "Denoiser.h"
+
+// Everything the renderer needs to know about the world
+struct Scene
+{
+	// One registry and one object space BVH per unique mesh, placed in the world by the instances
+	std::vector<TriangleRegistry> Meshes;
+	std::vector<BVH> MeshAccelerators;
+	std::vector<MeshInstance> Instances;
+	TopLevelBVH Accelerator;
+	Vec3 Light;
+
+	// Only the path tracer uses these, the direct shading has no units. The intensity lights a surface facing
+	// the light from amongus.glb's distance about as brightly as the direct shading does, and the sky is what
+	// rays that leave the scene see
+	float LightIntensity = 150.0f;
+	glm::vec3 SkyColor = glm::vec3(0.15f, 0.17f, 0.2f);
+
+	// Keeps the mapped scene cache alive while the registries and BVHs point into it. Null when loaded from the GLB
+	std::unique_ptr<MappedFile> Cache;
+
+	// What the registries and BVHs point into when the scene didn't come from the cache. Empty otherwise, and
+	// registries made some other way allocate their own
+	MemoryArena GeometryMemory; // Vertices and triangles of every mesh
+	MemoryArena AcceleratorMemory; // Nodes and packed triangles of every mesh BVH
+
+	// Base colors of the meshes' primitives. Null textures when no material has one, the encoded images they
+	// decode from are in TextureData or the mapped cache
+	std::vector<Material> Materials;
+	std::unique_ptr<TextureCache> Textures;
+	std::vector<uint8_t> TextureData;
+
+	// Bytes of vertex data in the registries
+	size_t GetVertexBytes() const
+	{
+		size_t bytes = 0;
+		for (const TriangleRegistry& mesh : Meshes)
+			bytes += mesh.GetBufferSize();
+		return bytes;
+	}
+
+	// Triangles actually stored, every unique mesh counted once
+	size_t GetTriangleCount() const
+	{
+		size_t count = 0;
+		for (const TriangleRegistry& mesh : Meshes)
+			count += mesh.Triangles.size();
+		return count;
+	}
+
+	// Triangles in the world, every instance counted
+	size_t GetInstancedTriangleCount() const
+	{
+		size_t count = 0;
+		for (const MeshInstance& instance : Instances)
+			count += Meshes[instance.MeshIndex].Triangles.size();
+		return count;
+	}
+};
+
+struct RenderSettings
+{
+	int32_t Width = 1280;
+	int32_t Height = 720;
+	int32_t SamplesPerPixel = 10; // The most any pixel gets when rendering adaptively
+	int32_t TileSize = 32;
+
+	// Adaptive sampling, on when either of these is set. Pixels stop once the relative error of their mean is at
+	// most ErrorThreshold, and the render stops taking new tiles once TimeLimit seconds have gone by
+	float ErrorThreshold = 0.0f;
+	double TimeLimit = 0.0;
+	int32_t MinSamplesPerPixel = 4; // Every pixel gets this many before its error is trusted, also the batch size of later passes
+
+	// Camera rays get traced 8x8 pixels at a time as a RayPacket. Off traces every one on its own, the image
+	// comes out the same either way
+	bool UsePacketTracing = true;
+
+	// Multi bounce path tracing with the wavefront engine instead of the direct shading. Always takes
+	// SamplesPerPixel samples, adaptive sampling is left out. Paths end after MaxBounces bounces at the latest,
+	// Russian roulette ends most of them earlier
+	bool UsePathTracing = false;
+	int32_t MaxBounces = 8;
+
+	// Where camera rays go in their pixel and on the lens. Bounces always use independent random numbers
+	SamplerType Sampler = SamplerType::Sobol;
+
+	bool IsAdaptive() const { return ErrorThreshold > 0.0f || TimeLimit > 0.0; }
+};
+
+// Running mean and variance of one pixel, the variance is tracked on luminance with Welford's method
+struct PixelEstimate
+{
+	glm::vec3 ColorSum = glm::vec3(0.0f);
+	float LuminanceMean = 0.0f;
+	float LuminanceM2 = 0.0f;
+	uint32_t SampleCount = 0;
+
+	void AddSample(const glm::vec3& color)
+	{
+		float luminance = glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+		SampleCount++;
+		ColorSum += color;
+		float delta = luminance - LuminanceMean;
+		LuminanceMean += delta / static_cast<float>(SampleCount);
+		LuminanceM2 += delta * (luminance - LuminanceMean);
+	}
+
+	glm::vec3 GetColor() const
+	{
+		return SampleCount > 0 ? ColorSum / static_cast<float>(SampleCount) : glm::vec3(0.0f);
+	}
+
+	// Variance of the luminance mean, not of the individual samples
+	float GetVariance() const
+	{
+		if (SampleCount < 2)
+			return std::numeric_limits<float>::infinity();
+		float n = static_cast<float>(SampleCount);
+		return LuminanceM2 / (n - 1.0f) / n;
+	}
+
+	// Standard error of the mean relative to the mean. The small offset keeps dark pixels from needing
+	// an absurd sample count, and a pixel that has only ever seen one value has no error at all
+	float GetRelativeError() const
+	{
+		return std::sqrt(GetVariance()) / (LuminanceMean + 0.01f);
+	}
+};
+
+struct RenderStats
+{
+	uint64_t SampleCount = 0;
+	uint32_t Passes = 0;
+	uint32_t ConvergedPixels = 0; // Pixels that got under ErrorThreshold, always 0 without adaptive sampling
+	uint64_t RayCount = 0; // Camera, bounce and shadow rays, only counted by the path tracer
+};
+
+// Camera placement shared by the viewer and the headless renderer. Defaults frame amongus.glb
+struct CameraSettings
+{
+	glm::vec3 LookFrom = { 10.0f, 2.0f, 3.0f };
+	glm::vec3 LookAt = { 0.0f, 0.0f, 1.0f };
+	float FieldOfView = 60.0f; // Vertical, in degrees
+	float Aperture = 0.1f;
+	float FocusDistance = glm::length(glm::vec3(10.0f, 2.0f, 3.0f));
+
+	Camera MakeCamera(const RenderSettings& settings) const
+	{
+		Real aspectRatio = static_cast<Real>(settings.Width) / static_cast<Real>(settings.Height);
+		return Camera(Vec3(LookFrom), Vec3(LookAt), Vec3(0, 1, 0), Real(FieldOfView), aspectRatio,
+			Real(Aperture), Real(FocusDistance));
+	}
+};
+
+// Loads a GLB and builds its BVH. Returns false if nothing could be loaded
+// With useCache the processed scene comes from <path>.nrcache when that was made from the same file, and
+// gets written there when it wasn't. layout picks how the vertices are stored, see VertexLayout
+bool LoadScene(Scene& scene, const std::string& path, bool useCache = false, VertexLayout layout = VertexLayout::Full);
+
+// Builds the BVH of every mesh and then the top level over the instances
+void BuildScene(Scene& scene);
+
+// ComputeHitAttributes for a hit on an instance, with the normals moved into world space and the albedo multiplied by
+// the material's base color. differential picks the texture mip levels, without one textures get sampled at full
+// resolution
+IntersectionResult ComputeHitAttributes(const Scene& scene, const Ray& ray, const TriangleHit& hit,
+	const RayDifferential* differential = nullptr);
+
+// First hit of a camera ray, what the denoiser tells edges from noise with. A miss leaves everything at 0
+struct SampleFeatures
+{
+	glm::vec3 Albedo = glm::vec3(0.0f);
+	glm::vec3 Normal = glm::vec3(0.0f); // World space shading normal
+	float Depth = 0.0f; // Distance along the ray
+};
+
+// Shades a single camera ray. features gets filled in when it isn't null
+glm::vec3 TraceRay(const Scene& scene, const Ray& ray, SampleFeatures* features = nullptr,
+	const RayDifferential* differential = nullptr);
+
+// Where rays leaving a surface start, pushed off it along the geometric normal by an amount that grows with the
+// coordinates, which is where the rounding error is. normal has to point to the side the ray leaves on. Offsetting
+// the origin rather than starting a little way along keeps the gap the same however far the ray goes
+inline Vec3 OffsetRayOrigin(const Vec3& position, const Vec3& normal)
+{
+	constexpr Real epsilon = Real(1e-4);
+	Real scale = std::max(Real(1), glm::max(glm::abs(position.x), glm::max(glm::abs(position.y), glm::abs(position.z))));
+	return position + normal * (epsilon * scale);
+}
+
+// Camera ray of one sample through pixel (x, y), jittered inside the pixel and over the lens. The same pixel and
+// sample index always give the same ray. differential gets the rays a pixel over when it isn't null, shrunk by
+// GetDifferentialScale
+Ray GetCameraRay(const Camera& camera, const RenderSettings& settings, int32_t x, int32_t y, uint32_t sampleIndex,
+	RayDifferential* differential = nullptr);
+
+// Every sample only has to cover its share of the pixel, so textures get filtered over less than a whole pixel
+// when there are more samples to average. Capped at an eighth, past that the mip chain is about as sharp as it gets
+// (what pbrt does)
+inline Real GetDifferentialScale(const RenderSettings& settings)
+{
+	return std::max(Real(0.125), Real(1) / std::sqrt(static_cast<Real>(std::max(settings.SamplesPerPixel, 1))));
+}
+
+// Traces one jittered camera sample through pixel (x, y). The same pixel and sample index always give the same result
+glm::vec3 RenderSample(const Scene& scene, const Camera& camera, const RenderSettings& settings,
+	int32_t x, int32_t y, uint32_t sampleIndex, SampleFeatures* features = nullptr);
+
+// One camera sample of one pixel, what RenderSamples takes a batch of
+struct PixelSample
+{
+	int32_t X;
+	int32_t Y;
+	uint32_t SampleIndex;
+};
+
+// Square blocks of pixels whose camera rays get traced as one packet, 8x8 fills a RayPacket
+static constexpr int32_t PacketBlockSize = 8;
+
+// RenderSample for up to RayPacket::MaxSize samples at once, traced as one packet. Meant for pixels next to each
+// other so the rays are coherent, packets whose directions don't agree on their signs get traced one ray at a time
+// instead. colors and features (when not null) get an entry per sample
+void RenderSamples(const Scene& scene, const Camera& camera, const RenderSettings& settings,
+	const PixelSample* samples, uint32_t count, glm::vec3* colors, SampleFeatures* features = nullptr);
+
+// Adds samples [firstSample, firstSample + sampleCount) of every pixel in the tile at (tileX, tileY) to colorSums,
+// which starts at the tile's top left pixel and has rowStride entries per row. Every pixel gets its samples in
+// order, so all of them in one call add up to exactly the ColorSum RenderImage's estimate gets
+void AccumulateTile(const Scene& scene, const Camera& camera, const RenderSettings& settings, int32_t tileX, int32_t tileY,
+	uint32_t firstSample, uint32_t sampleCount, glm::vec3* colorSums, size_t rowStride);
+
+// Marks the pixels adaptive sampling can stop on, the estimates are in scanline order. Pixels only count once they
+// have MinSamplesPerPixel samples and every pixel around them is under ErrorThreshold too
+void FindConvergedPixels(const RenderSettings& settings, const std::vector<PixelEstimate>& estimates, std::vector<uint8_t>& isConverged);
+
+// Splits the frame into tiles and renders them on the pool. Blocks until the whole image is done
+// Adaptive settings render in passes instead. The first pass gives every pixel MinSamplesPerPixel samples and
+// always finishes, the later ones only go over pixels that haven't converged and give the noisier ones more
+// With features the unquantized color and the averaged SampleFeatures of every pixel get written there too,
+// ready for Denoise
+// onRowsFinished gets called with how many rows from the top are done every time that goes up, from whichever
+// thread finished the last tile of the band, never two calls at once. Enough to feed an ImageStream. Adaptive
+// renders only know their rows are done at the very end
+// With UsePathTracing the WavefrontPathTracer renders the image instead, in batches of rows with every stage spread
+// over the pool
+RenderStats RenderImage(const Scene& scene, const Camera& camera, const RenderSettings& settings, ThreadPool& pool, HDRImage& image,
+	FeatureBuffer* features = nullptr, const std::function<void(int32_t rowCount)>& onRowsFinished = nullptr);
+
+// Traversal cost of every pixel for the heatmap, node visits plus triangle tests averaged over SamplesPerPixel
+// samples, shadow rays included. Scanline order. Every sample gets traced on its own since a packet's cost can't be
+// split between its rays, and always with the direct shading
+void RenderCostImage(const Scene& scene, const Camera& camera, const RenderSettings& settings, ThreadPool& pool, std::vector<float>& costs);
@@ -0,0 +1,205 @@
+#include "Sampler.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+static uint32_t ReverseBits(uint32_t value)
+{
+	value = ((value >> 1) & 0x55555555u) | ((value & 0x55555555u) << 1);
+	value = ((value >> 2) & 0x33333333u) | ((value & 0x33333333u) << 2);
+	value = ((value >> 4) & 0x0F0F0F0Fu) | ((value & 0x0F0F0F0Fu) << 4);
+	value = ((value >> 8) & 0x00FF00FFu) | ((value & 0x00FF00FFu) << 8);
+	return (value >> 16) | (value << 16);
+}
+
+// Laine and Karras's hash, every bit only depends on the bits below it. Run on reversed bits that's an Owen
+// scramble, every bit flipped depending on the ones above it
+static uint32_t NestedUniformScramble(uint32_t value, uint32_t seed)
+{
+	value = ReverseBits(value);
+	value += seed;
+	value ^= value * 0x6c50b47cu;
+	value ^= value * 0xb82f1e52u;
+	value ^= value * 0xc7afe638u;
+	value ^= value * 0x8d22f6e6u;
+	return ReverseBits(value);
+}
+
+static uint32_t HashSeed(uint64_t value)
+{
+	return static_cast<uint32_t>(MixBits(value));
+}
+
+// The second Sobol dimension's generator matrix is Pascal's triangle mod 2, the xor shift builds it a column at a
+// time. Applying it a byte of the index at a time from tables takes 4 lookups where the bit loop took 32 steps,
+// and a scrambled index always has all 32 bits in play
+static constexpr std::array<std::array<uint32_t, 256>, 4> MakeSobolTables()
+{
+	uint32_t directions[32] = {};
+	uint32_t direction = 1u << 31;
+	for (uint32_t bit = 0; bit < 32; bit++, direction ^= direction >> 1)
+		directions[bit] = direction;
+
+	std::array<std::array<uint32_t, 256>, 4> tables = {};
+	for (uint32_t byte = 0; byte < 4; byte++)
+	{
+		for (uint32_t value = 0; value < 256; value++)
+		{
+			uint32_t y = 0;
+			for (uint32_t bit = 0; bit < 8; bit++)
+				if (value & (1u << bit))
+					y ^= directions[byte * 8 + bit];
+			tables[byte][value] = y;
+		}
+	}
+	return tables;
+}
+
+static constexpr std::array<std::array<uint32_t, 256>, 4> s_SobolTables = MakeSobolTables();
+
+// The first two Sobol dimensions as 32 bit fractions, the first is the van der Corput sequence
+static glm::dvec2 GetScrambledSobol(uint32_t index, uint32_t seed)
+{
+	// Shuffling the order keeps every power of two prefix a net, and gives every seed different points even at index 0
+	index = NestedUniformScramble(index, seed);
+
+	uint32_t y = s_SobolTables[0][index & 0xFF] ^ s_SobolTables[1][(index >> 8) & 0xFF] ^
+		s_SobolTables[2][(index >> 16) & 0xFF] ^ s_SobolTables[3][index >> 24];
+
+	uint32_t scrambledX = NestedUniformScramble(ReverseBits(index), HashSeed(static_cast<uint64_t>(seed) << 1));
+	uint32_t scrambledY = NestedUniformScramble(y, HashSeed((static_cast<uint64_t>(seed) << 1) | 1));
+	return glm::dvec2(scrambledX, scrambledY) * (1.0 / 4294967296.0);
+}
+
+// Blue noise masks
+
+static constexpr int32_t BlueNoiseSize = 64;
+static constexpr int32_t BlueNoisePixels = BlueNoiseSize * BlueNoiseSize;
+
+// Ulichney's void and cluster method. Every set pixel spreads a gaussian of energy around itself, wrapping around
+// the edges. The initial random pattern gets relaxed by moving its tightest cluster into its largest void until
+// that doesn't change anything, then every pixel gets ranked by the order it would be taken out or filled in.
+// The ranks spread evenly over [0,1) make the mask
+static std::vector<float> MakeBlueNoiseMask(uint32_t seed)
+{
+	constexpr float Sigma = 1.5f;
+	constexpr int32_t Radius = 6; // Past 4 sigma the energy is too small to change which pixel wins
+	constexpr int32_t Width = 2 * Radius + 1;
+	float kernel[Width * Width];
+	for (int32_t dy = -Radius; dy <= Radius; dy++)
+		for (int32_t dx = -Radius; dx <= Radius; dx++)
+			kernel[(dx + Radius) + (dy + Radius) * Width] = std::exp(-static_cast<float>(dx * dx + dy * dy) / (2.0f * Sigma * Sigma));
+
+	std::vector<uint8_t> isSet(BlueNoisePixels, 0);
+	std::vector<float> energy(BlueNoisePixels, 0.0f);
+	auto toggle = [&](int32_t pixel) {
+		float sign = isSet[pixel] ? -1.0f : 1.0f;
+		isSet[pixel] ^= 1;
+		int32_t x = pixel % BlueNoiseSize, y = pixel / BlueNoiseSize;
+		for (int32_t dy = -Radius; dy <= Radius; dy++)
+		{
+			int32_t row = ((y + dy) & (BlueNoiseSize - 1)) * BlueNoiseSize;
+			for (int32_t dx = -Radius; dx <= Radius; dx++)
+				energy[row + ((x + dx) & (BlueNoiseSize - 1))] += sign * kernel[(dx + Radius) + (dy + Radius) * Width];
+		}
+	};
+
+	// The set pixel with the most energy around it, or the empty one with the least
+	auto findTightestCluster = [&]() {
+		int32_t best = -1;
+		for (int32_t i = 0; i < BlueNoisePixels; i++)
+			if (isSet[i] && (best < 0 || energy[i] > energy[best]))
+				best = i;
+		return best;
+	};
+	auto findLargestVoid = [&]() {
+		int32_t best = -1;
+		for (int32_t i = 0; i < BlueNoisePixels; i++)
+			if (!isSet[i] && (best < 0 || energy[i] < energy[best]))
+				best = i;
+		return best;
+	};
+
+	RandomStream random(seed, 0, RandomDimension::PixelJitter);
+	int32_t initialCount = BlueNoisePixels / 10;
+	for (int32_t placed = 0; placed < initialCount;)
+	{
+		int32_t pixel = static_cast<int32_t>(random.NextBits() % BlueNoisePixels);
+		if (!isSet[pixel])
+		{
+			toggle(pixel);
+			placed++;
+		}
+	}
+
+	while (true)
+	{
+		int32_t cluster = findTightestCluster();
+		toggle(cluster);
+		int32_t largestVoid = findLargestVoid();
+		toggle(largestVoid);
+		if (largestVoid == cluster)
+			break;
+	}
+
+	std::vector<int32_t> ranks(BlueNoisePixels);
+	std::vector<uint8_t> prototype = isSet;
+	std::vector<float> prototypeEnergy = energy;
+	for (int32_t rank = initialCount - 1; rank >= 0; rank--)
+	{
+		int32_t cluster = findTightestCluster();
+		toggle(cluster);
+		ranks[cluster] = rank;
+	}
+
+	isSet = std::move(prototype);
+	energy = std::move(prototypeEnergy);
+	for (int32_t rank = initialCount; rank < BlueNoisePixels; rank++)
+	{
+		int32_t largestVoid = findLargestVoid();
+		toggle(largestVoid);
+		ranks[largestVoid] = rank;
+	}
+
+	std::vector<float> mask(BlueNoisePixels);
+	for (int32_t i = 0; i < BlueNoisePixels; i++)
+		mask[i] = (static_cast<float>(ranks[i]) + 0.5f) / static_cast<float>(BlueNoisePixels);
+	return mask;
+}
+
+// One mask per axis, made the first time anything asks. Two independent masks rather than one read twice, so the
+// two coordinates of a pixel's shift don't depend on each other
+static const std::array<std::vector<float>, 2>& GetBlueNoiseMasks()
+{
+	static const std::array<std::vector<float>, 2> masks = { MakeBlueNoiseMask(1), MakeBlueNoiseMask(2) };
+	return masks;
+}
+
+glm::dvec2 PixelSampler::Get2D(RandomDimension dimension) const
+{
+	uint64_t dimensionKey = static_cast<uint64_t>(dimension) + 1;
+	switch (m_Type)
+	{
+	case SamplerType::Sobol:
+		return GetScrambledSobol(m_SampleIndex, HashSeed((static_cast<uint64_t>(m_PixelIndex) << 32) ^ (dimensionKey * 0x9e3779b97f4a7c15ull)));
+	case SamplerType::BlueNoise:
+	{
+		// Every dimension reads the masks somewhere else, or the jitter and lens shifts of a pixel would match
+		uint32_t seed = HashSeed(dimensionKey * 0x9e3779b97f4a7c15ull);
+		int32_t x = (m_X + static_cast<int32_t>(seed & 0xFF)) & (BlueNoiseSize - 1);
+		int32_t y = (m_Y + static_cast<int32_t>((seed >> 8) & 0xFF)) & (BlueNoiseSize - 1);
+		const std::array<std::vector<float>, 2>& masks = GetBlueNoiseMasks();
+		glm::dvec2 shift(masks[0][x + y * BlueNoiseSize], masks[1][x + y * BlueNoiseSize]);
+		glm::dvec2 point = GetScrambledSobol(m_SampleIndex, seed) + shift;
+		return point - glm::floor(point);
+	}
+	default:
+	{
+		RandomStream random(m_PixelIndex, m_SampleIndex, dimension);
+		double u = random.NextDouble();
+		return glm::dvec2(u, random.NextDouble());
+	}
+	}
+}
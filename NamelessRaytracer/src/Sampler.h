@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "glm/glm.hpp"
+
+#include "Random.h"
+
+// Camera samplers
+// Where in its pixel and where on the lens every sample of a pixel goes. Independent random points clump and leave
+// holes, so a pixel needs a lot of them before its mean settles. The low discrepancy samplers spread the first n
+// samples of every pixel evenly over the square instead, which gets the same noise level with far fewer samples.
+// Every 2D dimension gets its own decorrelated sequence, so the jitter and lens points never line up with each
+// other. Like RandomStream every point is a pure function of the pixel, sample and dimension.
+
+enum class SamplerType : uint8_t
+{
+	Random, // Independent random points from RandomStream
+	Sobol, // Owen scrambled Sobol points (Burley 2020), every pixel with its own scramble. Every power of two
+	       // prefix of a pixel's samples is stratified
+	BlueNoise // The same scrambled Sobol points for every pixel, shifted per pixel by a blue noise mask (Georgiev and
+	          // Fajardo 2016). What error is left at low sample counts is high frequency and looks like fine grain
+};
+
+class PixelSampler
+{
+public:
+	PixelSampler(SamplerType type, int32_t x, int32_t y, uint32_t pixelIndex, uint32_t sampleIndex)
+		: m_Type(type), m_X(x), m_Y(y), m_PixelIndex(pixelIndex), m_SampleIndex(sampleIndex)
+	{
+	}
+
+	// A point in [0,1)^2
+	glm::dvec2 Get2D(RandomDimension dimension) const;
+
+private:
+	SamplerType m_Type;
+	int32_t m_X;
+	int32_t m_Y;
+	uint32_t m_PixelIndex;
+	uint32_t m_SampleIndex;
+};
+
+// Shirley and Chiu's concentric mapping from the unit square to the unit disk. Squares map to rings around the
+// center, so stratified points stay stratified, and every point gets used where rejection sampling throws a
+// fifth of them away
+template<typename Scalar>
+glm::vec<2, Scalar> MapToConcentricDisk(Scalar u, Scalar v)
+{
+	Scalar a = Scalar(2) * u - Scalar(1);
+	Scalar b = Scalar(2) * v - Scalar(1);
+	if (a == Scalar(0) && b == Scalar(0))
+		return glm::vec<2, Scalar>(Scalar(0));
+
+	constexpr Scalar quarterPi = Scalar(0.78539816339744830962);
+	Scalar radius, angle;
+	if (std::abs(a) > std::abs(b))
+	{
+		radius = a;
+		angle = quarterPi * (b / a);
+	}
+	else
+	{
+		radius = b;
+		angle = Scalar(2) * quarterPi - quarterPi * (a / b);
+	}
+	return radius * glm::vec<2, Scalar>(std::cos(angle), std::sin(angle));
+}
@@ -0,0 +1,354 @@
+#include "SceneCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Random.h"
+
+static constexpr char SceneCacheMagic[8] = { 'N', 'R', 'S', 'C', 'A', 'C', 'H', 'E' };
+static constexpr uint64_t SectionAlignment = 64;
+
+struct SceneCacheHeader
+{
+	char Magic[8];
+	uint32_t Version;
+	uint32_t NodeSize; // sizeof(BVHNode), catches layout changes that forgot to bump the version
+	uint64_t SourceHash;
+	uint64_t FileSize;
+
+	uint32_t MeshCount;
+	uint32_t InstanceCount;
+	uint32_t MaterialCount;
+	uint32_t TextureCount;
+
+	// Byte offsets from the start of the file
+	uint64_t MeshesOffset;
+	uint64_t InstancesOffset;
+	uint64_t MaterialsOffset;
+	uint64_t TexturesOffset;
+};
+
+// One per mesh, straight after the header
+struct MeshCacheEntry
+{
+	uint64_t VertexCount;
+	uint32_t TriangleCount;
+	uint32_t NodeCount;
+	uint32_t Depth;
+	VertexLayout Layout;
+	glm::vec3 PositionOrigin;
+	glm::vec3 PositionScale;
+	uint32_t HasTexCoords;
+	uint32_t MaterialRangeCount;
+
+	uint64_t VertexDataOffset; // Every vertex array of the layout, back to back like TriangleRegistry::Allocate
+	uint64_t TrianglesOffset;
+	uint64_t NodesOffset;
+	uint64_t PackedTrianglesOffset;
+	uint64_t TexCoordsOffset;
+	uint64_t MaterialRangesOffset;
+};
+
+struct InstanceCacheEntry
+{
+	glm::mat4 ObjectToWorld;
+	uint32_t MeshIndex;
+	uint32_t Padding;
+};
+
+struct TextureCacheEntry
+{
+	uint64_t DataOffset;
+	uint64_t DataSize;
+	TextureWrap WrapS;
+	TextureWrap WrapT;
+};
+
+static uint64_t AlignOffset(uint64_t offset)
+{
+	return (offset + SectionAlignment - 1) & ~(SectionAlignment - 1);
+}
+
+bool HashFile(const std::string& path, uint64_t& hash)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	// Mixes whole 8 byte words, a lot quicker than a byte at a time hash on big files
+	std::vector<char> chunk(1 << 20);
+	uint64_t state = 0;
+	uint64_t length = 0;
+	while (file)
+	{
+		file.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+		size_t bytesRead = static_cast<size_t>(file.gcount());
+		if (bytesRead == 0)
+			break;
+
+		// Zeroes the rest of a partial last word so it always hashes the same
+		size_t wordCount = (bytesRead + 7) / 8;
+		std::memset(chunk.data() + bytesRead, 0, wordCount * 8 - bytesRead);
+
+		for (size_t i = 0; i < wordCount; i++)
+		{
+			uint64_t word;
+			std::memcpy(&word, chunk.data() + i * 8, sizeof(word));
+			state = MixBits(state ^ word);
+		}
+		length += bytesRead;
+	}
+
+	hash = MixBits(state ^ length);
+	return true;
+}
+
+bool WriteSceneCache(const std::string& cachePath, const Scene& scene, uint64_t sourceHash)
+{
+	uint32_t meshCount = static_cast<uint32_t>(scene.Meshes.size());
+	uint32_t instanceCount = static_cast<uint32_t>(scene.Instances.size());
+	uint32_t materialCount = static_cast<uint32_t>(scene.Materials.size());
+	uint32_t textureCount = scene.Textures ? scene.Textures->GetTextureCount() : 0;
+
+	SceneCacheHeader header{};
+	std::memcpy(header.Magic, SceneCacheMagic, sizeof(header.Magic));
+	header.Version = SceneCacheVersion;
+	header.NodeSize = sizeof(BVHNode);
+	header.SourceHash = sourceHash;
+	header.MeshCount = meshCount;
+	header.InstanceCount = instanceCount;
+	header.MaterialCount = materialCount;
+	header.TextureCount = textureCount;
+
+	std::vector<MeshCacheEntry> meshEntries(meshCount);
+	std::vector<InstanceCacheEntry> instanceEntries(instanceCount);
+	for (uint32_t i = 0; i < instanceCount; i++)
+		instanceEntries[i] = { scene.Instances[i].ObjectToWorld, scene.Instances[i].MeshIndex, 0 };
+
+	std::vector<TextureCacheEntry> textureEntries(textureCount);
+	for (uint32_t i = 0; i < textureCount; i++)
+	{
+		const TextureSource& source = scene.Textures->GetSource(i);
+		textureEntries[i] = { 0, source.EncodedSize, source.WrapS, source.WrapT };
+	}
+
+	struct Section
+	{
+		uint64_t* Offset;
+		const void* Data;
+		uint64_t Size;
+	};
+
+	// The tables first, then every mesh's data. The entries are only filled in once the offsets are known
+	std::vector<Section> sections;
+	sections.push_back({ &header.MeshesOffset, meshEntries.data(), meshCount * sizeof(MeshCacheEntry) });
+	sections.push_back({ &header.InstancesOffset, instanceEntries.data(), instanceCount * sizeof(InstanceCacheEntry) });
+	sections.push_back({ &header.MaterialsOffset, scene.Materials.data(), materialCount * sizeof(Material) });
+	sections.push_back({ &header.TexturesOffset, textureEntries.data(), textureCount * sizeof(TextureCacheEntry) });
+	for (uint32_t i = 0; i < textureCount; i++)
+		sections.push_back({ &textureEntries[i].DataOffset, scene.Textures->GetSource(i).EncodedData, textureEntries[i].DataSize });
+	for (uint32_t i = 0; i < meshCount; i++)
+	{
+		const TriangleRegistry& registry = scene.Meshes[i];
+		const BVH& bvh = scene.MeshAccelerators[i];
+		const PackedTriangles& packed = bvh.GetTriangles();
+
+		MeshCacheEntry& entry = meshEntries[i];
+		entry.VertexCount = registry.VertexCount;
+		entry.TriangleCount = static_cast<uint32_t>(registry.Triangles.size());
+		entry.NodeCount = bvh.GetNodeCount();
+		entry.Depth = bvh.GetDepth();
+		entry.Layout = registry.Layout;
+		entry.PositionOrigin = registry.PositionOrigin;
+		entry.PositionScale = registry.PositionScale;
+		entry.HasTexCoords = registry.TexCoords.empty() ? 0 : 1;
+		entry.MaterialRangeCount = static_cast<uint32_t>(registry.MaterialRanges.size());
+
+		sections.push_back({ &entry.VertexDataOffset, registry.VertexData, registry.GetBufferSize() });
+		sections.push_back({ &entry.TrianglesOffset, registry.Triangles.data(), registry.Triangles.size() * sizeof(glm::uvec3) });
+		sections.push_back({ &entry.NodesOffset, bvh.GetNodes(), bvh.GetNodeCount() * sizeof(BVHNode) });
+		sections.push_back({ &entry.PackedTrianglesOffset, packed.GetData(), packed.GetDataSize() });
+		sections.push_back({ &entry.TexCoordsOffset, registry.TexCoords.data(), registry.TexCoords.size() * sizeof(glm::vec2) });
+		sections.push_back({ &entry.MaterialRangesOffset, registry.MaterialRanges.data(), registry.MaterialRanges.size() * sizeof(MaterialRange) });
+	}
+
+	uint64_t offset = sizeof(SceneCacheHeader);
+	for (Section& section : sections)
+	{
+		offset = AlignOffset(offset);
+		*section.Offset = offset;
+		offset += section.Size;
+	}
+	header.FileSize = offset;
+
+	// Written next to the cache and renamed over it at the end, so a job running at the same time
+	// never maps a half written file
+	std::string tempPath = cachePath + ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+	{
+		std::ofstream outFile(tempPath, std::ios::binary | std::ios::trunc);
+		if (!outFile.is_open())
+			return false;
+
+		const char zeroes[SectionAlignment] = {};
+		outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		uint64_t written = sizeof(header);
+		for (const Section& section : sections)
+		{
+			outFile.write(zeroes, static_cast<std::streamsize>(*section.Offset - written));
+			if (section.Size > 0)
+				outFile.write(static_cast<const char*>(section.Data), static_cast<std::streamsize>(section.Size));
+			written = *section.Offset + section.Size;
+		}
+
+		if (!outFile)
+		{
+			outFile.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+#ifdef _WIN32
+	std::remove(cachePath.c_str()); // Windows won't rename over an existing file
+#endif
+	if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+	{
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Whether the indices in a mapped mesh stay inside it. Triangles have to use real vertices and leaves real
+// triangles, and both children of an interior node have to come after it inside the tree, which also rules out
+// loops. The tree can't be deeper than the traversal stacks either
+static bool AreMeshIndicesValid(const MeshCacheEntry& entry, const uint8_t* data)
+{
+	const glm::uvec3* triangles = reinterpret_cast<const glm::uvec3*>(data + entry.TrianglesOffset);
+	for (uint32_t i = 0; i < entry.TriangleCount; i++)
+	{
+		if (triangles[i].x >= entry.VertexCount || triangles[i].y >= entry.VertexCount || triangles[i].z >= entry.VertexCount)
+			return false;
+	}
+
+	const BVHNode* nodes = reinterpret_cast<const BVHNode*>(data + entry.NodesOffset);
+	std::vector<uint32_t> depths(entry.NodeCount, 0);
+	for (uint32_t i = 0; i < entry.NodeCount; i++)
+	{
+		const BVHNode& node = nodes[i];
+		if (node.IsLeaf())
+		{
+			if (node.LeftFirst > entry.TriangleCount || node.TriangleCount > entry.TriangleCount - node.LeftFirst)
+				return false;
+			continue;
+		}
+
+		if (node.LeftFirst <= i + 1 || node.LeftFirst >= entry.NodeCount || depths[i] >= BVHMaxDepth)
+			return false;
+		// Parents come first, so a node has its deepest depth by the time the loop gets to it
+		depths[i + 1] = std::max(depths[i + 1], depths[i] + 1);
+		depths[node.LeftFirst] = std::max(depths[node.LeftFirst], depths[i] + 1);
+	}
+	return true;
+}
+
+bool LoadSceneCache(const std::string& cachePath, uint64_t sourceHash, VertexLayout layout, Scene& scene)
+{
+	auto file = std::make_unique<MappedFile>();
+	if (!file->Open(cachePath) || file->GetSize() < sizeof(SceneCacheHeader))
+		return false;
+
+	SceneCacheHeader header;
+	std::memcpy(&header, file->GetData(), sizeof(header));
+	if (std::memcmp(header.Magic, SceneCacheMagic, sizeof(header.Magic)) != 0 || header.Version != SceneCacheVersion ||
+		header.NodeSize != sizeof(BVHNode) || header.SourceHash != sourceHash || header.FileSize != file->GetSize())
+		return false;
+
+	// Makes sure a truncated or corrupted file can't send anything past the end of the mapping, the sections here and
+	// the indices inside the meshes below
+	uint64_t fileSize = header.FileSize;
+	auto fits = [fileSize](uint64_t offset, uint64_t count, uint64_t elementSize) {
+		return offset % SectionAlignment == 0 && offset <= fileSize && count <= (fileSize - offset) / elementSize;
+	};
+	if (!fits(header.MeshesOffset, header.MeshCount, sizeof(MeshCacheEntry)) ||
+		!fits(header.InstancesOffset, header.InstanceCount, sizeof(InstanceCacheEntry)) ||
+		!fits(header.MaterialsOffset, header.MaterialCount, sizeof(Material)) ||
+		!fits(header.TexturesOffset, header.TextureCount, sizeof(TextureCacheEntry)))
+		return false;
+
+	uint8_t* data = file->GetData();
+	const MeshCacheEntry* meshEntries = reinterpret_cast<const MeshCacheEntry*>(data + header.MeshesOffset);
+	const InstanceCacheEntry* instanceEntries = reinterpret_cast<const InstanceCacheEntry*>(data + header.InstancesOffset);
+	const Material* materials = reinterpret_cast<const Material*>(data + header.MaterialsOffset);
+	const TextureCacheEntry* textureEntries = reinterpret_cast<const TextureCacheEntry*>(data + header.TexturesOffset);
+
+	std::vector<TextureSource> textures(header.TextureCount);
+	for (uint32_t i = 0; i < header.TextureCount; i++)
+	{
+		const TextureCacheEntry& entry = textureEntries[i];
+		if (!fits(entry.DataOffset, entry.DataSize, 1))
+			return false;
+		textures[i] = { data + entry.DataOffset, entry.DataSize, entry.WrapS, entry.WrapT };
+	}
+
+	for (uint32_t i = 0; i < header.MeshCount; i++)
+	{
+		const MeshCacheEntry& entry = meshEntries[i];
+		uint64_t packedFloats = PackedTriangles::GetPaddedCount(entry.TriangleCount) * 9;
+		// A cache in a different layout than the one asked for gets rebuilt like a stale one
+		if (entry.Layout != layout || entry.VertexCount > fileSize ||
+			!fits(entry.VertexDataOffset, TriangleRegistry::GetBufferSize(entry.VertexCount, layout), 1) ||
+			!fits(entry.TrianglesOffset, entry.TriangleCount, sizeof(glm::uvec3)) ||
+			!fits(entry.NodesOffset, entry.NodeCount, sizeof(BVHNode)) ||
+			!fits(entry.PackedTrianglesOffset, packedFloats, sizeof(float)) ||
+			!fits(entry.TexCoordsOffset, entry.HasTexCoords ? entry.VertexCount : 0, sizeof(glm::vec2)) ||
+			!fits(entry.MaterialRangesOffset, entry.MaterialRangeCount, sizeof(MaterialRange)) ||
+			!AreMeshIndicesValid(entry, data))
+			return false;
+	}
+
+	std::vector<MeshInstance> instances(header.InstanceCount);
+	for (uint32_t i = 0; i < header.InstanceCount; i++)
+	{
+		if (instanceEntries[i].MeshIndex >= header.MeshCount)
+			return false;
+		instances[i] = { instanceEntries[i].ObjectToWorld, instanceEntries[i].MeshIndex };
+	}
+
+	std::vector<TriangleRegistry> meshes(header.MeshCount);
+	std::vector<BVH> accelerators(header.MeshCount);
+	for (uint32_t i = 0; i < header.MeshCount; i++)
+	{
+		const MeshCacheEntry& entry = meshEntries[i];
+		TriangleRegistry& registry = meshes[i];
+		registry.SetBuffer(data + entry.VertexDataOffset, entry.VertexCount, entry.Layout);
+		registry.PositionOrigin = entry.PositionOrigin;
+		registry.PositionScale = entry.PositionScale;
+
+		// Used in place like the vertices, the mapping is copy-on-write so a rebuild reordering them is fine
+		registry.Triangles = { reinterpret_cast<glm::uvec3*>(data + entry.TrianglesOffset), entry.TriangleCount };
+		if (entry.HasTexCoords)
+			registry.TexCoords = { reinterpret_cast<glm::vec2*>(data + entry.TexCoordsOffset), entry.VertexCount };
+		const MaterialRange* materialRanges = reinterpret_cast<const MaterialRange*>(data + entry.MaterialRangesOffset);
+		registry.MaterialRanges.assign(materialRanges, materialRanges + entry.MaterialRangeCount);
+
+		accelerators[i].Attach(reinterpret_cast<const BVHNode*>(data + entry.NodesOffset), entry.NodeCount, entry.Depth,
+			reinterpret_cast<const float*>(data + entry.PackedTrianglesOffset), entry.TriangleCount);
+	}
+
+	scene.Meshes = std::move(meshes);
+	scene.MeshAccelerators = std::move(accelerators);
+	scene.Instances = std::move(instances);
+	scene.Accelerator.Build(scene.MeshAccelerators, scene.Instances);
+	scene.Materials.assign(materials, materials + header.MaterialCount);
+	scene.TextureData.clear();
+	scene.Textures = textures.empty() ? nullptr : std::make_unique<TextureCache>(std::move(textures));
+	scene.Cache = std::move(file);
+	return true;
+}
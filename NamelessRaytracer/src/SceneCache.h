@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "Renderer.h"
+
+// Binary scene cache
+// Everything LoadModel and the mesh BVH builds produce gets written out in the exact layout it has in memory,
+// every section 64 byte aligned. Loading maps the file and points the registries and BVHs straight into the
+// mapping, so there's nothing to parse and no vertex, node or packed triangle data gets copied. The encoded
+// textures get used in place too, their pages only get read once the texture cache decodes them. The materials
+// and the registries' material ranges are the only things copied out. The top level BVH isn't stored, it only
+// has a node per instance and gets rebuilt on load.
+// The cache stores a hash of the source file and gets ignored once the source changes. It uses the native
+// byte order and struct layout, so it's only meant to be read on the kind of machine that wrote it.
+
+static constexpr uint32_t SceneCacheVersion = 5;
+
+// Hashes the contents of a file. Returns false if it can't be read
+bool HashFile(const std::string& path, uint64_t& hash);
+
+bool WriteSceneCache(const std::string& cachePath, const Scene& scene, uint64_t sourceHash);
+
+// Fails without touching scene if the file is missing, from another version, made from a different source or
+// stores its vertices in a different layout
+bool LoadSceneCache(const std::string& cachePath, uint64_t sourceHash, VertexLayout layout, Scene& scene);
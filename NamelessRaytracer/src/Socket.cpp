@@ -0,0 +1,258 @@
+#include "Socket.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+#else
+	#include <netdb.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <sys/select.h>
+	#include <sys/socket.h>
+	#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+using NativeSocket = SOCKET;
+using IOSize = int;
+
+static bool StartNetworking()
+{
+	// Winsock needs starting once per process, it's never shut down since sockets can outlive anything that would
+	static bool isStarted = [] {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return isStarted;
+}
+
+static void CloseNative(NativeSocket socket)
+{
+	closesocket(socket);
+}
+
+static void ShutdownNative(NativeSocket socket)
+{
+	shutdown(socket, SD_BOTH);
+}
+
+static int SendFlags()
+{
+	return 0;
+}
+
+#else
+
+using NativeSocket = int;
+using IOSize = size_t;
+
+static bool StartNetworking()
+{
+	return true;
+}
+
+static void CloseNative(NativeSocket socket)
+{
+	close(socket);
+}
+
+static void ShutdownNative(NativeSocket socket)
+{
+	shutdown(socket, SHUT_RDWR);
+}
+
+static int SendFlags()
+{
+	// A worker that went away shouldn't take the whole process down with SIGPIPE
+#ifdef MSG_NOSIGNAL
+	return MSG_NOSIGNAL;
+#else
+	return 0;
+#endif
+}
+
+#endif
+
+static NativeSocket ToNative(intptr_t handle)
+{
+	return static_cast<NativeSocket>(handle);
+}
+
+// Jobs go back and forth one at a time, Nagle would hold the small ones up for nothing
+static void DisableNagle(NativeSocket socket)
+{
+	int isEnabled = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&isEnabled), sizeof(isEnabled));
+}
+
+Socket::Socket(Socket&& other) noexcept
+	: m_Handle(other.m_Handle)
+{
+	other.m_Handle = InvalidHandle;
+}
+
+Socket& Socket::operator=(Socket&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		m_Handle = other.m_Handle;
+		other.m_Handle = InvalidHandle;
+	}
+	return *this;
+}
+
+Socket Socket::Listen(uint16_t port)
+{
+	if (!StartNetworking())
+		return Socket();
+
+	NativeSocket listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (static_cast<intptr_t>(listener) == InvalidHandle)
+		return Socket();
+
+	// A coordinator that just exited leaves its port in TIME_WAIT, restarting on the same one should still work
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+	{
+		CloseNative(listener);
+		return Socket();
+	}
+	return Socket(static_cast<intptr_t>(listener));
+}
+
+Socket Socket::Connect(const std::string& host, uint16_t port)
+{
+	if (!StartNetworking())
+		return Socket();
+
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	addrinfo* addresses = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+		return Socket();
+
+	// Names can resolve to several addresses, the first one that takes the connection wins
+	Socket result;
+	for (addrinfo* address = addresses; address && !result.IsValid(); address = address->ai_next)
+	{
+		NativeSocket connection = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if (static_cast<intptr_t>(connection) == InvalidHandle)
+			continue;
+		if (connect(connection, address->ai_addr, static_cast<int>(address->ai_addrlen)) != 0)
+		{
+			CloseNative(connection);
+			continue;
+		}
+		DisableNagle(connection);
+		result = Socket(static_cast<intptr_t>(connection));
+	}
+	freeaddrinfo(addresses);
+	return result;
+}
+
+Socket Socket::Accept(double timeout)
+{
+	if (!IsValid() || !WaitReadable(timeout))
+		return Socket();
+
+	NativeSocket connection = accept(ToNative(m_Handle), nullptr, nullptr);
+	if (static_cast<intptr_t>(connection) == InvalidHandle)
+		return Socket();
+	DisableNagle(connection);
+	return Socket(static_cast<intptr_t>(connection));
+}
+
+bool Socket::Send(const void* data, size_t size)
+{
+	const char* bytes = static_cast<const char*>(data);
+	while (size > 0 && IsValid())
+	{
+		// Windows takes an int, big buffers go out in pieces
+		IOSize chunk = static_cast<IOSize>(std::min<size_t>(size, 1 << 30));
+		auto sent = send(ToNative(m_Handle), bytes, chunk, SendFlags());
+		if (sent <= 0)
+			return false;
+		bytes += sent;
+		size -= static_cast<size_t>(sent);
+	}
+	return size == 0;
+}
+
+bool Socket::Receive(void* data, size_t size, double timeout)
+{
+	// The timeout covers the whole buffer, not every piece it arrives in
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeout));
+
+	char* bytes = static_cast<char*>(data);
+	while (size > 0 && IsValid())
+	{
+		if (timeout > 0.0)
+		{
+			double remaining = std::chrono::duration<double>(deadline - Clock::now()).count();
+			if (remaining <= 0.0 || !WaitReadable(remaining))
+				return false;
+		}
+
+		IOSize chunk = static_cast<IOSize>(std::min<size_t>(size, 1 << 30));
+		auto received = recv(ToNative(m_Handle), bytes, chunk, 0);
+		if (received <= 0)
+			return false; // 0 is the other side closing the connection
+		bytes += received;
+		size -= static_cast<size_t>(received);
+	}
+	return size == 0;
+}
+
+uint16_t Socket::GetLocalPort() const
+{
+	sockaddr_in address{};
+	socklen_t length = sizeof(address);
+	if (!IsValid() || getsockname(ToNative(m_Handle), reinterpret_cast<sockaddr*>(&address), &length) != 0)
+		return 0;
+	return ntohs(address.sin_port);
+}
+
+void Socket::Shutdown()
+{
+	if (IsValid())
+		ShutdownNative(ToNative(m_Handle));
+}
+
+void Socket::Close()
+{
+	if (IsValid())
+		CloseNative(ToNative(m_Handle));
+	m_Handle = InvalidHandle;
+}
+
+bool Socket::WaitReadable(double timeout) const
+{
+	fd_set readable;
+	FD_ZERO(&readable);
+	FD_SET(ToNative(m_Handle), &readable);
+
+	timeval wait;
+	wait.tv_sec = static_cast<long>(timeout);
+	wait.tv_usec = static_cast<long>((timeout - static_cast<double>(wait.tv_sec)) * 1e6);
+
+	// The first argument is ignored on Windows
+	int ready = select(static_cast<int>(ToNative(m_Handle)) + 1, &readable, nullptr, nullptr, timeout > 0.0 ? &wait : nullptr);
+	return ready > 0;
+}
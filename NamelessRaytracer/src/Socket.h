@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Blocking TCP socket
+// Just enough for the distributed renderer to talk to its workers: listen, accept, connect and moving whole
+// buffers across. Waits that need to give up take a timeout in seconds, 0 waits for as long as it takes.
+
+class Socket
+{
+public:
+	Socket() = default;
+	~Socket() { Close(); }
+
+	Socket(Socket&& other) noexcept;
+	Socket& operator=(Socket&& other) noexcept;
+	Socket(const Socket&) = delete;
+	Socket& operator=(const Socket&) = delete;
+
+	// Listens on every interface. Port 0 picks a free one, see GetLocalPort. Invalid if the port can't be bound
+	static Socket Listen(uint16_t port);
+	// Invalid if nothing answers
+	static Socket Connect(const std::string& host, uint16_t port);
+
+	// Next connection on a listening socket. Invalid if none came in before the timeout
+	Socket Accept(double timeout);
+
+	// Both move exactly size bytes or fail. A failed Receive leaves the connection in an unknown state, it's
+	// only good for closing after that
+	bool Send(const void* data, size_t size);
+	bool Receive(void* data, size_t size, double timeout = 0.0);
+
+	uint16_t GetLocalPort() const;
+	bool IsValid() const { return m_Handle != InvalidHandle; }
+	void Close();
+
+	// Ends the connection without letting go of the handle, so another thread blocked in Send or Receive on it
+	// fails right away. Unlike Close that's safe while the other thread is still using the socket
+	void Shutdown();
+
+private:
+	// SOCKET on Windows and a file descriptor everywhere else, both fit. Windows' INVALID_SOCKET comes out as -1 too
+	static constexpr intptr_t InvalidHandle = -1;
+
+	explicit Socket(intptr_t handle) : m_Handle(handle) {}
+
+	// True once the socket has something to read, or a connection to accept
+	bool WaitReadable(double timeout) const;
+
+	intptr_t m_Handle = InvalidHandle;
+};
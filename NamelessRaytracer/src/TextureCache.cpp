@@ -0,0 +1,433 @@
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include "stb_image.h"
+
+#include "Random.h"
+
+// sRGB decoding of every 8 bit value, and the points halfway between neighboring values for encoding back
+static std::array<float, 256> MakeSRGBTable()
+{
+	std::array<float, 256> table;
+	for (int32_t i = 0; i < 256; i++)
+	{
+		float value = static_cast<float>(i) / 255.0f;
+		table[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+	}
+	return table;
+}
+
+static const std::array<float, 256> s_SRGBToLinear = MakeSRGBTable();
+
+static std::array<float, 255> MakeSRGBThresholds()
+{
+	std::array<float, 255> thresholds;
+	for (int32_t i = 0; i < 255; i++)
+		thresholds[i] = (s_SRGBToLinear[i] + s_SRGBToLinear[i + 1]) * 0.5f;
+	return thresholds;
+}
+
+static const std::array<float, 255> s_SRGBThresholds = MakeSRGBThresholds();
+
+// The 8 bit sRGB value closest to a linear value, in linear terms
+static uint8_t EncodeSRGB(float linear)
+{
+	return static_cast<uint8_t>(std::upper_bound(s_SRGBThresholds.begin(), s_SRGBThresholds.end(), linear) - s_SRGBThresholds.begin());
+}
+
+static glm::vec4 DecodeTexel(uint32_t texel)
+{
+	return glm::vec4(
+		s_SRGBToLinear[texel & 0xFF],
+		s_SRGBToLinear[(texel >> 8) & 0xFF],
+		s_SRGBToLinear[(texel >> 16) & 0xFF],
+		static_cast<float>(texel >> 24) / 255.0f
+	);
+}
+
+static size_t GetLevelBytes(glm::ivec2 size)
+{
+	return static_cast<size_t>(size.x) * size.y * 4;
+}
+
+static void FreeLevel(void* texels)
+{
+	delete[] static_cast<uint8_t*>(texels);
+}
+
+static uint32_t LoadTexel(const uint8_t* rgba, size_t index)
+{
+	uint32_t texel;
+	std::memcpy(&texel, rgba + index * 4, sizeof(texel));
+	return texel;
+}
+
+// Folds a texture coordinate into [0,1]. Mirroring folds the coordinate rather than the texel index, which keeps
+// the texel grid where it was, so filtering the folded coordinate with clamped edges is the same as filtering a
+// mirrored image
+static float WrapCoordinate(float coordinate, TextureWrap wrap)
+{
+	// NaN and coordinates too big to have a fraction left would turn into garbage texel indices
+	if (!(std::abs(coordinate) < 1e7f))
+		return 0.0f;
+
+	switch (wrap)
+	{
+	case TextureWrap::ClampToEdge:
+		return glm::clamp(coordinate, 0.0f, 1.0f);
+	case TextureWrap::MirroredRepeat:
+	{
+		float folded = coordinate - 2.0f * std::floor(coordinate * 0.5f);
+		return folded > 1.0f ? 2.0f - folded : folded;
+	}
+	default:
+		return coordinate - std::floor(coordinate);
+	}
+}
+
+// Where the texel after index lands along an axis of size texels, for the tile border
+static int32_t WrapBorderTexel(int32_t index, int32_t size, TextureWrap wrap)
+{
+	if (index < size)
+		return index;
+	return wrap == TextureWrap::Repeat && index == size ? 0 : size - 1;
+}
+
+// Box filters a level down into the next one. Odd sizes repeat their last row or column
+static void DownsampleLevel(const uint8_t* source, glm::ivec2 sourceSize, glm::ivec2 size, uint8_t* level)
+{
+	for (int32_t y = 0; y < size.y; y++)
+	{
+		int32_t y0 = std::min(y * 2, sourceSize.y - 1), y1 = std::min(y * 2 + 1, sourceSize.y - 1);
+		for (int32_t x = 0; x < size.x; x++)
+		{
+			int32_t x0 = std::min(x * 2, sourceSize.x - 1), x1 = std::min(x * 2 + 1, sourceSize.x - 1);
+
+			// Averaged in linear, sRGB averages come out too dark
+			glm::vec4 sum =
+				DecodeTexel(LoadTexel(source, static_cast<size_t>(y0) * sourceSize.x + x0)) +
+				DecodeTexel(LoadTexel(source, static_cast<size_t>(y0) * sourceSize.x + x1)) +
+				DecodeTexel(LoadTexel(source, static_cast<size_t>(y1) * sourceSize.x + x0)) +
+				DecodeTexel(LoadTexel(source, static_cast<size_t>(y1) * sourceSize.x + x1));
+			glm::vec4 average = sum * 0.25f;
+
+			uint8_t* texel = level + (static_cast<size_t>(y) * size.x + x) * 4;
+			texel[0] = EncodeSRGB(average.r);
+			texel[1] = EncodeSRGB(average.g);
+			texel[2] = EncodeSRGB(average.b);
+			texel[3] = static_cast<uint8_t>(std::round(glm::clamp(average.a, 0.0f, 1.0f) * 255.0f));
+		}
+	}
+}
+
+TextureCache::TextureCache(std::vector<TextureSource> textures, size_t memoryBudget)
+	: m_Textures(std::make_unique<Texture[]>(textures.size())), m_TextureCount(static_cast<uint32_t>(textures.size())),
+	m_MemoryBudget(memoryBudget)
+{
+	for (uint32_t i = 0; i < m_TextureCount; i++)
+		m_Textures[i].Source = textures[i];
+}
+
+uint64_t TextureCache::GetTileKey(uint32_t texture, uint32_t level, uint32_t tileX, uint32_t tileY)
+{
+	// 16 bits of tile index is a 4 million texel wide level, 5 bits of level is everything up to that
+	return (static_cast<uint64_t>(texture) << 37) | (static_cast<uint64_t>(level) << 32) |
+		(static_cast<uint64_t>(tileY) << 16) | tileX;
+}
+
+TextureCache::Shard& TextureCache::GetShard(uint64_t key)
+{
+	return m_Shards[MixBits(key) % ShardCount];
+}
+
+TextureCache::TextureState TextureCache::DescribeTexture(uint32_t texture)
+{
+	Texture& entry = m_Textures[texture];
+	std::lock_guard<std::mutex> lock(entry.DecodeMutex);
+	TextureState state = entry.State.load(std::memory_order_acquire);
+	if (state != TextureState::Unknown)
+		return state;
+
+	int32_t width = 0, height = 0, channels = 0;
+	bool isReadable = entry.Source.EncodedSize <= static_cast<size_t>(std::numeric_limits<int32_t>::max()) &&
+		stbi_info_from_memory(entry.Source.EncodedData, static_cast<int32_t>(entry.Source.EncodedSize), &width, &height, &channels) &&
+		width > 0 && height > 0 && width < (TileSize << 16) && height < (TileSize << 16);
+	if (!isReadable)
+	{
+		std::cout << "WARNING: Texture " << texture << " can't be read, it will be left out\n";
+		entry.State.store(TextureState::Broken, std::memory_order_release);
+		return TextureState::Broken;
+	}
+
+	glm::ivec2 size(width, height);
+	entry.LevelSizes.push_back(size);
+	while (size.x > 1 || size.y > 1)
+	{
+		size = glm::max(size / 2, glm::ivec2(1));
+		entry.LevelSizes.push_back(size);
+	}
+
+	entry.State.store(TextureState::Ready, std::memory_order_release);
+	return TextureState::Ready;
+}
+
+std::shared_ptr<const TextureCache::Tile> TextureCache::FindTile(uint64_t key)
+{
+	Shard& shard = GetShard(key);
+	std::lock_guard<std::mutex> lock(shard.Mutex);
+	shard.Lookups++;
+	auto found = shard.Index.find(key);
+	if (found == shard.Index.end())
+		return nullptr;
+
+	shard.Tiles.splice(shard.Tiles.begin(), shard.Tiles, found->second);
+	return found->second->second;
+}
+
+void TextureCache::InsertTile(uint64_t key, std::shared_ptr<const Tile> tile)
+{
+	Shard& shard = GetShard(key);
+	std::lock_guard<std::mutex> lock(shard.Mutex);
+	auto found = shard.Index.find(key);
+	if (found != shard.Index.end())
+	{
+		shard.Tiles.splice(shard.Tiles.begin(), shard.Tiles, found->second);
+		return;
+	}
+
+	shard.Index[key] = shard.Tiles.insert(shard.Tiles.begin(), { key, std::move(tile) });
+	shard.Bytes += sizeof(Tile);
+	AddResidentBytes(sizeof(Tile));
+	EvictTiles(shard);
+}
+
+void TextureCache::EvictTiles(Shard& shard)
+{
+	// The most recently used tile always stays, a budget smaller than a tile per shard still renders
+	size_t budget = m_MemoryBudget.load(std::memory_order_relaxed) / 2 / ShardCount;
+	while (shard.Bytes > budget && shard.Tiles.size() > 1)
+	{
+		shard.Index.erase(shard.Tiles.back().first);
+		shard.Tiles.pop_back();
+		shard.Bytes -= sizeof(Tile);
+		m_ResidentBytes.fetch_sub(sizeof(Tile), std::memory_order_relaxed);
+		m_Evictions.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+std::shared_ptr<const uint8_t> TextureCache::ChargeTexels(uint8_t* texels, size_t bytes, void (*release)(void*))
+{
+	AddResidentBytes(bytes);
+	return std::shared_ptr<const uint8_t>(texels, [this, bytes, release](const uint8_t* data) {
+		release(const_cast<uint8_t*>(data));
+		m_ResidentBytes.fetch_sub(bytes, std::memory_order_relaxed);
+	});
+}
+
+void TextureCache::AddResidentBytes(size_t bytes)
+{
+	size_t resident = m_ResidentBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	size_t peak = m_PeakResidentBytes.load(std::memory_order_relaxed);
+	while (resident > peak && !m_PeakResidentBytes.compare_exchange_weak(peak, resident, std::memory_order_relaxed))
+	{
+	}
+}
+
+std::shared_ptr<const TextureCache::DecodedChain> TextureCache::FindChain(uint32_t texture)
+{
+	std::lock_guard<std::mutex> lock(m_ChainMutex);
+	auto found = m_ChainIndex.find(texture);
+	if (found == m_ChainIndex.end())
+		return nullptr;
+
+	m_Chains.splice(m_Chains.begin(), m_Chains, found->second);
+	return *found->second;
+}
+
+void TextureCache::KeepChain(std::shared_ptr<const DecodedChain> chain)
+{
+	std::lock_guard<std::mutex> lock(m_ChainMutex);
+	auto found = m_ChainIndex.find(chain->Texture);
+	if (found != m_ChainIndex.end())
+	{
+		m_ChainBytes -= (*found->second)->Bytes;
+		m_Chains.erase(found->second);
+	}
+
+	m_ChainBytes += chain->Bytes;
+	uint32_t texture = chain->Texture;
+	m_ChainIndex[texture] = m_Chains.insert(m_Chains.begin(), std::move(chain));
+
+	// Like the tiles the most recently used chain always stays, even when it alone is over the budget
+	size_t budget = m_MemoryBudget.load(std::memory_order_relaxed) / 2;
+	while (m_ChainBytes > budget && m_Chains.size() > 1)
+	{
+		m_ChainIndex.erase(m_Chains.back()->Texture);
+		m_ChainBytes -= m_Chains.back()->Bytes;
+		m_Chains.pop_back();
+		m_Evictions.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+std::shared_ptr<const TextureCache::DecodedChain> TextureCache::DecodeChain(uint32_t texture, uint32_t finestLevel)
+{
+	Texture& entry = m_Textures[texture];
+	int32_t width = 0, height = 0, channels = 0;
+	uint8_t* pixels = stbi_load_from_memory(entry.Source.EncodedData, static_cast<int32_t>(entry.Source.EncodedSize),
+		&width, &height, &channels, 4);
+	std::shared_ptr<const uint8_t> texels;
+	if (pixels)
+		texels = ChargeTexels(pixels, GetLevelBytes(glm::ivec2(width, height)), stbi_image_free);
+	if (!pixels || glm::ivec2(width, height) != entry.LevelSizes[0])
+	{
+		std::cout << "WARNING: Texture " << texture << " can't be decoded, it will be left out\n";
+		entry.State.store(TextureState::Broken, std::memory_order_release);
+		return nullptr;
+	}
+	m_Decodes.fetch_add(1, std::memory_order_relaxed);
+
+	// The levels finer than the chain's first one only get filtered through, each goes as soon as the next is done
+	auto chain = std::make_shared<DecodedChain>();
+	chain->Texture = texture;
+	chain->FinestLevel = finestLevel;
+	for (uint32_t l = 0; l < entry.LevelSizes.size(); l++)
+	{
+		if (l > 0)
+		{
+			glm::ivec2 size = entry.LevelSizes[l];
+			uint8_t* data = new uint8_t[GetLevelBytes(size)];
+			std::shared_ptr<const uint8_t> next = ChargeTexels(data, GetLevelBytes(size), FreeLevel);
+			DownsampleLevel(texels.get(), entry.LevelSizes[l - 1], size, data);
+			texels = std::move(next);
+		}
+		if (l >= finestLevel)
+		{
+			chain->Levels.push_back(texels);
+			chain->Bytes += GetLevelBytes(entry.LevelSizes[l]);
+		}
+	}
+	return chain;
+}
+
+std::shared_ptr<const TextureCache::Tile> TextureCache::LoadTile(uint32_t texture, uint32_t level, uint32_t tileX, uint32_t tileY)
+{
+	m_Misses.fetch_add(1, std::memory_order_relaxed);
+
+	Texture& entry = m_Textures[texture];
+	std::lock_guard<std::mutex> lock(entry.DecodeMutex);
+
+	// Whoever had the texture before may have just cut this tile
+	uint64_t key = GetTileKey(texture, level, tileX, tileY);
+	if (std::shared_ptr<const Tile> tile = FindTile(key))
+		return tile;
+	if (entry.State.load(std::memory_order_relaxed) != TextureState::Ready)
+		return nullptr;
+
+	std::shared_ptr<const DecodedChain> chain = FindChain(texture);
+	if (!chain || chain->FinestLevel > level)
+	{
+		chain = DecodeChain(texture, level);
+		if (!chain)
+			return nullptr;
+		KeepChain(chain);
+	}
+
+	const uint8_t* texels = chain->Levels[level - chain->FinestLevel].get();
+	glm::ivec2 size = entry.LevelSizes[level];
+	auto tile = std::make_shared<Tile>();
+	for (int32_t y = 0; y <= TileSize; y++)
+	{
+		size_t row = static_cast<size_t>(WrapBorderTexel(static_cast<int32_t>(tileY) * TileSize + y, size.y, entry.Source.WrapT)) * size.x;
+		for (int32_t x = 0; x <= TileSize; x++)
+			tile->Texels[y * (TileSize + 1) + x] = LoadTexel(texels, row + WrapBorderTexel(static_cast<int32_t>(tileX) * TileSize + x, size.x, entry.Source.WrapS));
+	}
+
+	InsertTile(key, tile);
+	return tile;
+}
+
+glm::vec4 TextureCache::SampleLevel(uint32_t texture, uint32_t level, glm::vec2 uv)
+{
+	const Texture& entry = m_Textures[texture];
+	glm::ivec2 size = entry.LevelSizes[level];
+	TextureWrap wraps[2] = { entry.Source.WrapS, entry.Source.WrapT };
+
+	// Texel centers sit at half texels. The texel left of the first one is the last one when repeating and the
+	// first one again otherwise, the one right of the last comes from the tile border
+	glm::ivec2 texel;
+	glm::vec2 weight;
+	for (int32_t axis = 0; axis < 2; axis++)
+	{
+		float position = WrapCoordinate(uv[axis], wraps[axis]) * static_cast<float>(size[axis]) - 0.5f;
+		float first = std::floor(position);
+		texel[axis] = std::min(static_cast<int32_t>(first), size[axis] - 1);
+		weight[axis] = position - first;
+		if (texel[axis] < 0)
+		{
+			texel[axis] = wraps[axis] == TextureWrap::Repeat ? size[axis] - 1 : 0;
+			weight[axis] = wraps[axis] == TextureWrap::Repeat ? weight[axis] : 0.0f;
+		}
+	}
+
+	glm::ivec2 tileIndex = texel / TileSize;
+	uint64_t key = GetTileKey(texture, level, static_cast<uint32_t>(tileIndex.x), static_cast<uint32_t>(tileIndex.y));
+	std::shared_ptr<const Tile> tile = FindTile(key);
+	if (!tile)
+		tile = LoadTile(texture, level, static_cast<uint32_t>(tileIndex.x), static_cast<uint32_t>(tileIndex.y));
+	if (!tile)
+		return glm::vec4(1.0f);
+
+	glm::ivec2 local = texel - tileIndex * TileSize;
+	const uint32_t* texels = tile->Texels + local.y * (TileSize + 1) + local.x;
+	glm::vec4 top = glm::mix(DecodeTexel(texels[0]), DecodeTexel(texels[1]), weight.x);
+	glm::vec4 bottom = glm::mix(DecodeTexel(texels[TileSize + 1]), DecodeTexel(texels[TileSize + 2]), weight.x);
+	return glm::mix(top, bottom, weight.y);
+}
+
+glm::vec4 TextureCache::Sample(uint32_t texture, glm::vec2 uv, glm::vec2 duvdx, glm::vec2 duvdy)
+{
+	if (texture >= m_TextureCount)
+		return glm::vec4(1.0f);
+
+	TextureState state = m_Textures[texture].State.load(std::memory_order_acquire);
+	if (state == TextureState::Unknown)
+		state = DescribeTexture(texture);
+	if (state != TextureState::Ready)
+		return glm::vec4(1.0f);
+
+	// The level where one texel is as wide as the pixel's footprint along its longer side. Anything that isn't a
+	// real width, like the zero derivatives of a ray without differentials, gets the full resolution level
+	const std::vector<glm::ivec2>& levelSizes = m_Textures[texture].LevelSizes;
+	glm::vec2 size(levelSizes[0]);
+	float width = std::max(glm::length(duvdx * size), glm::length(duvdy * size));
+	float lod = width > 1.0f ? std::min(std::log2(width), static_cast<float>(levelSizes.size() - 1)) : 0.0f;
+
+	uint32_t level = static_cast<uint32_t>(lod);
+	float blend = lod - static_cast<float>(level);
+	glm::vec4 color = SampleLevel(texture, level, uv);
+	if (blend > 0.0f && level + 1 < levelSizes.size())
+		color = glm::mix(color, SampleLevel(texture, level + 1, uv), blend);
+	return color;
+}
+
+TextureCacheStats TextureCache::GetStats() const
+{
+	TextureCacheStats stats;
+	for (const Shard& shard : m_Shards)
+	{
+		std::lock_guard<std::mutex> lock(shard.Mutex);
+		stats.Lookups += shard.Lookups;
+	}
+	stats.Misses = m_Misses.load(std::memory_order_relaxed);
+	stats.Decodes = m_Decodes.load(std::memory_order_relaxed);
+	stats.Evictions = m_Evictions.load(std::memory_order_relaxed);
+	stats.ResidentBytes = m_ResidentBytes.load(std::memory_order_relaxed);
+	stats.PeakResidentBytes = m_PeakResidentBytes.load(std::memory_order_relaxed);
+	return stats;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// Texture cache
+// Textures stay in their encoded form (PNG, JPEG, anything stb_image reads) until a ray first lands on them. The
+// first touch decodes the image and filters it down into a mip chain that starts at the finest level asked for, and
+// every miss after that only cuts the tile it wants out of the chain. A miss finer than the chain decodes it again
+// from that level. Half the memory budget goes to tiles and half to decoded chains, and each throws out its least
+// recently used to make room, so a scene with gigabytes of texture renders in a fixed amount of memory. A distant
+// object only ever needs its coarse levels, the fine levels of its textures never take up any room. The most
+// recently used chain always stays, a budget too small for one still renders without decoding on every miss.
+// Tiles and chains are handed out as shared pointers, so one that gets evicted while a thread is still using it
+// stays alive until that thread lets go of it. Decoded texels count as resident until then, the levels that only
+// get filtered through on the way to a chain's first one included.
+
+// How texture coordinates outside [0,1] map back onto the image, glTF's sampler wrap modes
+enum class TextureWrap : uint32_t
+{
+	Repeat,
+	ClampToEdge,
+	MirroredRepeat
+};
+
+// Everything needed to decode a texture once something asks for it. The encoded bytes belong to whoever made the
+// source, like a model's texture data or a mapped scene cache, and have to outlive the cache
+struct TextureSource
+{
+	const uint8_t* EncodedData = nullptr;
+	size_t EncodedSize = 0;
+	TextureWrap WrapS = TextureWrap::Repeat;
+	TextureWrap WrapT = TextureWrap::Repeat;
+};
+
+struct TextureCacheStats
+{
+	uint64_t Lookups = 0;
+	uint64_t Misses = 0;
+	uint64_t Decodes = 0; // Once per texture, unless a finer level gets asked for or its chain gets evicted
+	uint64_t Evictions = 0; // Tiles and chains
+	size_t ResidentBytes = 0; // Tiles and decoded chains
+	size_t PeakResidentBytes = 0;
+};
+
+class TextureCache
+{
+public:
+	static constexpr int32_t TileSize = 64;
+	static constexpr size_t DefaultMemoryBudget = size_t(256) << 20;
+
+	TextureCache(std::vector<TextureSource> textures, size_t memoryBudget = DefaultMemoryBudget);
+
+	// Tiles and chains past a smaller budget get evicted by the next lookups that miss, not right away
+	void SetMemoryBudget(size_t bytes) { m_MemoryBudget = bytes; }
+	size_t GetMemoryBudget() const { return m_MemoryBudget; }
+
+	uint32_t GetTextureCount() const { return m_TextureCount; }
+	const TextureSource& GetSource(uint32_t texture) const { return m_Textures[texture].Source; }
+
+	// Trilinear filtered color of a texture at uv, linear RGB and alpha. The derivatives are how far uv moves from
+	// one pixel to the next in x and in y, and pick the mip level. Zero derivatives sample the full resolution level.
+	// Textures that can't be decoded come out white
+	glm::vec4 Sample(uint32_t texture, glm::vec2 uv, glm::vec2 duvdx, glm::vec2 duvdy);
+
+	TextureCacheStats GetStats() const;
+
+private:
+	// Square block of a mip level with one extra column and row holding the texels a bilinear filter at the tile's
+	// right and bottom edge needs from its neighbors, already wrapped. RGBA8, in sRGB
+	struct Tile
+	{
+		uint32_t Texels[(TileSize + 1) * (TileSize + 1)];
+	};
+
+	enum class TextureState : uint32_t { Unknown, Ready, Broken };
+
+	struct Texture
+	{
+		TextureSource Source;
+
+		// The level sizes come from the image header the first time anything samples the texture and never change
+		// after, State going to Ready publishes them
+		std::atomic<TextureState> State{ TextureState::Unknown };
+		std::vector<glm::ivec2> LevelSizes;
+
+		// Only one thread decodes a texture at a time, the others wait for its tiles instead of decoding it too
+		std::mutex DecodeMutex;
+	};
+
+	// The decoded mip levels of a texture from FinestLevel down to 1x1. RGBA8, in sRGB
+	struct DecodedChain
+	{
+		uint32_t Texture = 0;
+		uint32_t FinestLevel = 0;
+		std::vector<std::shared_ptr<const uint8_t>> Levels; // Levels[level - FinestLevel]
+		size_t Bytes = 0;
+	};
+
+	// The LRU lists are split by key hash so threads sampling different tiles don't wait on each other
+	struct Shard
+	{
+		mutable std::mutex Mutex;
+		std::list<std::pair<uint64_t, std::shared_ptr<const Tile>>> Tiles; // Most recently used first
+		std::unordered_map<uint64_t, std::list<std::pair<uint64_t, std::shared_ptr<const Tile>>>::iterator> Index;
+		size_t Bytes = 0;
+		uint64_t Lookups = 0;
+	};
+
+	static constexpr uint32_t ShardCount = 16;
+
+	static uint64_t GetTileKey(uint32_t texture, uint32_t level, uint32_t tileX, uint32_t tileY);
+	Shard& GetShard(uint64_t key);
+
+	// Reads the image header for the level sizes, Broken if the texture can't be read
+	TextureState DescribeTexture(uint32_t texture);
+
+	std::shared_ptr<const Tile> FindTile(uint64_t key);
+	void InsertTile(uint64_t key, std::shared_ptr<const Tile> tile);
+	void EvictTiles(Shard& shard);
+
+	// Texels from new[] or stb_image that count as resident until the last holder lets go of them
+	std::shared_ptr<const uint8_t> ChargeTexels(uint8_t* texels, size_t bytes, void (*release)(void*));
+	void AddResidentBytes(size_t bytes);
+
+	std::shared_ptr<const DecodedChain> FindChain(uint32_t texture);
+	void KeepChain(std::shared_ptr<const DecodedChain> chain);
+
+	// Decodes texture and filters it down to a chain starting at finestLevel. Null if the texture can't be decoded.
+	// Needs the texture's DecodeMutex
+	std::shared_ptr<const DecodedChain> DecodeChain(uint32_t texture, uint32_t finestLevel);
+
+	// Cuts the tile out of the texture's chain, decoding that first if it doesn't start at level or finer, and puts it
+	// in the cache. Null if the texture can't be decoded
+	std::shared_ptr<const Tile> LoadTile(uint32_t texture, uint32_t level, uint32_t tileX, uint32_t tileY);
+
+	// Bilinear filtered color of one level
+	glm::vec4 SampleLevel(uint32_t texture, uint32_t level, glm::vec2 uv);
+
+	std::unique_ptr<Texture[]> m_Textures;
+	uint32_t m_TextureCount = 0;
+	Shard m_Shards[ShardCount];
+	std::atomic<size_t> m_MemoryBudget;
+
+	std::atomic<uint64_t> m_Misses{ 0 };
+	std::atomic<uint64_t> m_Decodes{ 0 };
+	std::atomic<uint64_t> m_Evictions{ 0 };
+	std::atomic<size_t> m_ResidentBytes{ 0 };
+	std::atomic<size_t> m_PeakResidentBytes{ 0 };
+
+	// Kept decoded chains, most recently used first. Declared after the counters since dropping a chain updates them
+	std::mutex m_ChainMutex;
+	std::list<std::shared_ptr<const DecodedChain>> m_Chains;
+	std::unordered_map<uint32_t, std::list<std::shared_ptr<const DecodedChain>>::iterator> m_ChainIndex; // By texture
+	size_t m_ChainBytes = 0;
+};
@@ -0,0 +1,139 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+// Lets Submit() push onto the calling worker's own deque when a task spawns more tasks
+static thread_local ThreadPool* s_CurrentPool = nullptr;
+static thread_local uint32_t s_CurrentThreadIndex = 0;
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	m_Queues.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; i++)
+		m_Queues.push_back(std::make_unique<WorkQueue>());
+	m_Counters = std::make_unique<ThreadCounters[]>(threadCount);
+
+	m_Threads.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; i++)
+		m_Threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_Stopping = true;
+	}
+	m_WorkAvailable.notify_all();
+
+	for (std::thread& thread : m_Threads)
+		thread.join();
+}
+
+void ThreadPool::Submit(Task task)
+{
+	uint32_t queueIndex;
+	if (s_CurrentPool == this)
+		queueIndex = s_CurrentThreadIndex;
+	else
+		queueIndex = m_NextQueue.fetch_add(1, std::memory_order_relaxed) % GetThreadCount();
+
+	m_PendingTasks.fetch_add(1);
+	m_QueuedTasks.fetch_add(1);
+	{
+		WorkQueue& queue = *m_Queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		queue.Tasks.push_back(std::move(task));
+	}
+
+	// Taking the lock makes sure a worker that is about to sleep sees the new task first
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+	}
+	m_WorkAvailable.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(m_SleepMutex);
+	m_WorkFinished.wait(lock, [this]() { return m_PendingTasks.load() == 0; });
+}
+
+RenderCounterValues ThreadPool::GetTotalCounters() const
+{
+	RenderCounterValues total;
+	for (uint32_t i = 0; i < GetThreadCount(); i++)
+		total += m_Counters[i].Read();
+	return total;
+}
+
+void ThreadPool::ResetCounters()
+{
+	for (uint32_t i = 0; i < GetThreadCount(); i++)
+		m_Counters[i].Reset();
+}
+
+bool ThreadPool::TryPop(uint32_t threadIndex, Task& task)
+{
+	// Newest task first since its data is most likely still in cache
+	WorkQueue& queue = *m_Queues[threadIndex];
+	std::lock_guard<std::mutex> lock(queue.Mutex);
+	if (queue.Tasks.empty())
+		return false;
+
+	task = std::move(queue.Tasks.back());
+	queue.Tasks.pop_back();
+	return true;
+}
+
+bool ThreadPool::TrySteal(uint32_t threadIndex, Task& task)
+{
+	// Oldest task from the victim, which is the one it would get to last
+	uint32_t threadCount = GetThreadCount();
+	for (uint32_t offset = 1; offset < threadCount; offset++)
+	{
+		WorkQueue& queue = *m_Queues[(threadIndex + offset) % threadCount];
+		std::unique_lock<std::mutex> lock(queue.Mutex, std::try_to_lock);
+		if (!lock.owns_lock() || queue.Tasks.empty())
+			continue;
+
+		task = std::move(queue.Tasks.front());
+		queue.Tasks.pop_front();
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::WorkerLoop(uint32_t threadIndex)
+{
+	s_CurrentPool = this;
+	s_CurrentThreadIndex = threadIndex;
+	s_ThreadCounters = &m_Counters[threadIndex];
+
+	Task task;
+	while (true)
+	{
+		if (TryPop(threadIndex, task) || TrySteal(threadIndex, task))
+		{
+			m_QueuedTasks.fetch_sub(1);
+			task(threadIndex);
+			task = nullptr;
+
+			if (m_PendingTasks.fetch_sub(1) == 1)
+			{
+				std::lock_guard<std::mutex> lock(m_SleepMutex);
+				m_WorkFinished.notify_all();
+			}
+			continue;
+		}
+
+		// Nothing to pop or steal, so sleep until something gets submitted
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		m_WorkAvailable.wait(lock, [this]() { return m_Stopping || m_QueuedTasks.load() > 0; });
+		if (m_Stopping && m_QueuedTasks.load() == 0)
+			return;
+	}
+}
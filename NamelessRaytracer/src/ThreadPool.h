@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "RenderCounters.h"
+
+// Worker pool with a deque per thread. Workers take from the back of their own deque and steal from the
+// front of everyone else's when they run dry, so uneven tasks (like empty sky tiles next to dense mesh tiles)
+// balance out without any central queue everyone fights over.
+// Every worker also gets its own render counters that whatever it runs counts into.
+
+class ThreadPool
+{
+public:
+	// The task gets the index of the worker running it so it can use per-thread data
+	using Task = std::function<void(uint32_t threadIndex)>;
+
+	// A thread count of 0 uses every hardware thread
+	ThreadPool(uint32_t threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void Submit(Task task);
+
+	// Blocks until every submitted task has finished
+	void Wait();
+
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Threads.size()); }
+
+	// Readable at any time, they only ever grow while tasks run
+	const ThreadCounters& GetCounters(uint32_t threadIndex) const { return m_Counters[threadIndex]; }
+	RenderCounterValues GetTotalCounters() const;
+
+	// Only while nothing is running, the workers write their counters without any lock
+	void ResetCounters();
+
+private:
+	struct WorkQueue
+	{
+		std::mutex Mutex;
+		std::deque<Task> Tasks;
+	};
+
+	void WorkerLoop(uint32_t threadIndex);
+	bool TryPop(uint32_t threadIndex, Task& task);
+	bool TrySteal(uint32_t threadIndex, Task& task);
+
+	std::vector<std::thread> m_Threads;
+	std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+	std::unique_ptr<ThreadCounters[]> m_Counters;
+
+	std::atomic<uint32_t> m_NextQueue = 0;
+	std::atomic<uint64_t> m_QueuedTasks = 0; // Submitted but not picked up by a worker yet
+	std::atomic<uint64_t> m_PendingTasks = 0; // Submitted but not finished yet
+	bool m_Stopping = false;
+
+	// Sleeping workers and Wait() both park on these
+	std::mutex m_SleepMutex;
+	std::condition_variable m_WorkAvailable;
+	std::condition_variable m_WorkFinished;
+};
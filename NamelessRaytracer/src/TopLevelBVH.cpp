@@ -0,0 +1,194 @@
+#include "TopLevelBVH.h"
+
+// Testing an instance means a transform and a whole BVH traversal, so it's always worth splitting further
+static constexpr uint32_t MaxInstancesPerLeaf = 1;
+
+void TopLevelBVH::Build(const std::vector<BVH>& meshes, const std::vector<MeshInstance>& instances)
+{
+	m_Nodes.clear();
+	m_Instances.clear();
+	m_WorldToObjects.assign(instances.size(), InstanceMatrix(Real(1)));
+	m_NormalMatrices.assign(instances.size(), InstanceMatrix(Real(1)));
+	m_Meshes = meshes.data();
+	m_Depth = 0;
+
+	// World space bounds of every instance from the 8 corners of its mesh's root node
+	std::vector<BuildPrimitive> buildInstances;
+	std::vector<uint32_t> instanceIndices;
+	buildInstances.reserve(instances.size());
+	instanceIndices.reserve(instances.size());
+	for (uint32_t i = 0; i < static_cast<uint32_t>(instances.size()); i++)
+	{
+		const MeshInstance& instance = instances[i];
+		const BVH& mesh = meshes[instance.MeshIndex];
+		if (mesh.GetNodeCount() == 0)
+			continue;
+
+		// The inverse and the normal matrix are worked out in double no matter what Real is
+		glm::dmat4 objectToWorld = glm::dmat4(instance.ObjectToWorld);
+		if (glm::determinant(objectToWorld) == 0.0)
+			continue;
+
+		glm::dmat4 worldToObject = glm::inverse(objectToWorld);
+		m_WorldToObjects[i] = InstanceMatrix(worldToObject);
+		m_NormalMatrices[i] = InstanceMatrix(glm::transpose(worldToObject));
+
+		const BVHNode& root = mesh.GetNodes()[0];
+		BuildPrimitive buildInstance;
+		for (uint32_t corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 point(
+				corner & 1 ? root.BoundsMax.x : root.BoundsMin.x,
+				corner & 2 ? root.BoundsMax.y : root.BoundsMin.y,
+				corner & 4 ? root.BoundsMax.z : root.BoundsMin.z
+			);
+			buildInstance.Bounds.Grow(glm::vec3(instance.ObjectToWorld * glm::vec4(point, 1.0f)));
+		}
+		buildInstance.Centroid = (buildInstance.Bounds.Min + buildInstance.Bounds.Max) * 0.5f;
+
+		buildInstances.push_back(buildInstance);
+		instanceIndices.push_back(i);
+	}
+
+	std::vector<uint32_t> order;
+	m_Depth = BuildBVHNodes(buildInstances, MaxInstancesPerLeaf, m_Nodes, order);
+
+	m_Instances.reserve(order.size());
+	for (uint32_t buildIndex : order)
+	{
+		uint32_t instanceIndex = instanceIndices[buildIndex];
+		m_Instances.push_back({ m_WorldToObjects[instanceIndex], instances[instanceIndex].MeshIndex, instanceIndex });
+	}
+}
+
+TriangleHit TopLevelBVH::Intersect(const Ray& ray, Real tMax) const
+{
+	TriangleHit closestHit = { tMax, Real(0), Real(0) };
+	CountRenderWork(RenderCounter::Rays, 1);
+	if (m_Nodes.empty())
+		return closestHit;
+
+	TraverseBVH(m_Nodes.data(), ray, closestHit.T, [&](uint32_t first, uint32_t count) {
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			const LeafInstance& instance = m_Instances[i];
+			Ray objectRay = {
+				Vec3(instance.WorldToObject * glm::vec<4, Real>(ray.Origin, Real(1))),
+				Vec3(instance.WorldToObject * glm::vec<4, Real>(ray.Direction, Real(0)))
+			};
+
+			// Only hits closer than the closest so far come back
+			TriangleHit hit = m_Meshes[instance.MeshIndex].Intersect(objectRay, closestHit.T);
+			if (hit.IsHit())
+			{
+				closestHit = hit;
+				closestHit.InstanceIndex = instance.InstanceIndex;
+			}
+		}
+	});
+
+	if (closestHit.IsHit())
+		CountRenderWork(RenderCounter::Hits, 1);
+	return closestHit;
+}
+
+bool TopLevelBVH::IsOccluded(const Ray& ray, Real tMin, Real tMax) const
+{
+	CountRenderWork(RenderCounter::Rays, 1);
+	if (m_Nodes.empty() || tMax <= tMin)
+		return false;
+
+	Ray clippedRay = { RayEquation(ray, tMin), ray.Direction };
+	Real length = tMax - tMin;
+	bool isOccluded = TraverseBVHAnyHit(m_Nodes.data(), clippedRay, static_cast<float>(length), [&](uint32_t first, uint32_t count) {
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			const LeafInstance& instance = m_Instances[i];
+			Ray objectRay = {
+				Vec3(instance.WorldToObject * glm::vec<4, Real>(clippedRay.Origin, Real(1))),
+				Vec3(instance.WorldToObject * glm::vec<4, Real>(clippedRay.Direction, Real(0)))
+			};
+			if (m_Meshes[instance.MeshIndex].IsOccluded(objectRay, length))
+				return true;
+		}
+		return false;
+	});
+
+	if (isOccluded)
+		CountRenderWork(RenderCounter::Hits, 1);
+	return isOccluded;
+}
+
+void TopLevelBVH::IntersectPacket(RayPacket& packet, TriangleHitT<float>* hits) const
+{
+	CountRenderWork(RenderCounter::Rays, packet.Count);
+	if (m_Nodes.empty())
+		return;
+
+	// Reused for every instance, they're a few kilobytes each
+	RayPacket objectPacket;
+	TriangleHitT<float> objectHits[RayPacket::MaxSize];
+	uint32_t rayIndices[RayPacket::MaxSize];
+
+	uint32_t groupCount = packet.GetGroupCount();
+	TraverseBVHPacket(m_Nodes.data(), packet, [&](const BVHNode& node, uint32_t firstGroup) {
+		// Only the rays that reach the leaf are worth moving into object space
+		objectPacket.Clear();
+		for (uint32_t group = firstGroup; group < groupCount; group++)
+		{
+			uint32_t mask = packet.IntersectGroup(node.BoundsMin, node.BoundsMax, group);
+			for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1)
+			{
+				if (mask & 1)
+					rayIndices[objectPacket.Count++] = group * RayPacket::GroupSize + lane;
+			}
+		}
+		uint32_t rayCount = objectPacket.Count;
+
+		for (uint32_t i = node.LeftFirst; i < node.LeftFirst + node.TriangleCount; i++)
+		{
+			// Transformed exactly like Intersect does it so both find the same hits
+			const LeafInstance& instance = m_Instances[i];
+			glm::mat4 worldToObject = glm::mat4(instance.WorldToObject);
+			objectPacket.Clear();
+			for (uint32_t j = 0; j < rayCount; j++)
+			{
+				uint32_t r = rayIndices[j];
+				glm::vec3 origin(packet.OriginX[r], packet.OriginY[r], packet.OriginZ[r]);
+				glm::vec3 direction(packet.DirectionX[r], packet.DirectionY[r], packet.DirectionZ[r]);
+				objectPacket.AddRay(glm::vec3(worldToObject * glm::vec4(origin, 1.0f)), glm::vec3(worldToObject * glm::vec4(direction, 0.0f)),
+					packet.TMax[r]);
+				objectHits[j] = hits[r];
+			}
+			objectPacket.Finish();
+
+			m_Meshes[instance.MeshIndex].IntersectPacket(objectPacket, objectHits);
+			for (uint32_t j = 0; j < rayCount; j++)
+			{
+				uint32_t r = rayIndices[j];
+				if (objectPacket.TMax[j] < packet.TMax[r])
+				{
+					packet.TMax[r] = objectPacket.TMax[j];
+					hits[r] = objectHits[j];
+					hits[r].InstanceIndex = instance.InstanceIndex;
+				}
+			}
+		}
+	});
+
+	uint64_t hitCount = 0;
+	for (uint32_t i = 0; i < packet.Count; i++)
+		hitCount += hits[i].IsHit() ? 1 : 0;
+	CountRenderWork(RenderCounter::Hits, hitCount);
+}
+
+AABB TopLevelBVH::GetBounds() const
+{
+	AABB bounds;
+	if (!m_Nodes.empty())
+	{
+		bounds.Min = m_Nodes[0].BoundsMin;
+		bounds.Max = m_Nodes[0].BoundsMax;
+	}
+	return bounds;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+
+#include "glm/glm.hpp"
+
+#include "Ray.h"
+#include "Model.h"
+#include "BVH.h"
+
+// Two level acceleration structure
+// Every unique mesh has its own BVH built in object space and this hierarchy goes over the instances that place
+// them in the world. Rays that reach an instance get moved into its object space instead of the geometry being
+// moved into the world, so a mesh used by a thousand nodes is still only stored and built once.
+
+using InstanceMatrix = glm::mat<4, 4, Real>;
+
+class TopLevelBVH
+{
+public:
+	TopLevelBVH() = default;
+
+	// meshes[i] has to be the BVH of mesh i and has to outlive this. Instances that can't be inverted are left out
+	void Build(const std::vector<BVH>& meshes, const std::vector<MeshInstance>& instances);
+
+	// Closest hit over every instance. hit.Index is a triangle of the hit mesh and hit.InstanceIndex is the index
+	// of the instance in the list it was built from. Object space t is the same as world space t because the ray
+	// direction is transformed without being normalized again
+	TriangleHit Intersect(const Ray& ray, Real tMax = std::numeric_limits<Real>::infinity()) const;
+
+	// True when anything blocks the ray between tMin and tMax, for shadow rays. Stops at the first hit it finds
+	// and doesn't work out any hit attributes. tMin works by moving the origin up the ray, which keeps a ray that
+	// starts on a surface from hitting that surface again
+	bool IsOccluded(const Ray& ray, Real tMin, Real tMax) const;
+
+	// Intersect for a whole packet, see BVH::IntersectPacket. Every instance the packet reaches gets the rays from
+	// the first active group on moved into its object space as a packet of their own
+	void IntersectPacket(RayPacket& packet, TriangleHitT<float>* hits) const;
+
+	// Moves an object space normal of an instance into world space, not normalized
+	Vec3 NormalToWorld(uint32_t instanceIndex, const Vec3& normal) const
+	{
+		return Vec3(m_NormalMatrices[instanceIndex] * glm::vec<4, Real>(normal, Real(0)));
+	}
+
+	// The inverse of an instance's ObjectToWorld, identity for instances that can't be inverted
+	const InstanceMatrix& GetWorldToObject(uint32_t instanceIndex) const { return m_WorldToObjects[instanceIndex]; }
+
+	// World space bounds of everything, empty before the first build
+	AABB GetBounds() const;
+
+	uint32_t GetNodeCount() const { return static_cast<uint32_t>(m_Nodes.size()); }
+	uint32_t GetDepth() const { return m_Depth; }
+
+private:
+	// Stored in leaf order so a leaf's instances are next to each other
+	struct LeafInstance
+	{
+		InstanceMatrix WorldToObject;
+		uint32_t MeshIndex;
+		uint32_t InstanceIndex;
+	};
+
+	std::vector<BVHNode> m_Nodes;
+	std::vector<LeafInstance> m_Instances;
+	std::vector<InstanceMatrix> m_WorldToObjects; // Indexed by instance, not leaf order
+	std::vector<InstanceMatrix> m_NormalMatrices; // Same, the transposes of m_WorldToObjects
+	const BVH* m_Meshes = nullptr;
+	uint32_t m_Depth = 0;
+};
@@ -0,0 +1,234 @@
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "Ray.h"
+#include "Camera.h"
+#include "Model.h"
+#include "BVH.h"
+#include "ThreadPool.h"
+#include "RenderCounters.h"
+#include "Renderer.h"
+#include "ProgressiveRenderer.h"
+#include "StreamingTexture.h"
+
+#define GLFW_INCLUDE_NONE
+#include "GLFW/glfw3.h"
+#include "glad/glad.h"
+
+#include "imgui.h"
+#include "backends/imgui_impl_glfw.h"
+#include "backends/imgui_impl_opengl3.h"
+
+// Interactive window. The render runs on its own threads and the window just shows whatever the newest
+// pass is, so the UI keeps up with vsync no matter how slow a pass gets.
+static int32_t RunViewer(uint32_t threadCount)
+{
+	Scene scene;
+	if (!LoadScene(scene, "amongus.glb"))
+		return -1;
+
+	RenderSettings settings;
+	settings.SamplesPerPixel = 1024; // Keeps refining until the camera moves
+	settings.ErrorThreshold = 0.005f; // or until every pixel is clean enough
+	CameraSettings view;
+
+	if (!glfwInit())
+		return -1;
+
+	GLFWwindow* window = glfwCreateWindow(settings.Width, settings.Height, "I am not putting hello world here again", NULL, NULL);
+	if (!window)
+	{
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	glfwSwapInterval(1);
+
+	int status = gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+	if (!status)
+	{
+		glfwTerminate();
+		return -1;
+	}
+
+	IMGUI_CHECKVERSION();
+	ImGui::CreateContext();
+	ImGuiIO& io = ImGui::GetIO();
+
+	ImGui::StyleColorsDark();
+
+	ImGui_ImplGlfw_InitForOpenGL(window, true);
+	ImGui_ImplOpenGL3_Init();
+
+	{
+		// Both have to go before the GL context does
+		StreamingTexture texture(settings.Width, settings.Height);
+		ProgressiveRenderer renderer(scene, view.MakeCamera(settings), settings, threadCount);
+		uint64_t frameVersion = 0;
+		bool useReprojection = true;
+
+		// Rates are over the last half second or so, per frame they jump around too much to read
+		const ThreadPool& pool = renderer.GetPool();
+		std::vector<RenderCounterValues> previousCounters(pool.GetThreadCount());
+		std::vector<double> raysPerSecond(pool.GetThreadCount(), 0.0);
+		double previousCountTime = glfwGetTime();
+
+		while (!glfwWindowShouldClose(window))
+		{
+			glfwPollEvents();
+
+			// Only uploads when a new pass has been published since the last one
+			if (renderer.GetFrameVersion() != frameVersion)
+			{
+				if (uint32_t* pixels = texture.BeginUpload())
+				{
+					renderer.CopyLatestFrame(pixels, frameVersion);
+					texture.EndUpload();
+				}
+			}
+
+			ImGui_ImplOpenGL3_NewFrame();
+			ImGui_ImplGlfw_NewFrame();
+			ImGui::NewFrame();
+
+			// Render fitted to the window behind every other window
+			float scale = std::min(io.DisplaySize.x / static_cast<float>(settings.Width), io.DisplaySize.y / static_cast<float>(settings.Height));
+			ImVec2 imageSize(static_cast<float>(settings.Width) * scale, static_cast<float>(settings.Height) * scale);
+			ImVec2 imageMin((io.DisplaySize.x - imageSize.x) / 2.0f, (io.DisplaySize.y - imageSize.y) / 2.0f);
+			ImGui::GetBackgroundDrawList()->AddImage((ImTextureID)(intptr_t)texture.GetTexture(),
+				imageMin, ImVec2(imageMin.x + imageSize.x, imageMin.y + imageSize.y));
+
+			ImGui::Begin("Render");
+			ImGui::Text("%u / %d samples", renderer.GetSampleCount(), settings.SamplesPerPixel);
+			ImGui::Text("%u pixels still refining", renderer.GetActivePixelCount());
+			ImGui::Text("%.1f ms per pass", renderer.GetLastPassTime() * 1000.0);
+			ImGui::Text("%u pixels kept by the last camera move", renderer.GetReusedPixelCount());
+			ImGui::Text("%.1f fps", io.Framerate);
+			ImGui::TextDisabled(texture.IsPersistentlyMapped() ? "Persistently mapped upload" : "Remapped upload");
+			ImGui::Separator();
+
+			if (ImGui::Checkbox("Keep samples across camera moves", &useReprojection))
+				renderer.SetReprojection(useReprojection);
+
+			// Any edit restarts the accumulation, apart from the pixels that still see the same surface
+			bool cameraChanged = false;
+			cameraChanged |= ImGui::DragFloat3("Look from", &view.LookFrom.x, 0.05f);
+			cameraChanged |= ImGui::DragFloat3("Look at", &view.LookAt.x, 0.05f);
+			cameraChanged |= ImGui::SliderFloat("Field of view", &view.FieldOfView, 10.0f, 120.0f);
+			cameraChanged |= ImGui::SliderFloat("Aperture", &view.Aperture, 0.0f, 1.0f);
+			cameraChanged |= ImGui::DragFloat("Focus distance", &view.FocusDistance, 0.05f, 0.1f, 100.0f);
+			if (cameraChanged)
+				renderer.SetCamera(view.MakeCamera(settings));
+			ImGui::End();
+
+			double countTime = glfwGetTime();
+			if (countTime - previousCountTime >= 0.5)
+			{
+				for (uint32_t i = 0; i < pool.GetThreadCount(); i++)
+				{
+					RenderCounterValues counters = pool.GetCounters(i).Read();
+					raysPerSecond[i] = static_cast<double>(counters.Get(RenderCounter::Rays) - previousCounters[i].Get(RenderCounter::Rays)) / (countTime - previousCountTime);
+					previousCounters[i] = counters;
+				}
+				previousCountTime = countTime;
+			}
+
+			// Everything but the rate is a total since the viewer started
+			ImGui::Begin("Threads");
+			if (ImGui::BeginTable("Counters", 8, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+			{
+				const char* headers[] = { "Thread", "Mrays/s", "Rays", "Tests/ray", "Visits/ray", "Hits", "Samples", "ms/tile" };
+				for (const char* header : headers)
+					ImGui::TableSetupColumn(header);
+				ImGui::TableHeadersRow();
+
+				RenderCounterValues total;
+				double totalRaysPerSecond = 0.0;
+				for (uint32_t i = 0; i <= pool.GetThreadCount(); i++)
+				{
+					bool isTotal = i == pool.GetThreadCount();
+					RenderCounterValues counters = isTotal ? total : previousCounters[i];
+					if (!isTotal)
+					{
+						total += counters;
+						totalRaysPerSecond += raysPerSecond[i];
+					}
+
+					double rays = static_cast<double>(std::max<uint64_t>(counters.Get(RenderCounter::Rays), 1));
+					double tiles = static_cast<double>(std::max<uint64_t>(counters.Get(RenderCounter::Tiles), 1));
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					if (isTotal)
+						ImGui::Text("All");
+					else
+						ImGui::Text("%u", i);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f", (isTotal ? totalRaysPerSecond : raysPerSecond[i]) / 1e6);
+					ImGui::TableNextColumn();
+					ImGui::Text("%llu", static_cast<unsigned long long>(counters.Get(RenderCounter::Rays)));
+					ImGui::TableNextColumn();
+					ImGui::Text("%.1f", static_cast<double>(counters.Get(RenderCounter::TriangleTests)) / rays);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.1f", static_cast<double>(counters.Get(RenderCounter::NodeVisits)) / rays);
+					ImGui::TableNextColumn();
+					ImGui::Text("%llu", static_cast<unsigned long long>(counters.Get(RenderCounter::Hits)));
+					ImGui::TableNextColumn();
+					ImGui::Text("%llu", static_cast<unsigned long long>(counters.Get(RenderCounter::Samples)));
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f", static_cast<double>(counters.Get(RenderCounter::TileNanoseconds)) / tiles / 1e6);
+				}
+				ImGui::EndTable();
+			}
+			ImGui::End();
+
+			ImGui::Render();
+			int32_t width, height;
+			glfwGetFramebufferSize(window, &width, &height);
+			glViewport(0, 0, width, height);
+			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+
+			glfwSwapBuffers(window);
+		}
+	}
+
+	ImGui_ImplOpenGL3_Shutdown();
+	ImGui_ImplGlfw_Shutdown();
+	ImGui::DestroyContext();
+
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return 0;
+}
+
+static bool ParseInt(const std::string& text, int32_t& value, int32_t minimum)
+{
+	char trailing;
+	return std::sscanf(text.c_str(), "%d%c", &value, &trailing) == 1 && value >= minimum;
+}
+
+int main(int argc, char** argv)
+{
+	// Rendering straight to a file lives in the headless executable
+	uint32_t threadCount = 0;
+	for (int32_t i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		int32_t value = 0;
+		if (arg == "--threads" && i + 1 < argc && ParseInt(argv[++i], value, 0))
+			threadCount = static_cast<uint32_t>(value);
+		else
+		{
+			std::cout << "Usage: NamelessRaytracer [--threads <count>]\n";
+			return -1;
+		}
+	}
+
+	return RunViewer(threadCount);
+}
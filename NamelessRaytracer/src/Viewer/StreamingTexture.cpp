@@ -0,0 +1,128 @@
+#include "StreamingTexture.h"
+
+#define GLFW_INCLUDE_NONE
+#include "GLFW/glfw3.h"
+
+// The glad loader is generated for GL 4.3, so the 4.4 buffer storage bits are looked up by hand
+#ifndef GL_MAP_PERSISTENT_BIT
+	#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+	#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+static PFNGLBUFFERSTORAGEPROC LoadBufferStorage()
+{
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	bool supported = major > 4 || (major == 4 && minor >= 4) || glfwExtensionSupported("GL_ARB_buffer_storage");
+	if (!supported)
+		return nullptr;
+	return reinterpret_cast<PFNGLBUFFERSTORAGEPROC>(glfwGetProcAddress("glBufferStorage"));
+}
+
+StreamingTexture::StreamingTexture(uint32_t width, uint32_t height)
+	: m_Width(width), m_Height(height), m_ImageSize(static_cast<size_t>(width) * height * sizeof(uint32_t))
+{
+	glGenTextures(1, &m_Texture);
+	glBindTexture(GL_TEXTURE_2D, m_Texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenBuffers(1, &m_PixelBuffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PixelBuffer);
+
+	if (PFNGLBUFFERSTORAGEPROC bufferStorage = LoadBufferStorage())
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GLsizeiptr size = static_cast<GLsizeiptr>(m_ImageSize * RegionCount);
+		bufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+		m_PersistentData = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+	}
+
+	if (!m_PersistentData)
+	{
+		// Buffer storage is immutable so a failed map needs a fresh buffer for the fallback
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &m_PixelBuffer);
+		glGenBuffers(1, &m_PixelBuffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PixelBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(m_ImageSize), nullptr, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+StreamingTexture::~StreamingTexture()
+{
+	for (GLsync fence : m_Fences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+	}
+
+	if (m_PersistentData)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PixelBuffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	glDeleteBuffers(1, &m_PixelBuffer);
+	glDeleteTextures(1, &m_Texture);
+}
+
+uint32_t* StreamingTexture::BeginUpload()
+{
+	if (m_PersistentData)
+	{
+		// Only waits if the GPU is still copying out of the region from RegionCount uploads ago
+		GLsync& fence = m_Fences[m_Region];
+		if (fence)
+		{
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+		return reinterpret_cast<uint32_t*>(m_PersistentData + m_ImageSize * m_Region);
+	}
+
+	// Orphaning gives the driver a fresh block instead of waiting on the previous upload
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PixelBuffer);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(m_ImageSize), nullptr, GL_STREAM_DRAW);
+	void* data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(m_ImageSize),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	return static_cast<uint32_t*>(data);
+}
+
+void StreamingTexture::EndUpload()
+{
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PixelBuffer);
+
+	size_t offset = 0;
+	if (m_PersistentData)
+		offset = m_ImageSize * m_Region;
+	else
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	glBindTexture(GL_TEXTURE_2D, m_Texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, static_cast<GLsizei>(m_Width), static_cast<GLsizei>(m_Height),
+		GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(offset));
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (m_PersistentData)
+	{
+		m_Fences[m_Region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_Region = (m_Region + 1) % RegionCount;
+	}
+}
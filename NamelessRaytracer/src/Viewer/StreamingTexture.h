@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "glad/glad.h"
+
+// RGBA8 texture that gets a whole new image most frames
+// Uploads go through a pixel buffer object so glTexSubImage2D copies on the GPU side instead of stalling on
+// client memory. With GL 4.4 buffer storage the PBO is mapped once, persistently, and split into a ring of
+// regions fenced so the CPU never writes into a region the GPU is still copying from. Older drivers fall
+// back to orphaning and remapping the PBO every upload.
+
+class StreamingTexture
+{
+public:
+	// Needs a current GL context
+	StreamingTexture(uint32_t width, uint32_t height);
+	~StreamingTexture();
+
+	StreamingTexture(const StreamingTexture&) = delete;
+	StreamingTexture& operator=(const StreamingTexture&) = delete;
+
+	// Returns Width * Height pixels to write the next image into, valid until EndUpload
+	uint32_t* BeginUpload();
+	void EndUpload();
+
+	GLuint GetTexture() const { return m_Texture; }
+	uint32_t GetWidth() const { return m_Width; }
+	uint32_t GetHeight() const { return m_Height; }
+	bool IsPersistentlyMapped() const { return m_PersistentData != nullptr; }
+
+private:
+	static constexpr uint32_t RegionCount = 3;
+
+	uint32_t m_Width, m_Height;
+	size_t m_ImageSize;
+
+	GLuint m_Texture = 0;
+	GLuint m_PixelBuffer = 0;
+
+	// Persistent path
+	uint8_t* m_PersistentData = nullptr;
+	GLsync m_Fences[RegionCount] = {};
+	uint32_t m_Region = 0;
+};
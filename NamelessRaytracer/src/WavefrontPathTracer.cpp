@@ -0,0 +1,287 @@
+#include "WavefrontPathTracer.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "Random.h"
+#include "RayPacket.h"
+
+// Sort keys are the direction octant over a 9 bit Morton code of the origin's cell, 8 cells along each axis
+static constexpr uint32_t CellsPerAxis = 8;
+static constexpr uint32_t BinCount = 8 * CellsPerAxis * CellsPerAxis * CellsPerAxis;
+static constexpr uint16_t InvalidKey = 0xFFFF;
+
+// Queue entries handed to one task at a time. Also the chunks the sort keeps a histogram for
+static constexpr uint32_t ChunkSize = 8192;
+
+static constexpr double Pi = 3.14159265358979323846;
+static constexpr float InversePi = static_cast<float>(1.0 / Pi);
+
+// Splits [0, count) into ChunkSize pieces and runs them on the pool. Blocks until every piece is done
+template<typename Function>
+static void ParallelFor(ThreadPool& pool, uint32_t count, const Function& function)
+{
+	for (uint32_t begin = 0; begin < count; begin += ChunkSize)
+	{
+		uint32_t end = std::min(begin + ChunkSize, count);
+		pool.Submit([&function, begin, end](uint32_t) {
+			function(begin, end);
+		});
+	}
+	pool.Wait();
+}
+
+// Spreads the low 3 bits out to every third bit
+static uint32_t SpreadBits(uint32_t value)
+{
+	return (value & 1) | ((value & 2) << 2) | ((value & 4) << 4);
+}
+
+WavefrontPathTracer::WavefrontPathTracer(const Scene& scene, const Camera& camera, const RenderSettings& settings, ThreadPool& pool)
+	: m_Scene(scene), m_Camera(camera), m_Settings(settings), m_Pool(pool)
+{
+	AABB bounds = scene.Accelerator.GetBounds();
+	glm::vec3 extent = glm::max(bounds.Max - bounds.Min, glm::vec3(1e-6f));
+	m_BoundsMin = bounds.Min;
+	m_CellScale = static_cast<float>(CellsPerAxis) / extent;
+
+	m_Paths.resize(MaxBatchSize);
+	m_Rays.resize(MaxBatchSize);
+	m_Hits.resize(MaxBatchSize);
+	m_Bounces.resize(MaxBatchSize);
+	m_Shadows.resize(MaxBatchSize);
+	m_ShadowRays.resize(MaxBatchSize);
+	m_SortKeys.resize(MaxBatchSize);
+	m_BinOffsets.resize(static_cast<size_t>(MaxBatchSize / ChunkSize) * BinCount);
+}
+
+void WavefrontPathTracer::TraceSamples(uint32_t firstPixel, uint32_t count, uint32_t sampleIndex, glm::vec3* colors, SampleFeatures* features)
+{
+	count = std::min(count, MaxBatchSize);
+	GenerateCameraRays(firstPixel, count, sampleIndex);
+
+	// Every stage runs over the whole batch before the next one starts. The shading leaves a slot for a bounce and
+	// a shadow ray behind every ray it's given, the sorts compact the slots that got used
+	uint32_t slotCount = count;
+	for (uint32_t bounce = 0; ; bounce++)
+	{
+		uint32_t rayCount = SortRays(m_Bounces, slotCount, m_Rays);
+		if (rayCount == 0)
+			break;
+
+		IntersectRays(rayCount);
+		ShadeHits(rayCount, bounce, sampleIndex, features);
+
+		uint32_t shadowCount = SortRays(m_Shadows, rayCount, m_ShadowRays);
+		TraceShadowRays(shadowCount);
+
+		m_RayCount += rayCount + shadowCount;
+		slotCount = rayCount;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+		colors[i] = m_Paths[i].Radiance;
+}
+
+void WavefrontPathTracer::GenerateCameraRays(uint32_t firstPixel, uint32_t count, uint32_t sampleIndex)
+{
+	uint32_t width = static_cast<uint32_t>(m_Settings.Width);
+	ParallelFor(m_Pool, count, [&](uint32_t begin, uint32_t end) {
+		CountRenderWork(RenderCounter::Samples, end - begin);
+		for (uint32_t i = begin; i < end; i++)
+		{
+			uint32_t pixelIndex = firstPixel + i;
+			Ray ray = GetCameraRay(m_Camera, m_Settings, static_cast<int32_t>(pixelIndex % width), static_cast<int32_t>(pixelIndex / width), sampleIndex);
+			m_Paths[i] = { glm::vec3(1.0f), glm::vec3(0.0f), pixelIndex };
+			m_Bounces[i] = { ray.Origin, ray.Direction, i, glm::vec3(0.0f) };
+		}
+	});
+}
+
+uint32_t WavefrontPathTracer::SortRays(const std::vector<QueuedRay>& input, uint32_t count, std::vector<QueuedRay>& output)
+{
+	// Parallel counting sort. Every chunk counts its keys, the prefix sum over (bin, chunk) gives every chunk its
+	// own range in every bin, and the chunks scatter into those. Nothing depends on which thread runs what
+	uint32_t chunkCount = (count + ChunkSize - 1) / ChunkSize;
+	std::fill(m_BinOffsets.begin(), m_BinOffsets.begin() + static_cast<std::ptrdiff_t>(chunkCount) * BinCount, 0u);
+
+	ParallelFor(m_Pool, count, [&](uint32_t begin, uint32_t end) {
+		uint32_t* histogram = m_BinOffsets.data() + static_cast<size_t>(begin / ChunkSize) * BinCount;
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const QueuedRay& ray = input[i];
+			if (ray.PathIndex == InvalidPath)
+			{
+				m_SortKeys[i] = InvalidKey;
+				continue;
+			}
+
+			glm::vec3 cell = glm::min(glm::max((glm::vec3(ray.Origin) - m_BoundsMin) * m_CellScale, glm::vec3(0.0f)), glm::vec3(CellsPerAxis - 1));
+			uint32_t morton = SpreadBits(static_cast<uint32_t>(cell.x)) | (SpreadBits(static_cast<uint32_t>(cell.y)) << 1) |
+				(SpreadBits(static_cast<uint32_t>(cell.z)) << 2);
+			uint32_t octant = (ray.Direction.x < 0 ? 1 : 0) | (ray.Direction.y < 0 ? 2 : 0) | (ray.Direction.z < 0 ? 4 : 0);
+			uint16_t key = static_cast<uint16_t>(octant << 9 | morton);
+			m_SortKeys[i] = key;
+			histogram[key]++;
+		}
+	});
+
+	uint32_t total = 0;
+	for (uint32_t bin = 0; bin < BinCount; bin++)
+	{
+		for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+		{
+			uint32_t& offset = m_BinOffsets[static_cast<size_t>(chunk) * BinCount + bin];
+			uint32_t binCount = offset;
+			offset = total;
+			total += binCount;
+		}
+	}
+
+	ParallelFor(m_Pool, count, [&](uint32_t begin, uint32_t end) {
+		uint32_t* offsets = m_BinOffsets.data() + static_cast<size_t>(begin / ChunkSize) * BinCount;
+		for (uint32_t i = begin; i < end; i++)
+		{
+			if (m_SortKeys[i] != InvalidKey)
+				output[offsets[m_SortKeys[i]]++] = input[i];
+		}
+	});
+
+	return total;
+}
+
+void WavefrontPathTracer::IntersectRays(uint32_t count)
+{
+	ParallelFor(m_Pool, count, [&](uint32_t begin, uint32_t end) {
+#ifndef NR_DOUBLE_PRECISION
+		// After the sort neighbours mostly start in the same cell and go the same way, so runs of them go down the
+		// BVH together like camera rays do. The ones that still aren't coherent enough get traced on their own
+		if (m_Settings.UsePacketTracing)
+		{
+			RayPacket packet;
+			for (uint32_t first = begin; first < end; first += RayPacket::MaxSize)
+			{
+				uint32_t packetEnd = std::min(first + RayPacket::MaxSize, end);
+				packet.Clear();
+				for (uint32_t i = first; i < packetEnd; i++)
+				{
+					m_Hits[i] = { std::numeric_limits<Real>::infinity(), Real(0), Real(0) };
+					packet.AddRay(m_Rays[i].Origin, m_Rays[i].Direction, m_Hits[i].T);
+				}
+				packet.Finish();
+
+				if (packet.IsCoherent)
+					m_Scene.Accelerator.IntersectPacket(packet, m_Hits.data() + first);
+				else
+				{
+					for (uint32_t i = first; i < packetEnd; i++)
+						m_Hits[i] = m_Scene.Accelerator.Intersect({ m_Rays[i].Origin, m_Rays[i].Direction });
+				}
+			}
+			return;
+		}
+#endif
+
+		for (uint32_t i = begin; i < end; i++)
+			m_Hits[i] = m_Scene.Accelerator.Intersect({ m_Rays[i].Origin, m_Rays[i].Direction });
+	});
+}
+
+void WavefrontPathTracer::ShadeHits(uint32_t count, uint32_t bounce, uint32_t sampleIndex, SampleFeatures* features)
+{
+	ParallelFor(m_Pool, count, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const QueuedRay& queued = m_Rays[i];
+			PathState& path = m_Paths[queued.PathIndex];
+			m_Bounces[i].PathIndex = InvalidPath;
+			m_Shadows[i].PathIndex = InvalidPath;
+
+			Ray ray = { queued.Origin, queued.Direction };
+			const TriangleHit& hit = m_Hits[i];
+			if (!hit.IsHit())
+			{
+				path.Radiance += path.Throughput * m_Scene.SkyColor;
+				if (bounce == 0 && features)
+					features[queued.PathIndex] = SampleFeatures();
+				continue;
+			}
+
+			// Queued rays don't carry differentials, every hit gets the footprint a camera ray would have there
+			Real footprint = GetDifferentialScale(m_Settings);
+			RayDifferential differential = m_Camera.ApproximateDifferential(RayEquation(ray, hit.T),
+				footprint / static_cast<Real>(m_Settings.Width - 1), footprint / static_cast<Real>(m_Settings.Height - 1));
+			IntersectionResult surface = ComputeHitAttributes(m_Scene, ray, hit, &differential);
+			if (bounce == 0 && features)
+			{
+				SampleFeatures& feature = features[queued.PathIndex];
+				feature.Albedo = surface.Albedo;
+				feature.Normal = glm::vec3(surface.ShadingNormal);
+				feature.Depth = static_cast<float>(hit.T * glm::length(ray.Direction));
+			}
+
+			// Both normals get turned to the side the ray came from, the meshes aren't closed everywhere
+			Vec3 normal = glm::dot(surface.Normal, ray.Direction) < Real(0) ? surface.Normal : -surface.Normal;
+			Vec3 shadingNormal = glm::dot(surface.ShadingNormal, normal) < Real(0) ? -surface.ShadingNormal : surface.ShadingNormal;
+
+			// Same offset as the direct shading's shadow rays. Bounce rays can't start a little way along anyway,
+			// packets have no tMin
+			Vec3 origin = OffsetRayOrigin(surface.Position, normal);
+
+			// Next event estimation, the point light can only ever be hit on purpose
+			Vec3 toLight = m_Scene.Light - origin;
+			Real distanceSquared = glm::dot(toLight, toLight);
+			float cosine = static_cast<float>(glm::dot(toLight, shadingNormal) / std::sqrt(distanceSquared));
+			if (cosine > 0.0f && glm::dot(toLight, normal) > Real(0))
+			{
+				glm::vec3 contribution = path.Throughput * surface.Albedo * (InversePi * m_Scene.LightIntensity * cosine / static_cast<float>(distanceSquared));
+				m_Shadows[i] = { origin, toLight, queued.PathIndex, contribution };
+			}
+
+			if (bounce >= static_cast<uint32_t>(m_Settings.MaxBounces))
+				continue;
+
+			RandomStream random(path.PixelIndex, sampleIndex, static_cast<RandomDimension>(static_cast<uint32_t>(RandomDimension::Bounce) + bounce));
+			glm::vec3 throughput = path.Throughput * surface.Albedo;
+
+			// Russian roulette, paths that can't add much any more mostly stop here and the survivors make up for them
+			if (bounce >= 2)
+			{
+				float survival = std::min(std::max(throughput.x, std::max(throughput.y, throughput.z)), 0.95f);
+				if (static_cast<float>(random.NextDouble()) >= survival)
+					continue;
+				throughput /= survival;
+			}
+
+			// Cosine weighted hemisphere sample, its pdf cancels the Lambertian BRDF down to just the albedo
+			Real r1 = static_cast<Real>(random.NextDouble());
+			Real r2 = static_cast<Real>(random.NextDouble());
+			Real radius = std::sqrt(r1);
+			Real phi = Real(2 * Pi) * r2;
+			Vec3 tangent = glm::normalize(glm::cross(std::abs(shadingNormal.x) > Real(0.9) ? Vec3(0, 1, 0) : Vec3(1, 0, 0), shadingNormal));
+			Vec3 bitangent = glm::cross(shadingNormal, tangent);
+			Vec3 direction = tangent * (radius * std::cos(phi)) + bitangent * (radius * std::sin(phi)) +
+				shadingNormal * std::sqrt(std::max(Real(0), Real(1) - r1));
+
+			// Shading normals can tilt the hemisphere under the actual surface
+			if (glm::dot(direction, normal) <= Real(0))
+				continue;
+
+			path.Throughput = throughput;
+			m_Bounces[i] = { origin, direction, queued.PathIndex, glm::vec3(0.0f) };
+		}
+	});
+}
+
+void WavefrontPathTracer::TraceShadowRays(uint32_t count)
+{
+	ParallelFor(m_Pool, count, [&](uint32_t begin, uint32_t end) {
+		// A path has at most one shadow ray per bounce, so nothing else touches its radiance here
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const QueuedRay& shadow = m_ShadowRays[i];
+			if (!m_Scene.Accelerator.IsOccluded({ shadow.Origin, shadow.Direction }, Real(0), Real(1)))
+				m_Paths[shadow.PathIndex].Radiance += shadow.Contribution;
+		}
+	});
+}
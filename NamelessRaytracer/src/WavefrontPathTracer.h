@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "Ray.h"
+#include "Camera.h"
+#include "ThreadPool.h"
+#include "Renderer.h"
+
+// Wavefront path tracer (Laine, Karras and Aila 2013)
+// Instead of following one path at a time through every bounce, a whole batch of paths moves forward a stage at
+// a time: every path's ray gets intersected, then every hit gets shaded, then every shadow ray gets tested. Each
+// stage is one tight loop split over the pool, so the BVH and the triangles stay hot in cache for the whole batch
+// instead of getting thrown out by the shading of the path before. Between the stages the queues get binned by
+// direction octant and origin cell, which turns the scattered bounce rays back into runs of coherent rays that go
+// through the traversal as packets.
+// Surfaces are Lambertian with the vertex color times the material's base color as albedo, lit by the scene's
+// point light through shadow rays and by a constant sky.
+
+class WavefrontPathTracer
+{
+public:
+	WavefrontPathTracer(const Scene& scene, const Camera& camera, const RenderSettings& settings, ThreadPool& pool);
+
+	// Traces sample sampleIndex of the count pixels starting at firstPixel in scanline order, at most MaxBatchSize
+	// at a time. colors and features (when not null) get one entry per pixel, the features from the first hit
+	void TraceSamples(uint32_t firstPixel, uint32_t count, uint32_t sampleIndex, glm::vec3* colors, SampleFeatures* features);
+
+	// Every ray traced so far, shadow rays included
+	uint64_t GetRayCount() const { return m_RayCount; }
+
+	static constexpr uint32_t MaxBatchSize = 1 << 17;
+
+private:
+	static constexpr uint32_t InvalidPath = 0xFFFFFFFF;
+
+	struct PathState
+	{
+		glm::vec3 Throughput;
+		glm::vec3 Radiance;
+		uint32_t PixelIndex; // Keys the path's random streams
+	};
+
+	// A ray waiting in a queue. Shadow rays carry what they add to their path if nothing blocks them
+	struct QueuedRay
+	{
+		Vec3 Origin;
+		Vec3 Direction; // Shadow rays reach the light at t = 1
+		uint32_t PathIndex; // InvalidPath for a slot the shading stage left empty
+		glm::vec3 Contribution;
+	};
+
+	void GenerateCameraRays(uint32_t firstPixel, uint32_t count, uint32_t sampleIndex);
+	void IntersectRays(uint32_t count);
+	void ShadeHits(uint32_t count, uint32_t bounce, uint32_t sampleIndex, SampleFeatures* features);
+	void TraceShadowRays(uint32_t count);
+
+	// Compacts the filled slots of input into output, binned by direction octant and then origin. Stable, so the
+	// order only depends on the input. Returns how many rays made it
+	uint32_t SortRays(const std::vector<QueuedRay>& input, uint32_t count, std::vector<QueuedRay>& output);
+
+	const Scene& m_Scene;
+	const Camera& m_Camera;
+	const RenderSettings& m_Settings;
+	ThreadPool& m_Pool;
+
+	// Origins get binned into cells of the scene's bounds
+	glm::vec3 m_BoundsMin;
+	glm::vec3 m_CellScale;
+
+	std::vector<PathState> m_Paths; // Indexed by the pixel's place in the batch
+	std::vector<QueuedRay> m_Rays; // Sorted and compacted, what gets intersected
+	std::vector<TriangleHit> m_Hits;
+	std::vector<QueuedRay> m_Bounces; // One slot per ray in m_Rays, filled by the shading
+	std::vector<QueuedRay> m_Shadows; // Same, sorted into m_ShadowRays
+	std::vector<QueuedRay> m_ShadowRays;
+
+	// Counting sort scratch, the key of every input slot and a histogram per chunk
+	std::vector<uint16_t> m_SortKeys;
+	std::vector<uint32_t> m_BinOffsets;
+
+	uint64_t m_RayCount = 0;
+};
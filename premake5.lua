@@ -5,38 +5,85 @@ workspace "NamelessRaytracer"
 	{
 		"Debug",
 		"Release",
-		"Dist"
+		"Dist",
+		"Validation" -- Release build with the ray pipeline in double precision
 	}
 
 outputdir = "%{cfg.system}-%{cfg.architecture}-%{cfg.buildcfg}"
 
+-- Raytracer code and the model loading code it needs, shared by every executable
+coreFiles =
+{
+	"NamelessRaytracer/src/*.h",
+	"NamelessRaytracer/src/*.cpp",
+
+	-- GLM code
+	"NamelessRaytracer/vendor/glm/glm/**.h",
+	"NamelessRaytracer/vendor/glm/glm/**.hpp",
+	"NamelessRaytracer/vendor/glm/glm/**.inl",
+
+	-- TinyGLTF and included stb_image code
+	"NamelessRaytracer/vendor/tinygltf/stb_image.h",
+	"NamelessRaytracer/vendor/tinygltf/stb_image_write.h",
+	"NamelessRaytracer/vendor/tinygltf/json.hpp",
+	"NamelessRaytracer/vendor/tinygltf/tiny_gltf.h",
+	"NamelessRaytracer/vendor/tinygltf/tiny_gltf.cc"
+}
+
+coreIncludeDirs =
+{
+	"NamelessRaytracer/src",
+	"NamelessRaytracer/vendor/glm",
+	"NamelessRaytracer/vendor/tinygltf"
+}
+
+function coreConfigurations()
+	filter "system:windows"
+		cppdialect "C++17"
+		staticruntime "On"
+		systemversion "10.0.19041.0"
+		links { "ws2_32" } -- Sockets for distributed rendering
+
+	filter "system:linux"
+		cppdialect "C++17"
+		links { "pthread" }
+
+	filter "configurations:Debug"
+		defines "DEBUG"
+		symbols "On"
+
+	filter "configurations:Release"
+		defines "RELEASE"
+		optimize "On"
+
+	filter "configurations:Dist"
+		defines "DIST"
+		optimize "On"
+
+	filter "configurations:Validation"
+		defines { "VALIDATION", "NR_DOUBLE_PRECISION" }
+		optimize "On"
+
+	filter {}
+end
+
+-- Interactive viewer
 project "NamelessRaytracer"
 	location "NamelessRaytracer"
 	kind "ConsoleApp"
 	language "C++"
 
 	targetdir ("bin/" .. outputdir .. "/")
-	objdir ("bin-int/" .. outputdir .. "/")
+	objdir ("bin-int/" .. outputdir .. "/%{prj.name}")
 
 	defines "_CRT_SECURE_NO_WARNINGS" -- For GLFW
 
+	files(coreFiles)
 	files
 	{
-		-- My code
-		"%{prj.name}/src/**.h",
-		"%{prj.name}/src/**.cpp",
-
-		-- GLM code
-		"%{prj.name}/vendor/glm/glm/**.h",
-		"%{prj.name}/vendor/glm/glm/**.hpp",
-		"%{prj.name}/vendor/glm/glm/**.inl",
-
-		-- TinyGLTF and included stb_image code
-		"%{prj.name}/vendor/tinygltf/stb_image.h",
-		"%{prj.name}/vendor/tinygltf/stb_image_write.h",
-		"%{prj.name}/vendor/tinygltf/json.hpp",
-		"%{prj.name}/vendor/tinygltf/tiny_gltf.h",
-		"%{prj.name}/vendor/tinygltf/tiny_gltf.cc",
+		-- Viewer code
+		"%{prj.name}/src/Viewer/**.h",
+		"%{prj.name}/src/Viewer/**.cpp",
 
 		-- Generated glad OpenGL loader code
 		"%{prj.name}/vendor/glad/include/glad/glad.h",
@@ -82,21 +129,15 @@ project "NamelessRaytracer"
 		"%{prj.name}/vendor/imgui/backends/imgui_impl_opengl3_loader.h"
 	}
 
+	includedirs(coreIncludeDirs)
 	includedirs
 	{
-		"%{prj.name}/src",
-		"%{prj.name}/vendor/glm",
-		"%{prj.name}/vendor/tinygltf",
 		"%{prj.name}/vendor/glad/include",
 		"%{prj.name}/vendor/glfw/include",
 		"%{prj.name}/vendor/imgui"
 	}
 
 	filter "system:windows"
-		cppdialect "C++17"
-		staticruntime "On"
-		systemversion "10.0.19041.0"
-
 		defines "_GLFW_WIN32"
 
 		files
@@ -118,14 +159,73 @@ project "NamelessRaytracer"
 			"%{prj.name}/vendor/glfw/src/win32_window.c"
 		}
 
-	filter "configurations:Debug"
-		defines "DEBUG"
-		symbols "On"
+	filter "system:linux"
+		defines "_GLFW_X11"
 
-	filter "configurations:Release"
-		defines "RELEASE"
-		optimize "On"
+		files
+		{
+			-- GLFW X11 implementation
+			"%{prj.name}/vendor/glfw/src/egl_context.c",
+			"%{prj.name}/vendor/glfw/src/osmesa_context.c",
+			"%{prj.name}/vendor/glfw/src/glx_context.c",
+			"%{prj.name}/vendor/glfw/src/x11_init.c",
+			"%{prj.name}/vendor/glfw/src/x11_monitor.c",
+			"%{prj.name}/vendor/glfw/src/x11_platform.h",
+			"%{prj.name}/vendor/glfw/src/x11_window.c",
+			"%{prj.name}/vendor/glfw/src/xkb_unicode.c",
+			"%{prj.name}/vendor/glfw/src/xkb_unicode.h",
+			"%{prj.name}/vendor/glfw/src/linux_joystick.c",
+			"%{prj.name}/vendor/glfw/src/linux_joystick.h",
+			"%{prj.name}/vendor/glfw/src/posix_module.c",
+			"%{prj.name}/vendor/glfw/src/posix_poll.c",
+			"%{prj.name}/vendor/glfw/src/posix_poll.h",
+			"%{prj.name}/vendor/glfw/src/posix_thread.c",
+			"%{prj.name}/vendor/glfw/src/posix_thread.h",
+			"%{prj.name}/vendor/glfw/src/posix_time.c",
+			"%{prj.name}/vendor/glfw/src/posix_time.h"
+		}
 
-	filter "configurations:Dist"
-		defines "DIST"
-		optimize "On"
\ No newline at end of file
+		links { "X11", "dl" }
+
+	filter {}
+	coreConfigurations()
+
+-- Command line renderer for machines without a display, no GLFW, glad or imgui
+project "NamelessRaytracerHeadless"
+	location "NamelessRaytracer"
+	kind "ConsoleApp"
+	language "C++"
+
+	targetdir ("bin/" .. outputdir .. "/")
+	objdir ("bin-int/" .. outputdir .. "/%{prj.name}")
+
+	files(coreFiles)
+	files
+	{
+		"NamelessRaytracer/src/Headless/**.h",
+		"NamelessRaytracer/src/Headless/**.cpp"
+	}
+
+	includedirs(coreIncludeDirs)
+
+	coreConfigurations()
+
+-- Timing benchmarks, writes JSON for tracking regressions
+project "NamelessRaytracerBenchmark"
+	location "NamelessRaytracer"
+	kind "ConsoleApp"
+	language "C++"
+
+	targetdir ("bin/" .. outputdir .. "/")
+	objdir ("bin-int/" .. outputdir .. "/%{prj.name}")
+
+	files(coreFiles)
+	files
+	{
+		"NamelessRaytracer/src/Benchmark/**.h",
+		"NamelessRaytracer/src/Benchmark/**.cpp"
+	}
+
+	includedirs(coreIncludeDirs)
+
+	coreConfigurations()